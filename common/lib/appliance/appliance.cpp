@@ -0,0 +1,310 @@
+/*
+ * Appliance signature recognition shared by the sensor and host tools
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <string.h>
+
+#include "appliance.h"
+
+//! 定常状態の平滑化係数の逆数
+#define LEVEL_WEIGHT    (8)
+
+//! 定常状態の値の小数部のビット数
+#define LEVEL_FRAC      (4)
+
+//! 皮相電力の算出で下限とする力率(1/1000)
+#define MIN_PF          (50)
+
+//! デューティ比の平滑化係数の逆数
+#define DUTY_WEIGHT     (4)
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 絶対値
+ */
+static inline int32_t
+iabs(int32_t x)
+{
+  return (x < 0)? -x: x;
+}
+
+/**
+ * 範囲の制限
+ */
+static inline int32_t
+clamp(int32_t x, int32_t lo, int32_t hi)
+{
+  return (x < lo)? lo: (x > hi)? hi: x;
+}
+
+/**
+ * 皮相電力の算出
+ *
+ * @param [in] power  有効電力(0.1W)
+ * @param [in] pf     力率(1/1000)
+ *
+ * @return
+ *  皮相電力(0.1VA)を返す。
+ */
+static int32_t
+apparent_power(int32_t power, int32_t pf)
+{
+  pf = clamp(pf, MIN_PF, 1000);
+  return (int32_t)(((int64_t)power * 1000) / pf);
+}
+
+/**
+ * 特徴量の誤差の二乗
+ *
+ * @param [in] diff   誤差(1/1000相当に正規化済み)
+ * @param [in] shift  重みの右シフト量
+ */
+static inline uint64_t
+sq(int64_t diff, int shift)
+{
+  return (uint64_t)(diff * diff) >> shift;
+}
+
+/**
+ * 最近傍のシグネチャの探索
+ *
+ * @param [in] ctx      状態
+ * @param [in,out] ev   イベント(cls, distanceを書き込む)
+ *
+ * @remark
+ *  ステップの大きさは相対誤差(1/1000)、力率はそのままの差(1/1000)で比較す
+ *  る。ONのイベントでは行き過ぎ量と整定時間も重み1/4で加える(OFF時の過渡応
+ *  答は家電による差が小さいため用いない)。
+ */
+static void
+classify(const appliance_t* ctx, appliance_event_t* ev)
+{
+  const appliance_signature_t* s;
+  int32_t step;
+  uint64_t d;
+  uint64_t best;
+  int i;
+
+  step     = iabs(ev->step);
+  best     = UINT64_MAX;
+  ev->cls  = APPLIANCE_UNKNOWN;
+
+  for (i = 0; i < ctx->nsig; i++) {
+    s = &ctx->sig[i];
+    if (s->step <= 0) continue;
+
+    d  = sq(((int64_t)(step - s->step) * 1000) / s->step, 0);
+    d += sq(ev->pf - s->pf, 0);
+
+    if (ev->on) {
+      d += sq(((int64_t)(ev->overshoot - s->overshoot) * 1000) / 256, 2);
+      d += sq((int64_t)(ev->settle - s->settle) * 50, 2);
+    }
+
+    if (d < best) {
+      best    = d;
+      ev->cls = i;
+    }
+  }
+
+  ev->distance = (best > UINT32_MAX)? UINT32_MAX: (uint32_t)best;
+  if (ev->distance > ctx->param.maxDistance) ev->cls = APPLIANCE_UNKNOWN;
+}
+
+/**
+ * クラス毎の履歴の更新
+ *
+ * @param [in,out] ctx  状態
+ * @param [in,out] ev   イベント(dutyを書き込む)
+ *
+ * @remark
+ *  ONからOFFまでの時間を記録しておき、次にONになった時点でON周期に対する
+ *  比をデューティ比として移動平均する。
+ */
+static void
+update_history(appliance_t* ctx, appliance_event_t* ev)
+{
+  appliance_history_t* h;
+  uint64_t period;
+  int32_t duty;
+
+  ev->duty = 0;
+  if (ev->cls == APPLIANCE_UNKNOWN) return;
+
+  h = &ctx->history[ev->cls];
+
+  if (ev->on) {
+    if (h->onDuration > 0) {
+      period = ev->ts - h->onTs;
+
+      if (period > h->onDuration) {
+        duty = (int32_t)((h->onDuration * 1000) / period);
+
+        if (h->duty == 0) {
+          h->duty = duty;
+        } else {
+          h->duty += (duty - h->duty) / DUTY_WEIGHT;
+        }
+      }
+    }
+
+    h->onTs       = ev->ts;
+    h->onDuration = 0;
+    h->active     = true;
+
+  } else if (h->active) {
+    h->onDuration = ev->ts - h->onTs;
+    h->active     = false;
+  }
+
+  ev->duty = h->duty;
+}
+
+/*
+ * 公開関数の定義
+ */
+
+void
+appliance_init(appliance_t* ctx,
+               const appliance_param_t* param,
+               const appliance_signature_t* sig)
+{
+  memset(ctx, 0, sizeof(appliance_t));
+
+  ctx->param = *param;
+  ctx->sig   = sig;
+  ctx->nsig  = 0;
+
+  if (sig != NULL) {
+    while (ctx->nsig < APPLIANCE_MAX_CLASSES && sig[ctx->nsig].name != NULL) {
+      ctx->nsig++;
+    }
+  }
+}
+
+int
+appliance_push(appliance_t* ctx,
+               uint64_t ts,
+               int32_t power,
+               int32_t pf,
+               appliance_event_t* dst)
+{
+  int32_t s;
+  int32_t level;
+  int32_t apparent;
+  int32_t step;
+  int32_t ds;
+
+  if (power < 0) power = 0;
+  s = apparent_power(power, pf);
+
+  /*
+   * 初回のフレームは定常状態の初期値とする
+   */
+  if (!ctx->started) {
+    ctx->started  = true;
+    ctx->level    = power << LEVEL_FRAC;
+    ctx->apparent = s << LEVEL_FRAC;
+    return 0;
+  }
+
+  /*
+   * 定常状態
+   *   定常値から閾値以上離れたら過渡状態に移行し、それ以外は定常値を平滑化
+   *   して追従する。
+   */
+  if (!ctx->transient) {
+    level = ctx->level >> LEVEL_FRAC;
+
+    if (iabs(power - level) < ctx->param.stepThreshold) {
+      ctx->level    += ((power << LEVEL_FRAC) - ctx->level) / LEVEL_WEIGHT;
+      ctx->apparent += ((s << LEVEL_FRAC) - ctx->apparent) / LEVEL_WEIGHT;
+      return 0;
+    }
+
+    ctx->transient   = true;
+    ctx->preLevel    = level;
+    ctx->preApparent = ctx->apparent >> LEVEL_FRAC;
+    ctx->dir         = (power > level)? 1: -1;
+    ctx->peak        = power;
+    ctx->count       = 0;
+    ctx->prev        = power;
+    ctx->run         = 1;
+    ctx->runSum      = power;
+    ctx->runApparent = s;
+
+    return 0;
+  }
+
+  /*
+   * 過渡状態
+   *   フレーム間の変化がstableBand以内のフレームがstableFrames連続したら整
+   *   定したとみなす。
+   */
+  ctx->count++;
+
+  if ((power - ctx->peak) * ctx->dir > 0) ctx->peak = power;
+
+  if (iabs(power - ctx->prev) <= ctx->param.stableBand) {
+    ctx->run++;
+    ctx->runSum      += power;
+    ctx->runApparent += s;
+  } else {
+    ctx->run         = 1;
+    ctx->runSum      = power;
+    ctx->runApparent = s;
+  }
+
+  ctx->prev = power;
+
+  if (ctx->run < ctx->param.stableFrames) {
+    // 整定しない負荷(変動の大きい負荷)は、変化を捨てて現在値から再開する
+    if (ctx->count >= ctx->param.maxTransient) {
+      ctx->transient = false;
+      ctx->level     = power << LEVEL_FRAC;
+      ctx->apparent  = s << LEVEL_FRAC;
+    }
+
+    return 0;
+  }
+
+  /*
+   * 整定
+   */
+  level          = ctx->runSum / ctx->run;
+  apparent       = ctx->runApparent / ctx->run;
+  step           = level - ctx->preLevel;
+  ctx->transient = false;
+  ctx->level     = level << LEVEL_FRAC;
+  ctx->apparent  = apparent << LEVEL_FRAC;
+
+  // 元の値に戻った場合(スパイク)はイベントとしない
+  if (iabs(step) < ctx->param.stepThreshold) return 0;
+
+  ds = iabs(apparent - ctx->preApparent);
+
+  dst->ts        = ts;
+  dst->on        = (step > 0);
+  dst->step      = step;
+  dst->pf        = (ds > 0)? clamp((iabs(step) * 1000) / ds, 0, 1000): 1000;
+  dst->overshoot = clamp(((ctx->peak - level) * ctx->dir * 256) / iabs(step),
+                         0,
+                         INT16_MAX);
+  dst->settle    = clamp(ctx->count - ctx->run + 1, 0, INT16_MAX);
+
+  classify(ctx, dst);
+  update_history(ctx, dst);
+
+  return 1;
+}
+
+const char*
+appliance_name(const appliance_t* ctx, int cls)
+{
+  return (cls >= 0 && cls < ctx->nsig)? ctx->sig[cls].name: "?";
+}
@@ -0,0 +1,197 @@
+/*
+ * Appliance signature recognition shared by the sensor and host tools
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __APPLIANCE_H__
+#define __APPLIANCE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * 家電の識別
+ *   消費電力の階段状の変化(ステップ)を検出し、その特徴量(ステップの大きさ、
+ *   変化分の力率、突入電流による行き過ぎ量、整定までのフレーム数)を既知の
+ *   シグネチャと比較して、どの家電がON/OFFしたかを推定する。演算は全て整数
+ *   で行い、フレーム当たりの処理量はシグネチャ数に依存しない(識別はイベント
+ *   発生時のみ行う)。
+ *
+ *   単位は、電力が0.1W、力率が1/1000、行き過ぎ量がステップの大きさの1/256。
+ */
+
+//! シグネチャの最大数
+#define APPLIANCE_MAX_CLASSES   (16)
+
+//! 識別できなかったことを表すクラス番号
+#define APPLIANCE_UNKNOWN       (-1)
+
+//! シグネチャ(家電毎の特徴量の重心)
+typedef struct {
+  //! 名前(表の終端はNULL)
+  const char* name;
+
+  //! ステップの大きさ(0.1W, 正の値)
+  int32_t step;
+
+  //! 変化分の力率(1/1000)
+  int16_t pf;
+
+  //! 行き過ぎ量(ステップの大きさの1/256)
+  int16_t overshoot;
+
+  //! 整定までのフレーム数
+  int16_t settle;
+} appliance_signature_t;
+
+//! イベント
+typedef struct {
+  //! 整定したフレームのタイムスタンプ(ミリ秒)
+  uint64_t ts;
+
+  //! シグネチャのインデックス(識別できなかった場合はAPPLIANCE_UNKNOWN)
+  int cls;
+
+  //! ONの場合はtrue、OFFの場合はfalse
+  bool on;
+
+  //! ステップの大きさ(0.1W, 符号付き)
+  int32_t step;
+
+  //! 変化分の力率(1/1000)
+  int16_t pf;
+
+  //! 行き過ぎ量(ステップの大きさの1/256)
+  int16_t overshoot;
+
+  //! 整定までのフレーム数
+  int16_t settle;
+
+  //! 最も近いシグネチャとの距離
+  uint32_t distance;
+
+  //! 識別したクラスのデューティ比の移動平均(1/1000, 未確定の場合は0)
+  uint16_t duty;
+} appliance_event_t;
+
+//! 識別のパラメータ
+typedef struct {
+  //! ステップとみなす変化量の閾値(0.1W)
+  int32_t stepThreshold;
+
+  //! 定常とみなすフレーム間の変化量の幅(0.1W)
+  int32_t stableBand;
+
+  //! 整定とみなす連続した定常フレーム数
+  uint16_t stableFrames;
+
+  //! 過渡状態を打ち切るフレーム数
+  uint16_t maxTransient;
+
+  //! 識別を受け入れる最大の距離
+  uint32_t maxDistance;
+} appliance_param_t;
+
+//! クラス毎のON/OFF履歴
+typedef struct {
+  //! 最後にONになった時刻
+  uint64_t onTs;
+
+  //! 前回のONの継続時間(0の場合は未確定)
+  uint64_t onDuration;
+
+  //! デューティ比の移動平均(1/1000)
+  uint16_t duty;
+
+  //! ON中か否か
+  bool active;
+} appliance_history_t;
+
+//! 識別の状態
+typedef struct {
+  appliance_param_t param;
+
+  //! シグネチャ表
+  const appliance_signature_t* sig;
+  int nsig;
+
+  //! 過渡状態か否か
+  bool transient;
+
+  //! 定常状態の電力・皮相電力(0.1W, 0.1VA, 下位4ビットは小数部)
+  int32_t level;
+  int32_t apparent;
+
+  //! 変化前の電力・皮相電力(0.1W, 0.1VA)
+  int32_t preLevel;
+  int32_t preApparent;
+
+  //! 変化の方向(1もしくは-1)
+  int32_t dir;
+
+  //! 変化方向の極値(0.1W)
+  int32_t peak;
+
+  //! 過渡状態の継続フレーム数
+  uint16_t count;
+
+  //! 直前のフレームの電力(0.1W)
+  int32_t prev;
+
+  //! 定常フレームの連続数と、その間の電力・皮相電力の合計
+  uint16_t run;
+  int32_t runSum;
+  int32_t runApparent;
+
+  //! クラス毎の履歴
+  appliance_history_t history[APPLIANCE_MAX_CLASSES];
+
+  //! 初回のフレームを受け取ったか否か
+  bool started;
+} appliance_t;
+
+/**
+ * 識別の初期化
+ *
+ * @param [out] ctx   初期化する状態
+ * @param [in] param  パラメータ
+ * @param [in] sig    シグネチャ表(nameがNULLの要素で終端, NULL可)
+ *
+ * @remark
+ *  シグネチャ表はAPPLIANCE_MAX_CLASSESを超える分は無視される。
+ */
+void appliance_init(appliance_t* ctx,
+                    const appliance_param_t* param,
+                    const appliance_signature_t* sig);
+
+/**
+ * フレームの投入
+ *
+ * @param [in,out] ctx  状態
+ * @param [in] ts       フレームのタイムスタンプ(ミリ秒)
+ * @param [in] power    有効電力(0.1W)
+ * @param [in] pf       力率(1/1000)
+ * @param [out] dst     イベントの書き込み先
+ *
+ * @return
+ *  イベントが発生した場合は1を、発生しなかった場合は0を返す。
+ */
+int appliance_push(appliance_t* ctx,
+                   uint64_t ts,
+                   int32_t power,
+                   int32_t pf,
+                   appliance_event_t* dst);
+
+/**
+ * クラス名の取得
+ *
+ * @param [in] ctx  状態
+ * @param [in] cls  クラス番号
+ *
+ * @return
+ *  クラス名を返す。識別できなかった場合は"?"を返す。
+ */
+const char* appliance_name(const appliance_t* ctx, int cls);
+
+#endif /* !defined(__APPLIANCE_H__) */
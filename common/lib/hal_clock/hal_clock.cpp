@@ -0,0 +1,307 @@
+/*
+ * Clock abstraction shared by the sensor, the recorder and host tools
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include "hal_clock.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+/*
+ * 実機向けの定義
+ */
+
+uint32_t
+hal_millis()
+{
+  return millis();
+}
+
+uint32_t
+hal_micros()
+{
+  return micros();
+}
+
+void
+hal_delay(uint32_t ms)
+{
+  delay(ms);
+}
+
+time_t
+hal_time()
+{
+  return time(NULL);
+}
+
+bool
+hal_get_local_time(struct tm* tm, uint32_t timeout)
+{
+  return getLocalTime(tm, timeout);
+}
+
+#else /* defined(ARDUINO) */
+#include <string.h>
+
+/*
+ * ホスト向けの定義(仮想時計)
+ */
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+//! 時刻が設定済みとみなすUNIX時間の下限(getLocalTime()と同じく2016年)
+#define VALID_EPOCH     ((time_t)1451606400)
+
+//! 事象
+struct Event {
+  uint64_t at;
+  uint64_t seq;
+  vclock_handler_t handler;
+  void* arg;
+};
+
+//! 現在時刻(マイクロ秒)
+static uint64_t now = 0;
+
+//! hal_micros()の起点に対応するUNIX時間(マイクロ秒, 未設定の場合は0)
+static int64_t epochBase = 0;
+
+//! 事象の二分ヒープ
+static Event heap[VCLOCK_MAX_EVENTS];
+
+//! 登録されている事象の数
+static size_t count = 0;
+
+//! 事象の登録順の通し番号
+static uint64_t seq = 0;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 事象の順序の比較
+ */
+static bool
+earlier(const Event* a, const Event* b)
+{
+  return (a->at < b->at) || (a->at == b->at && a->seq < b->seq);
+}
+
+/**
+ * 先頭の事象の取り出し
+ */
+static void
+pop(Event* dst)
+{
+  size_t i;
+  size_t c;
+  Event tmp;
+
+  *dst = heap[0];
+  heap[0] = heap[--count];
+
+  for (i = 0; (c = i * 2 + 1) < count; i = c) {
+    if (c + 1 < count && earlier(&heap[c + 1], &heap[c])) c++;
+    if (!earlier(&heap[c], &heap[i])) break;
+
+    tmp     = heap[i];
+    heap[i] = heap[c];
+    heap[c] = tmp;
+  }
+}
+
+/*
+ * 公開関数の定義
+ */
+
+uint32_t
+hal_millis()
+{
+  return (uint32_t)(now / 1000);
+}
+
+uint32_t
+hal_micros()
+{
+  return (uint32_t)now;
+}
+
+void
+hal_delay(uint32_t ms)
+{
+  vclock_advance((uint64_t)ms * 1000);
+}
+
+time_t
+hal_time()
+{
+  return (epochBase > 0)? (time_t)((epochBase + (int64_t)now) / 1000000): 0;
+}
+
+bool
+hal_get_local_time(struct tm* tm, uint32_t timeout)
+{
+  time_t t;
+  uint32_t t0;
+
+  t0 = hal_millis();
+
+  while ((t = hal_time()) < VALID_EPOCH) {
+    if (hal_millis() - t0 >= timeout) return false;
+    hal_delay(10);
+  }
+
+  localtime_r(&t, tm);
+
+  return true;
+}
+
+void
+vclock_reset(uint64_t start, time_t epoch)
+{
+  now   = start;
+  count = 0;
+  seq   = 0;
+
+  epochBase = 0;
+  if (epoch > 0) vclock_set_epoch(epoch);
+}
+
+uint64_t
+vclock_now()
+{
+  return now;
+}
+
+void
+vclock_set_epoch(time_t epoch)
+{
+  epochBase = (int64_t)epoch * 1000000 - (int64_t)now;
+}
+
+int
+vclock_schedule(uint64_t at, vclock_handler_t handler, void* arg)
+{
+  int ret;
+  size_t i;
+  size_t p;
+  Event tmp;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * argument check
+   */
+  if (handler == NULL) ret = DEFAULT_ERROR;
+
+  /*
+   * state check
+   */
+  if (!ret) {
+    if (count >= VCLOCK_MAX_EVENTS) ret = DEFAULT_ERROR;
+  }
+
+  /*
+   * push to heap
+   */
+  if (!ret) {
+    i = count++;
+
+    heap[i].at      = (at < now)? now: at;
+    heap[i].seq     = seq++;
+    heap[i].handler = handler;
+    heap[i].arg     = arg;
+
+    for (; i > 0 && earlier(&heap[i], &heap[p = (i - 1) / 2]); i = p) {
+      tmp     = heap[i];
+      heap[i] = heap[p];
+      heap[p] = tmp;
+    }
+  }
+
+  return ret;
+}
+
+void
+vclock_advance(uint64_t us)
+{
+  uint64_t target;
+  Event ev;
+
+  target = now + us;
+
+  while (count > 0 && heap[0].at <= target) {
+    pop(&ev);
+
+    if (ev.at > now) now = ev.at;
+    ev.handler(ev.arg);
+  }
+
+  // 事象ハンドラ内のhal_delay()で既に追い越している場合は戻さない
+  if (now < target) now = target;
+}
+#endif /* defined(ARDUINO) */
+
+/*
+ * 共通の定義
+ */
+
+void
+hal_uptime_init(hal_uptime_t* ctx)
+{
+  ctx->base    = hal_millis();
+  ctx->elapsed = 0;
+}
+
+uint64_t
+hal_uptime_update(hal_uptime_t* ctx)
+{
+  uint32_t cur;
+
+  cur = hal_millis();
+
+  ctx->elapsed += (uint32_t)(cur - ctx->base);
+  ctx->base     = cur;
+
+  return ctx->elapsed;
+}
+
+void
+hal_interval_init(hal_interval_t* ctx, uint32_t period)
+{
+  ctx->period = period;
+  ctx->last   = hal_millis();
+}
+
+uint32_t
+hal_interval_check(hal_interval_t* ctx)
+{
+  uint32_t now;
+  uint32_t elapsed;
+
+  now     = hal_millis();
+  elapsed = now - ctx->last;
+  if (elapsed < ctx->period) return 0;
+
+  ctx->last = now;
+
+  return elapsed;
+}
+
+uint32_t
+hal_interval_remain(const hal_interval_t* ctx)
+{
+  uint32_t elapsed;
+
+  elapsed = hal_millis() - ctx->last;
+
+  return (elapsed < ctx->period)? ctx->period - elapsed: 0;
+}
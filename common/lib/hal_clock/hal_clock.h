@@ -0,0 +1,189 @@
+/*
+ * Clock abstraction shared by the sensor, the recorder and host tools
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __HAL_CLOCK_H__
+#define __HAL_CLOCK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+/*
+ * 時刻取得の抽象化
+ *   ARDUINOが定義されている場合(実機)はmillis()等の実APIをそのまま呼び出す。
+ *   定義されていない場合(ホスト)は離散事象型の仮想時計を用い、時間はhal_delay()
+ *   もしくはvclock_advance()を呼び出した時のみ進む。hal_millis()はいずれの場
+ *   合も32ビットで桁溢れする(約49.7日周期)。
+ */
+
+//! 64ビットの経過時間の積算状態
+typedef struct {
+  //! 前回更新時のhal_millis()の値
+  uint32_t base;
+
+  //! 初期化時からの経過時間(ミリ秒)
+  uint64_t elapsed;
+} hal_uptime_t;
+
+//! 周期処理の判定状態
+typedef struct {
+  //! 周期(ミリ秒)
+  uint32_t period;
+
+  //! 前回発火時(初期化時)のhal_millis()の値
+  uint32_t last;
+} hal_interval_t;
+
+/**
+ * 起動時からの経過時間の取得(ミリ秒, 32ビットで桁溢れ)
+ */
+uint32_t hal_millis();
+
+/**
+ * 起動時からの経過時間の取得(マイクロ秒, 32ビットで桁溢れ)
+ */
+uint32_t hal_micros();
+
+/**
+ * 指定時間の待機
+ *
+ * @param [in] ms  待機時間(ミリ秒)
+ */
+void hal_delay(uint32_t ms);
+
+/**
+ * 現在時刻(UNIX時間)の取得
+ */
+time_t hal_time();
+
+/**
+ * 現在時刻(ローカル時刻)の取得
+ *
+ * @param [out] tm       時刻の書き込み先
+ * @param [in] timeout   時刻が設定されるまで待つ最大時間(ミリ秒)
+ *
+ * @return
+ *  時刻が設定されていればtrueを、timeoutまでに設定されなければfalseを返す。
+ */
+bool hal_get_local_time(struct tm* tm, uint32_t timeout = 5000);
+
+/**
+ * 経過時間の積算の初期化
+ *
+ * @param [out] ctx  初期化する状態
+ */
+void hal_uptime_init(hal_uptime_t* ctx);
+
+/**
+ * 経過時間の積算の更新
+ *
+ * @param [in,out] ctx  状態
+ *
+ * @return
+ *  hal_uptime_init()からの経過時間(ミリ秒)を返す。
+ *
+ * @remark
+ *  hal_millis()の前回更新時からの差分を64ビットで積算するので、hal_millis()
+ *  の桁溢れの影響を受けない。ただし更新間隔は49.7日未満である必要がある。
+ */
+uint64_t hal_uptime_update(hal_uptime_t* ctx);
+
+/**
+ * 周期処理の判定の初期化
+ *
+ * @param [out] ctx    初期化する状態
+ * @param [in] period  周期(ミリ秒, 0より大きいこと)
+ *
+ * @remark
+ *  初回の発火は呼び出し時点からperiod後となる。
+ */
+void hal_interval_init(hal_interval_t* ctx, uint32_t period);
+
+/**
+ * 周期処理の発火の判定
+ *
+ * @param [in,out] ctx  状態
+ *
+ * @return
+ *  前回の発火からperiod以上経過していれば、その経過時間(ミリ秒)を返して発
+ *  火時刻を更新する。経過していなければ0を返す。
+ *
+ * @remark
+ *  両ファームウェアのprint_stats()とホスト側のシミュレータが共通に使う判定。
+ *  hal_millis()の差分で判定するので、桁溢れをまたいでも正しく動作する。
+ */
+uint32_t hal_interval_check(hal_interval_t* ctx);
+
+/**
+ * 次の発火までの時間の取得
+ *
+ * @param [in] ctx  状態
+ *
+ * @return
+ *  次の発火までの時間(ミリ秒)を返す。既に発火時刻を過ぎている場合は0を返す。
+ */
+uint32_t hal_interval_remain(const hal_interval_t* ctx);
+
+#ifndef ARDUINO
+//! 仮想時計に登録できる事象の最大数
+#define VCLOCK_MAX_EVENTS   (64)
+
+//! 仮想時計の事象ハンドラ
+typedef void (*vclock_handler_t)(void* arg);
+
+/**
+ * 仮想時計の初期化
+ *
+ * @param [in] start  hal_micros()の起点とする時刻(マイクロ秒)
+ * @param [in] epoch  起点に対応するUNIX時間(未設定とする場合は0)
+ *
+ * @remark
+ *  startに桁溢れの直前の値を与えることで、hal_millis()の桁溢れを含む場面を
+ *  短時間で再現できる。登録済みの事象は全て破棄される。
+ */
+void vclock_reset(uint64_t start, time_t epoch);
+
+/**
+ * 仮想時計の現在時刻の取得(マイクロ秒, 64ビット)
+ */
+uint64_t vclock_now();
+
+/**
+ * 仮想時計のUNIX時間の設定(NTPでの時刻合わせに相当)
+ *
+ * @param [in] epoch  現在時刻に対応するUNIX時間
+ */
+void vclock_set_epoch(time_t epoch);
+
+/**
+ * 事象の登録
+ *
+ * @param [in] at       事象を発生させる時刻(vclock_now()の値, マイクロ秒)
+ * @param [in] handler  事象ハンドラ
+ * @param [in] arg      事象ハンドラに渡す引数
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  同じ時刻の事象は登録順に発生する。事象ハンドラの中から事象を登録したり
+ *  hal_delay()を呼び出すことができる。
+ */
+int vclock_schedule(uint64_t at, vclock_handler_t handler, void* arg);
+
+/**
+ * 仮想時計を進める
+ *
+ * @param [in] us  進める時間(マイクロ秒)
+ *
+ * @remark
+ *  指定時間内に発生する事象を時刻順に処理する。各事象ハンドラの呼び出し時点
+ *  で仮想時計は事象の時刻を指している。
+ */
+void vclock_advance(uint64_t us);
+#endif /* !defined(ARDUINO) */
+
+#endif /* !defined(__HAL_CLOCK_H__) */
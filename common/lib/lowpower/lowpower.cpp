@@ -0,0 +1,70 @@
+/*
+ * Low-power link policy shared by the sensor, the recorder and host tools
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include "lowpower.h"
+
+/*
+ * 公開関数の定義
+ */
+
+void
+lp_tx_init(lp_tx_t* ctx)
+{
+  ctx->last = 0;
+  ctx->sent = false;
+}
+
+bool
+lp_tx_begin(lp_tx_t* ctx, uint32_t now)
+{
+  bool ret;
+
+  // hal_millis()の桁溢れをまたいでも差分で判定する
+  ret = (!ctx->sent || (uint32_t)(now - ctx->last) >= LP_PREAMBLE_IDLE);
+
+  ctx->last = now;
+  ctx->sent = true;
+
+  return ret;
+}
+
+void
+lp_rx_init(lp_rx_t* ctx, uint32_t now)
+{
+  ctx->last = now;
+}
+
+void
+lp_rx_activity(lp_rx_t* ctx, uint32_t now)
+{
+  ctx->last = now;
+}
+
+uint32_t
+lp_rx_sleep_time(const lp_rx_t* ctx,
+                 uint32_t now,
+                 uint32_t deadline,
+                 bool busy)
+{
+  if (busy) return 0;
+  if ((uint32_t)(now - ctx->last) < LP_SLEEP_IDLE) return 0;
+  if (deadline < LP_MIN_SLEEP) return 0;
+
+  return deadline;
+}
+
+uint32_t
+lp_estimate_current(uint64_t sleepUs,
+                    uint64_t totalUs,
+                    uint32_t sleepUa,
+                    uint32_t activeUa)
+{
+  if (totalUs == 0) return activeUa;
+  if (sleepUs > totalUs) sleepUs = totalUs;
+
+  return (uint32_t)((sleepUs * sleepUa + (totalUs - sleepUs) * activeUa) /
+                    totalUs);
+}
@@ -0,0 +1,139 @@
+/*
+ * Low-power link policy shared by the sensor, the recorder and host tools
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __LOWPOWER_H__
+#define __LOWPOWER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * 省電力動作のリンク規約
+ *   レコーダはライトスリープ中にUARTで受信したバイトを取りこぼす(RX信号の
+ *   立ち下がりで起床してからUARTが動作するまでの間のバイトは失われるか化け
+ *   る)。このため、センサーは送信が一定時間途絶えた後の行の前にNUL文字の並
+ *   び(プリアンブル)を送る。レコーダは受信が一定時間途絶えた後にのみスリー
+ *   プに入るので、スリープ中に届く行の前には必ずプリアンブルが付いている。
+ *
+ *   プリアンブル中に化けたバイトは、NUL文字を受信した時点で組み立て中の行と
+ *   共に捨てられる。NUL文字の並びの途中から受信を始めても、化けたバイトは1
+ *   ビットのみが立った値(0x01〜0x80)にしかならず、改行文字にはならない。
+ */
+
+//! プリアンブルのバイト数
+#define LP_PREAMBLE_BYTES   (32)
+
+//! プリアンブルを付ける送信の途絶時間(ミリ秒)
+#define LP_PREAMBLE_IDLE    (100)
+
+//! スリープに入る受信の途絶時間(ミリ秒)
+#define LP_SLEEP_IDLE       (200)
+
+//! スリープする最小の時間(ミリ秒, これより短い場合は起きたまま待つ)
+#define LP_MIN_SLEEP        (10)
+
+//! 通信速度(センサーとレコーダの間のリンク)
+#define LP_BAUDRATE         (115200)
+
+//! プリアンブルで吸収できる起床時間の上限(マイクロ秒)
+//  8N1では1バイト当たり10ビット。最後の1バイトはUARTの同期のために残す。
+#define LP_MAX_WAKE_US      \
+  ((uint32_t)((LP_PREAMBLE_BYTES - 1) * 10ULL * 1000000ULL / LP_BAUDRATE))
+
+#if LP_PREAMBLE_IDLE >= LP_SLEEP_IDLE
+#error "LP_PREAMBLE_IDLE must be shorter than LP_SLEEP_IDLE"
+#endif
+
+//! 送信側(センサー)の状態
+typedef struct {
+  //! 最後に送信した時刻(hal_millis()の値)
+  uint32_t last;
+
+  //! 送信済みか否か
+  bool sent;
+} lp_tx_t;
+
+//! 受信側(レコーダ)の状態
+typedef struct {
+  //! 最後に受信した時刻(hal_millis()の値)
+  uint32_t last;
+} lp_rx_t;
+
+/**
+ * 送信側の状態の初期化
+ *
+ * @param [out] ctx  初期化する状態
+ */
+void lp_tx_init(lp_tx_t* ctx);
+
+/**
+ * 行の送信の開始
+ *
+ * @param [in,out] ctx  状態
+ * @param [in] now      現在時刻(hal_millis()の値)
+ *
+ * @return
+ *  行の前にプリアンブルを送る必要がある場合はtrueを返す。
+ *
+ * @remark
+ *  一行を送信する毎に呼び出すこと(最初の行には必ずプリアンブルを付ける)。
+ */
+bool lp_tx_begin(lp_tx_t* ctx, uint32_t now);
+
+/**
+ * 受信側の状態の初期化
+ *
+ * @param [out] ctx  初期化する状態
+ * @param [in] now   現在時刻(hal_millis()の値)
+ */
+void lp_rx_init(lp_rx_t* ctx, uint32_t now);
+
+/**
+ * 受信の通知
+ *
+ * @param [in,out] ctx  状態
+ * @param [in] now      現在時刻(hal_millis()の値)
+ */
+void lp_rx_activity(lp_rx_t* ctx, uint32_t now);
+
+/**
+ * スリープできる時間の算出
+ *
+ * @param [in] ctx       状態
+ * @param [in] now       現在時刻(hal_millis()の値)
+ * @param [in] deadline  次に起きている必要がある時刻までの時間(ミリ秒)
+ * @param [in] busy      受信中の行や書き込み中のデータがあるか否か
+ *
+ * @return
+ *  スリープしてよい時間(ミリ秒)を返す。スリープできない場合は0を返す。
+ *
+ * @remark
+ *  受信がLP_SLEEP_IDLE以上途絶えていて、busyでない場合にのみスリープを許可
+ *  する。起床は受信(プリアンブル)、ボタン、もしくは戻り値の時間の経過によ
+ *  って行う。
+ */
+uint32_t lp_rx_sleep_time(const lp_rx_t* ctx,
+                          uint32_t now,
+                          uint32_t deadline,
+                          bool busy);
+
+/**
+ * 平均電流の推定
+ *
+ * @param [in] sleepUs   スリープしていた時間(マイクロ秒)
+ * @param [in] totalUs   全体の時間(マイクロ秒)
+ * @param [in] sleepUa   スリープ中の電流(マイクロアンペア)
+ * @param [in] activeUa  動作中の電流(マイクロアンペア)
+ *
+ * @return
+ *  時間で重み付けした平均電流(マイクロアンペア)を返す。
+ */
+uint32_t lp_estimate_current(uint64_t sleepUs,
+                             uint64_t totalUs,
+                             uint32_t sleepUa,
+                             uint32_t activeUa);
+
+#endif /* !defined(__LOWPOWER_H__) */
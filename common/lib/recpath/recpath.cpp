@@ -0,0 +1,219 @@
+/*
+ * Recording directory layout shared by the recorder and host tools
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "recpath.h"
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 記録先ディレクトリのオープン
+ *
+ * @param [in] ctx   状態
+ * @param [in] path  ディレクトリのパス
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  既に開いているディレクトリと同じ場合は何もしない。
+ */
+static int
+open_dir(recpath_t* ctx, const char* path)
+{
+  int ret;
+  uint32_t files;
+
+  /*
+   * check cache
+   */
+  if (ctx->path[0] != '\0' && strcmp(path, ctx->path) == 0) return 0;
+
+  /*
+   * open directory
+   */
+  ctx->path[0] = '\0';
+  ctx->files   = 0;
+
+  ret = ctx->fs->open_dir(ctx->fs->arg, path, &files);
+
+  /*
+   * update state
+   */
+  if (!ret) {
+    strncpy(ctx->path, path, sizeof(ctx->path) - 1);
+    ctx->path[sizeof(ctx->path) - 1] = '\0';
+    ctx->files = files;
+  }
+
+  return ret;
+}
+
+/**
+ * セッション番号の払い出し
+ *
+ * @param [in] ctx  状態
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  記録した番号を一つ進めて書き戻し、その番号のセッションディレクトリを開
+ *  く。記録した番号が失われた場合等で既に記録ファイルのあるディレクトリに
+ *  当たった場合は、空のディレクトリが見つかるまで進める。
+ */
+static int
+next_session(recpath_t* ctx)
+{
+  int ret;
+  char path[RECPATH_PATH_SIZE];
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * read session number
+   */
+  if (ctx->session == 0) {
+    if (ctx->fs->load_session(ctx->fs->arg, &ctx->session)) ctx->session = 0;
+  }
+
+  /*
+   * open session directory
+   */
+  do {
+    ctx->session++;
+
+    sprintf(path,
+            "/S%04lu/%02lu",
+            (unsigned long)(ctx->session / RECPATH_GROUP_SIZE),
+            (unsigned long)(ctx->session % RECPATH_GROUP_SIZE));
+
+    ret = open_dir(ctx, path);
+  } while (!ret && ctx->files > 0);
+
+  /*
+   * write back session number
+   */
+  if (!ret) {
+    if (ctx->fs->save_session(ctx->fs->arg, ctx->session)) ret = DEFAULT_ERROR;
+  }
+
+  return ret;
+}
+
+/*
+ * 公開関数の定義
+ */
+
+void
+recpath_init(recpath_t* ctx, const recpath_fs_t* fs, uint32_t maxFiles)
+{
+  memset(ctx, 0, sizeof(*ctx));
+
+  ctx->fs       = fs;
+  ctx->maxFiles = (maxFiles > 0)? maxFiles: RECPATH_MAX_FILES;
+}
+
+int
+recpath_begin(recpath_t* ctx, const struct tm* tm)
+{
+  // 日付のディレクトリは記録ファイル名の決定時に開く
+  return (tm == NULL)? next_session(ctx): 0;
+}
+
+int
+recpath_next(recpath_t* ctx, const struct tm* tm, char* dst, size_t size)
+{
+  int ret;
+  char path[RECPATH_PATH_SIZE];
+  long key;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * argument check
+   */
+  if (dst == NULL || size == 0) ret = DEFAULT_ERROR;
+
+  /*
+   * open directory
+   */
+  if (!ret) {
+    if (tm != NULL) {
+      key = ((1900L + tm->tm_year) * 100 + tm->tm_mon + 1) * 100 + tm->tm_mday;
+
+      if (key != ctx->day) {
+        ctx->day    = key;
+        ctx->branch = 0;
+      }
+
+      while (true) {
+        if (ctx->branch == 0) {
+          sprintf(path,
+                  "/%04d/%02d/%02d",
+                  1900 + tm->tm_year,
+                  tm->tm_mon + 1,
+                  tm->tm_mday);
+        } else {
+          sprintf(path,
+                  "/%04d/%02d/%02d_%d",
+                  1900 + tm->tm_year,
+                  tm->tm_mon + 1,
+                  tm->tm_mday,
+                  ctx->branch);
+        }
+
+        ret = open_dir(ctx, path);
+        if (ret || ctx->files < ctx->maxFiles) break;
+
+        ctx->branch++;
+      }
+
+    } else {
+      if (ctx->session == 0 || ctx->files >= ctx->maxFiles) {
+        ret = next_session(ctx);
+      }
+    }
+  }
+
+  /*
+   * make file name
+   *   ディレクトリを開けなかった場合も、呼び出し側がカレントディレクトリに
+   *   記録できるようファイル名は生成しておく。
+   */
+  if (dst != NULL && size > 0) {
+    if (tm != NULL) {
+      snprintf(dst,
+               size,
+               "output-%04d%02d%02d-%02d%02d%02d.csv",
+               1900 + tm->tm_year,
+               tm->tm_mon + 1,
+               tm->tm_mday,
+               tm->tm_hour,
+               tm->tm_min,
+               tm->tm_sec);
+    } else {
+      snprintf(dst, size, "output-%03lu.csv", (unsigned long)(ctx->files + 1));
+    }
+
+    ctx->files++;
+  }
+
+  return ret;
+}
@@ -0,0 +1,148 @@
+/*
+ * Recording directory layout shared by the recorder and host tools
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __RECPATH_H__
+#define __RECPATH_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+/*
+ * 記録先ディレクトリの決定
+ *   時刻情報が使用できる場合は"/YYYY/MM/DD"に"output-YYYYmmdd-HHMMSS.csv"
+ *   を、使用できない場合はセッションディレクトリ("/S0012/34"の形式、セッ
+ *   ション番号1234の場合)に"output-NNN.csv"を置く。一つのディレクトリの記
+ *   録ファイルが上限に達した場合、日付のディレクトリは"_1", "_2", ...を付け
+ *   た名前で、セッションディレクトリは次のセッション番号で作り直す。
+ *   ディレクトリの操作は記録先の媒体毎に用意したrecpath_fs_tを介して行うの
+ *   で、同じ処理をレコーダ(SdFat)とホスト(POSIX)の両方で実行できる。
+ */
+
+//! 一つのディレクトリに置く記録ファイルの数の上限のデフォルト値
+#define RECPATH_MAX_FILES   (100)
+
+//! 一つのセッショングループに置くセッションディレクトリの数
+#define RECPATH_GROUP_SIZE  (100)
+
+//! ディレクトリのパスのバッファサイズ("/YYYY/MM/DD_NNN"もしくは"/SNNNN/NN")
+//  実際のパスは24バイトに収まるが、書式上の最大長(各フィールドがintの最大
+//  桁数の場合)を確保しておく。
+#define RECPATH_PATH_SIZE   (64)
+
+//! ファイルシステムの操作
+typedef struct {
+  /**
+   * ディレクトリのオープン
+   *
+   * @param [in] arg     ユーザ引数
+   * @param [in] path    ディレクトリのパス
+   * @param [out] files  ディレクトリ中の記録ファイル(*.csv)の数
+   *
+   * @return
+   *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+   *
+   * @remark
+   *  存在しない場合は親ディレクトリを含めて作成する。記録先として保持して
+   *  いたディレクトリは閉じること(失敗した場合も閉じた状態とする)。
+   */
+  int (*open_dir)(void* arg, const char* path, uint32_t* files);
+
+  /**
+   * セッション番号の読み出し
+   *
+   * @param [in] arg        ユーザ引数
+   * @param [out] session  記録されていたセッション番号(無い場合は0)
+   *
+   * @return
+   *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+   */
+  int (*load_session)(void* arg, uint32_t* session);
+
+  /**
+   * セッション番号の書き込み
+   *
+   * @param [in] arg      ユーザ引数
+   * @param [in] session  セッション番号
+   *
+   * @return
+   *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+   */
+  int (*save_session)(void* arg, uint32_t session);
+
+  //! ユーザ引数
+  void* arg;
+} recpath_fs_t;
+
+//! 記録先ディレクトリの状態
+typedef struct {
+  //! ファイルシステムの操作
+  const recpath_fs_t* fs;
+
+  //! 一つのディレクトリに置く記録ファイルの数の上限
+  uint32_t maxFiles;
+
+  //! 記録先ディレクトリのパス(開いていない場合は空文字列)
+  char path[RECPATH_PATH_SIZE];
+
+  //! 記録先ディレクトリ中の記録ファイルの数
+  uint32_t files;
+
+  //! 記録先の日付(YYYYmmdd, 時刻情報が使用できる場合)
+  long day;
+
+  //! 日付のディレクトリの枝番
+  int branch;
+
+  //! セッション番号(時刻情報が使用できない場合)
+  uint32_t session;
+} recpath_t;
+
+/**
+ * 状態の初期化
+ *
+ * @param [out] ctx      初期化する状態
+ * @param [in] fs        ファイルシステムの操作
+ * @param [in] maxFiles  一つのディレクトリに置く記録ファイルの数の上限
+ */
+void recpath_init(recpath_t* ctx, const recpath_fs_t* fs, uint32_t maxFiles);
+
+/**
+ * 記録セッションの開始
+ *
+ * @param [in] ctx  状態
+ * @param [in] tm   記録開始時刻(時刻情報が使用できない場合はNULL)
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  時刻情報が使用できない場合は、記録したセッション番号を一つ進め、新しい
+ *  セッションディレクトリを開く。
+ */
+int recpath_begin(recpath_t* ctx, const struct tm* tm);
+
+/**
+ * 次の記録ファイル名の決定
+ *
+ * @param [in] ctx    状態
+ * @param [in] tm     記録開始時刻(時刻情報が使用できない場合はNULL)
+ * @param [out] dst   ファイル名(ディレクトリを含まない)の書き込み先
+ * @param [in] size   書き込み先のサイズ
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  記録先のディレクトリは、日付が変わった場合と記録ファイルの数が上限に達
+ *  した場合にのみ開き直す。既存のファイル名の探索は行わないので、カードに
+ *  蓄積されたファイル数に依らず一定の時間で決定できる。ディレクトリを開け
+ *  なかった場合も0以外の値を返した上でファイル名は生成する。
+ */
+int recpath_next(recpath_t* ctx, const struct tm* tm, char* dst, size_t size);
+
+#endif /* !defined(__RECPATH_H__) */
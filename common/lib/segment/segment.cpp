@@ -0,0 +1,23 @@
+/*
+ * Recording file segmentation policy shared by the recorder and host tools
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include "segment.h"
+
+/*
+ * 公開関数の定義
+ */
+
+uint64_t
+segment_limit(bool exfat, uint64_t exfatLimit)
+{
+  return (exfat)? exfatLimit: SEGMENT_SIZE_FAT;
+}
+
+bool
+segment_due(uint64_t size, uint64_t limit, int ch)
+{
+  return (ch == '\n' && limit > 0 && size >= limit);
+}
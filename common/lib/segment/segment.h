@@ -0,0 +1,53 @@
+/*
+ * Recording file segmentation policy shared by the recorder and host tools
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __SEGMENT_H__
+#define __SEGMENT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * 記録ファイルの切り替え
+ *   FAT12/16/32ではファイルサイズの上限(4GB - 1バイト)に達する前に、行境界
+ *   で新しいファイルに切り替えて記録を継続する。exFATにはこの上限が無いので、
+ *   切り替えサイズを指定した場合のみ切り替える。サイズは64ビットで扱い、
+ *   4GBを超える記録でも桁溢れしない。
+ */
+
+//! FAT12/16/32のファイルサイズの上限
+#define SEGMENT_FAT_MAX     (0xffffffffULL)
+
+//! FAT12/16/32での切り替えサイズ
+//  判定は行境界でのみ行うので、一行の長さと書き込み用バッファ中のデータの
+//  分の余裕(16MB)を持たせる。
+#define SEGMENT_SIZE_FAT    (0xff000000ULL)
+
+/**
+ * 切り替えサイズの決定
+ *
+ * @param [in] exfat       記録先のボリュームがexFATか否か
+ * @param [in] exfatLimit  exFATでの切り替えサイズ(0の場合は切り替えない)
+ *
+ * @return
+ *  切り替えサイズ(バイト数, 0の場合は切り替えない)を返す。
+ */
+uint64_t segment_limit(bool exfat, uint64_t exfatLimit);
+
+/**
+ * 切り替えの判定
+ *
+ * @param [in] size   現在のファイルに書き込みを受け付けたバイト数
+ * @param [in] limit  切り替えサイズ(segment_limit()の戻り値)
+ * @param [in] ch     直前に書き込んだ文字
+ *
+ * @return
+ *  行境界(chが改行文字)で、sizeがlimitに達している場合はtrueを返す。limit
+ *  が0の場合は常にfalseを返す。
+ */
+bool segment_due(uint64_t size, uint64_t limit, int ch);
+
+#endif /* !defined(__SEGMENT_H__) */
@@ -0,0 +1,406 @@
+/*
+ * Shared-memory live feed of recorder records for host tools
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "feed.h"
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "64-bit atomics must be lock-free to live in shared memory");
+
+static_assert(sizeof(feed_header_t) % alignof(feed_slot_t) == 0,
+              "slots must start on a cache line boundary");
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 共有メモリのサイズの算出
+ */
+static size_t
+shm_size(uint32_t capacity)
+{
+  return sizeof(feed_header_t) + (size_t)capacity * sizeof(feed_slot_t);
+}
+
+/**
+ * 現在時刻の取得(UNIX時間, ミリ秒)
+ */
+static int64_t
+now_ms()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * 既存の共有メモリの再利用可否の判定
+ *
+ * @param [in] hdr       共有メモリの先頭
+ * @param [in] capacity  要求するスロット数
+ */
+static bool
+reusable(const feed_header_t* hdr, uint32_t capacity)
+{
+  return (hdr->magic.load(std::memory_order_acquire) == FEED_MAGIC &&
+          hdr->version == FEED_VERSION &&
+          hdr->capacity == capacity &&
+          hdr->slotSize == sizeof(feed_slot_t));
+}
+
+/**
+ * 古い共有メモリの破棄
+ *
+ * @param [in] name  共有メモリの名前
+ * @param [in] fd    共有メモリのファイルディスクリプタ
+ * @param [in] size  共有メモリのサイズ
+ *
+ * @remark
+ *  接続中の読み出し側が作り直しに気付けるよう、識別子を消してから名前を削除
+ *  する。
+ */
+static void
+retire(const char* name, int fd, size_t size)
+{
+  void* addr;
+
+  if (size >= sizeof(feed_header_t)) {
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr != MAP_FAILED) {
+      ((feed_header_t*)addr)->magic.store(0, std::memory_order_release);
+      munmap(addr, size);
+    }
+  }
+
+  shm_unlink(name);
+}
+
+/*
+ * 公開関数の定義
+ */
+
+void
+feed_make_name(const char* prefix, const char* path, char* dst)
+{
+  size_t n;
+  size_t i;
+
+  if (strncmp(path, "/dev/", 5) == 0) path += 5;
+
+  snprintf(dst, FEED_NAME_SIZE, "%s-%s", prefix, path);
+
+  n = strlen(prefix) + 1;
+  for (i = n; dst[i] != '\0'; i++) {
+    if (dst[i] == '/') dst[i] = '-';
+  }
+}
+
+int
+feed_create(feed_writer_t* w,
+            const char* name,
+            const char* source,
+            uint32_t capacity)
+{
+  int ret;
+  int fd;
+  size_t size;
+  struct stat st;
+  void* addr;
+  bool fresh;
+
+  /*
+   * initialize
+   */
+  ret      = 0;
+  fd       = -1;
+  addr     = MAP_FAILED;
+  fresh    = false;
+  size     = shm_size(capacity);
+  w->hdr   = NULL;
+
+  /*
+   * argument check
+   */
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0) ret = DEFAULT_ERROR;
+
+  /*
+   * open shared memory
+   *   同じサイズで残っているものはマップして中身を確認し、再利用できない場
+   *   合は破棄して作り直す。
+   */
+  if (!ret) {
+    fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) ret = DEFAULT_ERROR;
+  }
+
+  if (!ret) {
+    if (fstat(fd, &st) < 0) ret = DEFAULT_ERROR;
+  }
+
+  if (!ret && (size_t)st.st_size == size) {
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      ret = DEFAULT_ERROR;
+    } else if (!reusable((feed_header_t*)addr, capacity)) {
+      munmap(addr, size);
+      addr = MAP_FAILED;
+    }
+  }
+
+  if (!ret && addr == MAP_FAILED) {
+    if (st.st_size > 0) {
+      retire(name, fd, st.st_size);
+      close(fd);
+
+      fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+      if (fd < 0) ret = DEFAULT_ERROR;
+    }
+
+    if (!ret) {
+      if (ftruncate(fd, size) < 0) ret = DEFAULT_ERROR;
+    }
+
+    if (!ret) {
+      addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (addr == MAP_FAILED) ret = DEFAULT_ERROR;
+    }
+
+    fresh = true;
+  }
+
+  /*
+   * setup header
+   *   新規の場合、ftruncate()で領域は0で埋められているので、スロットの番号
+   *   は全て未使用の状態になっている。識別子は最後に書く。
+   */
+  if (!ret) {
+    w->hdr   = (feed_header_t*)addr;
+    w->slots = (feed_slot_t*)((char*)addr + sizeof(feed_header_t));
+    w->size  = size;
+    w->mask  = capacity - 1;
+
+    if (fresh) {
+      w->hdr->version  = FEED_VERSION;
+      w->hdr->capacity = capacity;
+      w->hdr->slotSize = sizeof(feed_slot_t);
+      w->hdr->head.store(0, std::memory_order_relaxed);
+      w->hdr->broken.store(0, std::memory_order_relaxed);
+    }
+
+    snprintf(w->hdr->source, sizeof(w->hdr->source), "%s", source);
+
+    w->hdr->up.store(0, std::memory_order_relaxed);
+    w->hdr->beat.store(now_ms(), std::memory_order_relaxed);
+    w->hdr->alive.store(1, std::memory_order_relaxed);
+    w->hdr->magic.store(FEED_MAGIC, std::memory_order_release);
+
+    w->next = w->hdr->head.load(std::memory_order_relaxed);
+  }
+
+  /*
+   * post process
+   */
+  if (fd >= 0) close(fd);
+
+  if (ret) {
+    if (addr != MAP_FAILED) munmap(addr, size);
+    w->hdr = NULL;
+  }
+
+  return ret;
+}
+
+void
+feed_close(feed_writer_t* w)
+{
+  if (w->hdr != NULL) {
+    w->hdr->up.store(0, std::memory_order_relaxed);
+    w->hdr->alive.store(0, std::memory_order_release);
+
+    munmap(w->hdr, w->size);
+    w->hdr = NULL;
+  }
+}
+
+void
+feed_publish(feed_writer_t* w, const feed_record_t* rec)
+{
+  feed_slot_t* slot;
+
+  slot = &w->slots[w->next & w->mask];
+
+  slot->seq.store(FEED_BUSY, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot->rec = *rec;
+
+  slot->seq.store(w->next + 1, std::memory_order_release);
+  w->hdr->head.store(++w->next, std::memory_order_release);
+}
+
+int
+feed_attach(feed_reader_t* r, const char* name, int from)
+{
+  int ret;
+  int fd;
+  struct stat st;
+  void* addr;
+  uint64_t head;
+  uint32_t capacity;
+
+  /*
+   * initialize
+   */
+  ret    = 0;
+  addr   = MAP_FAILED;
+  r->hdr = NULL;
+
+  /*
+   * open shared memory
+   *   リードオンリーでマップするので、読み出し側が書き込み側の状態を変える
+   *   ことは無い。
+   */
+  fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) ret = DEFAULT_ERROR;
+
+  if (!ret) {
+    if (fstat(fd, &st) < 0) ret = DEFAULT_ERROR;
+  }
+
+  if (!ret) {
+    if ((size_t)st.st_size < sizeof(feed_header_t)) ret = DEFAULT_ERROR;
+  }
+
+  if (!ret) {
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) ret = DEFAULT_ERROR;
+  }
+
+  /*
+   * check header
+   */
+  if (!ret) {
+    r->hdr   = (const feed_header_t*)addr;
+    capacity = r->hdr->capacity;
+
+    if (!reusable(r->hdr, capacity) ||
+        capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        (size_t)st.st_size != shm_size(capacity)) {
+      ret = DEFAULT_ERROR;
+    }
+  }
+
+  /*
+   * setup cursor
+   */
+  if (!ret) {
+    r->slots = (const feed_slot_t*)((const char*)addr + sizeof(feed_header_t));
+    r->size  = st.st_size;
+    r->mask  = capacity - 1;
+    r->lost  = 0;
+
+    head = r->hdr->head.load(std::memory_order_acquire);
+
+    if (from == FEED_FROM_OLDEST) {
+      r->cursor = (head > capacity)? head - capacity: 0;
+    } else {
+      r->cursor = head;
+    }
+  }
+
+  /*
+   * post process
+   */
+  if (fd >= 0) close(fd);
+
+  if (ret) {
+    if (addr != MAP_FAILED) munmap(addr, st.st_size);
+    r->hdr = NULL;
+  }
+
+  return ret;
+}
+
+void
+feed_detach(feed_reader_t* r)
+{
+  if (r->hdr != NULL) {
+    munmap((void*)r->hdr, r->size);
+    r->hdr = NULL;
+  }
+}
+
+int
+feed_read(feed_reader_t* r, feed_record_t* dst, int max)
+{
+  const feed_slot_t* slot;
+  uint64_t capacity;
+  uint64_t head;
+  uint64_t target;
+  uint64_t s1;
+  uint64_t s2;
+  int n;
+
+  if (r->hdr->magic.load(std::memory_order_acquire) != FEED_MAGIC) {
+    return FEED_STALE;
+  }
+
+  capacity = r->mask + 1;
+  head     = r->hdr->head.load(std::memory_order_acquire);
+
+  if (head < r->cursor) return FEED_STALE;
+
+  if (head - r->cursor > capacity) {
+    r->lost  += head - capacity - r->cursor;
+    r->cursor = head - capacity;
+  }
+
+  n = 0;
+
+  while (n < max && r->cursor < head) {
+    slot = &r->slots[r->cursor & r->mask];
+    s1   = slot->seq.load(std::memory_order_acquire);
+
+    if (s1 == r->cursor + 1) {
+      dst[n] = slot->rec;
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      s2 = slot->seq.load(std::memory_order_relaxed);
+
+      if (s2 == s1) {
+        r->cursor++;
+        n++;
+        continue;
+      }
+    }
+
+    /*
+     * 書き込み側に追い越された
+     *   最新の位置から容量分戻った位置は書き込み中の可能性があるので、容量の
+     *   1/8の余裕を取った位置まで読み飛ばす。
+     */
+    head   = r->hdr->head.load(std::memory_order_acquire);
+    target = (head > capacity)? head - capacity + 1 + capacity / 8: 0;
+    if (target <= r->cursor) target = r->cursor + 1;
+
+    r->lost  += target - r->cursor;
+    r->cursor = target;
+  }
+
+  return n;
+}
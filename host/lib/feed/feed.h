@@ -0,0 +1,245 @@
+/*
+ * Shared-memory live feed of recorder records for host tools
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __FEED_H__
+#define __FEED_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <atomic>
+
+/*
+ * 共有メモリの構成
+ *   デバイス毎に一つの共有メモリ(POSIX共有メモリ)を作り、先頭のヘッダに続
+ *   けてスロットの配列(容量は2のべき乗)を置く。書き込み側(feedd)は一つで、
+ *   レコード毎に通し番号を振ってスロット[番号 & (容量 - 1)]に書き込む。
+ *
+ *   読み出し側は共有メモリをリードオンリーでマップし、自身のカーソル(次に読
+ *   む通し番号)のみを持つ。書き込み側は読み出し側の存在を一切参照しないので、
+ *   読み出し側の接続・切断・停止によって書き込みが待たされることは無い。読み
+ *   出しが容量分以上遅れた場合は古いレコードが上書きされ、読み出し側はその数
+ *   を欠落として数えて追従する。
+ *
+ *   スロットは番号付きのシーケンスロックで保護する。書き込み側はスロットの番
+ *   号をFEED_BUSYにしてからレコードを書き、最後に通し番号 + 1を書く。読み出
+ *   し側はレコードの前後で番号を読み、カーソル + 1で一致した場合のみ採用する。
+ */
+
+//! 共有メモリの識別子
+#define FEED_MAGIC        (0x46444d35)
+
+//! 共有メモリの構成の版数
+#define FEED_VERSION      (1)
+
+//! 書き込み中のスロットの番号
+#define FEED_BUSY         (UINT64_MAX)
+
+//! 共有メモリの名前の最大長(終端を含む)
+#define FEED_NAME_SIZE    (64)
+
+//! 読み出し開始位置(接続時点の最新の位置から)
+#define FEED_FROM_NOW     (0)
+
+//! 読み出し開始位置(残っている最も古いレコードから)
+#define FEED_FROM_OLDEST  (1)
+
+//! feed_read()の戻り値(共有メモリが作り直された)
+#define FEED_STALE        (-1)
+
+//! レコード
+typedef struct {
+  //! タイムスタンプ(センサー部の電源投入時からの通算時間, ミリ秒)
+  int64_t ts;
+
+  //! 電圧値(V)
+  double voltage;
+
+  //! 電流値(A)
+  double current;
+
+  //! 消費電力(W)
+  double wattage;
+
+  //! ホストでの受信時刻(UNIX時間, ナノ秒)
+  int64_t rx;
+} feed_record_t;
+
+//! スロット(キャッシュライン単位に揃える)
+typedef struct alignas(64) {
+  //! 格納しているレコードの通し番号 + 1(未使用の場合は0)
+  std::atomic<uint64_t> seq;
+
+  feed_record_t rec;
+} feed_slot_t;
+
+//! 共有メモリのヘッダ
+typedef struct alignas(64) {
+  //! 識別子(FEED_MAGIC, 作り直された共有メモリでは0)
+  std::atomic<uint32_t> magic;
+
+  //! 構成の版数
+  uint32_t version;
+
+  //! スロット数(2のべき乗)
+  uint32_t capacity;
+
+  //! スロットのサイズ
+  uint32_t slotSize;
+
+  //! 受信元のデバイスファイルのパス
+  char source[FEED_NAME_SIZE];
+
+  //! 次に書き込むレコードの通し番号(書き込み済みのレコード数)
+  alignas(64) std::atomic<uint64_t> head;
+
+  //! 書き込み側が動作しているか否か
+  alignas(64) std::atomic<uint32_t> alive;
+
+  //! デバイスを開いているか否か
+  std::atomic<uint32_t> up;
+
+  //! 書き込み側の生存通知の時刻(UNIX時間, ミリ秒)
+  std::atomic<int64_t> beat;
+
+  //! 解析に失敗したデータ行の数
+  std::atomic<uint64_t> broken;
+} feed_header_t;
+
+//! 書き込み側の状態
+typedef struct {
+  //! 共有メモリの先頭
+  feed_header_t* hdr;
+
+  //! スロットの配列
+  feed_slot_t* slots;
+
+  //! マップしたサイズ
+  size_t size;
+
+  //! 次に書き込むレコードの通し番号
+  uint64_t next;
+
+  //! 通し番号からスロット位置へのマスク
+  uint64_t mask;
+} feed_writer_t;
+
+//! 読み出し側の状態
+typedef struct {
+  //! 共有メモリの先頭
+  const feed_header_t* hdr;
+
+  //! スロットの配列
+  const feed_slot_t* slots;
+
+  //! マップしたサイズ
+  size_t size;
+
+  //! 次に読み出すレコードの通し番号
+  uint64_t cursor;
+
+  //! 通し番号からスロット位置へのマスク
+  uint64_t mask;
+
+  //! 上書きにより読み出せなかったレコードの数
+  uint64_t lost;
+} feed_reader_t;
+
+/**
+ * デバイスファイルのパスからの共有メモリの名前の生成
+ *
+ * @param [in] prefix  名前の接頭辞("/m5socket"等, 先頭は'/'とすること)
+ * @param [in] path    デバイスファイルのパス
+ * @param [out] dst    名前の書き込み先(FEED_NAME_SIZEバイト)
+ *
+ * @remark
+ *  パスから"/dev/"を除き、残りの'/'を'-'に置き換えたものを"接頭辞-"に続け
+ *  る(/dev/ttyACM0 → /m5socket-ttyACM0, /dev/pts/3 → /m5socket-pts-3)。
+ */
+void feed_make_name(const char* prefix, const char* path, char* dst);
+
+/**
+ * 共有メモリの作成(書き込み側)
+ *
+ * @param [out] w        書き込み側の状態の書き込み先
+ * @param [in] name      共有メモリの名前
+ * @param [in] source    受信元のデバイスファイルのパス
+ * @param [in] capacity  スロット数(2のべき乗)
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  同じ名前・容量の共有メモリが残っている場合は通し番号を引き継いで再利用す
+ *  る(接続中の読み出し側はそのまま読み続けられる)。容量が異なる場合は古い共
+ *  有メモリの識別子を消してから作り直すので、古い方を読んでいる読み出し側に
+ *  はfeed_read()がFEED_STALEを返す。
+ */
+int feed_create(feed_writer_t* w,
+                const char* name,
+                const char* source,
+                uint32_t capacity);
+
+/**
+ * 共有メモリの切り離し(書き込み側)
+ *
+ * @param [in] w  feed_create()で取得した状態
+ *
+ * @remark
+ *  書き込み側の停止を通知してアンマップする。共有メモリ自体は削除しないので、
+ *  読み出し側は残ったレコードを読み出せる。
+ */
+void feed_close(feed_writer_t* w);
+
+/**
+ * レコードの書き込み
+ *
+ * @param [in,out] w  書き込み側の状態
+ * @param [in] rec    書き込むレコード
+ *
+ * @remark
+ *  読み出し側の状態にかかわらず待つことなく書き込む。
+ */
+void feed_publish(feed_writer_t* w, const feed_record_t* rec);
+
+/**
+ * 共有メモリへの接続(読み出し側)
+ *
+ * @param [out] r    読み出し側の状態の書き込み先
+ * @param [in] name  共有メモリの名前
+ * @param [in] from  読み出し開始位置(FEED_FROM_NOW, FEED_FROM_OLDEST)
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ */
+int feed_attach(feed_reader_t* r, const char* name, int from);
+
+/**
+ * 共有メモリからの切断(読み出し側)
+ *
+ * @param [in] r  feed_attach()で取得した状態
+ */
+void feed_detach(feed_reader_t* r);
+
+/**
+ * レコードの読み出し
+ *
+ * @param [in,out] r  読み出し側の状態
+ * @param [out] dst   レコードの書き込み先
+ * @param [in] max    読み出す最大のレコード数
+ *
+ * @return
+ *  読み出したレコード数を返す(新しいレコードが無い場合は0)。共有メモリが作
+ *  り直された場合はFEED_STALEを返すので、切断して接続し直すこと。
+ *
+ * @remark
+ *  レコードは共有メモリ上のスロットから直接dstに取り出す(カーネルを経由した
+ *  コピーは行わない)。読み出す前に上書きされたレコードはr->lostに加算して読
+ *  み飛ばす。
+ */
+int feed_read(feed_reader_t* r, feed_record_t* dst, int max);
+
+#endif /* !defined(__FEED_H__) */
@@ -0,0 +1,303 @@
+/*
+ * Recorder log access library for host tools
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "reclog.h"
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+//! 小数部の桁数に対する除数テーブル
+static const double pow10_tbl[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,
+  1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18
+};
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 数値フィールドの解析
+ *
+ * @param [in,out] p  解析位置(解析後はフィールド直後を指す)
+ * @param [in] tail   解析範囲の終端
+ * @param [out] dst   解析結果の書き込み先
+ *
+ * @return
+ *  解析に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  センサー部が"%f"で出力する固定小数点表記のみを扱う(指数表記は扱わない)。
+ *  strtod()はロケール処理等で遅いため、仮数部を64ビット整数で積算してから一
+ *  回だけ除算を行う。
+ */
+static int
+parse_number(const char** p, const char* tail, double* dst)
+{
+  const char* s;
+  uint64_t mant;
+  int frac;
+  int digits;
+  bool neg;
+
+  s      = *p;
+  mant   = 0;
+  frac   = -1;
+  digits = 0;
+  neg    = false;
+
+  if (s < tail && (*s == '-' || *s == '+')) {
+    neg = (*s == '-');
+    s++;
+  }
+
+  if (tail - s >= 3 && (s[0] == 'n' || s[0] == 'i')) {
+    if (!memcmp(s, "nan", 3)) {
+      *dst = NAN;
+    } else if (!memcmp(s, "inf", 3)) {
+      *dst = (neg)? -INFINITY: INFINITY;
+    } else {
+      return DEFAULT_ERROR;
+    }
+
+    *p = s + 3;
+    return 0;
+  }
+
+  for (; s < tail; s++) {
+    if (*s >= '0' && *s <= '9') {
+      if (digits < 18) {
+        mant = (mant * 10) + (*s - '0');
+        digits++;
+        if (frac >= 0) frac++;
+      } else if (frac < 0) {
+        // 整数部が18桁を超える値はセンサーからは出てこない
+        return DEFAULT_ERROR;
+      }
+
+    } else if (*s == '.' && frac < 0) {
+      frac = 0;
+
+    } else {
+      break;
+    }
+  }
+
+  if (digits == 0) return DEFAULT_ERROR;
+
+  *dst = (double)mant / pow10_tbl[(frac > 0)? frac: 0];
+  if (neg) *dst = -*dst;
+  *p   = s;
+
+  return 0;
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+reclog_open(reclog_map_t* map, const char* path)
+{
+  int ret;
+  struct stat st;
+  void* addr;
+
+  /*
+   * initialize
+   */
+  ret     = 0;
+  map->fd = -1;
+
+  /*
+   * open file
+   */
+  map->fd = open(path, O_RDONLY);
+  if (map->fd < 0) ret = DEFAULT_ERROR;
+
+  if (!ret) {
+    if (fstat(map->fd, &st) < 0) ret = DEFAULT_ERROR;
+  }
+
+  /*
+   * map file
+   */
+  if (!ret) {
+    map->size = st.st_size;
+
+    if (map->size > 0) {
+      addr = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, map->fd, 0);
+      if (addr == MAP_FAILED) {
+        ret = DEFAULT_ERROR;
+      } else {
+        madvise(addr, map->size, MADV_SEQUENTIAL);
+        map->head = (const char*)addr;
+      }
+
+    } else {
+      map->head = NULL;
+    }
+  }
+
+  /*
+   * post process
+   */
+  if (ret) {
+    if (map->fd >= 0) close(map->fd);
+    map->fd   = -1;
+    map->head = NULL;
+    map->size = 0;
+  }
+
+  return ret;
+}
+
+void
+reclog_close(reclog_map_t* map)
+{
+  if (map->head != NULL) munmap((void*)map->head, map->size);
+  if (map->fd >= 0) close(map->fd);
+
+  map->fd   = -1;
+  map->head = NULL;
+  map->size = 0;
+}
+
+void
+reclog_release(const reclog_map_t* map, const char* head, const char* tail)
+{
+  uintptr_t page;
+  uintptr_t begin;
+  uintptr_t end;
+
+  page  = (uintptr_t)sysconf(_SC_PAGESIZE);
+  begin = ((uintptr_t)head + page - 1) & ~(page - 1);
+  end   = (uintptr_t)tail & ~(page - 1);
+
+  if (begin < (uintptr_t)map->head) return;
+  if (end > (uintptr_t)(map->head + map->size)) return;
+
+  if (begin < end) madvise((void*)begin, end - begin, MADV_DONTNEED);
+}
+
+const char*
+reclog_next_line(const char* p, const char* tail)
+{
+  const char* q;
+
+  q = (const char*)memchr(p, '\n', tail - p);
+
+  return (q != NULL)? q + 1: tail;
+}
+
+void
+reclog_split(const char* head, size_t size, int n, const char** cuts)
+{
+  const char* tail;
+  const char* p;
+  int i;
+
+  tail    = head + size;
+  cuts[0] = head;
+
+  for (i = 1; i < n; i++) {
+    p = head + (size * i) / n;
+    if (p < cuts[i - 1]) p = cuts[i - 1];
+
+    // 分割点の直前が改行でなければ、次の行頭まで進める
+    if (p > head && p < tail && p[-1] != '\n') p = reclog_next_line(p, tail);
+
+    cuts[i] = p;
+  }
+
+  cuts[n] = tail;
+}
+
+int
+reclog_parse_row(const char* head, const char* tail, reclog_row_t* row)
+{
+  const char* p;
+  double* fields[3];
+  double ts;
+  int i;
+
+  /*
+   * 行末のCRの除去
+   */
+  if (tail > head && tail[-1] == '\r') tail--;
+
+  /*
+   * データ行以外の判定
+   */
+  if (head == tail) return RECLOG_SKIP;
+  if (!(*head >= '0' && *head <= '9')) return RECLOG_SKIP;
+
+  /*
+   * タイムスタンプ
+   */
+  p = head;
+  if (parse_number(&p, tail, &ts)) return RECLOG_BROKEN;
+  if (isnan(ts) || ts != floor(ts)) return RECLOG_BROKEN;
+  row->ts = (int64_t)ts;
+
+  /*
+   * 測定値
+   */
+  fields[0] = &row->voltage;
+  fields[1] = &row->current;
+  fields[2] = &row->wattage;
+
+  for (i = 0; i < 3; i++) {
+    if (p >= tail || *p != ',') return RECLOG_BROKEN;
+    p++;
+
+    if (parse_number(&p, tail, fields[i])) return RECLOG_BROKEN;
+  }
+
+  if (p < tail && *p != ',') return RECLOG_BROKEN;
+
+  return RECLOG_ROW;
+}
+
+int
+reclog_parse_start_time(const char* path, int64_t* dst)
+{
+  const char* name;
+  struct tm tm;
+  int n;
+
+  name = strrchr(path, '/');
+  name = (name != NULL)? name + 1: path;
+
+  memset(&tm, 0, sizeof(tm));
+
+  n = sscanf(name,
+             "output-%4d%2d%2d-%2d%2d%2d.csv",
+             &tm.tm_year,
+             &tm.tm_mon,
+             &tm.tm_mday,
+             &tm.tm_hour,
+             &tm.tm_min,
+             &tm.tm_sec);
+
+  if (n != 6) return DEFAULT_ERROR;
+
+  tm.tm_year -= 1900;
+  tm.tm_mon  -= 1;
+
+  *dst = (int64_t)timegm(&tm);
+
+  return 0;
+}
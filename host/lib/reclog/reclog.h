@@ -0,0 +1,150 @@
+/*
+ * Recorder log access library for host tools
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __RECLOG_H__
+#define __RECLOG_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+//! 行の解析結果(データ行)
+#define RECLOG_ROW      (0)
+
+//! 行の解析結果(BOM、ヘッダ行、空行等のデータ以外の行)
+#define RECLOG_SKIP     (1)
+
+//! 行の解析結果(書式が不正な行)
+#define RECLOG_BROKEN   (2)
+
+//! 記録データの一行分
+typedef struct {
+  //! タイムスタンプ(センサー部の電源投入時からの通算時間, ミリ秒)
+  int64_t ts;
+
+  //! 電圧値(V)
+  double voltage;
+
+  //! 電流値(A)
+  double current;
+
+  //! 消費電力(W)
+  double wattage;
+} reclog_row_t;
+
+//! メモリマップしたログファイル
+typedef struct {
+  //! ファイル先頭へのポインタ
+  const char* head;
+
+  //! ファイルサイズ
+  size_t size;
+
+  //! ファイルディスクリプタ
+  int fd;
+} reclog_map_t;
+
+/**
+ * ログファイルのメモリマップ
+ *
+ * @param [out] map  マップ情報の書き込み先
+ * @param [in] path  ログファイルへのパス
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  ファイルはリードオンリーでマップされ、シーケンシャルアクセスのヒントが与
+ *  えられる。ファイル全体をメモリに読み込むわけではないので、数GB規模のログで
+ *  も常駐メモリ量はページキャッシュ分に留まる。
+ */
+int reclog_open(reclog_map_t* map, const char* path);
+
+/**
+ * ログファイルのアンマップ
+ *
+ * @param [in] map  reclog_open()で取得したマップ情報
+ */
+void reclog_close(reclog_map_t* map);
+
+/**
+ * 処理済み領域のページの解放
+ *
+ * @param [in] map   reclog_open()で取得したマップ情報
+ * @param [in] head  解放する領域の先頭
+ * @param [in] tail  解放する領域の終端
+ *
+ * @remark
+ *  処理を終えた範囲のページをページキャッシュに返却し、巨大なファイルを走査
+ *  する場合でもプロセスの常駐メモリ量が増え続けないようにする。範囲はページ
+ *  境界の内側に丸められる。
+ */
+void reclog_release(const reclog_map_t* map,
+                    const char* head,
+                    const char* tail);
+
+/**
+ * 次の行の先頭を探す
+ *
+ * @param [in] p     探索開始位置
+ * @param [in] tail  探索範囲の終端
+ *
+ * @return
+ *  pが含まれる行の次の行の先頭へのポインタを返す(改行が見つからない場合は
+ *  tailを返す)。
+ */
+const char* reclog_next_line(const char* p, const char* tail);
+
+/**
+ * 行単位の分割点の算出
+ *
+ * @param [in] head   分割対象の領域の先頭
+ * @param [in] size   分割対象の領域のサイズ
+ * @param [in] n      分割数
+ * @param [out] cuts  分割点の書き込み先(n + 1要素)
+ *
+ * @remark
+ *  領域をほぼ均等なn個のチャンクに分割する。各分割点は行の先頭に揃えられる
+ *  ので、チャンクiは[cuts[i], cuts[i + 1])の範囲の完全な行で構成される(行
+ *  が極端に長い場合は空のチャンクが生じることがある)。
+ */
+void reclog_split(const char* head, size_t size, int n, const char** cuts);
+
+/**
+ * 一行の解析
+ *
+ * @param [in] head  行の先頭
+ * @param [in] tail  行の終端(改行文字の位置)
+ * @param [out] row  解析結果の書き込み先
+ *
+ * @return
+ *  RECLOG_ROW, RECLOG_SKIP, RECLOG_BROKENのいずれかを返す。
+ *
+ * @remark
+ *  センサー部の出力する"タイムスタンプ,電圧,電流,消費電力"の形式の行を解析す
+ *  る。行末のCRは無視する。5列目以降が存在する場合は読み飛ばす。
+ *  数値以外で始まる行(BOM、ヘッダ行等)や空行はRECLOG_SKIPとして扱う。センサ
+ *  ーが測定値を取得する前の"nan"等の値はNANとして格納される。
+ */
+int reclog_parse_row(const char* head, const char* tail, reclog_row_t* row);
+
+/**
+ * ファイル名からの記録開始時刻の取得
+ *
+ * @param [in] path  ログファイルへのパス
+ * @param [out] dst  記録開始時刻(1970/1/1からの秒数, ローカル時刻)の書き込み先
+ *
+ * @return
+ *  ファイル名から記録開始時刻を取得できた場合は0を、取得できなかった場合は0以
+ *  外の値を返す。
+ *
+ * @remark
+ *  NTPによる時刻合わせが有効な場合、レコーダは"output-YYYYmmdd-HHMMSS.csv"
+ *  の形式のファイル名で記録を行うので、その部分から時刻を復元する。得られる
+ *  値はレコーダのローカル時刻(JST)をそのままUTCとみなした値となる。
+ */
+int reclog_parse_start_time(const char* path, int64_t* dst);
+
+#endif /* !defined(__RECLOG_H__) */
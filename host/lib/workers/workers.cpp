@@ -0,0 +1,67 @@
+/*
+ * Simple worker pool for host tools
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "workers.h"
+
+//! 使用するワーカー数(0の場合はCPUのコア数)
+static int count = 0;
+
+/*
+ * 公開関数の定義
+ */
+
+int
+workers_count()
+{
+  int n;
+
+  if (count > 0) return count;
+
+  n = (int)std::thread::hardware_concurrency();
+
+  return (n > 0)? n: 1;
+}
+
+void
+workers_set_count(int n)
+{
+  count = (n > 0)? n: 0;
+}
+
+void
+workers_for(size_t n, const std::function<void(size_t, int)>& func)
+{
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> threads;
+  int nw;
+  int i;
+
+  nw = workers_count();
+  if ((size_t)nw > n) nw = (int)n;
+
+  auto body = [&](int id) {
+    size_t idx;
+
+    while ((idx = next.fetch_add(1)) < n) func(idx, id);
+  };
+
+  /*
+   * 単一ワーカーの場合はスレッドを起こさずに呼び出し元で処理する
+   */
+  if (nw <= 1) {
+    body(0);
+    return;
+  }
+
+  for (i = 1; i < nw; i++) threads.emplace_back(body, i);
+  body(0);
+
+  for (auto& th: threads) th.join();
+}
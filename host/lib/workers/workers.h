@@ -0,0 +1,43 @@
+/*
+ * Simple worker pool for host tools
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __WORKERS_H__
+#define __WORKERS_H__
+
+#include <stddef.h>
+#include <functional>
+
+/**
+ * 使用するワーカー数の取得
+ *
+ * @return
+ *  workers_set_count()で設定された値を返す。未設定の場合はCPUのコア数を返す。
+ */
+int workers_count();
+
+/**
+ * 使用するワーカー数の設定
+ *
+ * @param [in] n  ワーカー数(0以下を指定した場合はCPUのコア数)
+ */
+void workers_set_count(int n);
+
+/**
+ * 並列ループ
+ *
+ * @param [in] n     ループ回数
+ * @param [in] func  ループ本体(引数としてインデックスとワーカー番号が渡される)
+ *
+ * @remark
+ *  [0, n)の各インデックスについてfuncを呼び出す。インデックスはワーカー間で
+ *  アトミックカウンタにより動的に割り当てられるので、処理量が不均一な場合で
+ *  も負荷が平準化される。全ての呼び出しが終了するまで本関数は復帰しない。
+ *  ワーカー番号は[0, workers_count())の範囲の値で、ワーカー単位の作業領域の
+ *  選択に使用できる。
+ */
+void workers_for(size_t n, const std::function<void(size_t, int)>& func);
+
+#endif /* !defined(__WORKERS_H__) */
@@ -0,0 +1,430 @@
+/*
+ * Appliance signature tool for recorder logs
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <reclog.h>
+#include <appliance.h>
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+//! ベンチマークのデフォルトのフレーム数
+#define BENCH_FRAMES    (50 * 1000 * 1000)
+
+//! 経過時間計測用の時計
+typedef std::chrono::steady_clock clock_type;
+
+//! 学習時の特徴量の集計
+struct Accum {
+  int64_t step;
+  int64_t pf;
+  int64_t overshoot;
+  int64_t settle;
+  int64_t n;
+};
+
+//! 識別のパラメータ(センサー側のデフォルト値と同じ)
+static const appliance_param_t default_param = {
+  100,      // stepThreshold: 10W
+  30,       // stableBand: 3W
+  5,        // stableFrames
+  200,      // maxTransient
+  40000     // maxDistance: 相対誤差20%相当
+};
+
+//! シグネチャの名前の格納領域
+static std::vector<std::string> names;
+
+//! シグネチャ表
+static std::vector<appliance_signature_t> signatures;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 使用方法の表示
+ */
+static void
+usage()
+{
+  fprintf(stderr,
+          "usage: appliance [-s SIGNATURES] FILE...   replay recorder logs\n"
+          "       appliance -L [-C] FILE...            learn from labeled events\n"
+          "       appliance -B [FRAMES]                benchmark\n"
+          "\n"
+          "options:\n"
+          "  -s FILE     signature table (name,step,pf,overshoot,settle)\n"
+          "  -L          average labeled \"!...,app,NAME,on,...\" lines\n"
+          "  -C          print the learned table as a C initializer\n"
+          "  -B          measure the per-frame cost with %d signatures\n",
+          APPLIANCE_MAX_CLASSES);
+}
+
+/**
+ * イベント行の出力
+ *
+ * @param [in] ctx  状態
+ * @param [in] ev   イベント
+ *
+ * @remark
+ *  センサーが出力するイベント行と同じ形式で出力する。
+ */
+static void
+print_event(const appliance_t* ctx, const appliance_event_t* ev)
+{
+  printf("!%llu,app,%s,%s,%.1f,%.3f,%d,%d,%.1f\n",
+         (unsigned long long)ev->ts,
+         appliance_name(ctx, ev->cls),
+         (ev->on)? "on": "off",
+         ev->step / 10.0,
+         ev->pf / 1000.0,
+         ev->overshoot,
+         ev->settle,
+         ev->duty / 10.0);
+}
+
+/**
+ * シグネチャ表の読み込み
+ *
+ * @param [in] path  シグネチャ表のファイル
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ */
+static int
+load_signatures(const char* path)
+{
+  int ret;
+  FILE* fp;
+  char line[256];
+  char name[64];
+  int step;
+  int pf;
+  int os;
+  int settle;
+  size_t i;
+
+  ret = 0;
+  fp  = fopen(path, "r");
+
+  if (fp == NULL) {
+    ret = DEFAULT_ERROR;
+
+  } else {
+    while (fgets(line, sizeof(line), fp) != NULL) {
+      if (line[0] == '#') continue;
+      if (sscanf(line,
+                 "%63[^,],%d,%d,%d,%d",
+                 name, &step, &pf, &os, &settle) != 5) continue;
+
+      names.push_back(name);
+      signatures.push_back({NULL,
+                            step,
+                            (int16_t)pf,
+                            (int16_t)os,
+                            (int16_t)settle});
+    }
+
+    fclose(fp);
+
+    for (i = 0; i < signatures.size(); i++) {
+      signatures[i].name = names[i].c_str();
+    }
+
+    signatures.push_back({NULL, 0, 0, 0, 0});
+  }
+
+  return ret;
+}
+
+/**
+ * 記録ファイルの再生
+ *
+ * @param [in] path  記録ファイル
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  記録ファイルの電圧・電流・電力からセンサーと同じ整数値を作って識別器に
+ *  投入し、発生したイベントを出力する。
+ */
+static int
+replay(const char* path)
+{
+  int ret;
+  reclog_map_t map;
+  appliance_t ctx;
+  appliance_event_t ev;
+  reclog_row_t row;
+  const char* p;
+  const char* tail;
+  const char* eol;
+  double va;
+  int32_t pf;
+
+  ret = reclog_open(&map, path);
+
+  if (!ret) {
+    appliance_init(&ctx,
+                   &default_param,
+                   (signatures.empty())? NULL: signatures.data());
+
+    p    = map.head;
+    tail = map.head + map.size;
+
+    while (p < tail) {
+      eol = (const char*)memchr(p, '\n', tail - p);
+      if (eol == NULL) eol = tail;
+
+      if (reclog_parse_row(p, eol, &row) == RECLOG_ROW &&
+          isfinite(row.wattage)) {
+        va = row.voltage * row.current;
+        pf = (va > 0.0)? (int32_t)lround(row.wattage * 1000.0 / va): 1000;
+
+        if (appliance_push(&ctx,
+                           (uint64_t)row.ts,
+                           (int32_t)lround(row.wattage * 10.0),
+                           pf,
+                           &ev)) {
+          print_event(&ctx, &ev);
+        }
+      }
+
+      p = eol + 1;
+    }
+
+    reclog_close(&map);
+  }
+
+  return ret;
+}
+
+/**
+ * ラベル付きイベントの集計
+ *
+ * @param [in] path   イベント行を含むファイル
+ * @param [out] acc   名前毎の集計
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  名前が"?"以外のONイベントのみを集計する。
+ */
+static int
+learn(const char* path, std::map<std::string, Accum>* acc)
+{
+  int ret;
+  FILE* fp;
+  char line[256];
+  unsigned long long ts;
+  char name[64];
+  char state[8];
+  double step;
+  double pf;
+  int os;
+  int settle;
+  Accum* a;
+
+  ret = 0;
+  fp  = fopen(path, "r");
+
+  if (fp == NULL) {
+    ret = DEFAULT_ERROR;
+
+  } else {
+    while (fgets(line, sizeof(line), fp) != NULL) {
+      if (sscanf(line,
+                 "!%llu,app,%63[^,],%7[^,],%lf,%lf,%d,%d",
+                 &ts, name, state, &step, &pf, &os, &settle) != 7) continue;
+
+      if (strcmp(name, "?") == 0 || strcmp(state, "on") != 0) continue;
+
+      a = &(*acc)[name];
+      a->step      += lround(step * 10.0);
+      a->pf        += lround(pf * 1000.0);
+      a->overshoot += os;
+      a->settle    += settle;
+      a->n++;
+    }
+
+    fclose(fp);
+  }
+
+  return ret;
+}
+
+/**
+ * ベンチマーク
+ *
+ * @param [in] n  フレーム数
+ *
+ * @remark
+ *  10Hzのフレームで、数種類の負荷が不規則にON/OFFする合成データを識別器に
+ *  投入し、フレーム当たりの処理時間を計測する。
+ */
+static void
+bench(size_t n)
+{
+  static const appliance_signature_t table[] = {
+    {"a", 6000, 990, 0, 1},   {"b", 12000, 980, 40, 3},
+    {"c", 800, 600, 300, 8},  {"d", 450, 650, 500, 12},
+    {"e", 100, 500, 0, 1},    {"f", 2500, 950, 20, 2},
+    {"g", 3500, 900, 100, 4}, {"h", 1500, 700, 800, 20},
+    {"i", 200, 400, 0, 1},    {"j", 9000, 1000, 0, 1},
+    {"k", 700, 800, 60, 5},   {"l", 5500, 850, 120, 6},
+    {"m", 300, 550, 200, 3},  {"n", 4000, 970, 10, 2},
+    {"o", 1100, 750, 400, 9}, {"p", 2000, 920, 30, 3},
+    {NULL, 0, 0, 0, 0}
+  };
+
+  std::vector<int32_t> power(n);
+  std::vector<int32_t> pf(n);
+  appliance_t ctx;
+  appliance_event_t ev;
+  uint32_t seed;
+  int32_t base;
+  size_t events;
+  size_t i;
+  clock_type::time_point t0;
+  double sec;
+
+  /*
+   * 合成データの生成
+   */
+  seed = 1;
+  base = 50;
+
+  for (i = 0; i < n; i++) {
+    seed = seed * 1103515245 + 12345;
+
+    if ((seed >> 16) % 600 == 0) {
+      base = 50 + table[(seed >> 8) % 16].step * ((seed >> 4) & 1);
+    }
+
+    power[i] = base + (int32_t)((seed >> 20) % 9) - 4;
+    pf[i]    = 900;
+  }
+
+  /*
+   * 計測
+   */
+  appliance_init(&ctx, &default_param, table);
+
+  events = 0;
+  t0     = clock_type::now();
+
+  for (i = 0; i < n; i++) {
+    events += appliance_push(&ctx, i * 100, power[i], pf[i], &ev);
+  }
+
+  sec = std::chrono::duration<double>(clock_type::now() - t0).count();
+
+  printf("frames=%zu events=%zu ns_per_frame=%.2f frames_per_sec=%.0f\n",
+         n,
+         events,
+         (sec * 1e9) / n,
+         n / sec);
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+main(int argc, char* argv[])
+{
+  int ret;
+  int opt;
+  bool learnMode;
+  bool cForm;
+  bool benchMode;
+  std::map<std::string, Accum> acc;
+  int i;
+
+  ret       = 0;
+  learnMode = false;
+  cForm     = false;
+  benchMode = false;
+
+  while ((opt = getopt(argc, argv, "s:LCBh")) != -1) {
+    switch (opt) {
+    case 's':
+      if (load_signatures(optarg)) {
+        fprintf(stderr, "error: cannot read %s\n", optarg);
+        return 1;
+      }
+      break;
+
+    case 'L':
+      learnMode = true;
+      break;
+
+    case 'C':
+      cForm = true;
+      break;
+
+    case 'B':
+      benchMode = true;
+      break;
+
+    default:
+      usage();
+      return (opt == 'h')? 0: 1;
+    }
+  }
+
+  /*
+   * ベンチマーク
+   */
+  if (benchMode) {
+    bench((optind < argc)? strtoul(argv[optind], NULL, 10): BENCH_FRAMES);
+    return 0;
+  }
+
+  if (optind >= argc) {
+    usage();
+    return 1;
+  }
+
+  /*
+   * 学習もしくは再生
+   */
+  for (i = optind; i < argc; i++) {
+    if ((learnMode)? learn(argv[i], &acc): replay(argv[i])) {
+      fprintf(stderr, "error: cannot read %s\n", argv[i]);
+      ret = 1;
+    }
+  }
+
+  if (learnMode) {
+    if (!cForm) printf("# name,step,pf,overshoot,settle\n");
+
+    for (auto& e: acc) {
+      printf((cForm)? "  {\"%s\", %lld, %lld, %lld, %lld},\n":
+                      "%s,%lld,%lld,%lld,%lld\n",
+             e.first.c_str(),
+             (long long)(e.second.step / e.second.n),
+             (long long)(e.second.pf / e.second.n),
+             (long long)(e.second.overshoot / e.second.n),
+             (long long)(e.second.settle / e.second.n));
+    }
+  }
+
+  return ret;
+}
@@ -0,0 +1,244 @@
+/*
+ * Calibration fitting tool for sensor sockets
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+
+#include "calib.h"
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+//! 基準計の測定値毎の積算値
+typedef struct {
+  double sum[CALIB_CHANNELS];
+  uint32_t count[CALIB_CHANNELS];
+} accum_t;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 行末のノードIDの取得
+ *
+ * @param [in] head  行の先頭
+ * @param [in] tail  行の終端(改行文字の位置)
+ *
+ * @return
+ *  5列目以降がある場合は最後の列の値を、無い場合は-1を返す。
+ *
+ * @remark
+ *  デイジーチェーン接続されたセンサーの出力ではノードIDが最後の列となる(区
+ *  間長の列がある場合はその後ろ)。
+ */
+static int
+row_node(const char* head, const char* tail)
+{
+  const char* p;
+  const char* last;
+  int cols;
+
+  cols = 1;
+  last = head;
+
+  for (p = head; p < tail; p++) {
+    if (*p == ',') {
+      cols++;
+      last = p + 1;
+    }
+  }
+
+  return (cols >= 5)? (int)strtol(last, NULL, 10): -1;
+}
+
+/**
+ * 値の取り出し
+ */
+static inline double
+row_value(const reclog_row_t* row, int ch)
+{
+  switch (ch) {
+  case CALIB_VOLTAGE: return row->voltage;
+  case CALIB_CURRENT: return row->current;
+  default:            return row->wattage;
+  }
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+calib_load_reference(const char* path, std::vector<reclog_row_t>* dst)
+{
+  int ret;
+  reclog_map_t map;
+  const char* p;
+  const char* tail;
+  const char* eol;
+  reclog_row_t row;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  dst->clear();
+
+  /*
+   * read rows
+   */
+  if (reclog_open(&map, path)) {
+    perror(path);
+    return DEFAULT_ERROR;
+  }
+
+  p    = map.head;
+  tail = map.head + map.size;
+
+  while (p < tail) {
+    eol = (const char*)memchr(p, '\n', tail - p);
+    if (eol == NULL) eol = tail;
+
+    switch (reclog_parse_row(p, eol, &row)) {
+    case RECLOG_ROW:
+      dst->push_back(row);
+      break;
+
+    case RECLOG_BROKEN:
+      fprintf(stderr, "%s: broken line at %zu\n", path, (size_t)(p - map.head));
+      ret = DEFAULT_ERROR;
+      break;
+    }
+
+    if (ret) break;
+    p = eol + 1;
+  }
+
+  reclog_close(&map);
+
+  /*
+   * sort by timestamp
+   */
+  if (!ret) {
+    std::stable_sort(dst->begin(), dst->end(),
+                     [](const reclog_row_t& a, const reclog_row_t& b) {
+                       return a.ts < b.ts;
+                     });
+  }
+
+  return ret;
+}
+
+int
+calib_align(const job_t* job,
+            const std::vector<reclog_row_t>& refs,
+            const align_param_t* param,
+            samples_t* dst)
+{
+  reclog_map_t map;
+  std::vector<int64_t> ts;
+  std::vector<accum_t> acc;
+  const char* p;
+  const char* tail;
+  const char* eol;
+  const char* released;
+  reclog_row_t row;
+  double v;
+  size_t i;
+  size_t j;
+  int ch;
+
+  /*
+   * initialize
+   */
+  for (ch = 0; ch < CALIB_CHANNELS; ch++) {
+    dst->x[ch].clear();
+    dst->y[ch].clear();
+  }
+
+  dst->rows      = 0;
+  dst->refs      = refs.size();
+  dst->unmatched = 0;
+
+  ts.resize(refs.size());
+  acc.resize(refs.size());
+
+  for (i = 0; i < refs.size(); i++) {
+    ts[i] = refs[i].ts + param->shift;
+    memset(&acc[i], 0, sizeof(acc[i]));
+  }
+
+  /*
+   * scan recording
+   */
+  if (reclog_open(&map, job->recording.c_str())) {
+    perror(job->recording.c_str());
+    return DEFAULT_ERROR;
+  }
+
+  p        = map.head;
+  tail     = map.head + map.size;
+  released = p;
+
+  while (p < tail) {
+    eol = (const char*)memchr(p, '\n', tail - p);
+    if (eol == NULL) eol = tail;
+
+    if (reclog_parse_row(p, eol, &row) == RECLOG_ROW &&
+        (job->node < 0 || row_node(p, eol) == job->node)) {
+      dst->rows++;
+
+      // 窓に入る基準計の測定値は高々数個なので、先頭を二分探索して順に見る
+      i = std::lower_bound(ts.begin(), ts.end(), row.ts - param->window) -
+          ts.begin();
+
+      for (j = i; j < ts.size() && ts[j] <= row.ts + param->window; j++) {
+        for (ch = 0; ch < CALIB_CHANNELS; ch++) {
+          v = row_value(&row, ch);
+          if (isnan(v)) continue;
+
+          acc[j].sum[ch] += v;
+          acc[j].count[ch]++;
+        }
+      }
+    }
+
+    p = eol + 1;
+
+    if (p - released >= (1 << 24)) {
+      reclog_release(&map, released, p);
+      released = p;
+    }
+  }
+
+  reclog_close(&map);
+
+  /*
+   * make pairs
+   */
+  for (i = 0; i < refs.size(); i++) {
+    bool matched = false;
+
+    for (ch = 0; ch < CALIB_CHANNELS; ch++) {
+      v = row_value(&refs[i], ch);
+      if (isnan(v) || acc[i].count[ch] == 0) continue;
+
+      dst->x[ch].push_back(acc[i].sum[ch] / acc[i].count[ch]);
+      dst->y[ch].push_back(v);
+      matched = true;
+    }
+
+    if (!matched) dst->unmatched++;
+  }
+
+  return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * Calibration fitting tool for sensor sockets
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __CALIB_H__
+#define __CALIB_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include <reclog.h>
+
+//! チャンネル数(電圧・電流・消費電力)
+#define CALIB_CHANNELS    (3)
+
+//! チャンネル番号(電圧)
+#define CALIB_VOLTAGE     (0)
+
+//! チャンネル番号(電流)
+#define CALIB_CURRENT     (1)
+
+//! チャンネル番号(消費電力)
+#define CALIB_WATTAGE     (2)
+
+//! フィッティングのモード(フィッティングを行えなかった)
+#define FIT_NONE          (0)
+
+//! フィッティングのモード(利得と切片)
+#define FIT_AFFINE        (1)
+
+//! フィッティングのモード(利得のみ, 原点を通る直線)
+#define FIT_GAIN          (2)
+
+//! 較正対象の一台分の指定
+typedef struct {
+  //! デバイス名(出力ファイル名に使用する)
+  std::string name;
+
+  //! レコーダの記録ファイルへのパス
+  std::string recording;
+
+  //! 基準計の測定値のファイルへのパス
+  std::string reference;
+
+  //! デイジーチェーン接続時のノードID(-1の場合は選別しない)
+  int node;
+} job_t;
+
+//! 突き合わせのパラメータ
+typedef struct {
+  //! 基準計の測定値と対応付ける記録データの時間幅(前後, ミリ秒)
+  int64_t window;
+
+  //! 基準計のタイムスタンプに加算する補正値(ミリ秒)
+  int64_t shift;
+} align_param_t;
+
+//! 突き合わせ結果
+typedef struct {
+  //! 記録データの値(窓内の平均, チャンネル毎)
+  std::vector<double> x[CALIB_CHANNELS];
+
+  //! 基準計の値(チャンネル毎)
+  std::vector<double> y[CALIB_CHANNELS];
+
+  //! 記録データの行数(選別後)
+  uint64_t rows;
+
+  //! 基準計の測定値の数
+  size_t refs;
+
+  //! 対応する記録データが無かった基準計の測定値の数
+  size_t unmatched;
+} samples_t;
+
+//! フィッティングのパラメータ
+typedef struct {
+  //! Huber関数の閾値(ロバストな標準偏差に対する倍率)
+  double huber;
+
+  //! 最大の反復回数
+  int maxIter;
+
+  //! フィッティングに必要な最小の点数
+  size_t minPoints;
+
+  //! 切片も求めるのに必要な値の幅(平均に対する比率)
+  double minSpan;
+} fit_param_t;
+
+//! フィッティング結果
+typedef struct {
+  //! モード(FIT_NONE, FIT_AFFINE, FIT_GAIN)
+  int mode;
+
+  //! 利得
+  double gain;
+
+  //! 切片
+  double offset;
+
+  //! 使用した点数
+  size_t n;
+
+  //! 外れ値とみなした点数(ロバストな標準偏差の3倍を超える残差)
+  size_t outliers;
+
+  //! 反復回数
+  int iter;
+
+  //! 較正前の残差の二乗平均平方根(外れ値を除く)
+  double rmsBefore;
+
+  //! 較正後の残差の二乗平均平方根(外れ値を除く)
+  double rmsAfter;
+
+  //! 較正後の残差のロバストな標準偏差(1.4826 * MAD)
+  double sigma;
+} fit_t;
+
+/**
+ * 基準計の測定値の読み込み
+ *
+ * @param [in] path  ファイルへのパス
+ * @param [out] dst  測定値の書き込み先(タイムスタンプ順に整列される)
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  記録ファイルと同じ"タイムスタンプ,電圧,電流,消費電力"の形式とする。測定
+ *  していないチャンネルは"nan"とする。
+ */
+int calib_load_reference(const char* path, std::vector<reclog_row_t>* dst);
+
+/**
+ * 記録データと基準計の測定値の突き合わせ
+ *
+ * @param [in] job    較正対象の指定
+ * @param [in] refs   基準計の測定値(タイムスタンプ順)
+ * @param [in] param  パラメータ
+ * @param [out] dst   突き合わせ結果の書き込み先
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  基準計の各測定値について、前後param->windowの範囲の記録データの平均を対
+ *  応付ける。記録ファイルは先頭から順に一度だけ走査する。
+ */
+int calib_align(const job_t* job,
+                const std::vector<reclog_row_t>& refs,
+                const align_param_t* param,
+                samples_t* dst);
+
+/**
+ * ロバストな直線の当てはめ
+ *
+ * @param [in] x      記録データの値
+ * @param [in] y      基準計の値
+ * @param [in] n      点数
+ * @param [in] param  パラメータ
+ * @param [out] dst   結果の書き込み先
+ *
+ * @remark
+ *  y = gain * x + offsetをHuber損失の反復重み付き最小二乗法(IRLS)で求める。
+ *  残差の尺度は各反復でMADから推定する。xの幅が平均に対して小さい場合(電圧
+ *  等)は利得と切片が分離できないので、原点を通る直線とする。点数が不足する
+ *  場合や結果の利得が異常な場合はFIT_NONEとなる。
+ */
+void calib_fit(const double* x,
+               const double* y,
+               size_t n,
+               const fit_param_t* param,
+               fit_t* dst);
+
+#endif /* !defined(__CALIB_H__) */
@@ -0,0 +1,246 @@
+/*
+ * Calibration fitting tool for sensor sockets
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "calib.h"
+
+//! MADから正規分布の標準偏差への換算係数
+#define MAD_SCALE       (1.4826)
+
+//! 外れ値とみなす残差(ロバストな標準偏差に対する倍率)
+#define OUTLIER_SIGMA   (3.0)
+
+//! 収束判定の閾値(相対値)
+#define CONVERGENCE     (1e-10)
+
+//! 受け入れる利得の範囲(これを外れる場合は対応付けの誤りとみなす)
+#define GAIN_MIN        (0.5)
+#define GAIN_MAX        (2.0)
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * ロバストな尺度の推定
+ *
+ * @param [in] r     残差
+ * @param [out] tmp  作業領域
+ *
+ * @return
+ *  残差の絶対値の中央値(MAD)から求めた標準偏差を返す。
+ */
+static double
+robust_sigma(const std::vector<double>& r, std::vector<double>* tmp)
+{
+  size_t mid;
+  size_t i;
+
+  tmp->resize(r.size());
+  for (i = 0; i < r.size(); i++) (*tmp)[i] = fabs(r[i]);
+
+  mid = tmp->size() / 2;
+  std::nth_element(tmp->begin(), tmp->begin() + mid, tmp->end());
+
+  return MAD_SCALE * (*tmp)[mid];
+}
+
+/**
+ * 重み付き最小二乗法
+ *
+ * @param [in] x       記録データの値
+ * @param [in] y       基準計の値
+ * @param [in] w       重み
+ * @param [in] affine  切片も求めるか否か
+ * @param [out] gain    利得の書き込み先
+ * @param [out] offset  切片の書き込み先
+ *
+ * @return
+ *  解が求まった場合はtrueを返す。
+ *
+ * @remark
+ *  桁落ちを避けるため、xとyは重み付き平均からの偏差で積算する。
+ */
+static bool
+weighted_ls(const double* x,
+            const double* y,
+            const std::vector<double>& w,
+            size_t n,
+            bool affine,
+            double* gain,
+            double* offset)
+{
+  double sw;
+  double mx;
+  double my;
+  double sxx;
+  double sxy;
+  double dx;
+  size_t i;
+
+  sw = mx = my = 0.0;
+
+  for (i = 0; i < n; i++) {
+    sw += w[i];
+    mx += w[i] * x[i];
+    my += w[i] * y[i];
+  }
+
+  if (sw <= 0.0) return false;
+
+  if (affine) {
+    mx /= sw;
+    my /= sw;
+  } else {
+    mx = my = 0.0;
+  }
+
+  sxx = sxy = 0.0;
+
+  for (i = 0; i < n; i++) {
+    dx   = x[i] - mx;
+    sxx += w[i] * dx * dx;
+    sxy += w[i] * dx * (y[i] - my);
+  }
+
+  if (sxx <= 0.0) return false;
+
+  *gain   = sxy / sxx;
+  *offset = my - *gain * mx;
+
+  return true;
+}
+
+/*
+ * 公開関数の定義
+ */
+
+void
+calib_fit(const double* x,
+          const double* y,
+          size_t n,
+          const fit_param_t* param,
+          fit_t* dst)
+{
+  std::vector<double> w;
+  std::vector<double> r;
+  std::vector<double> tmp;
+  double lo;
+  double hi;
+  double mean;
+  double gain;
+  double offset;
+  double prevGain;
+  double prevOffset;
+  double sigma;
+  double limit;
+  double e0;
+  double e1;
+  bool affine;
+  size_t i;
+
+  /*
+   * initialize
+   */
+  dst->mode      = FIT_NONE;
+  dst->gain      = 1.0;
+  dst->offset    = 0.0;
+  dst->n         = n;
+  dst->outliers  = 0;
+  dst->iter      = 0;
+  dst->rmsBefore = NAN;
+  dst->rmsAfter  = NAN;
+  dst->sigma     = NAN;
+
+  if (n < param->minPoints || n < 2) return;
+
+  /*
+   * select model
+   *   値の幅が狭い場合、利得と切片の推定値は強く相関して不安定になる。
+   */
+  lo   = hi = x[0];
+  mean = 0.0;
+
+  for (i = 0; i < n; i++) {
+    lo    = std::min(lo, x[i]);
+    hi    = std::max(hi, x[i]);
+    mean += x[i];
+  }
+
+  mean  /= n;
+  affine = ((hi - lo) >= param->minSpan * fabs(mean));
+
+  /*
+   * initial estimate (ordinary least squares)
+   */
+  w.assign(n, 1.0);
+  r.resize(n);
+
+  if (!weighted_ls(x, y, w, n, affine, &gain, &offset)) return;
+
+  /*
+   * iteratively reweighted least squares
+   */
+  sigma = 0.0;
+
+  for (dst->iter = 1; dst->iter <= param->maxIter; dst->iter++) {
+    for (i = 0; i < n; i++) r[i] = y[i] - (gain * x[i] + offset);
+
+    sigma = robust_sigma(r, &tmp);
+    if (sigma <= 0.0) break;
+
+    // Huberの重み: 閾値以内は1、超える分は残差に反比例させる
+    limit = param->huber * sigma;
+    for (i = 0; i < n; i++) {
+      w[i] = (fabs(r[i]) <= limit)? 1.0: limit / fabs(r[i]);
+    }
+
+    prevGain   = gain;
+    prevOffset = offset;
+
+    if (!weighted_ls(x, y, w, n, affine, &gain, &offset)) return;
+
+    if (fabs(gain - prevGain) <= CONVERGENCE * fabs(gain) &&
+        fabs(offset - prevOffset) <= CONVERGENCE * (1.0 + fabs(offset))) {
+      break;
+    }
+  }
+
+  if (dst->iter > param->maxIter) dst->iter = param->maxIter;
+  if (!(gain >= GAIN_MIN && gain <= GAIN_MAX)) return;
+
+  /*
+   * evaluate
+   */
+  for (i = 0; i < n; i++) r[i] = y[i] - (gain * x[i] + offset);
+
+  sigma = robust_sigma(r, &tmp);
+  e0    = e1 = 0.0;
+
+  for (i = 0; i < n; i++) {
+    if (fabs(r[i]) > OUTLIER_SIGMA * sigma) {
+      dst->outliers++;
+      continue;
+    }
+
+    e0 += (y[i] - x[i]) * (y[i] - x[i]);
+    e1 += r[i] * r[i];
+  }
+
+  i = n - dst->outliers;
+
+  dst->mode      = (affine)? FIT_AFFINE: FIT_GAIN;
+  dst->gain      = gain;
+  dst->offset    = offset;
+  dst->rmsBefore = (i > 0)? sqrt(e0 / i): NAN;
+  dst->rmsAfter  = (i > 0)? sqrt(e1 / i): NAN;
+  dst->sigma     = sigma;
+}
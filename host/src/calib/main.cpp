@@ -0,0 +1,437 @@
+/*
+ * Calibration fitting tool for sensor sockets
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include <workers.h>
+
+#include "calib.h"
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR     (__LINE__)
+
+//! 突き合わせの時間幅のデフォルト値(前後, ミリ秒)
+#define DEFAULT_WINDOW    (500)
+
+//! Huber関数の閾値のデフォルト値(正規分布で95%の効率となる値)
+#define DEFAULT_HUBER     (1.345)
+
+//! フィッティングに必要な最小の点数のデフォルト値
+#define DEFAULT_POINTS    (20)
+
+//! 切片も求めるのに必要な値の幅のデフォルト値(平均に対する比率)
+#define DEFAULT_SPAN      (0.2)
+
+//! 最大の反復回数
+#define MAX_ITER          (50)
+
+//! チャンネルの表示名
+static const char* channel_names[] = {"V", "A", "W"};
+
+//! NVSのキーの接頭辞(チャンネル毎)
+static const char* key_prefixes[] = {"v", "a", "w"};
+
+//! モードの表示名
+static const char* mode_names[] = {"none", "affine", "gain"};
+
+//! 一台分の処理結果
+typedef struct {
+  //! 処理に失敗したか否か
+  bool error;
+
+  //! 突き合わせ結果
+  samples_t samples;
+
+  //! フィッティング結果(チャンネル毎)
+  fit_t fit[CALIB_CHANNELS];
+} result_t;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 使用方法の表示
+ */
+static void
+usage()
+{
+  fprintf(stderr,
+          "usage: calib [options] MANIFEST\n"
+          "\n"
+          "  MANIFEST lists one socket per line as\n"
+          "  \"NAME,RECORDING,REFERENCE[,NODE_ID]\" (paths are relative to\n"
+          "  the manifest). REFERENCE has the same \"ts,V,A,W\" rows as a\n"
+          "  recording (use nan for channels the meter does not measure).\n"
+          "\n"
+          "options:\n"
+          "  -o OUTDIR   write NAME.csv (NVS partition CSV) to OUTDIR\n"
+          "              (created if it does not exist)\n"
+          "  -w MSEC     average recorder rows within +-MSEC (default %d)\n"
+          "  -s MSEC     add MSEC to reference timestamps (default 0)\n"
+          "  -k K        Huber threshold in robust sigmas (default %.3f)\n"
+          "  -n COUNT    minimum pairs per channel (default %d)\n"
+          "  -j JOBS     number of worker threads (default: all cores)\n",
+          DEFAULT_WINDOW,
+          DEFAULT_HUBER,
+          DEFAULT_POINTS);
+}
+
+/**
+ * ディレクトリの作成(途中のディレクトリを含む)
+ *
+ * @param [in] path  作成するディレクトリへのパス
+ *
+ * @return
+ *  処理に成功した場合(既に存在する場合を含む)は0を、失敗した場合は0以外の
+ *  値を返す。
+ */
+static int
+make_dirs(const std::string& path)
+{
+  struct stat st;
+  size_t pos;
+
+  pos = 0;
+
+  while (pos != std::string::npos) {
+    pos = path.find('/', pos + 1);
+    std::string sub = path.substr(0, pos);
+
+    if (mkdir(sub.c_str(), 0755) < 0 && errno != EEXIST) {
+      perror(sub.c_str());
+      return DEFAULT_ERROR;
+    }
+  }
+
+  if (stat(path.c_str(), &st) < 0 || !S_ISDIR(st.st_mode)) {
+    fprintf(stderr, "%s: not a directory\n", path.c_str());
+    return DEFAULT_ERROR;
+  }
+
+  return 0;
+}
+
+/**
+ * 前後の空白の除去
+ */
+static std::string
+trim(const std::string& s)
+{
+  size_t head;
+  size_t tail;
+
+  head = s.find_first_not_of(" \t\r\n");
+  if (head == std::string::npos) return "";
+
+  tail = s.find_last_not_of(" \t\r\n");
+
+  return s.substr(head, tail - head + 1);
+}
+
+/**
+ * マニフェストの読み込み
+ *
+ * @param [in] path  マニフェストへのパス
+ * @param [out] dst  較正対象の追加先
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  空行と"#"で始まる行は読み飛ばす。相対パスはマニフェストのあるディレクト
+ *  リからのパスとみなす。
+ */
+static int
+load_manifest(const char* path, std::vector<job_t>* dst)
+{
+  int ret;
+  FILE* fp;
+  char buf[4096];
+  std::string base;
+  std::vector<std::string> cols;
+  std::string line;
+  const char* p;
+  size_t pos;
+  size_t next;
+  int lineno;
+  job_t job;
+
+  ret    = 0;
+  lineno = 0;
+
+  fp = fopen(path, "r");
+  if (fp == NULL) {
+    perror(path);
+    return DEFAULT_ERROR;
+  }
+
+  p    = strrchr(path, '/');
+  base = (p != NULL)? std::string(path, p - path + 1): "";
+
+  while (fgets(buf, sizeof(buf), fp) != NULL) {
+    lineno++;
+
+    line = trim(buf);
+    if (line.empty() || line[0] == '#') continue;
+
+    cols.clear();
+    for (pos = 0; ; pos = next + 1) {
+      next = line.find(',', pos);
+      cols.push_back(trim(line.substr(pos, next - pos)));
+      if (next == std::string::npos) break;
+    }
+
+    if (cols.size() < 3 || cols.size() > 4 || cols[0].empty() ||
+        cols[0].find('/') != std::string::npos) {
+      fprintf(stderr, "%s:%d: invalid line\n", path, lineno);
+      ret = DEFAULT_ERROR;
+      continue;
+    }
+
+    job.name      = cols[0];
+    job.recording = (cols[1][0] == '/')? cols[1]: base + cols[1];
+    job.reference = (cols[2][0] == '/')? cols[2]: base + cols[2];
+    job.node      = (cols.size() == 4)? atoi(cols[3].c_str()): -1;
+
+    dst->push_back(job);
+  }
+
+  fclose(fp);
+
+  return ret;
+}
+
+/**
+ * 一台分の処理
+ *
+ * @param [in] job     較正対象の指定
+ * @param [in] align   突き合わせのパラメータ
+ * @param [in] fit     フィッティングのパラメータ
+ * @param [out] dst    処理結果の書き込み先
+ */
+static void
+process(const job_t* job,
+        const align_param_t* align,
+        const fit_param_t* fit,
+        result_t* dst)
+{
+  std::vector<reclog_row_t> refs;
+  int ch;
+
+  dst->error = true;
+
+  if (calib_load_reference(job->reference.c_str(), &refs)) return;
+  if (calib_align(job, refs, align, &dst->samples)) return;
+
+  for (ch = 0; ch < CALIB_CHANNELS; ch++) {
+    calib_fit(dst->samples.x[ch].data(),
+              dst->samples.y[ch].data(),
+              dst->samples.x[ch].size(),
+              fit,
+              &dst->fit[ch]);
+  }
+
+  dst->error = false;
+}
+
+/**
+ * 較正値の書き出し
+ *
+ * @param [in] path  書き出し先のパス
+ * @param [in] res   処理結果
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  ESP-IDFのnvs_partition_gen.pyに与えるCSV形式で、名前空間"calib"に利得を
+ *  ppm単位("v_gain"等)、切片をミリ単位("v_off"等, mV・mA・mW)の整数で書き
+ *  出す。フィッティングを行えなかったチャンネルは書き出さない(センサーは既
+ *  定値で動作する)。
+ */
+static int
+write_blob(const char* path, const result_t* res)
+{
+  int ret;
+  FILE* fp;
+  const fit_t* f;
+  int ch;
+
+  ret = 0;
+
+  fp = fopen(path, "w");
+  if (fp == NULL) {
+    perror(path);
+    return DEFAULT_ERROR;
+  }
+
+  fprintf(fp, "key,type,encoding,value\n");
+  fprintf(fp, "calib,namespace,,\n");
+
+  for (ch = 0; ch < CALIB_CHANNELS; ch++) {
+    f = &res->fit[ch];
+    if (f->mode == FIT_NONE) continue;
+
+    fprintf(fp, "%s_gain,data,i32,%ld\n",
+            key_prefixes[ch], lround(f->gain * 1e6));
+    fprintf(fp, "%s_off,data,i32,%ld\n",
+            key_prefixes[ch], lround(f->offset * 1e3));
+  }
+
+  if (fclose(fp) != 0) {
+    perror(path);
+    ret = DEFAULT_ERROR;
+  }
+
+  return ret;
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+main(int argc, char* argv[])
+{
+  int ret;
+  int opt;
+  const char* outdir;
+  align_param_t align;
+  fit_param_t fit;
+  std::vector<job_t> jobs;
+  std::vector<result_t> results;
+  std::string dst;
+  size_t unfitted;
+  const fit_t* f;
+  size_t i;
+  int ch;
+
+  /*
+   * initialize
+   */
+  ret           = 0;
+  outdir        = NULL;
+  unfitted      = 0;
+  align.window  = DEFAULT_WINDOW;
+  align.shift   = 0;
+  fit.huber     = DEFAULT_HUBER;
+  fit.maxIter   = MAX_ITER;
+  fit.minPoints = DEFAULT_POINTS;
+  fit.minSpan   = DEFAULT_SPAN;
+
+  /*
+   * parse options
+   */
+  while ((opt = getopt(argc, argv, "o:w:s:k:n:j:h")) != -1) {
+    switch (opt) {
+    case 'o':
+      outdir = optarg;
+      break;
+
+    case 'w':
+      align.window = atoll(optarg);
+      break;
+
+    case 's':
+      align.shift = atoll(optarg);
+      break;
+
+    case 'k':
+      fit.huber = atof(optarg);
+      break;
+
+    case 'n':
+      fit.minPoints = strtoul(optarg, NULL, 10);
+      break;
+
+    case 'j':
+      workers_set_count(atoi(optarg));
+      break;
+
+    default:
+      usage();
+      return (opt == 'h')? 0: 1;
+    }
+  }
+
+  if (optind != argc - 1 || align.window < 0 || fit.huber <= 0.0) {
+    usage();
+    return 1;
+  }
+
+  if (outdir != NULL) {
+    if (make_dirs(outdir)) return 1;
+  }
+
+  if (load_manifest(argv[optind], &jobs)) return 1;
+
+  /*
+   * fit
+   *   記録ファイルの走査が処理の大半を占めるので、デバイス単位で並列化する。
+   */
+  results.resize(jobs.size());
+
+  workers_for(jobs.size(), [&](size_t idx, int) {
+    process(&jobs[idx], &align, &fit, &results[idx]);
+  });
+
+  /*
+   * report and write blobs
+   */
+  for (i = 0; i < jobs.size(); i++) {
+    if (results[i].error) {
+      fprintf(stderr, "%s: failed\n", jobs[i].name.c_str());
+      ret = DEFAULT_ERROR;
+      continue;
+    }
+
+    printf("%s: rows=%llu refs=%zu unmatched=%zu\n",
+           jobs[i].name.c_str(),
+           (unsigned long long)results[i].samples.rows,
+           results[i].samples.refs,
+           results[i].samples.unmatched);
+
+    for (ch = 0; ch < CALIB_CHANNELS; ch++) {
+      f = &results[i].fit[ch];
+
+      if (f->mode == FIT_NONE) {
+        printf("  %s none n=%zu\n", channel_names[ch], f->n);
+        if (f->n > 0) unfitted++;
+        continue;
+      }
+
+      printf("  %s %-6s n=%zu outliers=%zu iter=%d gain=%.6f offset=%+.4f"
+             " rms=%.4f->%.4f sigma=%.4f\n",
+             channel_names[ch],
+             mode_names[f->mode],
+             f->n,
+             f->outliers,
+             f->iter,
+             f->gain,
+             f->offset,
+             f->rmsBefore,
+             f->rmsAfter,
+             f->sigma);
+    }
+
+    if (outdir != NULL) {
+      dst = std::string(outdir) + "/" + jobs[i].name + ".csv";
+      if (write_blob(dst.c_str(), &results[i])) ret = DEFAULT_ERROR;
+    }
+  }
+
+  return (ret)? 1: (unfitted > 0)? 2: 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * Integrity scanner and repair tool for recorder cards
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __CARDSCAN_H__
+#define __CARDSCAN_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include <reclog.h>
+
+//! 問題の種類(解析できない行)
+#define ISSUE_BROKEN      (0)
+
+//! 問題の種類(NUL文字を含む行)
+#define ISSUE_NUL         (1)
+
+//! 問題の種類(タイムスタンプの逆行)
+#define ISSUE_BACKSTEP    (2)
+
+//! 問題の種類(タイムスタンプの欠測)
+#define ISSUE_GAP         (3)
+
+//! 問題の種類(改行で終わっていない末尾の行)
+#define ISSUE_TRUNCATED   (4)
+
+//! 検出した問題
+typedef struct {
+  //! 種類
+  int kind;
+
+  //! 行の先頭のファイル内オフセット
+  size_t offset;
+
+  //! 直前のデータ行のタイムスタンプ(逆行・欠測の場合)
+  int64_t prev;
+
+  //! 該当行のタイムスタンプ(逆行・欠測の場合)
+  int64_t ts;
+} issue_t;
+
+//! 保存する範囲
+typedef struct {
+  size_t offset;
+  size_t size;
+} span_t;
+
+//! 走査結果(チャンク毎, およびファイル全体)
+typedef struct {
+  //! データ行の数
+  uint64_t rows;
+
+  //! ヘッダ行の数
+  uint64_t headers;
+
+  //! イベント行("!"で始まる行)・テレメトリ行("#"で始まる行)の数
+  uint64_t events;
+
+  //! 空行の数
+  uint64_t blanks;
+
+  //! 解析できない行の数
+  uint64_t broken;
+
+  //! NUL文字を含む行の数
+  uint64_t nulLines;
+
+  //! 行中のNUL文字の数
+  uint64_t nulBytes;
+
+  //! タイムスタンプの逆行の数
+  uint64_t backsteps;
+
+  //! タイムスタンプの欠測の数
+  uint64_t gaps;
+
+  //! 最初と最後のデータ行のタイムスタンプ(データ行が無い場合は-1)
+  int64_t first;
+  int64_t last;
+
+  //! 最初のデータ行の先頭のファイル内オフセット(範囲をまたぐ検査の報告用)
+  size_t firstOffset;
+
+  //! 検出した問題(種類毎に上限まで)
+  std::vector<issue_t> issues;
+
+  //! 保存する範囲(隣接する範囲は結合済み)
+  std::vector<span_t> spans;
+} scan_t;
+
+//! 走査のパラメータ
+typedef struct {
+  //! 欠測とみなすタイムスタンプの間隔(ミリ秒)
+  int64_t gap;
+
+  //! 種類毎に記録する問題の最大数(チャンク毎)
+  size_t maxIssues;
+} scan_param_t;
+
+/**
+ * 範囲の走査
+ *
+ * @param [in] map    対象のファイル
+ * @param [in] head   範囲の先頭(行頭)
+ * @param [in] tail   範囲の終端(行頭もしくはファイルの有効範囲の末尾)
+ * @param [in] param  パラメータ
+ * @param [out] dst   走査結果の書き込み先
+ *
+ * @remark
+ *  範囲内のタイムスタンプの逆行・欠測のみを検出する。範囲間の検査は
+ *  scan_merge()で行う。
+ */
+void scan_range(const reclog_map_t* map,
+                const char* head,
+                const char* tail,
+                const scan_param_t* param,
+                scan_t* dst);
+
+/**
+ * 走査結果の結合
+ *
+ * @param [in,out] dst  結合先(ファイルの先頭側)
+ * @param [in] src      結合する走査結果(dstの直後の範囲)
+ * @param [in] param    パラメータ
+ *
+ * @remark
+ *  境界をまたぐタイムスタンプの逆行・欠測の検査もここで行う。
+ */
+void scan_merge(scan_t* dst, const scan_t* src, const scan_param_t* param);
+
+/**
+ * 末尾のNUL文字の連続の長さの取得
+ *
+ * @param [in] map  対象のファイル
+ *
+ * @return
+ *  ファイル末尾から連続するNUL文字のバイト数を返す。
+ *
+ * @remark
+ *  電源断で書き込みが途中になったブロック(クラスタ)の未書き込み部分が0で埋
+ *  まったもの。
+ */
+size_t scan_zero_tail(const reclog_map_t* map);
+
+/**
+ * 走査結果の初期化
+ */
+void scan_init(scan_t* dst);
+
+#endif /* !defined(__CARDSCAN_H__) */
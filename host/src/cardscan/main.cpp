@@ -0,0 +1,570 @@
+/*
+ * Integrity scanner and repair tool for recorder cards
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <workers.h>
+
+#include "cardscan.h"
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+//! 欠測とみなす間隔のデフォルト値(ミリ秒)
+#define DEFAULT_GAP     (2000)
+
+//! 報告する問題の種類毎の最大数のデフォルト値
+#define DEFAULT_ISSUES  (20)
+
+//! ワーカー当たりのチャンク数
+#define CHUNK_FACTOR    (4)
+
+//! 問題の種類の表示名
+static const char* issue_names[] = {
+  "broken", "nul", "backstep", "gap", "truncated"
+};
+
+//! 対象ファイル
+typedef struct {
+  //! ファイルへのパス
+  std::string path;
+
+  //! 引数で指定されたディレクトリからの相対パス(修復先のパスに使用)
+  std::string rel;
+} target_t;
+
+//! 全ファイルの集計
+static struct {
+  size_t files;
+  size_t damaged;
+  size_t repaired;
+  uint64_t bytes;
+} total;
+
+//! 今回の実行で書き出した修復先のパス
+static std::set<std::string> written;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 使用方法の表示
+ */
+static void
+usage()
+{
+  fprintf(stderr,
+          "usage: cardscan [options] PATH...\n"
+          "\n"
+          "  PATH is a log file or a directory (e.g. the mounted card),\n"
+          "  directories are searched recursively for *.csv\n"
+          "\n"
+          "options:\n"
+          "  -g MSEC     report timestamp gaps longer than MSEC (default %d)\n"
+          "  -n COUNT    max issues listed per kind and file (default %d)\n"
+          "  -j JOBS     number of worker threads (default: all cores)\n"
+          "  -o OUTDIR   write repaired copies of damaged files to OUTDIR,\n"
+          "              keeping their path relative to PATH (directories\n"
+          "              are created as needed)\n"
+          "  -q          print only damaged files and the summary\n",
+          DEFAULT_GAP,
+          DEFAULT_ISSUES);
+}
+
+/**
+ * 現在時刻の取得(秒)
+ */
+static double
+now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * ディレクトリの作成(途中のディレクトリを含む)
+ *
+ * @param [in] path  作成するディレクトリへのパス
+ *
+ * @return
+ *  処理に成功した場合(既に存在する場合を含む)は0を、失敗した場合は0以外の
+ *  値を返す。
+ */
+static int
+make_dirs(const std::string& path)
+{
+  struct stat st;
+  size_t pos;
+
+  pos = 0;
+
+  while (pos != std::string::npos) {
+    pos = path.find('/', pos + 1);
+    std::string sub = path.substr(0, pos);
+
+    if (mkdir(sub.c_str(), 0755) < 0 && errno != EEXIST) {
+      perror(sub.c_str());
+      return DEFAULT_ERROR;
+    }
+  }
+
+  if (stat(path.c_str(), &st) < 0 || !S_ISDIR(st.st_mode)) {
+    fprintf(stderr, "%s: not a directory\n", path.c_str());
+    return DEFAULT_ERROR;
+  }
+
+  return 0;
+}
+
+/**
+ * 対象ファイルの列挙
+ *
+ * @param [in] path  ファイルもしくはディレクトリへのパス
+ * @param [in] rel   引数で指定されたディレクトリからpathへの相対パス
+ *                   (引数で指定されたパスそのものの場合は空文字列)
+ * @param [out] dst  対象ファイルの追加先
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  引数でファイルが指定された場合の相対パスはファイル名のみとする。
+ */
+static int
+collect(const std::string& path,
+        const std::string& rel,
+        std::vector<target_t>* dst)
+{
+  struct stat st;
+  DIR* dir;
+  struct dirent* ent;
+  std::vector<std::string> names;
+  size_t len;
+
+  if (stat(path.c_str(), &st) < 0) {
+    perror(path.c_str());
+    return DEFAULT_ERROR;
+  }
+
+  if (!S_ISDIR(st.st_mode)) {
+    len = path.rfind('/');
+    if (len == std::string::npos) {
+      dst->push_back({path, path});
+    } else {
+      dst->push_back({path, path.substr(len + 1)});
+    }
+    return 0;
+  }
+
+  dir = opendir(path.c_str());
+  if (dir == NULL) {
+    perror(path.c_str());
+    return DEFAULT_ERROR;
+  }
+
+  while ((ent = readdir(dir)) != NULL) {
+    if (ent->d_name[0] == '.') continue;
+    names.push_back(ent->d_name);
+  }
+
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+
+  for (auto& name: names) {
+    std::string sub = path + "/" + name;
+    std::string subRel = (rel.empty())? name: rel + "/" + name;
+
+    if (stat(sub.c_str(), &st) < 0) continue;
+
+    if (S_ISDIR(st.st_mode)) {
+      collect(sub, subRel, dst);
+
+    } else if (S_ISREG(st.st_mode)) {
+      len = name.size();
+      if (len > 4 && !strcasecmp(name.c_str() + len - 4, ".csv")) {
+        dst->push_back({sub, subRel});
+      }
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * ファイルの走査
+ *
+ * @param [in] map    対象のファイル
+ * @param [in] size   有効範囲のサイズ(末尾のNUL文字の連続を除いたもの)
+ * @param [in] param  パラメータ
+ * @param [out] dst   走査結果の書き込み先
+ */
+static void
+scan_file(const reclog_map_t* map,
+          size_t size,
+          const scan_param_t* param,
+          scan_t* dst)
+{
+  int n;
+  std::vector<const char*> cuts;
+  std::vector<scan_t> parts;
+  int i;
+
+  n = workers_count() * CHUNK_FACTOR;
+  cuts.resize(n + 1);
+  parts.resize(n);
+
+  reclog_split(map->head, size, n, cuts.data());
+
+  workers_for(n, [&](size_t idx, int) {
+    scan_range(map, cuts[idx], cuts[idx + 1], param, &parts[idx]);
+    reclog_release(map, cuts[idx], cuts[idx + 1]);
+  });
+
+  scan_init(dst);
+  for (i = 0; i < n; i++) scan_merge(dst, &parts[i], param);
+}
+
+/**
+ * 修復したファイルの書き出し
+ *
+ * @param [in] map   対象のファイル
+ * @param [in] res   走査結果
+ * @param [in] path  書き出し先のパス
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  走査で保存対象とした行(ヘッダ行、データ行、イベント行)のみを元の順序のま
+ *  ま書き出す。各範囲は改行で終わっているので、連結しても行は壊れない。
+ */
+static int
+write_repaired(const reclog_map_t* map, const scan_t* res, const char* path)
+{
+  int ret;
+  FILE* fp;
+
+  ret = 0;
+
+  fp = fopen(path, "wb");
+  if (fp == NULL) {
+    perror(path);
+    return DEFAULT_ERROR;
+  }
+
+  for (auto& s: res->spans) {
+    if (fwrite(map->head + s.offset, 1, s.size, fp) != s.size) {
+      perror(path);
+      ret = DEFAULT_ERROR;
+      break;
+    }
+  }
+
+  if (fclose(fp) != 0 && !ret) {
+    perror(path);
+    ret = DEFAULT_ERROR;
+  }
+
+  return ret;
+}
+
+/**
+ * 走査結果の表示
+ */
+static void
+print_result(const char* path,
+             size_t size,
+             size_t zero,
+             const scan_t* res,
+             double elapsed)
+{
+  bool truncated;
+
+  truncated = false;
+  for (auto& e: res->issues) {
+    if (e.kind == ISSUE_TRUNCATED) truncated = true;
+  }
+
+  printf("%s: size=%zu rows=%llu headers=%llu events=%llu blanks=%llu "
+         "broken=%llu nul_lines=%llu nul_bytes=%llu zero_tail=%zu "
+         "truncated=%d backsteps=%llu gaps=%llu "
+         "first_ts=%lld last_ts=%lld %.1fMB/s\n",
+         path,
+         size,
+         (unsigned long long)res->rows,
+         (unsigned long long)res->headers,
+         (unsigned long long)res->events,
+         (unsigned long long)res->blanks,
+         (unsigned long long)res->broken,
+         (unsigned long long)res->nulLines,
+         (unsigned long long)res->nulBytes,
+         zero,
+         (truncated)? 1: 0,
+         (unsigned long long)res->backsteps,
+         (unsigned long long)res->gaps,
+         (long long)res->first,
+         (long long)res->last,
+         (elapsed > 0.0)? size / elapsed / 1e6: 0.0);
+
+  for (auto& e: res->issues) {
+    if (e.kind == ISSUE_BACKSTEP || e.kind == ISSUE_GAP) {
+      printf("  %-9s at %zu: %lld -> %lld (%+lld ms)\n",
+             issue_names[e.kind],
+             e.offset,
+             (long long)e.prev,
+             (long long)e.ts,
+             (long long)(e.ts - e.prev));
+    } else {
+      printf("  %-9s at %zu\n", issue_names[e.kind], e.offset);
+    }
+  }
+}
+
+/**
+ * 一ファイル分の処理
+ *
+ * @param [in] target  対象のファイル
+ * @param [in] param   パラメータ
+ * @param [in] outdir  修復したファイルの書き出し先(NULLの場合は修復しない)
+ * @param [in] quiet   trueの場合は問題のあるファイルのみ表示する
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  修復したファイルはoutdirの下に対象ファイルの相対パスを再現して書き出す。
+ *  複数の引数で同じ相対パスのファイルが指定された場合など、今回の実行で既
+ *  に書き出したパスには上書きせずにエラーとする。
+ */
+static int
+process(const target_t* target,
+        const scan_param_t* param,
+        const char* outdir,
+        bool quiet)
+{
+  int ret;
+  int err;
+  struct stat st;
+  reclog_map_t map;
+  size_t zero;
+  scan_t res;
+  double t0;
+  bool damaged;
+  const char* path;
+  std::string dst;
+  size_t pos;
+  char src_real[PATH_MAX];
+  char dst_real[PATH_MAX];
+
+  /*
+   * initialize
+   */
+  ret    = 0;
+  map.fd = -1;
+  path   = target->path.c_str();
+
+  scan_init(&res);
+
+  /*
+   * map file
+   */
+  if (stat(path, &st) < 0) {
+    perror(path);
+    return DEFAULT_ERROR;
+  }
+
+  total.files++;
+
+  if (st.st_size == 0) {
+    // 記録開始直後の電源断ではヘッダも書き込まれずに空のファイルが残る
+    printf("%s: empty\n", path);
+    total.damaged++;
+    return 0;
+  }
+
+  err = reclog_open(&map, path);
+  if (err) {
+    perror(path);
+    return DEFAULT_ERROR;
+  }
+
+  /*
+   * scan
+   */
+  t0   = now();
+  zero = scan_zero_tail(&map);
+  scan_file(&map, map.size - zero, param, &res);
+
+  damaged = (zero > 0 ||
+             res.broken > 0 ||
+             res.nulLines > 0 ||
+             res.blanks > 0 ||
+             res.backsteps > 0);
+
+  total.bytes += map.size;
+  if (damaged) total.damaged++;
+
+  if (damaged || !quiet) {
+    print_result(path, map.size, zero, &res, now() - t0);
+  }
+
+  /*
+   * repair
+   */
+  if (damaged && outdir != NULL) {
+    dst = std::string(outdir) + "/" + target->rel;
+    pos = dst.rfind('/');
+
+    if (!written.insert(dst).second) {
+      fprintf(stderr, "%s: already written in this run\n", dst.c_str());
+      ret = DEFAULT_ERROR;
+
+    } else if (make_dirs(dst.substr(0, pos))) {
+      ret = DEFAULT_ERROR;
+
+    } else if (realpath(path, src_real) != NULL &&
+        realpath(dst.c_str(), dst_real) != NULL &&
+        !strcmp(src_real, dst_real)) {
+      fprintf(stderr, "%s: refusing to overwrite the source\n", dst.c_str());
+      ret = DEFAULT_ERROR;
+
+    } else {
+      err = write_repaired(&map, &res, dst.c_str());
+      if (err) {
+        ret = DEFAULT_ERROR;
+      } else {
+        printf("  repaired -> %s\n", dst.c_str());
+        total.repaired++;
+      }
+    }
+  }
+
+  /*
+   * post process
+   */
+  reclog_close(&map);
+
+  return ret;
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+main(int argc, char* argv[])
+{
+  int ret;
+  int err;
+  int opt;
+  scan_param_t param;
+  const char* outdir;
+  bool quiet;
+  std::vector<target_t> files;
+  double t0;
+  double elapsed;
+  int i;
+
+  /*
+   * initialize
+   */
+  ret             = 0;
+  param.gap       = DEFAULT_GAP;
+  param.maxIssues = DEFAULT_ISSUES;
+  outdir          = NULL;
+  quiet           = false;
+
+  /*
+   * parse options
+   */
+  while ((opt = getopt(argc, argv, "g:n:j:o:qh")) != -1) {
+    switch (opt) {
+    case 'g':
+      param.gap = atoll(optarg);
+      break;
+
+    case 'n':
+      param.maxIssues = strtoul(optarg, NULL, 10);
+      break;
+
+    case 'j':
+      workers_set_count(atoi(optarg));
+      break;
+
+    case 'o':
+      outdir = optarg;
+      break;
+
+    case 'q':
+      quiet = true;
+      break;
+
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  if (optind >= argc || param.gap <= 0) {
+    usage();
+    return 1;
+  }
+
+  if (outdir != NULL) {
+    if (make_dirs(outdir)) return 1;
+  }
+
+  /*
+   * collect files
+   */
+  for (i = optind; i < argc; i++) {
+    err = collect(argv[i], "", &files);
+    if (err) ret = DEFAULT_ERROR;
+  }
+
+  /*
+   * scan
+   */
+  t0 = now();
+
+  for (auto& target: files) {
+    err = process(&target, &param, outdir, quiet);
+    if (err) ret = DEFAULT_ERROR;
+  }
+
+  elapsed = now() - t0;
+
+  /*
+   * summary
+   */
+  printf("%zu files, %zu damaged, %zu repaired, %.1f MB in %.2f s "
+         "(%.1f MB/s)\n",
+         total.files,
+         total.damaged,
+         total.repaired,
+         total.bytes / 1e6,
+         elapsed,
+         (elapsed > 0.0)? total.bytes / elapsed / 1e6: 0.0);
+
+  return (ret)? 1: (total.damaged > 0)? 2: 0;
+}
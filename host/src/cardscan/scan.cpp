@@ -0,0 +1,235 @@
+/*
+ * Integrity scanner and repair tool for recorder cards
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <string.h>
+
+#include "cardscan.h"
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 問題の記録
+ */
+static void
+add_issue(scan_t* dst,
+          const scan_param_t* param,
+          int kind,
+          size_t offset,
+          int64_t prev,
+          int64_t ts)
+{
+  size_t n;
+
+  n = 0;
+  for (auto& e: dst->issues) {
+    if (e.kind == kind) n++;
+  }
+
+  if (n < param->maxIssues) dst->issues.push_back({kind, offset, prev, ts});
+}
+
+/**
+ * 保存範囲の追加
+ */
+static void
+add_span(scan_t* dst, size_t offset, size_t size)
+{
+  span_t* last;
+
+  if (!dst->spans.empty()) {
+    last = &dst->spans.back();
+
+    if (last->offset + last->size == offset) {
+      last->size += size;
+      return;
+    }
+  }
+
+  dst->spans.push_back({offset, size});
+}
+
+/**
+ * タイムスタンプの連続性の検査
+ */
+static void
+check_ts(scan_t* dst,
+         const scan_param_t* param,
+         size_t offset,
+         int64_t prev,
+         int64_t ts)
+{
+  if (prev < 0) return;
+
+  if (ts < prev) {
+    dst->backsteps++;
+    add_issue(dst, param, ISSUE_BACKSTEP, offset, prev, ts);
+
+  } else if (ts - prev > param->gap) {
+    dst->gaps++;
+    add_issue(dst, param, ISSUE_GAP, offset, prev, ts);
+  }
+}
+
+/*
+ * 公開関数の定義
+ */
+
+void
+scan_init(scan_t* dst)
+{
+  dst->rows      = 0;
+  dst->headers   = 0;
+  dst->events    = 0;
+  dst->blanks    = 0;
+  dst->broken    = 0;
+  dst->nulLines  = 0;
+  dst->nulBytes  = 0;
+  dst->backsteps = 0;
+  dst->gaps      = 0;
+  dst->first     = -1;
+  dst->last      = -1;
+
+  dst->firstOffset = 0;
+
+  dst->issues.clear();
+  dst->spans.clear();
+}
+
+void
+scan_range(const reclog_map_t* map,
+           const char* head,
+           const char* tail,
+           const scan_param_t* param,
+           scan_t* dst)
+{
+  const char* p;
+  const char* eol;
+  const char* end;
+  size_t off;
+  size_t nul;
+  reclog_row_t row;
+  bool keep;
+
+  scan_init(dst);
+
+  for (p = head; p < tail; p = end) {
+    eol = (const char*)memchr(p, '\n', tail - p);
+    end = (eol != NULL)? eol + 1: tail;
+    off = p - map->head;
+
+    /*
+     * 改行で終わっていない行(書き込み途中)
+     */
+    if (eol == NULL) {
+      dst->broken++;
+      add_issue(dst, param, ISSUE_TRUNCATED, off, -1, -1);
+      break;
+    }
+
+    /*
+     * NUL文字を含む行
+     */
+    nul = 0;
+    for (const char* q = p; q < eol; q++) {
+      if (*q == '\0') nul++;
+    }
+
+    if (nul > 0) {
+      dst->nulLines++;
+      dst->nulBytes += nul;
+      add_issue(dst, param, ISSUE_NUL, off, -1, -1);
+      continue;
+    }
+
+    /*
+     * 行の分類
+     */
+    keep = true;
+
+    if (p == eol || (eol - p == 1 && *p == '\r')) {
+      dst->blanks++;
+      keep = false;
+
+    } else if (*p == '"' || (uint8_t)*p == 0xef) {
+      dst->headers++;
+
+    } else if (*p == '!' || *p == '#') {
+      dst->events++;
+
+    } else if (reclog_parse_row(p, eol, &row) == RECLOG_ROW) {
+      check_ts(dst, param, off, dst->last, row.ts);
+
+      if (dst->first < 0) {
+        dst->first       = row.ts;
+        dst->firstOffset = off;
+      }
+
+      dst->last = row.ts;
+      dst->rows++;
+
+    } else {
+      dst->broken++;
+      add_issue(dst, param, ISSUE_BROKEN, off, -1, -1);
+      keep = false;
+    }
+
+    if (keep) add_span(dst, off, end - p);
+  }
+}
+
+void
+scan_merge(scan_t* dst, const scan_t* src, const scan_param_t* param)
+{
+  size_t i;
+
+  /*
+   * 境界をまたぐタイムスタンプの検査
+   */
+  if (src->first >= 0) {
+    check_ts(dst, param, src->firstOffset, dst->last, src->first);
+
+    if (dst->first < 0) {
+      dst->first       = src->first;
+      dst->firstOffset = src->firstOffset;
+    }
+
+    dst->last = src->last;
+  }
+
+  /*
+   * 集計値と一覧の結合
+   */
+  dst->rows      += src->rows;
+  dst->headers   += src->headers;
+  dst->events    += src->events;
+  dst->blanks    += src->blanks;
+  dst->broken    += src->broken;
+  dst->nulLines  += src->nulLines;
+  dst->nulBytes  += src->nulBytes;
+  dst->backsteps += src->backsteps;
+  dst->gaps      += src->gaps;
+
+  for (auto& e: src->issues) {
+    add_issue(dst, param, e.kind, e.offset, e.prev, e.ts);
+  }
+
+  for (i = 0; i < src->spans.size(); i++) {
+    add_span(dst, src->spans[i].offset, src->spans[i].size);
+  }
+}
+
+size_t
+scan_zero_tail(const reclog_map_t* map)
+{
+  const char* p;
+
+  p = map->head + map->size;
+  while (p > map->head && p[-1] == '\0') p--;
+
+  return (map->head + map->size) - p;
+}
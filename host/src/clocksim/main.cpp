@@ -0,0 +1,556 @@
+/*
+ * Virtual clock simulator for the sensor and recorder timing logic
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <hal_clock.h>
+#include <lowpower.h>
+
+//! 一日のマイクロ秒数
+#define DAY_US          (86400ULL * 1000000ULL)
+
+//! hal_millis()が桁溢れするまでのマイクロ秒数
+#define WRAP_US         ((1ULL << 32) * 1000ULL)
+
+//! 動作統計の出力周期(ミリ秒, 両ファームウェアと同じ値)
+#define STAT_INTERVAL   (10000)
+
+//! センサーデバイスのフレーム周期のデフォルト値(ミリ秒)
+#define DEFAULT_PERIOD  (55)
+
+//! レコーダの起動をセンサーより遅らせる時間のデフォルト値(ミリ秒)
+#define DEFAULT_OFFSET  (3700)
+
+//! センサーが送る一行のバイト数(8N1で一行の受信に約5.6ミリ秒を要する)
+#define LINE_BYTES      (64)
+
+//! 一行の受信に要する時間(マイクロ秒)
+#define LINE_US         (LINE_BYTES * 10ULL * 1000000ULL / LP_BAUDRATE)
+
+//! 仮想時計の起点に対応するUNIX時間(2024-05-01 00:00:00 UTC)
+#define DEFAULT_EPOCH   ((time_t)1714521600)
+
+//! 動作統計の出力周期の判定と発火間隔の記録
+typedef struct {
+  hal_interval_t timer;
+  uint64_t fired;
+  uint32_t minGap;
+  uint32_t maxGap;
+} stat_timer_t;
+
+//! レコーダの状態(loop()の判定に関わるもののみ)
+typedef struct {
+  //! 起動済みか否か
+  bool booted;
+
+  //! LOW_POWERでビルドした場合の動作(ライトスリープ)を模擬するか否か
+  bool lowPower;
+
+  //! 行の受信中か否か(受信中はprint_stats()を呼ばない)
+  bool midline;
+
+  //! スリープ中か否かと、タイマーによる起床の時刻
+  bool asleep;
+  uint64_t sleepUntil;
+
+  //! 次に判定を行う時刻(これ以外の時刻の再評価の予約は無視する)
+  uint64_t checkAt;
+
+  //! 予約済みの動作統計の出力時刻の事象(同じ時刻の予約を重ねないため)
+  uint64_t deadlineAt;
+
+  //! 受信側の省電力動作の状態
+  lp_rx_t rx;
+
+  //! 動作統計の周期タイマ
+  stat_timer_t stat;
+
+  //! 集計
+  uint64_t lines;
+  uint64_t sleeps;
+  uint64_t wakeRx;
+  uint64_t wakeTimer;
+} recorder_t;
+
+//! シミュレーションの状態
+typedef struct {
+  //! フレーム周期(マイクロ秒)
+  uint64_t period;
+
+  //! 起点時刻(マイクロ秒)
+  uint64_t start;
+
+  //! センサー側のタイムスタンプ
+  hal_uptime_t uptime;
+  uint64_t ts;
+
+  //! millis()をそのままタイムスタンプにした場合の前回値
+  uint32_t naive;
+
+  //! 何フレーム毎に一行を出力するか(出力レート制御の間引きに相当)
+  uint32_t decimate;
+
+  //! 乱数の状態(周期の揺らぎ用)
+  uint32_t seed;
+
+  //! 集計
+  uint64_t frames;
+  uint64_t tsErrors;
+  uint64_t tsBacksteps;
+  uint64_t naiveBacksteps;
+  uint64_t wraps;
+
+  //! センサーの動作統計の周期タイマ
+  stat_timer_t sensorStat;
+
+  //! レコーダ
+  recorder_t rec;
+} sim_t;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 使用方法の表示
+ */
+static void
+usage()
+{
+  fprintf(stderr,
+          "usage: clocksim [options]\n"
+          "\n"
+          "options:\n"
+          "  -d DAYS     simulated duration (default 7)\n"
+          "  -w HOURS    start this many hours before the millis() wrap\n"
+          "              (default: half of the duration)\n"
+          "  -p MS       sensor frame period (default %d)\n"
+          "  -o N        sensor sends one line every N frames (default 1)\n"
+          "  -r MS       recorder boots MS after the sensor (default %d)\n"
+          "  -s          simulate the recorder LOW_POWER light sleep\n",
+          DEFAULT_PERIOD,
+          DEFAULT_OFFSET);
+}
+
+/**
+ * 周期タイマの評価
+ *
+ * @remark
+ *  両ファームウェアのprint_stats()と同じくhal_interval_check()で判定し、発
+ *  火間隔の最小・最大を記録する。
+ */
+static void
+timer_poll(stat_timer_t* tm)
+{
+  uint32_t gap;
+
+  gap = hal_interval_check(&tm->timer);
+  if (gap == 0) return;
+
+  if (tm->fired > 0) {
+    if (tm->fired == 1 || gap < tm->minGap) tm->minGap = gap;
+    if (gap > tm->maxGap) tm->maxGap = gap;
+  }
+
+  tm->fired++;
+}
+
+static void on_recorder_check(void* arg);
+
+/**
+ * レコーダの再評価の予約
+ *
+ * @param [in] rec       レコーダの状態
+ * @param [in] at        再評価の時刻
+ * @param [in] deadline  動作統計の出力時刻か否か
+ *
+ * @remark
+ *  受信で取り消された予約も仮想時計には残るので、出力時刻の予約は一つにま
+ *  とめて事象の数が増え続けないようにする。
+ */
+static void
+recorder_schedule(recorder_t* rec, uint64_t at, bool deadline)
+{
+  if (deadline) {
+    if (rec->deadlineAt == at) return;
+    rec->deadlineAt = at;
+  }
+
+  vclock_schedule(at, on_recorder_check, rec);
+}
+
+/**
+ * レコーダのloop()の評価
+ *
+ * @param [in] rec  レコーダの状態
+ *
+ * @remark
+ *  ファームウェアのloop()と同じく、行の受信中でなければprint_stats()の判定
+ *  を行い、LOW_POWERの場合はlight_sleep()の判定を行う。実機のloop()は空回り
+ *  し続けるが、判定結果が変わり得る時刻(動作統計の出力時刻, スリープ可能に
+ *  なる時刻)にのみ再評価を予約する。
+ */
+static void
+recorder_poll(recorder_t* rec)
+{
+  uint64_t now;
+  uint32_t remain;
+  uint32_t idle;
+  uint32_t msec;
+  uint64_t deadline;
+  uint64_t next;
+
+  if (rec->midline) return;
+
+  now = vclock_now();
+
+  timer_poll(&rec->stat);
+
+  // 次の動作統計の出力時刻(hal_millis()の刻みに揃える)
+  remain   = hal_interval_remain(&rec->stat.timer);
+  deadline = (now / 1000 + remain) * 1000;
+
+  if (rec->lowPower) {
+    msec = lp_rx_sleep_time(&rec->rx, hal_millis(), remain, false);
+
+    if (msec > 0) {
+      rec->asleep     = true;
+      rec->sleepUntil = deadline;
+      rec->checkAt    = 0;
+      rec->sleeps++;
+
+      recorder_schedule(rec, deadline, true);
+      return;
+    }
+  }
+
+  /*
+   * 次に判定が変わり得る時刻
+   *   出力時刻(lp_rx_sleep_time()がLP_MIN_SLEEP未満を拒否した場合を含む)
+   *   と、LOW_POWERの場合は受信の途絶がLP_SLEEP_IDLEに達する時刻。
+   */
+  rec->checkAt = (deadline > now)? deadline: now + 1000;
+  recorder_schedule(rec, rec->checkAt, true);
+
+  if (rec->lowPower) {
+    idle = hal_millis() - rec->rx.last;
+
+    if (idle < LP_SLEEP_IDLE) {
+      next = (now / 1000 + LP_SLEEP_IDLE - idle) * 1000;
+
+      if (next < rec->checkAt) {
+        rec->checkAt = next;
+        recorder_schedule(rec, next, false);
+      }
+    }
+  }
+}
+
+/**
+ * レコーダの再評価・タイマー起床の事象のハンドラ
+ *
+ * @remark
+ *  行の受信で取り消された予約は無視する。
+ */
+static void
+on_recorder_check(void* arg)
+{
+  recorder_t* rec;
+  uint64_t now;
+
+  rec = (recorder_t*)arg;
+  now = vclock_now();
+
+  if (now == rec->deadlineAt) rec->deadlineAt = 0;
+
+  if (rec->asleep) {
+    if (now != rec->sleepUntil) return;
+
+    rec->asleep = false;
+    rec->wakeTimer++;
+
+  } else if (now != rec->checkAt) {
+    return;
+  }
+
+  recorder_poll(rec);
+}
+
+/**
+ * レコーダの行の受信完了の事象のハンドラ
+ */
+static void
+on_line_end(void* arg)
+{
+  recorder_t* rec;
+
+  rec = (recorder_t*)arg;
+
+  rec->midline = false;
+  rec->lines++;
+  lp_rx_activity(&rec->rx, hal_millis());
+
+  recorder_poll(rec);
+}
+
+/**
+ * レコーダでの行の受信開始
+ *
+ * @param [in] rec  レコーダの状態
+ *
+ * @remark
+ *  スリープ中の場合は受信で起床する。受信中は予約済みの再評価を取り消し、
+ *  受信完了時に再評価する。
+ */
+static void
+recorder_line(recorder_t* rec)
+{
+  if (!rec->booted || rec->midline) return;
+
+  if (rec->asleep) {
+    rec->asleep = false;
+    rec->wakeRx++;
+  }
+
+  rec->midline = true;
+  rec->checkAt = 0;
+  lp_rx_activity(&rec->rx, hal_millis());
+
+  vclock_schedule(vclock_now() + LINE_US, on_line_end, rec);
+}
+
+/**
+ * レコーダの起動事象のハンドラ
+ *
+ * @remark
+ *  ファームウェアのstatTimerの静的な初期値と同じく、起動時から周期を数える。
+ */
+static void
+on_recorder_boot(void* arg)
+{
+  recorder_t* rec;
+
+  rec = (recorder_t*)arg;
+
+  hal_interval_init(&rec->stat.timer, STAT_INTERVAL);
+  lp_rx_init(&rec->rx, hal_millis());
+  rec->booted = true;
+
+  recorder_poll(rec);
+}
+
+/**
+ * フレーム受信事象のハンドラ
+ *
+ * @remark
+ *  センサーのloop()でのタイムスタンプ算出と、レコーダ側での受信を模擬する。
+ *  フレーム周期には±2ミリ秒の揺らぎを与える。
+ */
+static void
+on_frame(void* arg)
+{
+  sim_t* sim;
+  uint64_t now;
+  uint64_t expect;
+  uint32_t naive;
+  int64_t jitter;
+
+  sim = (sim_t*)arg;
+  now = hal_uptime_update(&sim->uptime);
+
+  // タイムスタンプは仮想時計上の経過ミリ秒と厳密に一致するはず
+  expect = vclock_now() / 1000 - sim->start / 1000;
+  if (now != expect) sim->tsErrors++;
+  if (sim->frames > 0 && now <= sim->ts) sim->tsBacksteps++;
+  sim->ts = now;
+
+  // 比較用: millis()をそのまま使った場合
+  naive = hal_millis();
+  if (sim->frames > 0 && naive < sim->naive) sim->naiveBacksteps++;
+  sim->naive = naive;
+
+  sim->frames++;
+
+  timer_poll(&sim->sensorStat);
+
+  // レコーダへの一行の送信
+  if (sim->frames % sim->decimate == 0) recorder_line(&sim->rec);
+
+  // 次のフレーム
+  sim->seed = sim->seed * 1103515245 + 12345;
+  jitter    = (int64_t)((sim->seed >> 16) % 4001) - 2000;
+
+  vclock_schedule(vclock_now() + sim->period + jitter, on_frame, sim);
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+main(int argc, char* argv[])
+{
+  double days;
+  double before;
+  int period;
+  int offset;
+  int decimate;
+  bool lowPower;
+  int opt;
+  uint64_t duration;
+  sim_t sim = {};
+  struct timespec t0;
+  struct timespec t1;
+  double wall;
+  struct tm tm;
+  char str[32];
+  uint32_t limit;
+  uint32_t recLimit;
+  bool ok;
+
+  /*
+   * parse options
+   */
+  days   = 7.0;
+  before = -1.0;
+  period   = DEFAULT_PERIOD;
+  offset   = DEFAULT_OFFSET;
+  decimate = 1;
+  lowPower = false;
+
+  while ((opt = getopt(argc, argv, "d:w:p:o:r:sh")) != -1) {
+    switch (opt) {
+    case 'd':
+      days = atof(optarg);
+      break;
+
+    case 'w':
+      before = atof(optarg);
+      break;
+
+    case 'p':
+      period = atoi(optarg);
+      break;
+
+    case 'o':
+      decimate = atoi(optarg);
+      break;
+
+    case 'r':
+      offset = atoi(optarg);
+      break;
+
+    case 's':
+      lowPower = true;
+      break;
+
+    default:
+      usage();
+      return (opt == 'h')? 0: 1;
+    }
+  }
+
+  if (days <= 0.0 || period <= 0 || decimate <= 0 || offset < 0) {
+    usage();
+    return 1;
+  }
+
+  duration = (uint64_t)(days * DAY_US);
+  if (before < 0.0) before = days * 12.0;
+
+  /*
+   * setup virtual clock
+   */
+  sim.period       = (uint64_t)period * 1000;
+  sim.start        = WRAP_US - (uint64_t)(before * 3600.0 * 1000000.0);
+  sim.decimate     = decimate;
+  sim.seed         = 1;
+  sim.rec.lowPower = lowPower;
+
+  vclock_reset(sim.start, DEFAULT_EPOCH);
+
+  hal_uptime_init(&sim.uptime);
+  hal_interval_init(&sim.sensorStat.timer, STAT_INTERVAL);
+
+  vclock_schedule(sim.start + sim.period, on_frame, &sim);
+  vclock_schedule(sim.start + offset * 1000ULL, on_recorder_boot, &sim.rec);
+
+  /*
+   * run
+   */
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  vclock_advance(duration);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+  /*
+   * report
+   */
+  hal_get_local_time(&tm, 0);
+  strftime(str, sizeof(str), "%Y-%m-%d %H:%M:%S", &tm);
+
+  /*
+   * 周期タイマの発火間隔の上限
+   *   センサーはフレーム毎にloop()が回るので周期+フレーム間隔(揺らぎ込み)、
+   *   レコーダは行の受信中に判定を見送るので周期+一行の受信時間以内に発火
+   *   するはず。
+   */
+  limit    = STAT_INTERVAL + period + 2;
+  recLimit = STAT_INTERVAL + (uint32_t)((LINE_US + 999) / 1000) + 1;
+
+  ok = (sim.tsErrors == 0 &&
+        sim.tsBacksteps == 0 &&
+        sim.sensorStat.fired > 1 &&
+        sim.sensorStat.minGap >= STAT_INTERVAL &&
+        sim.sensorStat.maxGap <= limit &&
+        sim.rec.stat.fired > 1 &&
+        sim.rec.stat.minGap >= STAT_INTERVAL &&
+        sim.rec.stat.maxGap <= recLimit);
+
+  printf("simulated_days=%.2f wraps=%llu end_time=\"%s\"\n",
+         days,
+         (unsigned long long)((sim.start + duration) / WRAP_US -
+                              sim.start / WRAP_US),
+         str);
+
+  printf("frames=%llu last_ts_ms=%llu ts_errors=%llu ts_backsteps=%llu"
+         " naive_backsteps=%llu\n",
+         (unsigned long long)sim.frames,
+         (unsigned long long)sim.ts,
+         (unsigned long long)sim.tsErrors,
+         (unsigned long long)sim.tsBacksteps,
+         (unsigned long long)sim.naiveBacksteps);
+
+  printf("sensor_stat_fired=%llu sensor_stat_gap_min_ms=%lu"
+         " sensor_stat_gap_max_ms=%lu\n",
+         (unsigned long long)sim.sensorStat.fired,
+         (unsigned long)sim.sensorStat.minGap,
+         (unsigned long)sim.sensorStat.maxGap);
+
+  printf("recorder_stat_fired=%llu recorder_stat_gap_min_ms=%lu"
+         " recorder_stat_gap_max_ms=%lu recorder_lines=%llu"
+         " recorder_sleeps=%llu recorder_wake_rx=%llu"
+         " recorder_wake_timer=%llu\n",
+         (unsigned long long)sim.rec.stat.fired,
+         (unsigned long)sim.rec.stat.minGap,
+         (unsigned long)sim.rec.stat.maxGap,
+         (unsigned long long)sim.rec.lines,
+         (unsigned long long)sim.rec.sleeps,
+         (unsigned long long)sim.rec.wakeRx,
+         (unsigned long long)sim.rec.wakeTimer);
+
+  printf("wall_sec=%.3f speedup=%.0fx result=%s\n",
+         wall,
+         (duration * 1e-6) / wall,
+         (ok)? "ok": "NG");
+
+  return (ok)? 0: 1;
+}
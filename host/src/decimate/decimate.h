@@ -0,0 +1,117 @@
+/*
+ * Downsampling tool for plotting recorder logs
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __DECIMATE_H__
+#define __DECIMATE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include <reclog.h>
+
+//! 間引き方式(最小・最大値保存)
+#define METHOD_MINMAX   (0)
+
+//! 間引き方式(Largest-Triangle-Three-Buckets)
+#define METHOD_LTTB     (1)
+
+//! 対象列(電圧)
+#define COLUMN_VOLTAGE  (0)
+
+//! 対象列(電流)
+#define COLUMN_CURRENT  (1)
+
+//! 対象列(消費電力)
+#define COLUMN_WATTAGE  (2)
+
+//! 時刻と値の組
+typedef struct {
+  int64_t t;
+  double v;
+} point_t;
+
+//! バケット(出力上の1ピクセル列に相当)の集計値
+typedef struct {
+  //! サンプル数
+  uint64_t count;
+
+  //! 時刻の合計
+  double sum_t;
+
+  //! 値の合計
+  double sum_v;
+
+  //! 最も早い時刻のサンプル
+  point_t first;
+
+  //! 最も遅い時刻のサンプル
+  point_t last;
+
+  //! 最小値のサンプル
+  point_t min;
+
+  //! 最大値のサンプル
+  point_t max;
+
+  //! LTTBで選択されたサンプル(三角形の面積の2倍とその点)
+  double area;
+  point_t pick;
+} bucket_t;
+
+//! 解像度レベル毎の集計領域
+typedef struct {
+  //! バケット数
+  size_t width;
+
+  //! バケット配列
+  std::vector<bucket_t> buckets;
+} level_t;
+
+//! 間引き処理の設定
+typedef struct {
+  //! 対象のログ
+  const reclog_map_t* map;
+
+  //! 対象列
+  int column;
+
+  //! 対象とする時刻範囲の先頭
+  int64_t t0;
+
+  //! 対象とする時刻範囲の長さ(ms)
+  int64_t span;
+} decimate_t;
+
+/**
+ * 集計パス
+ *
+ * @param [in] ctx     間引き処理の設定
+ * @param [out] levels 解像度レベル毎の集計結果の書き込み先
+ *
+ * @remark
+ *  ファイルをワーカー数分のチャンクに分割し、各ワーカーが自分の集計領域に対
+ *  してバケット単位の件数・合計・最小・最大・先頭・末尾を集計した後にマージ
+ *  する。メモリ使用量はワーカー数とバケット数にのみ依存する。
+ */
+void decimate_collect(const decimate_t* ctx, std::vector<level_t>* levels);
+
+/**
+ * LTTBの選択パス
+ *
+ * @param [in] ctx        間引き処理の設定
+ * @param [in,out] levels 集計パスの結果(選択結果が追記される)
+ *
+ * @remark
+ *  各バケットについて、前後のバケットの重心を頂点とする三角形の面積が最大と
+ *  なるサンプルを選択する。本来のLTTBは前のバケットで選択した点を頂点とする
+ *  ため逐次処理となるが、ここでは前のバケットについても重心を用いることでバ
+ *  ケット間の依存を無くし、チャンク並列で処理できるようにしている。
+ */
+void decimate_pick(const decimate_t* ctx, std::vector<level_t>* levels);
+
+#endif /* !defined(__DECIMATE_H__) */
@@ -0,0 +1,371 @@
+/*
+ * Downsampling tool for plotting recorder logs
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+
+#include <workers.h>
+
+#include "decimate.h"
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+//! 出力幅(ピクセル数)のデフォルト値
+#define DEFAULT_WIDTH   (1920)
+
+//! 解像度レベル間の倍率のデフォルト値
+#define DEFAULT_ZOOM    (4)
+
+//! 出力する列のヘッダ
+static const char* column_names[] = {"voltage", "current", "wattage"};
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 使用方法の表示
+ */
+static void
+usage()
+{
+  fprintf(stderr,
+          "usage: decimate [options] FILE\n"
+          "\n"
+          "options:\n"
+          "  -w PIXELS   target width of the base level (default %d)\n"
+          "  -m METHOD   minmax or lttb (default minmax)\n"
+          "  -c COLUMN   v, a or w (default w)\n"
+          "  -l LEVELS   number of resolution levels (default 1)\n"
+          "  -z FACTOR   resolution ratio between levels (default %d)\n"
+          "  -j JOBS     number of worker threads (default: all cores)\n"
+          "  -o PREFIX   write PREFIX-L<n>.csv for each level\n",
+          DEFAULT_WIDTH,
+          DEFAULT_ZOOM);
+}
+
+/**
+ * 有効なデータ行の探索
+ *
+ * @param [in] map      対象のログ
+ * @param [in] column   対象列
+ * @param [in] forward  trueの場合は先頭から、falseの場合は末尾から探索する
+ * @param [out] dst     見つかった行のタイムスタンプの書き込み先
+ *
+ * @return
+ *  見つかった場合はtrueを返す。
+ */
+static bool
+find_edge(const reclog_map_t* map, int column, bool forward, int64_t* dst)
+{
+  const char* head;
+  const char* tail;
+  const char* p;
+  const char* eol;
+  reclog_row_t row;
+  double v;
+
+  head = map->head;
+  tail = map->head + map->size;
+  p    = (forward)? head: tail;
+
+  while (true) {
+    if (forward) {
+      if (p >= tail) return false;
+      eol = (const char*)memchr(p, '\n', tail - p);
+      if (eol == NULL) return false;
+
+    } else {
+      // 末尾の改行で終わっていない行は書き込み途中とみなして対象外とする
+      eol = (const char*)memrchr(head, '\n', p - head);
+      if (eol == NULL) return false;
+      p   = (const char*)memrchr(head, '\n', eol - head);
+      p   = (p != NULL)? p + 1: head;
+    }
+
+    if (reclog_parse_row(p, eol, &row) == RECLOG_ROW) {
+      v = (column == COLUMN_VOLTAGE)? row.voltage:
+          (column == COLUMN_CURRENT)? row.current:
+                                      row.wattage;
+      if (isfinite(v)) {
+        *dst = row.ts;
+        return true;
+      }
+    }
+
+    p = (forward)? eol + 1: p;
+  }
+}
+
+/**
+ * バケット内の出力点の列挙
+ *
+ * @param [in] b       対象のバケット
+ * @param [in] method  間引き方式
+ * @param [out] dst    出力点の書き込み先(時刻順)
+ *
+ * @remark
+ *  最小・最大値方式ではバケットの先頭・最小・最大・末尾の最大4点を時刻順に出
+ *  力する(同一サンプルは1点にまとめる)。折れ線で描画した場合、ピクセル列毎
+ *  の縦方向の範囲と隣接列との接続が全サンプルを描画した場合と一致する。
+ */
+static void
+bucket_points(const bucket_t* b, int method, std::vector<point_t>* dst)
+{
+  point_t pts[4];
+  int n;
+  int i;
+
+  dst->clear();
+  if (b->count == 0) return;
+
+  if (method == METHOD_LTTB) {
+    dst->push_back(b->pick);
+    return;
+  }
+
+  pts[0] = b->first;
+  pts[1] = b->min;
+  pts[2] = b->max;
+  pts[3] = b->last;
+
+  std::sort(pts, pts + 4, [](const point_t& a, const point_t& c) {
+    return a.t < c.t;
+  });
+
+  for (n = 0, i = 0; i < 4; i++) {
+    if (n > 0 && pts[i].t == pts[n - 1].t && pts[i].v == pts[n - 1].v) {
+      continue;
+    }
+    pts[n++] = pts[i];
+  }
+
+  dst->assign(pts, pts + n);
+}
+
+/**
+ * 解像度レベルの出力
+ *
+ * @param [in] fp      出力先
+ * @param [in] lv      対象の解像度レベル
+ * @param [in] method  間引き方式
+ * @param [in] column  対象列
+ *
+ * @return
+ *  出力した点数を返す。
+ */
+static size_t
+write_level(FILE* fp, const level_t* lv, int method, int column)
+{
+  std::vector<point_t> pts;
+  size_t n;
+
+  fprintf(fp, "timestamp,%s\n", column_names[column]);
+
+  n = 0;
+  for (auto& b: lv->buckets) {
+    bucket_points(&b, method, &pts);
+
+    for (auto& pt: pts) {
+      fprintf(fp, "%lld,%f\n", (long long)pt.t, pt.v);
+    }
+
+    n += pts.size();
+  }
+
+  return n;
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+main(int argc, char* argv[])
+{
+  int ret;
+  int err;
+  int opt;
+  size_t width;
+  int method;
+  int column;
+  int nlevels;
+  int zoom;
+  const char* prefix;
+  reclog_map_t map;
+  decimate_t ctx;
+  std::vector<level_t> levels;
+  int64_t t1;
+  std::string path;
+  FILE* fp;
+  size_t n;
+  int i;
+
+  /*
+   * initialize
+   */
+  ret     = 0;
+  width   = DEFAULT_WIDTH;
+  method  = METHOD_MINMAX;
+  column  = COLUMN_WATTAGE;
+  nlevels = 1;
+  zoom    = DEFAULT_ZOOM;
+  prefix  = NULL;
+  map.fd  = -1;
+
+  /*
+   * parse options
+   */
+  while ((opt = getopt(argc, argv, "w:m:c:l:z:j:o:h")) != -1) {
+    switch (opt) {
+    case 'w':
+      width = strtoul(optarg, NULL, 10);
+      break;
+
+    case 'm':
+      if (!strcmp(optarg, "minmax")) {
+        method = METHOD_MINMAX;
+      } else if (!strcmp(optarg, "lttb")) {
+        method = METHOD_LTTB;
+      } else {
+        usage();
+        return 1;
+      }
+      break;
+
+    case 'c':
+      switch (optarg[0]) {
+      case 'v': column = COLUMN_VOLTAGE; break;
+      case 'a': column = COLUMN_CURRENT; break;
+      case 'w': column = COLUMN_WATTAGE; break;
+      default:
+        usage();
+        return 1;
+      }
+      break;
+
+    case 'l':
+      nlevels = atoi(optarg);
+      break;
+
+    case 'z':
+      zoom = atoi(optarg);
+      break;
+
+    case 'j':
+      workers_set_count(atoi(optarg));
+      break;
+
+    case 'o':
+      prefix = optarg;
+      break;
+
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  if (optind + 1 != argc || width == 0 || nlevels < 1 || zoom < 2) {
+    usage();
+    return 1;
+  }
+
+  if (prefix == NULL && nlevels > 1) {
+    fprintf(stderr, "-o is required for multiple levels\n");
+    return 1;
+  }
+
+  /*
+   * map file
+   */
+  err = reclog_open(&map, argv[optind]);
+  if (err) {
+    perror(argv[optind]);
+    ret = DEFAULT_ERROR;
+  }
+
+  /*
+   * determine time range
+   */
+  if (!ret) {
+    ctx.map    = &map;
+    ctx.column = column;
+
+    if (!find_edge(&map, column, true, &ctx.t0) ||
+        !find_edge(&map, column, false, &t1) ||
+        t1 < ctx.t0) {
+      fprintf(stderr, "%s: no valid rows\n", argv[optind]);
+      ret = DEFAULT_ERROR;
+    } else {
+      ctx.span = t1 - ctx.t0 + 1;
+    }
+  }
+
+  /*
+   * setup levels
+   */
+  if (!ret) {
+    levels.resize(nlevels);
+
+    for (i = 0; i < nlevels; i++) {
+      levels[i].width = width;
+      levels[i].buckets.assign(width, bucket_t());
+      width *= zoom;
+    }
+  }
+
+  /*
+   * decimate
+   */
+  if (!ret) {
+    decimate_collect(&ctx, &levels);
+    if (method == METHOD_LTTB) decimate_pick(&ctx, &levels);
+  }
+
+  /*
+   * output
+   */
+  if (!ret) {
+    for (i = 0; i < nlevels; i++) {
+      if (prefix == NULL) {
+        write_level(stdout, &levels[i], method, column);
+        continue;
+      }
+
+      path = std::string(prefix) + "-L" + std::to_string(i) + ".csv";
+      fp   = fopen(path.c_str(), "w");
+      if (fp == NULL) {
+        perror(path.c_str());
+        ret = DEFAULT_ERROR;
+        break;
+      }
+
+      n = write_level(fp, &levels[i], method, column);
+      fclose(fp);
+
+      fprintf(stderr,
+              "%s: %zu buckets, %zu points\n",
+              path.c_str(),
+              levels[i].width,
+              n);
+    }
+  }
+
+  /*
+   * post process
+   */
+  if (map.fd >= 0) reclog_close(&map);
+
+  return (ret)? 1: 0;
+}
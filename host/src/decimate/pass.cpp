@@ -0,0 +1,343 @@
+/*
+ * Downsampling tool for plotting recorder logs
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include <workers.h>
+
+#include "decimate.h"
+
+//! ワーカー数に対するチャンクの分割数の倍率
+#define CHUNKS_PER_WORKER   (4)
+
+//! 行単位の処理関数
+typedef void (*row_func_t)(const decimate_t* ctx,
+                           const point_t* pt,
+                           std::vector<level_t>* levels);
+
+//! LTTBの三角形の頂点(前後のバケットの重心)
+typedef struct {
+  point_t a;
+  point_t c;
+  bool valid;
+} anchor_t;
+
+//! 解像度レベル毎・バケット毎の三角形の頂点
+static std::vector<std::vector<anchor_t>> anchors;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * バケットの初期化
+ */
+static void
+reset_levels(std::vector<level_t>* dst, const std::vector<level_t>& src)
+{
+  size_t i;
+
+  dst->resize(src.size());
+
+  for (i = 0; i < src.size(); i++) {
+    (*dst)[i].width = src[i].width;
+    (*dst)[i].buckets.assign(src[i].width, bucket_t());
+  }
+}
+
+/**
+ * バケット番号の算出
+ */
+static inline size_t
+bucket_index(const decimate_t* ctx, int64_t t, size_t width)
+{
+  return (size_t)(((t - ctx->t0) * (int64_t)width) / ctx->span);
+}
+
+/**
+ * 集計パスの行処理
+ */
+static void
+collect_row(const decimate_t* ctx,
+            const point_t* pt,
+            std::vector<level_t>* levels)
+{
+  bucket_t* b;
+
+  for (auto& lv: *levels) {
+    b = &lv.buckets[bucket_index(ctx, pt->t, lv.width)];
+
+    if (b->count == 0) {
+      b->first = *pt;
+      b->last  = *pt;
+      b->min   = *pt;
+      b->max   = *pt;
+
+    } else {
+      if (pt->t < b->first.t) b->first = *pt;
+      if (pt->t >= b->last.t) b->last  = *pt;
+      if (pt->v < b->min.v) b->min = *pt;
+      if (pt->v > b->max.v) b->max = *pt;
+    }
+
+    b->count++;
+    b->sum_t += pt->t;
+    b->sum_v += pt->v;
+  }
+}
+
+/**
+ * 選択パスの行処理
+ *
+ * @remark
+ *  三角形の残りの頂点(前後のバケットの重心)はdecimate_pick()で事前に求めて
+ *  おいたものを使用する。先頭と末尾のバケットは片側の重心が存在しないため、
+ *  面積の代わりに外側(先頭・末尾)に近いサンプルほど優先されるようにする。
+ */
+static void
+pick_row(const decimate_t* ctx,
+         const point_t* pt,
+         std::vector<level_t>* levels)
+{
+  size_t i;
+  size_t idx;
+  bucket_t* b;
+  const anchor_t* an;
+  double area;
+
+  for (i = 0; i < levels->size(); i++) {
+    idx = bucket_index(ctx, pt->t, (*levels)[i].width);
+    b   = &(*levels)[i].buckets[idx];
+    an  = &anchors[i][idx];
+
+    if (an->valid) {
+      area = fabs((double)(an->a.t - an->c.t) * (pt->v - an->a.v) -
+                  (double)(an->a.t - pt->t) * (an->c.v - an->a.v));
+    } else if (idx == 0) {
+      area = (double)(ctx->t0 + ctx->span - pt->t);
+    } else {
+      area = (double)(pt->t - ctx->t0);
+    }
+
+    if (b->count == 0 || area > b->area) {
+      b->area = area;
+      b->pick = *pt;
+    }
+
+    b->count++;
+  }
+}
+
+/**
+ * 三角形の頂点の算出
+ *
+ * @param [in] lv    対象の解像度レベル(集計パスの結果)
+ * @param [out] dst  バケット毎の頂点の書き込み先
+ *
+ * @remark
+ *  空のバケットは読み飛ばし、前後それぞれで最も近い空でないバケットの重心を
+ *  頂点とする。
+ */
+static void
+make_anchors(const level_t* lv, std::vector<anchor_t>* dst)
+{
+  const bucket_t* b;
+  point_t prev;
+  bool has_prev;
+  size_t i;
+
+  dst->assign(lv->width, anchor_t());
+
+  prev.t = 0;
+  prev.v = 0.0;
+
+  has_prev = false;
+
+  for (i = 0; i < lv->width; i++) {
+    (*dst)[i].a     = prev;
+    (*dst)[i].valid = has_prev;
+
+    b = &lv->buckets[i];
+    if (b->count > 0) {
+      prev.t   = (int64_t)(b->sum_t / b->count);
+      prev.v   = b->sum_v / b->count;
+      has_prev = true;
+    }
+  }
+
+  has_prev = false;
+
+  for (i = lv->width; i-- > 0; ) {
+    (*dst)[i].c     = prev;
+    (*dst)[i].valid = (*dst)[i].valid && has_prev;
+
+    b = &lv->buckets[i];
+    if (b->count > 0) {
+      prev.t   = (int64_t)(b->sum_t / b->count);
+      prev.v   = b->sum_v / b->count;
+      has_prev = true;
+    }
+  }
+}
+
+/**
+ * チャンクの走査
+ *
+ * @param [in] ctx    間引き処理の設定
+ * @param [in] head   チャンクの先頭
+ * @param [in] tail   チャンクの終端
+ * @param [in] func   行単位の処理関数
+ * @param [out] dst   集計領域
+ */
+static void
+scan_chunk(const decimate_t* ctx,
+           const char* head,
+           const char* tail,
+           row_func_t func,
+           std::vector<level_t>* dst)
+{
+  const char* p;
+  const char* eol;
+  reclog_row_t row;
+  point_t pt;
+  double* col;
+
+  col = (ctx->column == COLUMN_VOLTAGE)? &row.voltage:
+        (ctx->column == COLUMN_CURRENT)? &row.current:
+                                         &row.wattage;
+
+  for (p = head; p < tail; p = eol + 1) {
+    eol = (const char*)memchr(p, '\n', tail - p);
+    if (eol == NULL) break;
+
+    if (reclog_parse_row(p, eol, &row) != RECLOG_ROW) continue;
+    if (!isfinite(*col)) continue;
+    if (row.ts < ctx->t0 || row.ts - ctx->t0 >= ctx->span) continue;
+
+    pt.t = row.ts;
+    pt.v = *col;
+    func(ctx, &pt, dst);
+  }
+
+  // 処理済みのページは常駐させておく必要が無いので返却する
+  reclog_release(ctx->map, head, tail);
+}
+
+/**
+ * 全チャンクの並列走査
+ *
+ * @param [in] ctx      間引き処理の設定
+ * @param [in] func     行単位の処理関数
+ * @param [in] proto    集計領域の雛形(レベル構成の参照用)
+ * @param [out] locals  ワーカー毎の集計領域の書き込み先
+ */
+static void
+scan_all(const decimate_t* ctx,
+         row_func_t func,
+         const std::vector<level_t>& proto,
+         std::vector<std::vector<level_t>>* locals)
+{
+  std::vector<const char*> cuts;
+  size_t n;
+  int nw;
+  int i;
+
+  nw = workers_count();
+  n  = (size_t)nw * CHUNKS_PER_WORKER;
+
+  cuts.resize(n + 1);
+  reclog_split(ctx->map->head, ctx->map->size, (int)n, cuts.data());
+
+  locals->resize(nw);
+  for (i = 0; i < nw; i++) reset_levels(&(*locals)[i], proto);
+
+  workers_for(n, [&](size_t j, int id) {
+    scan_chunk(ctx, cuts[j], cuts[j + 1], func, &(*locals)[id]);
+  });
+}
+
+/*
+ * 公開関数の定義
+ */
+
+void
+decimate_collect(const decimate_t* ctx, std::vector<level_t>* levels)
+{
+  std::vector<std::vector<level_t>> locals;
+  size_t i;
+  size_t j;
+  bucket_t* d;
+  const bucket_t* s;
+
+  scan_all(ctx, collect_row, *levels, &locals);
+
+  /*
+   * ワーカー毎の集計結果のマージ
+   */
+  reset_levels(levels, *levels);
+
+  for (auto& local: locals) {
+    for (i = 0; i < levels->size(); i++) {
+      for (j = 0; j < (*levels)[i].width; j++) {
+        d = &(*levels)[i].buckets[j];
+        s = &local[i].buckets[j];
+
+        if (s->count == 0) continue;
+
+        if (d->count == 0) {
+          *d = *s;
+          continue;
+        }
+
+        if (s->first.t < d->first.t) d->first = s->first;
+        if (s->last.t >= d->last.t) d->last = s->last;
+        if (s->min.v < d->min.v) d->min = s->min;
+        if (s->max.v > d->max.v) d->max = s->max;
+
+        d->count += s->count;
+        d->sum_t += s->sum_t;
+        d->sum_v += s->sum_v;
+      }
+    }
+  }
+}
+
+void
+decimate_pick(const decimate_t* ctx, std::vector<level_t>* levels)
+{
+  std::vector<std::vector<level_t>> locals;
+  size_t i;
+  size_t j;
+  bucket_t* d;
+  const bucket_t* s;
+
+  anchors.resize(levels->size());
+  for (i = 0; i < levels->size(); i++) {
+    make_anchors(&(*levels)[i], &anchors[i]);
+  }
+
+  scan_all(ctx, pick_row, *levels, &locals);
+
+  /*
+   * ワーカー毎の選択結果のマージ
+   */
+  for (i = 0; i < levels->size(); i++) {
+    for (j = 0; j < (*levels)[i].width; j++) {
+      d        = &(*levels)[i].buckets[j];
+      d->area  = -1.0;
+
+      for (auto& local: locals) {
+        s = &local[i].buckets[j];
+
+        if (s->count > 0 && s->area > d->area) {
+          d->area = s->area;
+          d->pick = s->pick;
+        }
+      }
+    }
+  }
+}
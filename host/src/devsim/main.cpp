@@ -0,0 +1,359 @@
+/*
+ * Simulated device on a pseudo terminal for testing host tools
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+//! デフォルトの統計出力周期(ミリ秒, ファームウェアと同じ値)
+#define DEFAULT_INTERVAL  (10000)
+
+//! デフォルトのデータ行の出力周期(ミリ秒)
+#define DEFAULT_PERIOD    (100)
+
+//! ヒストグラムのバケット数(レコーダと同じ値)
+#define HIST_BUCKETS      (12)
+
+//! 模擬するデバイスの種類(レコーダ)
+#define KIND_RECORDER     (0)
+
+//! 模擬するデバイスの種類(センサー)
+#define KIND_SENSOR       (1)
+
+//! 模擬するデバイスの種類(LOW_POWERを定義したレコーダ)
+#define KIND_LOWPOWER     (2)
+
+//! 模擬するデバイスの種類(BRIDGEを定義したレコーダ)
+#define KIND_BRIDGE       (3)
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 使用方法の表示
+ */
+static void
+usage()
+{
+  fprintf(stderr,
+          "usage: devsim [options]\n"
+          "\n"
+          "options:\n"
+          "  -k KIND     recorder, lowpower, bridge or sensor\n"
+          "              (default recorder; lowpower and bridge are\n"
+          "              recorders built with LOW_POWER or BRIDGE)\n"
+          "  -i MS       telemetry interval (default %d)\n"
+          "  -p MS       data row period, 0 to disable (default %d)\n"
+          "  -n COUNT    stop after COUNT telemetry records (default: never)\n",
+          DEFAULT_INTERVAL,
+          DEFAULT_PERIOD);
+}
+
+/**
+ * 文字列の送信
+ *
+ * @remark
+ *  読み出し側が居ない場合に停止しないよう、書き込めない分は捨てる。
+ */
+static void
+put(int fd, const std::string& s)
+{
+  ssize_t n;
+  size_t off;
+
+  for (off = 0; off < s.size(); off += n) {
+    n = write(fd, s.data() + off, s.size() - off);
+    if (n <= 0) break;
+  }
+}
+
+/**
+ * 名前=値の追加
+ */
+static void
+append_field(std::string* dst, const char* name, unsigned long long val)
+{
+  char buf[64];
+
+  snprintf(buf, sizeof(buf), " %s=%llu", name, val);
+  *dst += buf;
+}
+
+/**
+ * レコーダの#stat行の生成
+ *
+ * @param [in] kind  模擬するデバイスの種類
+ * @param [in] seq   通し番号
+ * @param [out] dst  生成した行の書き込み先
+ *
+ * @remark
+ *  フィールドの並びはレコーダのstats.cppのフィールド表と同じにする。
+ *  LOW_POWER, BRIDGEの場合はファームウェアと同じく末尾に区間毎の値を付
+ *  加する。
+ */
+static void
+make_recorder_stat(int kind, uint64_t seq, std::string* dst)
+{
+  char buf[128];
+  bool lp;
+  bool br;
+
+  lp = (kind == KIND_LOWPOWER);
+  br = (kind == KIND_BRIDGE);
+
+  *dst = "#stat";
+
+  append_field(dst, "rx_bytes", seq * 4400);
+  append_field(dst, "rx_lines", seq * 100);
+  append_field(dst, "rx_split", 0);
+  append_field(dst, "rx_resync", seq / 500);
+  append_field(dst, "uart_break", 0);
+  append_field(dst, "uart_buffer_full", 0);
+  append_field(dst, "uart_fifo_ovf", seq / 100);
+  append_field(dst, "uart_frame", 0);
+  append_field(dst, "uart_parity", 0);
+  append_field(dst, "resample_in", 0);
+  append_field(dst, "resample_out", 0);
+  append_field(dst, "resample_rejects", 0);
+  append_field(dst, "resample_gaps", 0);
+  append_field(dst, "resample_restarts", 0);
+  append_field(dst, "resample_dups", 0);
+  append_field(dst, "wr_blocks", seq / 2);
+  append_field(dst, "wr_errors", 0);
+  append_field(dst, "wr_queue_peak", 1 + seq % 2);
+  append_field(dst, "wr_segments", seq / 1000);
+  append_field(dst, "wr_prealloc_errors", 0);
+  append_field(dst, "wr_open_peak_ms", 12 + seq % 5);
+  append_field(dst, "wr_dir_opens", 1 + seq / 1000);
+  append_field(dst, "lp_sleeps", (lp)? seq * 10: 0);
+  append_field(dst, "lp_sleep_ms", (lp)? seq * 9000: 0);
+  append_field(dst, "lp_wake_rx", (lp)? seq * 9: 0);
+  append_field(dst, "lp_wake_button", 0);
+  append_field(dst, "lp_wake_timer", (lp)? seq: 0);
+  append_field(dst, "lp_wake_lat_peak_us", (lp)? 800 + seq % 200: 0);
+  append_field(dst, "trim_rows", 0);
+  append_field(dst, "trim_rejects", 0);
+  append_field(dst, "trim_bytes_in", 0);
+  append_field(dst, "trim_bytes_out", 0);
+  append_field(dst, "bridge_bytes", (br)? seq * 920000: 0);
+  append_field(dst, "bridge_chunks", (br)? seq * 14400: 0);
+  append_field(dst, "bridge_writes", (br)? seq * 1200: 0);
+  append_field(dst, "bridge_drops", 0);
+  append_field(dst, "bridge_xoff", 0);
+  append_field(dst, "bridge_lat_sum_us", (br)? seq * 14400 * 2000: 0);
+  append_field(dst, "bridge_lat_peak_us", (br)? 6000 + seq % 1000: 0);
+  append_field(dst, "bridge_line_drops", 0);
+
+  if (lp) {
+    append_field(dst, "est_current_ua", 4200 + seq % 300);
+
+  } else if (br) {
+    snprintf(buf, sizeof(buf),
+             " bridge_rate_avg_bps=736000 bridge_lat_avg_us=2000"
+             " bridge_util_pct=%.1f",
+             80.0 + (seq % 10) * 0.1);
+    *dst += buf;
+  }
+
+  *dst += "\n";
+}
+
+/**
+ * テレメトリ行の生成
+ *
+ * @param [in] kind  模擬するデバイスの種類
+ * @param [in] seq   通し番号
+ * @param [out] dst  生成した行の書き込み先
+ */
+static void
+make_telemetry(int kind, uint64_t seq, std::string* dst)
+{
+  static uint32_t hist[HIST_BUCKETS];
+  char buf[512];
+  uint32_t cum;
+  uint32_t sum;
+  int i;
+
+  if (kind == KIND_SENSOR) {
+    snprintf(buf, sizeof(buf),
+             "#stat frames=%llu len_err=%llu hdr_err=0 sum_err=%llu"
+             " hlw_break=0 hlw_buffer_full=0 hlw_fifo_ovf=0 hlw_frame=0"
+             " hlw_parity=0 chain_own=%llu chain_fwd=0 chain_drop=0"
+             " chain_lat_avg_us=0 chain_lat_max_us=0 link_util_pct=%.1f"
+             " chain_preamble=0 headless=0 calibrated=0 cpu_mhz=240"
+             " proc_avg_us=%llu proc_max_us=%llu"
+             " lo_break=0 lo_buffer_full=0 lo_fifo_ovf=0 lo_frame=0"
+             " lo_parity=0\r\n",
+             (unsigned long long)(seq * 181),
+             (unsigned long long)(seq / 7),
+             (unsigned long long)(seq / 13),
+             (unsigned long long)(seq * 181),
+             3.0 + (seq % 10) * 0.1,
+             (unsigned long long)(900 + seq % 50),
+             (unsigned long long)(4000 + seq % 500));
+
+    *dst = buf;
+    return;
+  }
+
+  make_recorder_stat(kind, seq, dst);
+
+  // 書き込み時間は主に8〜64ミリ秒に分布させる
+  hist[3 + (seq * 7) % 4]++;
+  if (seq % 50 == 0) hist[9]++;
+
+  snprintf(buf, sizeof(buf), "#hist wr_latency_ms");
+  *dst += buf;
+
+  for (i = 0, cum = 0, sum = 0; i < HIST_BUCKETS; i++) {
+    cum += hist[i];
+    sum += hist[i] * (1U << i);
+  }
+
+  snprintf(buf, sizeof(buf), " sum=%u count=%u", sum, cum);
+  *dst += buf;
+
+  for (i = 0, cum = 0; i < HIST_BUCKETS; i++) {
+    cum += hist[i];
+
+    if (i < HIST_BUCKETS - 1) {
+      snprintf(buf, sizeof(buf), " %u=%u", 1U << i, cum);
+    } else {
+      snprintf(buf, sizeof(buf), " +Inf=%u", cum);
+    }
+
+    *dst += buf;
+  }
+
+  *dst += "\n";
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+main(int argc, char* argv[])
+{
+  int opt;
+  int kind;
+  int interval;
+  int period;
+  long limit;
+  int fd;
+  int slave;
+  uint64_t seq;
+  uint64_t ts;
+  int elapsed;
+  std::string line;
+  char row[80];
+
+  kind     = KIND_RECORDER;
+  interval = DEFAULT_INTERVAL;
+  period   = DEFAULT_PERIOD;
+  limit    = -1;
+
+  while ((opt = getopt(argc, argv, "k:i:p:n:h")) != -1) {
+    switch (opt) {
+    case 'k':
+      if (strcmp(optarg, "sensor") == 0) {
+        kind = KIND_SENSOR;
+      } else if (strcmp(optarg, "lowpower") == 0) {
+        kind = KIND_LOWPOWER;
+      } else if (strcmp(optarg, "bridge") == 0) {
+        kind = KIND_BRIDGE;
+      } else {
+        kind = KIND_RECORDER;
+      }
+      break;
+
+    case 'i':
+      interval = atoi(optarg);
+      break;
+
+    case 'p':
+      period = atoi(optarg);
+      break;
+
+    case 'n':
+      limit = atol(optarg);
+      break;
+
+    default:
+      usage();
+      return (opt == 'h')? 0: 1;
+    }
+  }
+
+  if (interval <= 0 || period < 0) {
+    usage();
+    return 1;
+  }
+
+  /*
+   * 擬似端末の準備
+   *   スレーブ側を自身でも開いておき、読み出し側が閉じても終了しないように
+   *   する。
+   */
+  fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+  if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0) {
+    fprintf(stderr, "error: cannot open pty (%s)\n", strerror(errno));
+    return 1;
+  }
+
+  slave = open(ptsname(fd), O_RDWR | O_NOCTTY);
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  printf("%s\n", ptsname(fd));
+  fflush(stdout);
+
+  /*
+   * 出力ループ
+   *   データ行(CSVのミラーに相当)の間に、interval毎にテレメトリ行を挟む。
+   */
+  seq     = 0;
+  ts      = 0;
+  elapsed = 0;
+
+  while (limit < 0 || (long)seq < limit) {
+    if (period > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(period));
+
+      ts      += period;
+      elapsed += period;
+
+      snprintf(row, sizeof(row),
+               "%llu,100.500000,1.250000,120.000000\r\n",
+               (unsigned long long)ts);
+      put(fd, row);
+
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+      elapsed = interval;
+    }
+
+    if (elapsed >= interval) {
+      elapsed = 0;
+      make_telemetry(kind, ++seq, &line);
+      put(fd, line);
+    }
+  }
+
+  close(slave);
+  close(fd);
+
+  return 0;
+}
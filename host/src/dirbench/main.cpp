@@ -0,0 +1,603 @@
+/*
+ * Recording directory layout benchmark on a host file system
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <recpath.h>
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+//! 作成する記録ファイルの数のデフォルト値
+#define DEFAULT_FILES   (3000)
+
+//! 一回の記録セッションで作成する記録ファイルの数のデフォルト値
+#define DEFAULT_SESSION (250)
+
+//! 記録ファイルの間隔のデフォルト値(秒, -t指定時)
+#define DEFAULT_STEP    (60)
+
+//! 模擬する時刻の起点(2024-01-01 00:00:00 UTC)
+#define EPOCH           (1704067200)
+
+//! セッション番号を記録するファイル(レコーダと同じ名前)
+#define SESSION_FILE    "/session.idx"
+
+//! ファイルシステムの操作の状態(POSIX)
+typedef struct {
+  //! 記録先のルートディレクトリ
+  std::string root;
+
+  //! 記録先ディレクトリのファイルディスクリプタ
+  int fd;
+
+  //! ディレクトリを開いた回数
+  uint64_t opens;
+} posix_fs_t;
+
+//! 所要時間の集計
+typedef struct {
+  std::vector<double> usec;
+  uint64_t errors;
+} bench_t;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 使用方法の表示
+ */
+static void
+usage()
+{
+  fprintf(stderr,
+          "usage: dirbench [options] ROOT\n"
+          "\n"
+          "  ROOT is where the card layout is created (e.g. a mounted FAT\n"
+          "  image), ROOT/tree and ROOT/flat must not exist\n"
+          "\n"
+          "options:\n"
+          "  -n FILES    recording files to create (default %d)\n"
+          "  -s FILES    recording files per session (default %d)\n"
+          "  -m FILES    max recording files per directory (default %d)\n"
+          "  -t          dated directories (simulated clock) instead of\n"
+          "              session directories\n"
+          "  -i SEC      seconds between recording files for -t (default %d)\n"
+          "  -r          restart at every session, as after a power cycle\n"
+          "  -l          also create the files in the legacy flat layout\n"
+          "              (ROOT/flat) for comparison\n",
+          DEFAULT_FILES,
+          DEFAULT_SESSION,
+          RECPATH_MAX_FILES,
+          DEFAULT_STEP);
+}
+
+/**
+ * 現在時刻の取得(マイクロ秒)
+ */
+static double
+now_us()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+/**
+ * ディレクトリの作成(途中のディレクトリを含む)
+ */
+static int
+make_dirs(const std::string& path)
+{
+  size_t pos;
+
+  pos = 0;
+
+  while (pos != std::string::npos) {
+    pos = path.find('/', pos + 1);
+    std::string sub = path.substr(0, pos);
+
+    if (mkdir(sub.c_str(), 0755) < 0 && errno != EEXIST) return DEFAULT_ERROR;
+  }
+
+  return 0;
+}
+
+/**
+ * 空のファイルの作成(既に存在する場合はエラー)
+ *
+ * @param [in] dirfd  ディレクトリのファイルディスクリプタ
+ * @param [in] name   ファイル名
+ * @param [in] text   書き込む内容(ヘッダ行の代わり)
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ */
+static int
+create_file(int dirfd, const char* name, const char* text)
+{
+  int fd;
+  int ret;
+
+  fd = openat(dirfd, name, O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) return DEFAULT_ERROR;
+
+  ret = (write(fd, text, strlen(text)) < 0)? DEFAULT_ERROR: 0;
+  close(fd);
+
+  return ret;
+}
+
+/**
+ * 記録先ディレクトリのオープン(recpath_fs_t::open_dir)
+ *
+ * @remark
+ *  レコーダと同じく、開いた時に一度だけ記録ファイルを数え上げる。
+ */
+static int
+posix_open_dir(void* arg, const char* path, uint32_t* files)
+{
+  posix_fs_t* fs;
+  std::string full;
+  DIR* dir;
+  struct dirent* ent;
+  size_t len;
+  int fd;
+
+  fs   = (posix_fs_t*)arg;
+  full = fs->root + path;
+
+  if (fs->fd >= 0) {
+    close(fs->fd);
+    fs->fd = -1;
+  }
+
+  if (make_dirs(full)) return DEFAULT_ERROR;
+
+  fs->fd = open(full.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fs->fd < 0) return DEFAULT_ERROR;
+
+  *files = 0;
+
+  fd  = dup(fs->fd);
+  dir = (fd >= 0)? fdopendir(fd): NULL;
+
+  if (dir == NULL) {
+    if (fd >= 0) close(fd);
+    close(fs->fd);
+    fs->fd = -1;
+    return DEFAULT_ERROR;
+  }
+
+  while ((ent = readdir(dir)) != NULL) {
+    len = strlen(ent->d_name);
+    if (len > 4 && !strcasecmp(ent->d_name + len - 4, ".csv")) (*files)++;
+  }
+
+  closedir(dir);
+  fs->opens++;
+
+  return 0;
+}
+
+/**
+ * セッション番号の読み出し(recpath_fs_t::load_session)
+ */
+static int
+posix_load_session(void* arg, uint32_t* session)
+{
+  posix_fs_t* fs;
+  FILE* fp;
+
+  fs       = (posix_fs_t*)arg;
+  *session = 0;
+
+  fp = fopen((fs->root + SESSION_FILE).c_str(), "r");
+  if (fp != NULL) {
+    if (fscanf(fp, "%u", session) != 1) *session = 0;
+    fclose(fp);
+  }
+
+  return 0;
+}
+
+/**
+ * セッション番号の書き込み(recpath_fs_t::save_session)
+ */
+static int
+posix_save_session(void* arg, uint32_t session)
+{
+  posix_fs_t* fs;
+  FILE* fp;
+  int ret;
+
+  fs = (posix_fs_t*)arg;
+
+  fp = fopen((fs->root + SESSION_FILE).c_str(), "w");
+  if (fp == NULL) return DEFAULT_ERROR;
+
+  ret = (fprintf(fp, "%lu\n", (unsigned long)session) < 0)? DEFAULT_ERROR: 0;
+  if (fclose(fp) != 0) ret = DEFAULT_ERROR;
+
+  return ret;
+}
+
+/**
+ * 所要時間の区間平均(先頭からの割合で指定)
+ */
+static double
+mean_range(const bench_t* b, double from, double to)
+{
+  size_t n;
+  size_t i0;
+  size_t i1;
+  double sum;
+  size_t i;
+
+  n  = b->usec.size();
+  i0 = (size_t)(n * from);
+  i1 = std::max(i0 + 1, (size_t)(n * to));
+  if (i1 > n) return 0.0;
+
+  sum = 0.0;
+  for (i = i0; i < i1; i++) sum += b->usec[i];
+
+  return sum / (i1 - i0);
+}
+
+/**
+ * 所要時間の集計結果の表示
+ */
+static void
+print_bench(const char* name, const bench_t* b)
+{
+  double first;
+  double last;
+  double peak;
+
+  first = mean_range(b, 0.0, 0.1);
+  last  = mean_range(b, 0.9, 1.0);
+  peak  = (b->usec.empty())?
+          0.0: *std::max_element(b->usec.begin(), b->usec.end());
+
+  printf("%s: files=%zu errors=%llu open_us_first=%.1f open_us_last=%.1f"
+         " open_us_max=%.1f growth=%.2f\n",
+         name,
+         b->usec.size(),
+         (unsigned long long)b->errors,
+         first,
+         last,
+         peak,
+         (first > 0.0)? last / first: 0.0);
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+main(int argc, char* argv[])
+{
+  int opt;
+  uint32_t total;
+  uint32_t perSession;
+  uint32_t maxFiles;
+  bool dated;
+  long step;
+  bool restart;
+  bool legacy;
+  std::string root;
+  struct stat st;
+  posix_fs_t pfs;
+  recpath_fs_t fs;
+  recpath_t ctx;
+  std::map<std::string, uint32_t> dirs;
+  std::string lastDir;
+  uint32_t prevSession;
+  uint32_t stored;
+  uint64_t dirErrors;
+  uint64_t dateErrors;
+  uint64_t sessionErrors;
+  uint64_t overflows;
+  uint64_t branches;
+  uint64_t sessions;
+  bench_t tree;
+  bench_t flat;
+  time_t t;
+  struct tm tmbuf;
+  struct tm* tm;
+  char name[64];
+  char prefix[RECPATH_PATH_SIZE];
+  int flatFd;
+  int fno;
+  double t0;
+  uint32_t i;
+  bool ok;
+
+  /*
+   * parse options
+   */
+  total      = DEFAULT_FILES;
+  perSession = DEFAULT_SESSION;
+  maxFiles   = RECPATH_MAX_FILES;
+  dated      = false;
+  step       = DEFAULT_STEP;
+  restart    = false;
+  legacy     = false;
+
+  while ((opt = getopt(argc, argv, "n:s:m:ti:rlh")) != -1) {
+    switch (opt) {
+    case 'n':
+      total = strtoul(optarg, NULL, 10);
+      break;
+
+    case 's':
+      perSession = strtoul(optarg, NULL, 10);
+      break;
+
+    case 'm':
+      maxFiles = strtoul(optarg, NULL, 10);
+      break;
+
+    case 't':
+      dated = true;
+      break;
+
+    case 'i':
+      step = atol(optarg);
+      break;
+
+    case 'r':
+      restart = true;
+      break;
+
+    case 'l':
+      legacy = true;
+      break;
+
+    default:
+      usage();
+      return (opt == 'h')? 0: 1;
+    }
+  }
+
+  if (optind + 1 != argc ||
+      total == 0 || perSession == 0 || maxFiles == 0 || step <= 0) {
+    usage();
+    return 1;
+  }
+
+  root = argv[optind];
+
+  if (stat((root + "/tree").c_str(), &st) == 0 ||
+      stat((root + "/flat").c_str(), &st) == 0) {
+    fprintf(stderr, "%s: remove tree/ and flat/ first\n", root.c_str());
+    return 1;
+  }
+
+  /*
+   * initialize
+   */
+  pfs.root  = root + "/tree";
+  pfs.fd    = -1;
+  pfs.opens = 0;
+
+  fs.open_dir     = posix_open_dir;
+  fs.load_session = posix_load_session;
+  fs.save_session = posix_save_session;
+  fs.arg          = &pfs;
+
+  if (make_dirs(pfs.root)) {
+    perror(pfs.root.c_str());
+    return 1;
+  }
+
+  recpath_init(&ctx, &fs, maxFiles);
+
+  prevSession   = 0;
+  dirErrors     = 0;
+  dateErrors    = 0;
+  sessionErrors = 0;
+  overflows     = 0;
+  branches      = 0;
+  sessions      = 0;
+  tree.errors   = 0;
+  flat.errors   = 0;
+  t             = EPOCH;
+
+  /*
+   * run (directory layout)
+   *   レコーダと同じく、記録セッションの開始時にrecpath_begin()を、記録ファ
+   *   イル毎にrecpath_next()を呼び出し、記録ファイルを作成するまでを計る。
+   *   -rの場合は記録セッション毎に状態を初期化し、再起動後の再開を模擬する。
+   */
+  for (i = 0; i < total; i++) {
+    tm = (dated)? gmtime_r(&t, &tmbuf): NULL;
+
+    if (i % perSession == 0) {
+      if (restart && i > 0) {
+        if (pfs.fd >= 0) close(pfs.fd);
+        pfs.fd = -1;
+        recpath_init(&ctx, &fs, maxFiles);
+      }
+
+      if (recpath_begin(&ctx, tm)) dirErrors++;
+
+      if (!dated) {
+        // セッション番号は増加し、session.idxに書き戻されているはず
+        posix_load_session(&pfs, &stored);
+        if (ctx.session <= prevSession || stored != ctx.session) {
+          sessionErrors++;
+        }
+
+        prevSession = ctx.session;
+      }
+
+      sessions++;
+    }
+
+    t0 = now_us();
+
+    if (recpath_next(&ctx, tm, name, sizeof(name)) || pfs.fd < 0) {
+      dirErrors++;
+      tree.errors++;
+      t += step;
+      continue;
+    }
+
+    if (create_file(pfs.fd, name, "time,voltage,current,power\n")) {
+      tree.errors++;
+    }
+
+    tree.usec.push_back(now_us() - t0);
+
+    /*
+     * check layout
+     */
+    if (ctx.path != lastDir) {
+      if (strchr(ctx.path, '_') != NULL) branches++;
+      lastDir = ctx.path;
+    }
+
+    if (++dirs[ctx.path] > maxFiles) overflows++;
+
+    if (dated) {
+      snprintf(prefix,
+               sizeof(prefix),
+               "/%04d/%02d/%02d",
+               1900 + tm->tm_year,
+               tm->tm_mon + 1,
+               tm->tm_mday);
+
+      if (strncmp(ctx.path, prefix, strlen(prefix)) != 0 ||
+          (ctx.path[strlen(prefix)] != '\0' &&
+           ctx.path[strlen(prefix)] != '_')) {
+        dateErrors++;
+      }
+    }
+
+    // 記録ファイル毎に作られる".log"のファイル
+    strcpy(strrchr(name, '.'), ".log");
+    if (create_file(pfs.fd, name, "file=\n")) tree.errors++;
+
+    t += step;
+  }
+
+  if (pfs.fd >= 0) close(pfs.fd);
+
+  /*
+   * run (legacy flat layout)
+   *   以前のレコーダと同じく、全ての記録ファイルをルートに作成する。時刻情
+   *   報が使用できない場合は、記録ファイル毎に"output-001.csv"から順に存在
+   *   を確かめて空いている名前を探す(SD.exists()と同じ)。
+   */
+  if (legacy) {
+    if (make_dirs(root + "/flat")) {
+      perror((root + "/flat").c_str());
+      return 1;
+    }
+
+    flatFd = open((root + "/flat").c_str(), O_RDONLY | O_DIRECTORY);
+    if (flatFd < 0) {
+      perror((root + "/flat").c_str());
+      return 1;
+    }
+
+    t = EPOCH;
+
+    for (i = 0; i < total; i++) {
+      t0 = now_us();
+
+      if (dated) {
+        tm = gmtime_r(&t, &tmbuf);
+        snprintf(name,
+                 sizeof(name),
+                 "output-%04d%02d%02d-%02d%02d%02d.csv",
+                 1900 + tm->tm_year,
+                 tm->tm_mon + 1,
+                 tm->tm_mday,
+                 tm->tm_hour,
+                 tm->tm_min,
+                 tm->tm_sec);
+      } else {
+        fno = 1;
+
+        do {
+          snprintf(name, sizeof(name), "output-%03d.csv", fno++);
+        } while (fstatat(flatFd, name, &st, 0) == 0);
+      }
+
+      if (create_file(flatFd, name, "time,voltage,current,power\n")) {
+        flat.errors++;
+      }
+
+      flat.usec.push_back(now_us() - t0);
+
+      strcpy(strrchr(name, '.'), ".log");
+      if (create_file(flatFd, name, "file=\n")) flat.errors++;
+
+      t += step;
+    }
+
+    close(flatFd);
+  }
+
+  /*
+   * report
+   *   記録ファイルの名前が重複せず(O_EXCLで作成できる)、どのディレクトリも
+   *   上限を超えず、日付・セッション番号が正しく進んでいることを確かめる。
+   *   所要時間は先頭と末尾の1割の平均を比べ、growthが1に近ければカードに蓄
+   *   積されたファイル数に依らず一定の時間で作成できている。
+   */
+  ok = (tree.errors == 0 &&
+        dirErrors == 0 &&
+        dateErrors == 0 &&
+        sessionErrors == 0 &&
+        overflows == 0);
+
+  printf("layout=%s files=%lu sessions=%llu max_per_dir=%lu restart=%d\n",
+         (dated)? "dated": "session",
+         (unsigned long)total,
+         (unsigned long long)sessions,
+         (unsigned long)maxFiles,
+         (restart)? 1: 0);
+
+  printf("dirs=%zu dir_opens=%llu branches=%llu last_session=%lu"
+         " overflows=%llu dir_errors=%llu date_errors=%llu"
+         " session_errors=%llu\n",
+         dirs.size(),
+         (unsigned long long)pfs.opens,
+         (unsigned long long)branches,
+         (unsigned long)ctx.session,
+         (unsigned long long)overflows,
+         (unsigned long long)dirErrors,
+         (unsigned long long)dateErrors,
+         (unsigned long long)sessionErrors);
+
+  print_bench("tree", &tree);
+  if (legacy) print_bench("flat", &flat);
+
+  printf("result=%s\n", (ok)? "ok": "NG");
+
+  return (ok)? 0: 1;
+}
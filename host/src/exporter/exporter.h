@@ -0,0 +1,116 @@
+/*
+ * OpenMetrics exporter for device telemetry
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __EXPORTER_H__
+#define __EXPORTER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+//! 名前の最大長(終端を含む)
+#define EXPORTER_NAME_SIZE    (48)
+
+//! ヒストグラムの最大バケット数(+Infを含む)
+#define EXPORTER_MAX_BUCKETS  (32)
+
+//! 行の解析結果(テレメトリ行以外)
+#define EXPORTER_IGNORED      (0)
+
+//! 行の解析結果(#stat行)
+#define EXPORTER_STAT         (1)
+
+//! 行の解析結果(#hist行)
+#define EXPORTER_HIST         (2)
+
+//! 行の解析結果(解析失敗)
+#define EXPORTER_BROKEN       (-1)
+
+//! 値
+typedef struct {
+  char name[EXPORTER_NAME_SIZE];
+  double value;
+} metric_t;
+
+//! ヒストグラム
+typedef struct {
+  char name[EXPORTER_NAME_SIZE];
+  double sum;
+  double count;
+
+  //! バケット数
+  int size;
+
+  //! バケットの上限値(最後の要素は+Inf)
+  double le[EXPORTER_MAX_BUCKETS];
+
+  //! 上限値以下のサンプルの累積数
+  double cum[EXPORTER_MAX_BUCKETS];
+} histogram_t;
+
+//! デバイス毎の状態
+typedef struct {
+  //! ラベル(デバイスファイルのパスから"/dev/"を除いたもの)
+  std::string label;
+
+  //! デバイスファイルのパス
+  std::string path;
+
+  //! 状態の排他制御
+  std::mutex lock;
+
+  //! デバイスを開いているか否か
+  bool up;
+
+  //! #stat行の値(出現順)
+  std::vector<metric_t> stats;
+
+  //! #hist行のヒストグラム(出現順)
+  std::vector<histogram_t> hists;
+
+  //! 次に更新される見込みの値のインデックス
+  size_t hint;
+
+  //! 受理したテレメトリ行の数
+  uint64_t records;
+
+  //! 解析に失敗したテレメトリ行の数
+  uint64_t broken;
+
+  //! 最後にテレメトリ行を受理した時刻(UNIX時間)
+  double lastSeen;
+} device_t;
+
+/**
+ * 一行の解析と状態の更新
+ *
+ * @param [in,out] dev  デバイスの状態(呼び出し側でロックしておくこと)
+ * @param [in] line     行の先頭
+ * @param [in] len      行の長さ(改行文字を含まない)
+ *
+ * @return
+ *  EXPORTER_IGNORED, EXPORTER_STAT, EXPORTER_HIST, EXPORTER_BROKENのいずれ
+ *  かを返す。
+ *
+ * @remark
+ *  "#stat 名前=値 ..."の行は値を、"#hist 名前 sum=合計 count=件数 上限=累
+ *  積件数 ... +Inf=累積件数"の行はヒストグラムを更新する。メモリ確保は新し
+ *  い名前が現れた場合のみ行う。
+ */
+int exporter_parse_line(device_t* dev, const char* line, size_t len);
+
+/**
+ * OpenMetrics形式での出力
+ *
+ * @param [in] devs  デバイス一覧
+ * @param [out] dst  出力先
+ */
+void exporter_render(const std::vector<device_t*>& devs, std::string* dst);
+
+#endif /* !defined(__EXPORTER_H__) */
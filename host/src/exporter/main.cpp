@@ -0,0 +1,394 @@
+/*
+ * OpenMetrics exporter for device telemetry
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <termios.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <chrono>
+#include <thread>
+
+#include "exporter.h"
+
+//! デフォルトの待ち受けポート
+#define DEFAULT_PORT    (9464)
+
+//! デフォルトの通信速度
+#define DEFAULT_BAUD    (115200)
+
+//! デバイスを開き直すまでの待ち時間(ミリ秒)
+#define REOPEN_WAIT     (1000)
+
+//! 受信バッファのサイズ
+#define RX_BUFF_SIZE    (4096)
+
+//! ベンチマークの繰り返し回数
+#define BENCH_COUNT     (1000000)
+
+//! 経過時間計測用の時計
+typedef std::chrono::steady_clock clock_type;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 使用方法の表示
+ */
+static void
+usage()
+{
+  fprintf(stderr,
+          "usage: exporter [options] DEVICE...\n"
+          "       exporter -B\n"
+          "\n"
+          "options:\n"
+          "  -p PORT     listen port on 127.0.0.1 (default %d)\n"
+          "  -a ADDR     listen address (default 127.0.0.1)\n"
+          "  -b BAUD     serial baud rate (default %d)\n"
+          "  -B          measure the parse cost per record\n",
+          DEFAULT_PORT,
+          DEFAULT_BAUD);
+}
+
+/**
+ * 通信速度の定数への変換
+ */
+static speed_t
+to_speed(int baud)
+{
+  switch (baud) {
+  case 9600:    return B9600;
+  case 19200:   return B19200;
+  case 38400:   return B38400;
+  case 57600:   return B57600;
+  case 115200:  return B115200;
+  case 230400:  return B230400;
+  case 460800:  return B460800;
+  case 921600:  return B921600;
+  default:      return B0;
+  }
+}
+
+/**
+ * シリアルデバイスのオープン
+ *
+ * @param [in] path  デバイスファイルのパス
+ * @param [in] baud  通信速度
+ *
+ * @return
+ *  ファイルディスクリプタを返す。失敗した場合は-1を返す。
+ */
+static int
+open_serial(const char* path, speed_t baud)
+{
+  int fd;
+  struct termios tio;
+
+  fd = open(path, O_RDONLY | O_NOCTTY);
+  if (fd < 0) return -1;
+
+  // ptyではtcsetattr()の一部が失敗するが、読み出しには支障がない
+  if (tcgetattr(fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, baud);
+    cfsetospeed(&tio, baud);
+
+    tio.c_cc[VMIN]  = 1;
+    tio.c_cc[VTIME] = 0;
+
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+
+  return fd;
+}
+
+/**
+ * デバイス毎の受信スレッド
+ *
+ * @param [in] dev   デバイスの状態
+ * @param [in] baud  通信速度
+ *
+ * @remark
+ *  行単位に組み立てて解析する。テレメトリ行以外(CSVのミラー等)は先頭の数
+ *  文字を見ただけで捨てる。デバイスが抜かれた場合は開き直しを繰り返す。
+ */
+static void
+reader_thread(device_t* dev, speed_t baud)
+{
+  char buf[RX_BUFF_SIZE];
+  char line[RX_BUFF_SIZE];
+  size_t used;
+  bool overflow;
+  ssize_t n;
+  ssize_t i;
+  int fd;
+
+  while (true) {
+    fd = open_serial(dev->path.c_str(), baud);
+
+    if (fd < 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(REOPEN_WAIT));
+      continue;
+    }
+
+    dev->lock.lock();
+    dev->up = true;
+    dev->lock.unlock();
+
+    used     = 0;
+    overflow = false;
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+      for (i = 0; i < n; i++) {
+        if (buf[i] != '\n') {
+          if (used < sizeof(line)) {
+            line[used++] = buf[i];
+          } else {
+            overflow = true;
+          }
+          continue;
+        }
+
+        if (!overflow && used > 0 && line[0] == '#') {
+          dev->lock.lock();
+          exporter_parse_line(dev, line, used);
+          dev->lock.unlock();
+        }
+
+        used     = 0;
+        overflow = false;
+      }
+    }
+
+    close(fd);
+
+    dev->lock.lock();
+    dev->up = false;
+    dev->lock.unlock();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(REOPEN_WAIT));
+  }
+}
+
+/**
+ * HTTPリクエストの処理
+ *
+ * @param [in] fd    接続のソケット
+ * @param [in] devs  デバイス一覧
+ *
+ * @remark
+ *  "GET /metrics"と"GET /"にのみ応答し、応答後に接続を閉じる。
+ */
+static void
+serve(int fd, const std::vector<device_t*>& devs)
+{
+  char req[4096];
+  size_t used;
+  ssize_t n;
+  std::string body;
+  std::string head;
+  const char* status;
+
+  used = 0;
+
+  while (used < sizeof(req) - 1) {
+    n = recv(fd, req + used, sizeof(req) - 1 - used, 0);
+    if (n <= 0) return;
+
+    used += n;
+    req[used] = '\0';
+
+    if (strstr(req, "\r\n\r\n") != NULL) break;
+  }
+
+  if (strncmp(req, "GET /metrics ", 13) == 0 ||
+      strncmp(req, "GET / ", 6) == 0) {
+    exporter_render(devs, &body);
+    status = "200 OK";
+  } else {
+    body   = "not found\n";
+    status = "404 Not Found";
+  }
+
+  head  = "HTTP/1.1 ";
+  head += status;
+  head += "\r\nContent-Type: application/openmetrics-text; version=1.0.0;"
+          " charset=utf-8\r\nContent-Length: ";
+  head += std::to_string(body.size());
+  head += "\r\nConnection: close\r\n\r\n";
+
+  send(fd, head.data(), head.size(), MSG_NOSIGNAL);
+  send(fd, body.data(), body.size(), MSG_NOSIGNAL);
+}
+
+/**
+ * 解析処理のベンチマーク
+ *
+ * @remark
+ *  レコーダの#stat行と#hist行を交互に解析し、一行当たりの処理時間を計測す
+ *  る。
+ */
+static void
+bench()
+{
+  static const char* lines[] = {
+    "#stat rx_bytes=1234567 rx_lines=45678 rx_split=0 uart_break=0"
+    " uart_buffer_full=0 uart_fifo_ovf=0 uart_frame=2 uart_parity=0"
+    " resample_in=0 resample_out=0 resample_rejects=0 resample_gaps=0"
+    " resample_restarts=0 wr_blocks=150 wr_errors=0 wr_queue_peak=1",
+    "#hist wr_latency_ms sum=12345 count=150 1=0 2=0 4=3 8=40 16=90 32=120"
+    " 64=140 128=148 256=150 512=150 1024=150 +Inf=150"
+  };
+
+  device_t dev;
+  size_t len[2];
+  clock_type::time_point t0;
+  double sec;
+  int i;
+
+  len[0] = strlen(lines[0]);
+  len[1] = strlen(lines[1]);
+
+  dev.hint    = 0;
+  dev.records = 0;
+  dev.broken  = 0;
+
+  t0 = clock_type::now();
+
+  for (i = 0; i < BENCH_COUNT; i++) {
+    exporter_parse_line(&dev, lines[i & 1], len[i & 1]);
+  }
+
+  sec = std::chrono::duration<double>(clock_type::now() - t0).count();
+
+  printf("records=%d broken=%llu ns_per_record=%.1f\n",
+         BENCH_COUNT,
+         (unsigned long long)dev.broken,
+         (sec * 1e9) / BENCH_COUNT);
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+main(int argc, char* argv[])
+{
+  int opt;
+  int port;
+  int baud;
+  const char* addr;
+  std::vector<device_t*> devs;
+  struct sockaddr_in sa;
+  int sock;
+  int fd;
+  int on;
+  int i;
+
+  port = DEFAULT_PORT;
+  baud = DEFAULT_BAUD;
+  addr = "127.0.0.1";
+
+  while ((opt = getopt(argc, argv, "p:a:b:Bh")) != -1) {
+    switch (opt) {
+    case 'p':
+      port = atoi(optarg);
+      break;
+
+    case 'a':
+      addr = optarg;
+      break;
+
+    case 'b':
+      baud = atoi(optarg);
+      break;
+
+    case 'B':
+      bench();
+      return 0;
+
+    default:
+      usage();
+      return (opt == 'h')? 0: 1;
+    }
+  }
+
+  if (optind >= argc || to_speed(baud) == B0) {
+    usage();
+    return 1;
+  }
+
+  /*
+   * 待ち受けソケットの準備
+   */
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port   = htons(port);
+
+  if (inet_pton(AF_INET, addr, &sa.sin_addr) != 1) {
+    fprintf(stderr, "error: invalid address %s\n", addr);
+    return 1;
+  }
+
+  sock = socket(AF_INET, SOCK_STREAM, 0);
+  on   = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  if (bind(sock, (struct sockaddr*)&sa, sizeof(sa)) < 0 ||
+      listen(sock, 8) < 0) {
+    fprintf(stderr, "error: cannot listen on %s:%d (%s)\n",
+            addr, port, strerror(errno));
+    return 1;
+  }
+
+  /*
+   * 受信スレッドの起動
+   */
+  for (i = optind; i < argc; i++) {
+    device_t* dev = new device_t();
+
+    // ラベルは"/dev/"を除いたパス(ttyACM0, pts/3等)とする
+    dev->path     = argv[i];
+    dev->label    = (strncmp(argv[i], "/dev/", 5) == 0)? argv[i] + 5: argv[i];
+    dev->up       = false;
+    dev->hint     = 0;
+    dev->records  = 0;
+    dev->broken   = 0;
+    dev->lastSeen = 0.0;
+
+    devs.push_back(dev);
+    std::thread(reader_thread, dev, to_speed(baud)).detach();
+  }
+
+  fprintf(stderr, "listening on http://%s:%d/metrics\n", addr, port);
+
+  /*
+   * 待ち受けループ
+   */
+  while (true) {
+    fd = accept(sock, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+
+    serve(fd, devs);
+    close(fd);
+  }
+
+  close(sock);
+
+  return 1;
+}
@@ -0,0 +1,444 @@
+/*
+ * OpenMetrics exporter for device telemetry
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <set>
+
+#include "exporter.h"
+
+//! メトリクス名の接頭辞
+#define PREFIX          "m5socket_"
+
+//! ゲージとして扱う値の名前に含まれる語
+static const char* gauge_words[] = {
+  "_avg", "_max", "_min", "_pct", "_peak", "_mhz", "headless",
+  "calibrated", "_ua", "_source", "_state"
+};
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 空白の読み飛ばし
+ */
+static inline const char*
+skip_space(const char* p, const char* tail)
+{
+  while (p < tail && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+  return p;
+}
+
+/**
+ * 名前の切り出し
+ *
+ * @param [in] p      先頭
+ * @param [in] tail   行末
+ * @param [in] stop   名前の終端とする文字(空白以外)
+ * @param [out] dst   名前の書き込み先(EXPORTER_NAME_SIZE)
+ *
+ * @return
+ *  名前の直後の位置を返す。名前が空もしくは長すぎる場合はNULLを返す。
+ *
+ * @remark
+ *  OpenMetricsで使用できない文字は'_'に置き換える。
+ */
+static const char*
+cut_name(const char* p, const char* tail, char stop, char* dst)
+{
+  size_t n;
+  char c;
+
+  for (n = 0; p < tail && *p != stop && *p != ' ' && *p != '\r'; p++) {
+    if (n >= EXPORTER_NAME_SIZE - 1) return NULL;
+
+    c = *p;
+    if (!((c >= 'a' && c <= 'z') ||
+          (c >= 'A' && c <= 'Z') ||
+          (c >= '0' && c <= '9') ||
+          c == '_')) c = '_';
+
+    dst[n++] = c;
+  }
+
+  dst[n] = '\0';
+
+  return (n > 0)? p: NULL;
+}
+
+/**
+ * 数値の切り出し
+ *
+ * @param [in] p      先頭
+ * @param [in] tail   行末
+ * @param [out] dst   値の書き込み先
+ *
+ * @return
+ *  数値の直後の位置を返す。数値として解釈できない場合はNULLを返す。
+ */
+static const char*
+cut_number(const char* p, const char* tail, double* dst)
+{
+  char tmp[32];
+  size_t n;
+  char* end;
+
+  for (n = 0; p + n < tail && p[n] != ' ' && p[n] != '\r'; n++) {
+    if (n >= sizeof(tmp) - 1) return NULL;
+    tmp[n] = p[n];
+  }
+
+  if (n == 0) return NULL;
+  tmp[n] = '\0';
+
+  *dst = strtod(tmp, &end);
+  if (*end != '\0') return NULL;
+
+  return p + n;
+}
+
+/**
+ * 値の検索(無ければ追加)
+ *
+ * @remark
+ *  デバイスは毎回同じ順序で値を出力するので、前回の次の位置から探す。
+ */
+static metric_t*
+find_stat(device_t* dev, const char* name)
+{
+  size_t n;
+  size_t i;
+  size_t j;
+  metric_t m;
+
+  n = dev->stats.size();
+
+  for (i = 0; i < n; i++) {
+    j = (dev->hint + i) % n;
+
+    if (strcmp(dev->stats[j].name, name) == 0) {
+      dev->hint = j + 1;
+      return &dev->stats[j];
+    }
+  }
+
+  strcpy(m.name, name);
+  m.value = 0.0;
+
+  dev->stats.push_back(m);
+  dev->hint = 0;
+
+  return &dev->stats.back();
+}
+
+/**
+ * ヒストグラムの検索(無ければ追加)
+ */
+static histogram_t*
+find_hist(device_t* dev, const char* name)
+{
+  histogram_t h = {};
+
+  for (auto& e: dev->hists) {
+    if (strcmp(e.name, name) == 0) return &e;
+  }
+
+  strcpy(h.name, name);
+  dev->hists.push_back(h);
+
+  return &dev->hists.back();
+}
+
+/**
+ * #stat行の解析
+ */
+static int
+parse_stat(device_t* dev, const char* p, const char* tail)
+{
+  char name[EXPORTER_NAME_SIZE];
+  double val;
+
+  while ((p = skip_space(p, tail)) < tail) {
+    p = cut_name(p, tail, '=', name);
+    if (p == NULL || p >= tail || *p != '=') return EXPORTER_BROKEN;
+
+    p = cut_number(p + 1, tail, &val);
+    if (p == NULL) return EXPORTER_BROKEN;
+
+    find_stat(dev, name)->value = val;
+  }
+
+  return EXPORTER_STAT;
+}
+
+/**
+ * #hist行の解析
+ */
+static int
+parse_hist(device_t* dev, const char* p, const char* tail)
+{
+  char name[EXPORTER_NAME_SIZE];
+  char key[EXPORTER_NAME_SIZE];
+  histogram_t tmp;
+  histogram_t* h;
+  double val;
+
+  p = cut_name(skip_space(p, tail), tail, ' ', name);
+  if (p == NULL) return EXPORTER_BROKEN;
+
+  strcpy(tmp.name, name);
+  tmp.size  = 0;
+  tmp.sum   = NAN;
+  tmp.count = NAN;
+
+  while ((p = skip_space(p, tail)) < tail) {
+    const char* eq = (const char*)memchr(p, '=', tail - p);
+    if (eq == NULL || eq == p || (size_t)(eq - p) >= sizeof(key)) {
+      return EXPORTER_BROKEN;
+    }
+
+    memcpy(key, p, eq - p);
+    key[eq - p] = '\0';
+
+    p = cut_number(eq + 1, tail, &val);
+    if (p == NULL) return EXPORTER_BROKEN;
+
+    if (strcmp(key, "sum") == 0) {
+      tmp.sum = val;
+
+    } else if (strcmp(key, "count") == 0) {
+      tmp.count = val;
+
+    } else {
+      if (tmp.size >= EXPORTER_MAX_BUCKETS) return EXPORTER_BROKEN;
+
+      tmp.le[tmp.size] = (strcmp(key, "+Inf") == 0)? INFINITY: atof(key);
+      tmp.cum[tmp.size++] = val;
+    }
+  }
+
+  if (isnan(tmp.sum) || isnan(tmp.count) || tmp.size == 0) {
+    return EXPORTER_BROKEN;
+  }
+
+  if (!isinf(tmp.le[tmp.size - 1])) return EXPORTER_BROKEN;
+
+  h  = find_hist(dev, name);
+  *h = tmp;
+
+  return EXPORTER_HIST;
+}
+
+/**
+ * ゲージとして扱う値か否か
+ */
+static bool
+is_gauge(const char* name)
+{
+  for (auto w: gauge_words) {
+    if (strstr(name, w) != NULL) return true;
+  }
+
+  return false;
+}
+
+/**
+ * 数値の文字列化
+ */
+static void
+append_value(std::string* dst, double v)
+{
+  char tmp[40];
+
+  if (isinf(v)) {
+    dst->append((v > 0)? "+Inf": "-Inf");
+  } else if (v == floor(v) && fabs(v) < 1e15) {
+    snprintf(tmp, sizeof(tmp), "%.0f", v);
+    dst->append(tmp);
+  } else {
+    snprintf(tmp, sizeof(tmp), "%.15g", v);
+    dst->append(tmp);
+  }
+}
+
+/**
+ * 一つのサンプル行の出力
+ */
+static void
+append_sample(std::string* dst,
+              const char* name,
+              const char* suffix,
+              const device_t* dev,
+              const char* le,
+              double v)
+{
+  dst->append(PREFIX);
+  dst->append(name);
+  dst->append(suffix);
+  dst->append("{device=\"");
+  dst->append(dev->label);
+  dst->append("\"");
+
+  if (le != NULL) {
+    dst->append(",le=\"");
+    dst->append(le);
+    dst->append("\"");
+  }
+
+  dst->append("} ");
+  append_value(dst, v);
+  dst->append("\n");
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+exporter_parse_line(device_t* dev, const char* line, size_t len)
+{
+  const char* tail;
+  int ret;
+
+  tail = line + len;
+
+  if (len > 6 && memcmp(line, "#stat ", 6) == 0) {
+    ret = parse_stat(dev, line + 6, tail);
+  } else if (len > 6 && memcmp(line, "#hist ", 6) == 0) {
+    ret = parse_hist(dev, line + 6, tail);
+  } else {
+    return EXPORTER_IGNORED;
+  }
+
+  if (ret == EXPORTER_BROKEN) {
+    dev->broken++;
+  } else {
+    dev->records++;
+    dev->lastSeen = (double)time(NULL);
+  }
+
+  return ret;
+}
+
+void
+exporter_render(const std::vector<device_t*>& devs, std::string* dst)
+{
+  std::vector<std::string> stats;
+  std::vector<std::string> hists;
+  std::set<std::string> seen;
+  char le[32];
+  int i;
+
+  dst->clear();
+
+  for (auto dev: devs) dev->lock.lock();
+
+  /*
+   * 名前の一覧(デバイス間の和集合, 出現順)
+   */
+  for (auto dev: devs) {
+    for (auto& m: dev->stats) {
+      if (seen.insert(std::string("s") + m.name).second) {
+        stats.push_back(m.name);
+      }
+    }
+
+    for (auto& h: dev->hists) {
+      if (seen.insert(std::string("h") + h.name).second) {
+        hists.push_back(h.name);
+      }
+    }
+  }
+
+  /*
+   * 値
+   */
+  for (auto& name: stats) {
+    bool gauge = is_gauge(name.c_str());
+
+    dst->append("# TYPE " PREFIX);
+    dst->append(name);
+    dst->append((gauge)? " gauge\n": " counter\n");
+
+    for (auto dev: devs) {
+      for (auto& m: dev->stats) {
+        if (name != m.name) continue;
+        append_sample(dst, m.name, (gauge)? "": "_total", dev, NULL, m.value);
+      }
+    }
+  }
+
+  /*
+   * ヒストグラム
+   */
+  for (auto& name: hists) {
+    dst->append("# TYPE " PREFIX);
+    dst->append(name);
+    dst->append(" histogram\n");
+
+    for (auto dev: devs) {
+      for (auto& h: dev->hists) {
+        if (name != h.name) continue;
+
+        for (i = 0; i < h.size; i++) {
+          if (isinf(h.le[i])) {
+            strcpy(le, "+Inf");
+          } else {
+            snprintf(le, sizeof(le), "%g", h.le[i]);
+          }
+
+          append_sample(dst, h.name, "_bucket", dev, le, h.cum[i]);
+        }
+
+        append_sample(dst, h.name, "_sum", dev, NULL, h.sum);
+        append_sample(dst, h.name, "_count", dev, NULL, h.count);
+      }
+    }
+  }
+
+  /*
+   * ブリッジ自身の値
+   */
+  dst->append("# TYPE " PREFIX "up gauge\n");
+  for (auto dev: devs) {
+    append_sample(dst, "up", "", dev, NULL, (dev->up)? 1.0: 0.0);
+  }
+
+  dst->append("# TYPE " PREFIX "exporter_records counter\n");
+  for (auto dev: devs) {
+    append_sample(dst, "exporter_records", "_total", dev, NULL, dev->records);
+  }
+
+  dst->append("# TYPE " PREFIX "exporter_broken_records counter\n");
+  for (auto dev: devs) {
+    append_sample(dst,
+                  "exporter_broken_records",
+                  "_total",
+                  dev,
+                  NULL,
+                  dev->broken);
+  }
+
+  dst->append("# TYPE " PREFIX "exporter_last_record_seconds gauge\n");
+  dst->append("# UNIT " PREFIX "exporter_last_record_seconds seconds\n");
+  for (auto dev: devs) {
+    append_sample(dst,
+                  "exporter_last_record_seconds",
+                  "",
+                  dev,
+                  NULL,
+                  dev->lastSeen);
+  }
+
+  for (auto dev: devs) dev->lock.unlock();
+
+  dst->append("# EOF\n");
+}
@@ -0,0 +1,258 @@
+/*
+ * Example consumer of the shared-memory live feed
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+
+#include "feed.h"
+
+//! デフォルトの共有メモリの名前の接頭辞
+#define DEFAULT_PREFIX    "/m5socket"
+
+//! 新しいレコードが無い場合の待ち時間(ミリ秒)
+#define POLL_INTERVAL     (20)
+
+//! 接続し直すまでの待ち時間(ミリ秒)
+#define REATTACH_WAIT     (1000)
+
+//! 書き込み側が停止したとみなす生存通知の途絶時間(ミリ秒)
+#define BEAT_TIMEOUT      (5000)
+
+//! 一回に読み出す最大のレコード数
+#define READ_BATCH        (256)
+
+//! 停止要求フラグ
+static volatile sig_atomic_t stop = 0;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 使用方法の表示
+ */
+static void
+usage()
+{
+  fprintf(stderr,
+          "usage: feedcat [options] DEVICE|NAME\n"
+          "\n"
+          "options:\n"
+          "  -o          start from the oldest record in the ring\n"
+          "  -n PREFIX   shared memory name prefix (default %s)\n"
+          "  -r          append the host receive latency column (ms)\n"
+          "  -s SEC      report status to stderr every SEC seconds\n",
+          DEFAULT_PREFIX);
+}
+
+/**
+ * SIGINT, SIGTERMのハンドラ
+ */
+static void
+on_signal(int sig)
+{
+  stop = 1;
+}
+
+/**
+ * 現在時刻の取得(UNIX時間, ナノ秒)
+ */
+static int64_t
+now_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * 状態の表示
+ *
+ * @param [in] r    読み出し側の状態
+ * @param [in] got  読み出したレコード数
+ */
+static void
+report(const feed_reader_t* r, uint64_t got)
+{
+  const feed_header_t* hdr;
+
+  hdr = r->hdr;
+
+  fprintf(stderr,
+          "#feed source=%s alive=%u up=%u beat_age_ms=%lld head=%llu"
+          " cursor=%llu got=%llu lost=%llu broken=%llu\n",
+          hdr->source,
+          hdr->alive.load(),
+          hdr->up.load(),
+          (long long)(now_ns() / 1000000 - hdr->beat.load()),
+          (unsigned long long)hdr->head.load(),
+          (unsigned long long)r->cursor,
+          (unsigned long long)got,
+          (unsigned long long)r->lost,
+          (unsigned long long)hdr->broken.load());
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+main(int argc, char* argv[])
+{
+  int opt;
+  int from;
+  int interval;
+  bool latency;
+  const char* prefix;
+  char name[FEED_NAME_SIZE];
+  feed_reader_t r;
+  feed_record_t buf[READ_BATCH];
+  struct sigaction sa;
+  uint64_t got;
+  int64_t last;
+  int64_t now;
+  bool attached;
+  int n;
+  int i;
+
+  /*
+   * parse options
+   */
+  from     = FEED_FROM_NOW;
+  interval = 0;
+  latency  = false;
+  prefix   = DEFAULT_PREFIX;
+
+  while ((opt = getopt(argc, argv, "on:rs:h")) != -1) {
+    switch (opt) {
+    case 'o':
+      from = FEED_FROM_OLDEST;
+      break;
+
+    case 'n':
+      prefix = optarg;
+      break;
+
+    case 'r':
+      latency = true;
+      break;
+
+    case 's':
+      interval = atoi(optarg);
+      break;
+
+    default:
+      usage();
+      return (opt == 'h')? 0: 1;
+    }
+  }
+
+  if (optind != argc - 1) {
+    usage();
+    return 1;
+  }
+
+  /*
+   * setup
+   *   "/"で始まり"/dev/"で始まらない引数は共有メモリの名前として扱う。
+   */
+  if (argv[optind][0] == '/' && strncmp(argv[optind], "/dev/", 5) != 0) {
+    snprintf(name, sizeof(name), "%s", argv[optind]);
+  } else {
+    feed_make_name(prefix, argv[optind], name);
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  /*
+   * run
+   *   共有メモリが無い場合や作り直された場合は接続し直す。作り直しの後は
+   *   残っているレコードを全て読む(feeddの再起動の間の取りこぼしを防ぐ)。
+   */
+  attached = false;
+  got      = 0;
+  last     = now_ns();
+
+  while (!stop) {
+    if (!attached) {
+      if (feed_attach(&r, name, from)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(REATTACH_WAIT));
+        continue;
+      }
+
+      attached = true;
+      from     = FEED_FROM_OLDEST;
+      fprintf(stderr, "attached %s (source=%s)\n", name, r.hdr->source);
+    }
+
+    n = feed_read(&r, buf, READ_BATCH);
+
+    if (n == FEED_STALE) {
+      fprintf(stderr, "%s was recreated, reattaching\n", name);
+      feed_detach(&r);
+      attached = false;
+      continue;
+    }
+
+    for (i = 0; i < n; i++) {
+      if (latency) {
+        printf("%lld,%f,%f,%f,%.3f\n",
+               (long long)buf[i].ts,
+               buf[i].voltage,
+               buf[i].current,
+               buf[i].wattage,
+               (now_ns() - buf[i].rx) / 1e6);
+      } else {
+        printf("%lld,%f,%f,%f\n",
+               (long long)buf[i].ts,
+               buf[i].voltage,
+               buf[i].current,
+               buf[i].wattage);
+      }
+    }
+
+    got += n;
+
+    if (n < READ_BATCH) {
+      fflush(stdout);
+      std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL));
+    }
+
+    now = now_ns();
+
+    if (interval > 0 && now - last >= interval * 1000000000LL) {
+      report(&r, got);
+
+      if (r.hdr->alive.load() &&
+          now / 1000000 - r.hdr->beat.load() > BEAT_TIMEOUT) {
+        fprintf(stderr, "warning: feedd for %s is not responding\n", name);
+      }
+
+      last = now;
+    }
+  }
+
+  /*
+   * post process
+   */
+  if (attached) {
+    report(&r, got);
+    feed_detach(&r);
+  }
+
+  return 0;
+}
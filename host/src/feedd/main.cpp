@@ -0,0 +1,498 @@
+/*
+ * Shared-memory live feed publisher for recorder serial streams
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "reclog.h"
+#include "feed.h"
+
+//! デフォルトの通信速度
+#define DEFAULT_BAUD      (115200)
+
+//! デフォルトのスロット数
+#define DEFAULT_CAPACITY  (65536)
+
+//! デフォルトの共有メモリの名前の接頭辞
+#define DEFAULT_PREFIX    "/m5socket"
+
+//! デバイスを開き直すまでの待ち時間(ミリ秒)
+#define REOPEN_WAIT       (1000)
+
+//! 生存通知の周期(ミリ秒)
+#define BEAT_INTERVAL     (1000)
+
+//! 受信バッファのサイズ
+#define RX_BUFF_SIZE      (4096)
+
+//! ベンチマークのレコード数
+#define BENCH_COUNT       (20000000)
+
+//! ベンチマークの読み出し単位
+#define BENCH_BATCH       (256)
+
+//! 経過時間計測用の時計
+typedef std::chrono::steady_clock clock_type;
+
+//! デバイス毎の状態
+typedef struct {
+  //! デバイスファイルのパス
+  const char* path;
+
+  //! 共有メモリの名前
+  char name[FEED_NAME_SIZE];
+
+  //! 書き込み側の状態
+  feed_writer_t writer;
+} device_t;
+
+//! 停止要求フラグ
+static volatile sig_atomic_t stop = 0;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 使用方法の表示
+ */
+static void
+usage()
+{
+  fprintf(stderr,
+          "usage: feedd [options] DEVICE...\n"
+          "       feedd -B [READERS]\n"
+          "\n"
+          "options:\n"
+          "  -b BAUD     serial baud rate (default %d)\n"
+          "  -c SLOTS    ring capacity in records, power of 2 (default %d)\n"
+          "  -n PREFIX   shared memory name prefix (default %s)\n"
+          "  -u          unlink the shared memory on exit\n"
+          "  -B          measure the publish rate with READERS consumers\n",
+          DEFAULT_BAUD,
+          DEFAULT_CAPACITY,
+          DEFAULT_PREFIX);
+}
+
+/**
+ * SIGINT, SIGTERMのハンドラ
+ */
+static void
+on_signal(int sig)
+{
+  stop = 1;
+}
+
+/**
+ * 現在時刻の取得(UNIX時間, ナノ秒)
+ */
+static int64_t
+now_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * 通信速度の定数への変換
+ */
+static speed_t
+to_speed(int baud)
+{
+  switch (baud) {
+  case 9600:    return B9600;
+  case 19200:   return B19200;
+  case 38400:   return B38400;
+  case 57600:   return B57600;
+  case 115200:  return B115200;
+  case 230400:  return B230400;
+  case 460800:  return B460800;
+  case 921600:  return B921600;
+  default:      return B0;
+  }
+}
+
+/**
+ * シリアルデバイスのオープン
+ *
+ * @param [in] path  デバイスファイルのパス
+ * @param [in] baud  通信速度
+ *
+ * @return
+ *  ファイルディスクリプタを返す。失敗した場合は-1を返す。
+ */
+static int
+open_serial(const char* path, speed_t baud)
+{
+  int fd;
+  struct termios tio;
+
+  fd = open(path, O_RDONLY | O_NOCTTY);
+  if (fd < 0) return -1;
+
+  // ptyではtcsetattr()の一部が失敗するが、読み出しには支障がない
+  if (tcgetattr(fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, baud);
+    cfsetospeed(&tio, baud);
+
+    tio.c_cc[VMIN]  = 1;
+    tio.c_cc[VTIME] = 0;
+
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+
+  return fd;
+}
+
+/**
+ * デバイス毎の受信スレッド
+ *
+ * @param [in] dev   デバイスの状態
+ * @param [in] baud  通信速度
+ *
+ * @remark
+ *  行単位に組み立ててデータ行のみを解析し、共有メモリに書き込む。共有メモリ
+ *  の書き込み側はこのスレッドのみとなる。デバイスが抜かれた場合は開き直しを
+ *  繰り返す。
+ */
+static void
+reader_thread(device_t* dev, speed_t baud)
+{
+  char buf[RX_BUFF_SIZE];
+  char line[RX_BUFF_SIZE];
+  size_t used;
+  bool overflow;
+  ssize_t n;
+  ssize_t i;
+  int fd;
+  reclog_row_t row;
+  feed_record_t rec;
+  feed_header_t* hdr;
+
+  hdr = dev->writer.hdr;
+
+  while (true) {
+    fd = open_serial(dev->path, baud);
+
+    if (fd < 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(REOPEN_WAIT));
+      continue;
+    }
+
+    hdr->up.store(1, std::memory_order_relaxed);
+
+    used     = 0;
+    overflow = false;
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+      for (i = 0; i < n; i++) {
+        if (buf[i] != '\n') {
+          if (used < sizeof(line)) {
+            line[used++] = buf[i];
+          } else {
+            overflow = true;
+          }
+          continue;
+        }
+
+        // テレメトリ行(#stat等)とイベント行は先頭の一文字で捨てられる
+        if (!overflow && used > 0) {
+          switch (reclog_parse_row(line, line + used, &row)) {
+          case RECLOG_ROW:
+            rec.ts      = row.ts;
+            rec.voltage = row.voltage;
+            rec.current = row.current;
+            rec.wattage = row.wattage;
+            rec.rx      = now_ns();
+
+            feed_publish(&dev->writer, &rec);
+            break;
+
+          case RECLOG_BROKEN:
+            hdr->broken.fetch_add(1, std::memory_order_relaxed);
+            break;
+
+          default:
+            break;
+          }
+        }
+
+        used     = 0;
+        overflow = false;
+      }
+    }
+
+    close(fd);
+
+    hdr->up.store(0, std::memory_order_relaxed);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(REOPEN_WAIT));
+  }
+}
+
+/**
+ * 書き込み・読み出しのベンチマーク
+ *
+ * @param [in] readers   読み出し側のスレッド数
+ * @param [in] capacity  スロット数
+ *
+ * @remark
+ *  一時的な共有メモリを作成し、書き込み側が全速で書き込む間に各読み出し側が
+ *  全速で読み出す。書き込みのレート、一件当たりの時間、読み出し側毎の読み出
+ *  し件数と欠落件数を表示する。読み出し側が何台あっても書き込み側のレートが
+ *  変わらないこと(待たされないこと)を確認できる。
+ */
+static int
+bench(int readers, uint32_t capacity)
+{
+  char name[FEED_NAME_SIZE];
+  feed_writer_t writer;
+  feed_record_t rec;
+  std::vector<std::thread> threads;
+  std::vector<uint64_t> got(readers);
+  std::vector<uint64_t> lost(readers);
+  std::vector<int> broken(readers);
+  std::atomic<bool> done;
+  std::atomic<int> ready;
+  clock_type::time_point t0;
+  double sec;
+  int i;
+
+  snprintf(name, sizeof(name), "%s-bench-%d", DEFAULT_PREFIX, (int)getpid());
+
+  if (feed_create(&writer, name, "bench", capacity)) {
+    fprintf(stderr, "error: cannot create %s (%s)\n", name, strerror(errno));
+    return 1;
+  }
+
+  done  = false;
+  ready = 0;
+
+  for (i = 0; i < readers; i++) {
+    threads.emplace_back([&, i]() {
+      feed_reader_t r;
+      feed_record_t buf[BENCH_BATCH];
+      int64_t prev;
+      int n;
+      int j;
+
+      if (feed_attach(&r, name, FEED_FROM_NOW)) {
+        broken[i] = 1;
+        ready++;
+        return;
+      }
+
+      ready++;
+      prev = -1;
+
+      while (true) {
+        n = feed_read(&r, buf, BENCH_BATCH);
+        if (n < 0) {
+          broken[i] = 1;
+          break;
+        }
+
+        // 順序(欠落分を除いて増加していること)と、書き込み途中のスロット
+        // を読んでいないこと(フィールド間の整合)を確認
+        for (j = 0; j < n; j++) {
+          if (buf[j].ts <= prev) broken[i] = 1;
+          if (buf[j].wattage != buf[j].ts * 0.001) broken[i] = 1;
+          prev = buf[j].ts;
+        }
+
+        got[i] += n;
+
+        if (n == 0 && done) {
+          if (r.cursor == r.hdr->head.load()) break;
+        }
+      }
+
+      lost[i] = r.lost;
+      feed_detach(&r);
+    });
+  }
+
+  while (ready < readers) std::this_thread::yield();
+
+  memset(&rec, 0, sizeof(rec));
+  t0 = clock_type::now();
+
+  for (i = 0; i < BENCH_COUNT; i++) {
+    rec.ts      = i;
+    rec.wattage = i * 0.001;
+    feed_publish(&writer, &rec);
+  }
+
+  sec  = std::chrono::duration<double>(clock_type::now() - t0).count();
+  done = true;
+
+  for (auto& t: threads) t.join();
+
+  printf("records=%d readers=%d capacity=%u\n",
+         BENCH_COUNT, readers, capacity);
+  printf("publish_rate=%.0f ns_per_record=%.1f\n",
+         BENCH_COUNT / sec, (sec * 1e9) / BENCH_COUNT);
+
+  for (i = 0; i < readers; i++) {
+    printf("reader%d got=%llu lost=%llu check=%s\n",
+           i,
+           (unsigned long long)got[i],
+           (unsigned long long)lost[i],
+           (broken[i] || got[i] + lost[i] != BENCH_COUNT)? "NG": "ok");
+  }
+
+  feed_close(&writer);
+  shm_unlink(name);
+
+  return 0;
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+main(int argc, char* argv[])
+{
+  int opt;
+  int baud;
+  uint32_t capacity;
+  const char* prefix;
+  bool unlinkOnExit;
+  bool benchmark;
+  std::vector<device_t*> devs;
+  struct sigaction sa;
+  int64_t beat;
+  int i;
+
+  /*
+   * parse options
+   */
+  baud      = DEFAULT_BAUD;
+  capacity  = DEFAULT_CAPACITY;
+  prefix    = DEFAULT_PREFIX;
+  unlinkOnExit = false;
+  benchmark = false;
+
+  while ((opt = getopt(argc, argv, "b:c:n:uBh")) != -1) {
+    switch (opt) {
+    case 'b':
+      baud = atoi(optarg);
+      break;
+
+    case 'c':
+      capacity = strtoul(optarg, NULL, 0);
+      break;
+
+    case 'n':
+      prefix = optarg;
+      break;
+
+    case 'u':
+      unlinkOnExit = true;
+      break;
+
+    case 'B':
+      benchmark = true;
+      break;
+
+    default:
+      usage();
+      return (opt == 'h')? 0: 1;
+    }
+  }
+
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+    usage();
+    return 1;
+  }
+
+  if (benchmark) {
+    return bench((optind < argc)? atoi(argv[optind]): 2, capacity);
+  }
+
+  if (optind >= argc || to_speed(baud) == B0 || prefix[0] != '/') {
+    usage();
+    return 1;
+  }
+
+  /*
+   * setup
+   */
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  for (i = optind; i < argc; i++) {
+    device_t* dev = new device_t();
+
+    dev->path = argv[i];
+    feed_make_name(prefix, argv[i], dev->name);
+
+    if (feed_create(&dev->writer, dev->name, dev->path, capacity)) {
+      fprintf(stderr, "error: cannot create %s (%s)\n",
+              dev->name, strerror(errno));
+      return 1;
+    }
+
+    fprintf(stderr, "%s -> %s (head=%llu)\n",
+            dev->path,
+            dev->name,
+            (unsigned long long)dev->writer.next);
+
+    devs.push_back(dev);
+  }
+
+  /*
+   * run
+   *   受信スレッドは停止要求時に切り離したまま終了させる(共有メモリは切り
+   *   離し後もマップされたままなので、書き込みが残っていても問題は無い)。
+   */
+  for (auto dev: devs) {
+    std::thread(reader_thread, dev, to_speed(baud)).detach();
+  }
+
+  while (!stop) {
+    beat = now_ns() / 1000000;
+
+    for (auto dev: devs) {
+      dev->writer.hdr->beat.store(beat, std::memory_order_relaxed);
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(BEAT_INTERVAL));
+  }
+
+  /*
+   * post process
+   *   停止を通知するのみでアンマップはしない(受信スレッドが書き込み中の可能
+   *   性があるため、プロセスの終了時に解放させる)。
+   */
+  for (auto dev: devs) {
+    dev->writer.hdr->up.store(0, std::memory_order_relaxed);
+    dev->writer.hdr->alive.store(0, std::memory_order_release);
+
+    if (unlinkOnExit) shm_unlink(dev->name);
+  }
+
+  return 0;
+}
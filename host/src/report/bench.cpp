@@ -0,0 +1,217 @@
+/*
+ * Energy report engine for recorder logs
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <chrono>
+
+#include <reclog.h>
+#include <workers.h>
+
+#include "report.h"
+
+//! 積分ベンチマークの繰り返し回数
+#define ITERATIONS      (5)
+
+//! 並列処理の分割単位(サンプル数)
+#define BLOCK_SIZE      (64 * 1024)
+
+//! 経過時間計測用の時計
+typedef std::chrono::steady_clock clock_type;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 経過時間の取得
+ *
+ * @param [in] t0  計測開始時刻
+ *
+ * @return
+ *  t0からの経過時間を秒単位で返す。
+ */
+static double
+elapsed(clock_type::time_point t0)
+{
+  return std::chrono::duration<double>(clock_type::now() - t0).count();
+}
+
+/**
+ * 合成データの生成
+ *
+ * @param [in] n     サンプル数
+ * @param [out] dt   サンプル間隔の書き込み先
+ * @param [out] w    消費電力の書き込み先
+ * @param [out] csv  CSVテキストの書き込み先
+ *
+ * @remark
+ *  10Hzで記録された、周期的にオン・オフを繰り返す負荷を模擬する。
+ */
+static void
+synthesize(size_t n,
+           std::vector<int32_t>* dt,
+           std::vector<float>* w,
+           std::string* csv)
+{
+  size_t i;
+  uint64_t ts;
+  uint32_t seed;
+  char line[80];
+
+  dt->resize(n);
+  w->resize(n + 1);
+  csv->reserve(n * 40);
+
+  ts   = 0;
+  seed = 1;
+
+  for (i = 0; i <= n; i++) {
+    seed    = seed * 1103515245 + 12345;
+    (*w)[i] = ((i / 3000) % 2)? 1.2f: 600.0f + (seed >> 24);
+
+    if (i < n) (*dt)[i] = 98 + (int32_t)((seed >> 16) % 5);
+
+    snprintf(line,
+             sizeof(line),
+             "%llu,%f,%f,%f\n",
+             (unsigned long long)ts,
+             100.0 + (seed >> 28),
+             (*w)[i] / 100.0,
+             (*w)[i]);
+    csv->append(line);
+
+    if (i < n) ts += (*dt)[i];
+  }
+}
+
+/**
+ * 積分処理のベンチマーク
+ */
+static void
+bench_integrate(const std::vector<int32_t>& dt,
+                const std::vector<float>& w,
+                int nw)
+{
+  report_param_t param;
+  std::vector<integral_t> results;
+  size_t n;
+  size_t blocks;
+  clock_type::time_point t0;
+  double sec;
+  double rate;
+  int i;
+
+  param.threshold = 5.0f;
+  param.gap       = 10000;
+
+  n      = dt.size();
+  blocks = (n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  results.resize(blocks);
+
+  workers_set_count(nw);
+
+  t0 = clock_type::now();
+
+  for (i = 0; i < ITERATIONS; i++) {
+    memset(results.data(), 0, sizeof(integral_t) * blocks);
+
+    workers_for(blocks, [&](size_t j, int id) {
+      size_t begin = j * BLOCK_SIZE;
+      size_t end   = (begin + BLOCK_SIZE < n)? begin + BLOCK_SIZE: n;
+
+      report_integrate(dt.data() + begin,
+                       w.data() + begin,
+                       end - begin,
+                       &param,
+                       &results[j]);
+    });
+  }
+
+  sec  = elapsed(t0) / ITERATIONS;
+  rate = n / sec;
+
+  printf("integrate,%d,%.0f,%.0f\n", nw, rate, rate / nw);
+}
+
+/**
+ * 解析処理のベンチマーク
+ */
+static void
+bench_parse(const std::string& csv, size_t samples, int nw)
+{
+  std::vector<const char*> cuts;
+  std::vector<uint64_t> counts;
+  size_t n;
+  clock_type::time_point t0;
+  double sec;
+  double rate;
+
+  n = csv.size() / (4 * 1024 * 1024) + 1;
+  cuts.resize(n + 1);
+  counts.resize(n);
+
+  workers_set_count(nw);
+
+  t0 = clock_type::now();
+
+  reclog_split(csv.data(), csv.size(), (int)n, cuts.data());
+
+  workers_for(n, [&](size_t j, int id) {
+    const char* p;
+    const char* eol;
+    reclog_row_t row;
+    uint64_t cnt = 0;
+
+    for (p = cuts[j]; p < cuts[j + 1]; p = eol + 1) {
+      eol = (const char*)memchr(p, '\n', cuts[j + 1] - p);
+      if (eol == NULL) break;
+
+      if (reclog_parse_row(p, eol, &row) == RECLOG_ROW) cnt++;
+    }
+
+    counts[j] = cnt;
+  });
+
+  sec  = elapsed(t0);
+  rate = samples / sec;
+
+  printf("parse,%d,%.0f,%.0f\n", nw, rate, rate / nw);
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+report_bench(size_t samples)
+{
+  std::vector<int32_t> dt;
+  std::vector<float> w;
+  std::string csv;
+  int ncpu;
+  int nw;
+
+  ncpu = workers_count();
+
+  fprintf(stderr, "synthesizing %zu samples...\n", samples);
+  synthesize(samples, &dt, &w, &csv);
+
+  printf("phase,threads,samples_per_sec,samples_per_sec_per_core\n");
+
+  for (nw = 1; ; nw *= 2) {
+    if (nw > ncpu) nw = ncpu;
+
+    bench_parse(csv, samples + 1, nw);
+    bench_integrate(dt, w, nw);
+
+    if (nw == ncpu) break;
+  }
+
+  return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * Energy report engine for recorder logs
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <string.h>
+
+#include "report.h"
+
+//! ベクタのレーン数
+#define LANES           (8)
+
+//! float側の積算値をdoubleに払い出す周期(ベクタ単位)
+#define FLUSH_INTERVAL  (256)
+
+//! float x LANES のベクタ型
+typedef float vfloat_t __attribute__((vector_size(LANES * sizeof(float))));
+
+//! int32 x LANES のベクタ型
+typedef int32_t vint_t __attribute__((vector_size(LANES * sizeof(int32_t))));
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * マスクによる要素選択
+ *
+ * @param [in] v     選択対象のベクタ
+ * @param [in] mask  マスク(比較結果)
+ *
+ * @return
+ *  マスクが真のレーンはvの値を、偽のレーンは0を返す。
+ */
+static inline vfloat_t
+select(vfloat_t v, vint_t mask)
+{
+  return (vfloat_t)((vint_t)v & mask);
+}
+
+/**
+ * レーン毎の積算値の払い出し
+ *
+ * @param [in,out] acc  レーン毎の積算値(払い出し後に0クリアされる)
+ *
+ * @return
+ *  全レーンの合計値を返す。
+ */
+static inline double
+drain(vfloat_t* acc)
+{
+  double sum;
+  int i;
+
+  sum = 0.0;
+  for (i = 0; i < LANES; i++) sum += (*acc)[i];
+
+  memset(acc, 0, sizeof(*acc));
+
+  return sum;
+}
+
+/**
+ * 一区間分の積分(スカラー版)
+ *
+ * @param [in] dt     サンプル間隔(ms)
+ * @param [in] w0     区間始点の消費電力(W)
+ * @param [in] w1     区間終点の消費電力(W)
+ * @param [in] param  集計パラメータ
+ * @param [out] dst   積分結果の書き込み先(加算される)
+ */
+static inline void
+integrate_one(int32_t dt,
+              float w0,
+              float w1,
+              const report_param_t* param,
+              integral_t* dst)
+{
+  float mid;
+
+  if (dt <= 0 || dt > param->gap) return;
+
+  mid = (w0 + w1) * 0.5f;
+
+  dst->energy  += mid * dt;
+  dst->covered += dt;
+
+  if (mid >= param->threshold) {
+    dst->on_time += dt;
+  } else {
+    dst->standby += mid * dt;
+  }
+}
+
+/*
+ * 公開関数の定義
+ */
+
+void
+report_integrate(const int32_t* dt,
+                 const float* w,
+                 size_t n,
+                 const report_param_t* param,
+                 integral_t* dst)
+{
+  vfloat_t acc_energy  = {0};
+  vfloat_t acc_standby = {0};
+  vfloat_t acc_on      = {0};
+  vfloat_t acc_covered = {0};
+  vfloat_t thr;
+  vint_t gap;
+  vint_t zero = {0};
+  vint_t d;
+  vint_t ok;
+  vint_t on;
+  vfloat_t w0;
+  vfloat_t w1;
+  vfloat_t df;
+  vfloat_t mid;
+  vfloat_t e;
+  size_t i;
+  int k;
+
+  for (i = 0; i < LANES; i++) {
+    thr[i] = param->threshold;
+    gap[i] = param->gap;
+  }
+
+  /*
+   * ベクタ処理
+   *   非アライン領域からの読み込みはmemcpy()で行う(コンパイラが単一のロード
+   *   命令に置き換える)。
+   */
+  k = 0;
+
+  for (i = 0; i + LANES <= n; i += LANES) {
+    memcpy(&d, dt + i, sizeof(d));
+    memcpy(&w0, w + i, sizeof(w0));
+    memcpy(&w1, w + i + 1, sizeof(w1));
+
+    ok  = (d > zero) & (d <= gap);
+    df  = __builtin_convertvector(d, vfloat_t);
+    mid = (w0 + w1) * 0.5f;
+    e   = mid * df;
+    on  = ok & (mid >= thr);
+
+    acc_energy  += select(e, ok);
+    acc_covered += select(df, ok);
+    acc_on      += select(df, on);
+    acc_standby += select(e, ok & ~on);
+
+    // floatでの積算による桁落ちを避けるため、定期的にdoubleへ払い出す
+    if (++k == FLUSH_INTERVAL) {
+      dst->energy  += drain(&acc_energy);
+      dst->covered += drain(&acc_covered);
+      dst->on_time += drain(&acc_on);
+      dst->standby += drain(&acc_standby);
+      k = 0;
+    }
+  }
+
+  dst->energy  += drain(&acc_energy);
+  dst->covered += drain(&acc_covered);
+  dst->on_time += drain(&acc_on);
+  dst->standby += drain(&acc_standby);
+
+  /*
+   * 端数の処理
+   */
+  for (; i < n; i++) integrate_one(dt[i], w[i], w[i + 1], param, dst);
+}
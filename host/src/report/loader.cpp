@@ -0,0 +1,196 @@
+/*
+ * Energy report engine for recorder logs
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include <reclog.h>
+#include <workers.h>
+
+#include "report.h"
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+//! 並列解析時のチャンクサイズの目安(バイト)
+#define CHUNK_SIZE      (8 * 1024 * 1024)
+
+//! チャンク単位の解析結果
+typedef struct {
+  std::vector<int64_t> ts;
+  std::vector<float> wattage;
+  uint64_t skipped;
+  uint64_t broken;
+} chunk_t;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * ソケット名の取得
+ *
+ * @param [in] path  ログファイルへのパス
+ *
+ * @return
+ *  パスからディレクトリ部分と拡張子を除いた文字列を返す。
+ */
+static std::string
+socket_name(const char* path)
+{
+  const char* p;
+  const char* q;
+
+  p = strrchr(path, '/');
+  p = (p != NULL)? p + 1: path;
+  q = strrchr(p, '.');
+
+  return (q != NULL)? std::string(p, q - p): std::string(p);
+}
+
+/**
+ * チャンクの解析
+ *
+ * @param [in] head  チャンクの先頭
+ * @param [in] tail  チャンクの終端
+ * @param [out] dst  解析結果の書き込み先
+ */
+static void
+parse_chunk(const char* head, const char* tail, chunk_t* dst)
+{
+  const char* p;
+  const char* eol;
+  reclog_row_t row;
+
+  dst->skipped = 0;
+  dst->broken  = 0;
+
+  // 一行あたり40バイト程度を見込んで予約しておく
+  dst->ts.reserve((tail - head) / 40);
+  dst->wattage.reserve((tail - head) / 40);
+
+  for (p = head; p < tail; p = eol + 1) {
+    eol = (const char*)memchr(p, '\n', tail - p);
+
+    // 改行で終わっていない最終行は書き込み途中とみなして捨てる
+    if (eol == NULL) {
+      dst->broken++;
+      break;
+    }
+
+    switch (reclog_parse_row(p, eol, &row)) {
+    case RECLOG_ROW:
+      if (isfinite(row.wattage)) {
+        dst->ts.push_back(row.ts);
+        dst->wattage.push_back((float)row.wattage);
+      } else {
+        dst->skipped++;
+      }
+      break;
+
+    case RECLOG_SKIP:
+      dst->skipped++;
+      break;
+
+    default:
+      dst->broken++;
+      break;
+    }
+  }
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+report_load(const char* path, series_t* dst)
+{
+  int ret;
+  int err;
+  reclog_map_t map;
+  std::vector<const char*> cuts;
+  std::vector<chunk_t> chunks;
+  int64_t start;
+  int64_t offset;
+  size_t total;
+  size_t n;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  dst->name    = socket_name(path);
+  dst->start   = -1;
+  dst->skipped = 0;
+  dst->broken  = 0;
+  dst->ts.clear();
+  dst->wattage.clear();
+
+  /*
+   * map file
+   */
+  err = reclog_open(&map, path);
+  if (err) ret = DEFAULT_ERROR;
+
+  /*
+   * parse chunks
+   */
+  if (!ret) {
+    n = map.size / CHUNK_SIZE + 1;
+
+    cuts.resize(n + 1);
+    chunks.resize(n);
+
+    reclog_split(map.head, map.size, (int)n, cuts.data());
+
+    workers_for(n, [&](size_t i, int id) {
+      parse_chunk(cuts[i], cuts[i + 1], &chunks[i]);
+    });
+  }
+
+  /*
+   * concatenate chunks
+   */
+  if (!ret) {
+    total = 0;
+    for (auto& c: chunks) total += c.ts.size();
+
+    dst->ts.reserve(total);
+    dst->wattage.reserve(total);
+
+    for (auto& c: chunks) {
+      dst->ts.insert(dst->ts.end(), c.ts.begin(), c.ts.end());
+      dst->wattage.insert(dst->wattage.end(),
+                          c.wattage.begin(),
+                          c.wattage.end());
+      dst->skipped += c.skipped;
+      dst->broken  += c.broken;
+    }
+  }
+
+  /*
+   * convert to absolute time
+   *   センサーのタイムスタンプは電源投入時からの通算時間なので、ファイル名
+   *   から記録開始時刻が分かる場合は先頭行を記録開始時刻として換算する。
+   */
+  if (!ret) {
+    if (!reclog_parse_start_time(path, &start) && !dst->ts.empty()) {
+      dst->start = start * 1000;
+      offset     = dst->start - dst->ts[0];
+
+      for (auto& t: dst->ts) t += offset;
+    }
+  }
+
+  /*
+   * post process
+   */
+  if (map.fd >= 0) reclog_close(&map);
+
+  return ret;
+}
@@ -0,0 +1,509 @@
+/*
+ * Energy report engine for recorder logs
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <map>
+
+#include <workers.h>
+
+#include "report.h"
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+//! 稼働/待機判定閾値のデフォルト値(W)
+#define DEFAULT_THRESHOLD   (5.0f)
+
+//! 欠測とみなすサンプル間隔のデフォルト値(ms)
+#define DEFAULT_GAP         (10000)
+
+//! ベンチマークのデフォルトのサンプル数
+#define DEFAULT_BENCH_SIZE  (20000000)
+
+//! 積分処理の単位(同一デマンド窓に属する連続区間)
+typedef struct {
+  //! 対象の系列の番号
+  size_t series;
+
+  //! デマンド窓の番号
+  int64_t window;
+
+  //! 区間の開始位置
+  size_t begin;
+
+  //! 区間の終了位置(この位置は含まない)
+  size_t end;
+
+  //! 積分結果
+  integral_t result;
+} run_t;
+
+//! 系列毎の集計結果(デマンド窓番号をキーとする)
+typedef std::map<int64_t, integral_t> windows_t;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 使用方法の表示
+ */
+static void
+usage()
+{
+  fprintf(stderr,
+          "usage: report [options] FILE...\n"
+          "       report -B [SAMPLES]\n"
+          "\n"
+          "options:\n"
+          "  -t WATT     threshold for on/standby (default %.1f)\n"
+          "  -g MSEC     sample interval treated as a gap (default %d)\n"
+          "  -j JOBS     number of worker threads (default: all cores)\n"
+          "  -o PREFIX   write PREFIXdaily.csv and PREFIXsummary.csv\n"
+          "  -B          run benchmark on synthetic data\n",
+          DEFAULT_THRESHOLD,
+          DEFAULT_GAP);
+}
+
+/**
+ * 切り捨て方向の整数除算
+ */
+static inline int64_t
+floor_div(int64_t a, int64_t b)
+{
+  return (a >= 0)? a / b: -((-a + b - 1) / b);
+}
+
+/**
+ * 日付ラベルの生成
+ *
+ * @param [in] s    対象の系列
+ * @param [in] day  日番号
+ * @param [out] dst 書き込み先
+ * @param [in] n    書き込み先のサイズ
+ */
+static void
+format_day(const series_t* s, int64_t day, char* dst, size_t n)
+{
+  time_t t;
+  struct tm tm;
+
+  if (s->start >= 0) {
+    t = (time_t)(day * (DAY_LENGTH / 1000));
+    gmtime_r(&t, &tm);
+    strftime(dst, n, "%Y-%m-%d", &tm);
+
+  } else {
+    // 絶対時刻が分からない場合はセンサー起動からの日数で表す
+    snprintf(dst, n, "+%lldd", (long long)day);
+  }
+}
+
+/**
+ * 時刻ラベルの生成
+ *
+ * @param [in] s    対象の系列
+ * @param [in] ms   時刻(ミリ秒)
+ * @param [out] dst 書き込み先
+ * @param [in] n    書き込み先のサイズ
+ */
+static void
+format_time(const series_t* s, int64_t ms, char* dst, size_t n)
+{
+  time_t t;
+  struct tm tm;
+
+  t = (time_t)floor_div(ms, 1000);
+  gmtime_r(&t, &tm);
+
+  if (s->start >= 0) {
+    strftime(dst, n, "%Y-%m-%d %H:%M", &tm);
+  } else {
+    snprintf(dst,
+             n,
+             "+%lldd %02d:%02d",
+             (long long)floor_div(ms, DAY_LENGTH),
+             tm.tm_hour,
+             tm.tm_min);
+  }
+}
+
+/**
+ * 積分単位の切り出し
+ *
+ * @param [in] idx    系列の番号
+ * @param [in] s      対象の系列
+ * @param [out] dt    サンプル間隔の書き込み先
+ * @param [out] runs  積分単位の書き込み先
+ *
+ * @remark
+ *  区間はその始点のサンプルが属するデマンド窓に計上する(窓境界をまたぐ区間は
+ *  按分しない)。タイムスタンプが逆行した場合(センサーのリセット等)は、その
+ *  区間のdtが負となるので積分カーネル側で除外される。
+ */
+static void
+split_runs(size_t idx,
+           const series_t* s,
+           std::vector<int32_t>* dt,
+           std::vector<run_t>* runs)
+{
+  size_t n;
+  size_t i;
+  int64_t d;
+  int64_t win;
+  run_t run;
+
+  n = s->ts.size();
+  if (n < 2) return;
+
+  dt->resize(n - 1);
+
+  for (i = 0; i < n - 1; i++) {
+    d = s->ts[i + 1] - s->ts[i];
+    (*dt)[i] = (d > INT32_MAX)? -1: (int32_t)d;
+  }
+
+  memset(&run, 0, sizeof(run));
+  run.series = idx;
+  run.window = floor_div(s->ts[0], DEMAND_WINDOW);
+  run.begin  = 0;
+
+  for (i = 1; i < n - 1; i++) {
+    win = floor_div(s->ts[i], DEMAND_WINDOW);
+
+    if (win != run.window) {
+      run.end = i;
+      runs->push_back(run);
+
+      run.window = win;
+      run.begin  = i;
+    }
+  }
+
+  run.end = n - 1;
+  runs->push_back(run);
+}
+
+/**
+ * 積算値の加算
+ */
+static inline void
+accumulate(integral_t* dst, const integral_t* src)
+{
+  dst->energy  += src->energy;
+  dst->standby += src->standby;
+  dst->on_time += src->on_time;
+  dst->covered += src->covered;
+}
+
+/**
+ * 日次集計表の出力
+ *
+ * @param [in] fp      出力先
+ * @param [in] series  系列の配列
+ * @param [in] wins    系列毎の集計結果
+ */
+static void
+write_daily(FILE* fp,
+            const std::vector<series_t>& series,
+            const std::vector<windows_t>& wins)
+{
+  size_t i;
+  int64_t day;
+  int64_t d;
+  integral_t sum;
+  double peak;
+  int64_t peak_win;
+  char date[32];
+  char at[32];
+
+  fprintf(fp,
+          "socket,date,energy_kwh,peak_demand_kw,peak_window,"
+          "duty_cycle,standby_kwh,coverage\n");
+
+  for (i = 0; i < series.size(); i++) {
+    auto it = wins[i].begin();
+
+    while (it != wins[i].end()) {
+      day      = floor_div(it->first * DEMAND_WINDOW, DAY_LENGTH);
+      peak     = -1.0;
+      peak_win = it->first;
+      memset(&sum, 0, sizeof(sum));
+
+      for (; it != wins[i].end(); it++) {
+        d = floor_div(it->first * DEMAND_WINDOW, DAY_LENGTH);
+        if (d != day) break;
+
+        accumulate(&sum, &it->second);
+
+        if (it->second.energy > peak) {
+          peak     = it->second.energy;
+          peak_win = it->first;
+        }
+      }
+
+      format_day(&series[i], day, date, sizeof(date));
+      format_time(&series[i], peak_win * DEMAND_WINDOW, at, sizeof(at));
+
+      fprintf(fp,
+              "%s,%s,%.4f,%.4f,%s,%.4f,%.4f,%.4f\n",
+              series[i].name.c_str(),
+              date,
+              sum.energy / WMS_PER_KWH,
+              (peak / DEMAND_WINDOW) / 1000.0,
+              at + ((series[i].start >= 0)? 11: 0),
+              (sum.covered > 0.0)? sum.on_time / sum.covered: 0.0,
+              sum.standby / WMS_PER_KWH,
+              sum.covered / DAY_LENGTH);
+    }
+  }
+}
+
+/**
+ * 総括表の出力
+ *
+ * @param [in] fp      出力先
+ * @param [in] series  系列の配列
+ * @param [in] wins    系列毎の集計結果
+ */
+static void
+write_summary(FILE* fp,
+              const std::vector<series_t>& series,
+              const std::vector<windows_t>& wins)
+{
+  size_t i;
+  integral_t sum;
+  double peak;
+  int64_t peak_win;
+  double standby_time;
+  char at[32];
+
+  fprintf(fp,
+          "socket,days,energy_kwh,peak_demand_kw,peak_at,duty_cycle,"
+          "standby_kwh,standby_w,samples,skipped,broken\n");
+
+  for (i = 0; i < series.size(); i++) {
+    peak     = 0.0;
+    peak_win = 0;
+    memset(&sum, 0, sizeof(sum));
+
+    for (auto& w: wins[i]) {
+      accumulate(&sum, &w.second);
+
+      if (w.second.energy > peak) {
+        peak     = w.second.energy;
+        peak_win = w.first;
+      }
+    }
+
+    standby_time = sum.covered - sum.on_time;
+    format_time(&series[i], peak_win * DEMAND_WINDOW, at, sizeof(at));
+
+    fprintf(fp,
+            "%s,%.3f,%.4f,%.4f,%s,%.4f,%.4f,%.3f,%zu,%llu,%llu\n",
+            series[i].name.c_str(),
+            sum.covered / DAY_LENGTH,
+            sum.energy / WMS_PER_KWH,
+            (peak / DEMAND_WINDOW) / 1000.0,
+            at,
+            (sum.covered > 0.0)? sum.on_time / sum.covered: 0.0,
+            sum.standby / WMS_PER_KWH,
+            (standby_time > 0.0)? sum.standby / standby_time: 0.0,
+            series[i].ts.size(),
+            (unsigned long long)series[i].skipped,
+            (unsigned long long)series[i].broken);
+  }
+}
+
+/**
+ * 集計表の出力
+ *
+ * @param [in] prefix  出力ファイル名のプレフィックス(NULLの場合は標準出力)
+ * @param [in] series  系列の配列
+ * @param [in] wins    系列毎の集計結果
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ */
+static int
+write_tables(const char* prefix,
+             const std::vector<series_t>& series,
+             const std::vector<windows_t>& wins)
+{
+  int ret;
+  std::string path;
+  FILE* fp;
+
+  ret = 0;
+
+  if (prefix == NULL) {
+    write_daily(stdout, series, wins);
+    fputc('\n', stdout);
+    write_summary(stdout, series, wins);
+    return ret;
+  }
+
+  path = std::string(prefix) + "daily.csv";
+  fp   = fopen(path.c_str(), "w");
+  if (fp != NULL) {
+    write_daily(fp, series, wins);
+    fclose(fp);
+  } else {
+    perror(path.c_str());
+    ret = DEFAULT_ERROR;
+  }
+
+  path = std::string(prefix) + "summary.csv";
+  fp   = fopen(path.c_str(), "w");
+  if (fp != NULL) {
+    write_summary(fp, series, wins);
+    fclose(fp);
+  } else {
+    perror(path.c_str());
+    ret = DEFAULT_ERROR;
+  }
+
+  return ret;
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+main(int argc, char* argv[])
+{
+  int ret;
+  int err;
+  int opt;
+  report_param_t param;
+  const char* prefix;
+  bool bench;
+  std::vector<series_t> series;
+  std::vector<std::vector<int32_t>> dts;
+  std::vector<std::vector<run_t>> parts;
+  std::vector<run_t> runs;
+  std::vector<windows_t> wins;
+  int i;
+
+  /*
+   * initialize
+   */
+  ret             = 0;
+  param.threshold = DEFAULT_THRESHOLD;
+  param.gap       = DEFAULT_GAP;
+  prefix          = NULL;
+  bench           = false;
+
+  /*
+   * parse options
+   */
+  while ((opt = getopt(argc, argv, "t:g:j:o:Bh")) != -1) {
+    switch (opt) {
+    case 't':
+      param.threshold = strtof(optarg, NULL);
+      break;
+
+    case 'g':
+      param.gap = atoi(optarg);
+      break;
+
+    case 'j':
+      workers_set_count(atoi(optarg));
+      break;
+
+    case 'o':
+      prefix = optarg;
+      break;
+
+    case 'B':
+      bench = true;
+      break;
+
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  if (bench) {
+    return report_bench((optind < argc)?
+                        strtoull(argv[optind], NULL, 10):
+                        DEFAULT_BENCH_SIZE);
+  }
+
+  if (optind >= argc) {
+    usage();
+    return 1;
+  }
+
+  /*
+   * load files
+   */
+  series.resize(argc - optind);
+
+  for (i = optind; i < argc; i++) {
+    err = report_load(argv[i], &series[i - optind]);
+    if (err) {
+      fprintf(stderr, "%s: load failed\n", argv[i]);
+      ret = DEFAULT_ERROR;
+      break;
+    }
+  }
+
+  /*
+   * split into runs
+   */
+  if (!ret) {
+    dts.resize(series.size());
+    parts.resize(series.size());
+
+    workers_for(series.size(), [&](size_t j, int id) {
+      split_runs(j, &series[j], &dts[j], &parts[j]);
+    });
+
+    for (auto& p: parts) runs.insert(runs.end(), p.begin(), p.end());
+  }
+
+  /*
+   * integrate
+   */
+  if (!ret) {
+    workers_for(runs.size(), [&](size_t j, int id) {
+      run_t* r = &runs[j];
+
+      report_integrate(dts[r->series].data() + r->begin,
+                       series[r->series].wattage.data() + r->begin,
+                       r->end - r->begin,
+                       &param,
+                       &r->result);
+    });
+  }
+
+  /*
+   * merge into windows
+   */
+  if (!ret) {
+    wins.resize(series.size());
+
+    for (auto& r: runs) accumulate(&wins[r.series][r.window], &r.result);
+  }
+
+  /*
+   * output
+   */
+  if (!ret) {
+    err = write_tables(prefix, series, wins);
+    if (err) ret = DEFAULT_ERROR;
+  }
+
+  return (ret)? 1: 0;
+}
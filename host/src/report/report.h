@@ -0,0 +1,117 @@
+/*
+ * Energy report engine for recorder logs
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __REPORT_H__
+#define __REPORT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+//! デマンド集計の窓幅(ミリ秒, 15分)
+#define DEMAND_WINDOW   (15 * 60 * 1000LL)
+
+//! 日次集計の単位(ミリ秒)
+#define DAY_LENGTH      (24 * 60 * 60 * 1000LL)
+
+//! W・ms から kWh への換算係数
+#define WMS_PER_KWH     (3.6e9)
+
+//! 一つのログファイル(ソケット)分のデータ
+typedef struct {
+  //! ソケット名(ファイル名から拡張子を除いたもの)
+  std::string name;
+
+  //! 記録開始時刻(ミリ秒, ファイル名から取得できない場合は-1)
+  int64_t start;
+
+  //! タイムスタンプ(ミリ秒, 記録開始時刻が分かる場合は絶対時刻に変換済み)
+  std::vector<int64_t> ts;
+
+  //! 消費電力(W)
+  std::vector<float> wattage;
+
+  //! 読み飛ばした行数(ヘッダ行、測定値が無効な行)
+  uint64_t skipped;
+
+  //! 書式が不正だった行数
+  uint64_t broken;
+} series_t;
+
+//! 積分結果(区間単位の集計値)
+typedef struct {
+  //! 消費電力量(W・ms)
+  double energy;
+
+  //! 待機電力量(閾値未満の区間の消費電力量, W・ms)
+  double standby;
+
+  //! 稼働時間(閾値以上の区間の合計時間, ms)
+  double on_time;
+
+  //! 有効区間の合計時間(ms)
+  double covered;
+} integral_t;
+
+//! 集計パラメータ
+typedef struct {
+  //! 稼働/待機を判定する消費電力の閾値(W)
+  float threshold;
+
+  //! 欠測とみなすサンプル間隔(ms)
+  int32_t gap;
+} report_param_t;
+
+/**
+ * ログファイルの読み込み
+ *
+ * @param [in] path  ログファイルへのパス
+ * @param [out] dst  読み込み結果の書き込み先
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  ファイルをメモリマップし、行単位に分割したチャンクをワーカーで並列に解析
+ *  する。消費電力が数値でない行(センサー起動直後の"nan"等)は読み飛ばす。
+ */
+int report_load(const char* path, series_t* dst);
+
+/**
+ * 積分カーネル
+ *
+ * @param [in] dt     サンプル間隔の配列(n要素, ms)
+ * @param [in] w      消費電力の配列(n + 1要素, W)
+ * @param [in] n      区間数
+ * @param [in] param  集計パラメータ
+ * @param [out] dst   積分結果の書き込み先(加算される)
+ *
+ * @remark
+ *  区間iはサンプルiとi + 1の間で、その消費電力量は台形則で求める。区間の中点
+ *  の電力が閾値以上なら稼働、未満なら待機として扱う。dtが0以下もしくは欠測間
+ *  隔を超える区間は集計しない。
+ *  SIMD向けのベクタ型で記述しているので、コンパイラがターゲットの命令セット
+ *  (SSE/AVX/NEON等)に展開する。
+ */
+void report_integrate(const int32_t* dt,
+                      const float* w,
+                      size_t n,
+                      const report_param_t* param,
+                      integral_t* dst);
+
+/**
+ * ベンチマークの実行
+ *
+ * @param [in] samples  合成するサンプル数
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ */
+int report_bench(size_t samples);
+
+#endif /* !defined(__REPORT_H__) */
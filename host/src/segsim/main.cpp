@@ -0,0 +1,281 @@
+/*
+ * Recording file segmentation simulator for large sessions
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <segment.h>
+
+//! 1GBのバイト数
+#define GB              (1024ULL * 1024ULL * 1024ULL)
+
+//! 記録するバイト数のデフォルト値(GB)
+#define DEFAULT_TOTAL   (10.0)
+
+//! exFATで記録開始時に確保する連続領域のデフォルト値(WRITER_PREALLOC_SIZE)
+#define DEFAULT_PREALLOC (256ULL * 1024 * 1024)
+
+//! ファイル毎のヘッダ行(start_writer_task()が書き込むもの)のバイト数
+#define HEADER_BYTES    (48)
+
+//! データ行の最短・最長のバイト数(ノードIDや区間長の列を含む場合を想定)
+#define ROW_MIN         (28)
+#define ROW_MAX         (96)
+
+//! イベント行のバイト数の上限(受信タスクの行バッファのサイズ)
+#define EVENT_MAX       (256)
+
+//! シミュレーションの状態
+typedef struct {
+  /*
+   * parameters
+   */
+  uint64_t total;
+  uint64_t limit;
+  uint64_t prealloc;
+  bool exfat;
+
+  //! 乱数の状態
+  uint32_t seed;
+
+  /*
+   * 書き込みモジュールの模擬
+   *   writer.cppと同じく受け付けたバイト数を64ビットで数える。exFATの場合
+   *   はファイルを開いた時点でpreallocバイトを確保し、閉じる時に書き込んだ
+   *   サイズまで切り詰める。
+   */
+  uint64_t size;
+  uint64_t allocated;
+
+  /*
+   * results
+   */
+  uint64_t written;
+  uint64_t rows;
+  uint64_t segments;
+  uint64_t minSegment;
+  uint64_t maxSegment;
+  uint64_t maxAllocated;
+  uint64_t shortSegments;
+  uint64_t midlineDue;
+  uint64_t released;
+
+  //! 比較用: サイズを32ビットで数えた場合に判定が食い違った回数
+  uint64_t naiveMismatch;
+} sim_t;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 使用方法の表示
+ */
+static void
+usage()
+{
+  fprintf(stderr,
+          "usage: segsim [options]\n"
+          "\n"
+          "options:\n"
+          "  -g GB       bytes to record in one session (default %.0f)\n"
+          "  -e          simulate an exFAT volume (default FAT32)\n"
+          "  -x BYTES    SEGMENT_SIZE_EXFAT for -e (default 0, no rollover)\n"
+          "  -p BYTES    exFAT preallocation size (default %llu)\n"
+          "  -s SEED     random seed (default 1)\n",
+          DEFAULT_TOTAL,
+          (unsigned long long)DEFAULT_PREALLOC);
+}
+
+/**
+ * 乱数の生成
+ */
+static uint32_t
+next_random(sim_t* sim)
+{
+  sim->seed = sim->seed * 1103515245 + 12345;
+  return (sim->seed >> 16);
+}
+
+/**
+ * ファイルを開く(書き込みタスクの起動とヘッダ行の書き込み)
+ */
+static void
+open_file(sim_t* sim)
+{
+  sim->size      = HEADER_BYTES;
+  sim->allocated = (sim->exfat)? sim->prealloc: 0;
+  sim->written  += HEADER_BYTES;
+}
+
+/**
+ * ファイルを閉じる(書き込みタスクの停止)
+ *
+ * @param [in] sim     シミュレーションの状態
+ * @param [in] rotate  切り替えによるものか否か
+ *
+ * @remark
+ *  閉じた時点のファイルサイズを記録する。exFATでは確保した領域のうち使わ
+ *  なかった分を解放した量も記録する。
+ */
+static void
+close_file(sim_t* sim, bool rotate)
+{
+  uint64_t fileSize;
+
+  if (sim->size > sim->allocated) sim->allocated = sim->size;
+  if (sim->allocated > sim->maxAllocated) sim->maxAllocated = sim->allocated;
+
+  // 確保したまま使わなかった領域の解放(file.truncate())
+  fileSize       = sim->size;
+  sim->released += sim->allocated - sim->size;
+
+  if (sim->segments == 0 || fileSize < sim->minSegment) {
+    sim->minSegment = fileSize;
+  }
+
+  if (fileSize > sim->maxSegment) sim->maxSegment = fileSize;
+  if (rotate && fileSize < sim->limit) sim->shortSegments++;
+
+  sim->segments++;
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+main(int argc, char* argv[])
+{
+  double gb;
+  uint64_t exfatLimit;
+  int opt;
+  sim_t sim = {};
+  struct timespec t0;
+  struct timespec t1;
+  double wall;
+  uint64_t len;
+  bool ok;
+
+  /*
+   * parse options
+   */
+  gb           = DEFAULT_TOTAL;
+  exfatLimit   = 0;
+  sim.prealloc = DEFAULT_PREALLOC;
+  sim.seed     = 1;
+
+  while ((opt = getopt(argc, argv, "g:ex:p:s:h")) != -1) {
+    switch (opt) {
+    case 'g':
+      gb = atof(optarg);
+      break;
+
+    case 'e':
+      sim.exfat = true;
+      break;
+
+    case 'x':
+      exfatLimit = strtoull(optarg, NULL, 0);
+      break;
+
+    case 'p':
+      sim.prealloc = strtoull(optarg, NULL, 0);
+      break;
+
+    case 's':
+      sim.seed = strtoul(optarg, NULL, 0);
+      break;
+
+    default:
+      usage();
+      return (opt == 'h')? 0: 1;
+    }
+  }
+
+  if (gb <= 0.0) {
+    usage();
+    return 1;
+  }
+
+  sim.total = (uint64_t)(gb * GB);
+  sim.limit = segment_limit(sim.exfat, exfatLimit);
+
+  /*
+   * run
+   *   do_record_state_proc()と同じく、一行を書き込む毎に行末で判定する。行
+   *   の途中(先頭の文字)でも判定し、切り替えが要求されないことを確かめる。
+   */
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+
+  open_file(&sim);
+
+  while (sim.written < sim.total) {
+    if (next_random(&sim) % 1000 == 0) {
+      len = ROW_MIN + next_random(&sim) % (EVENT_MAX - ROW_MIN + 1);
+    } else {
+      len = ROW_MIN + next_random(&sim) % (ROW_MAX - ROW_MIN + 1);
+    }
+
+    sim.size    += len;
+    sim.written += len;
+    sim.rows++;
+
+    if (segment_due(sim.size, sim.limit, '0')) sim.midlineDue++;
+
+    if (segment_due(sim.size, sim.limit, '\n') !=
+        segment_due((uint32_t)sim.size, sim.limit, '\n')) {
+      sim.naiveMismatch++;
+    }
+
+    if (segment_due(sim.size, sim.limit, '\n')) {
+      close_file(&sim, true);
+      open_file(&sim);
+    }
+  }
+
+  close_file(&sim, false);
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+  /*
+   * report
+   *   切り替えたファイルは切り替えサイズ以上・切り替えサイズ+一行未満になる
+   *   はず。切り替えない場合は一つのファイルに全てを記録する。
+   */
+  ok = ((sim.limit > 0 || sim.segments == 1) &&
+        sim.shortSegments == 0 &&
+        sim.midlineDue == 0 &&
+        (sim.exfat || sim.maxSegment <= SEGMENT_FAT_MAX) &&
+        (sim.limit == 0 || sim.maxSegment < sim.limit + EVENT_MAX));
+
+  printf("volume=%s limit=%llu prealloc=%llu written=%llu rows=%llu\n",
+         (sim.exfat)? "exfat": "fat32",
+         (unsigned long long)sim.limit,
+         (unsigned long long)((sim.exfat)? sim.prealloc: 0),
+         (unsigned long long)sim.written,
+         (unsigned long long)sim.rows);
+
+  printf("segments=%llu segment_min=%llu segment_max=%llu"
+         " allocated_max=%llu released=%llu short_segments=%llu"
+         " midline_due=%llu naive32_mismatch=%llu\n",
+         (unsigned long long)sim.segments,
+         (unsigned long long)sim.minSegment,
+         (unsigned long long)sim.maxSegment,
+         (unsigned long long)sim.maxAllocated,
+         (unsigned long long)sim.released,
+         (unsigned long long)sim.shortSegments,
+         (unsigned long long)sim.midlineDue,
+         (unsigned long long)sim.naiveMismatch);
+
+  printf("wall_sec=%.3f result=%s\n", wall, (ok)? "ok": "NG");
+
+  return (ok)? 0: 1;
+}
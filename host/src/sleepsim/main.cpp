@@ -0,0 +1,611 @@
+/*
+ * Virtual clock simulator for the recorder low-power mode
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <hal_clock.h>
+#include <lowpower.h>
+
+//! 一時間のマイクロ秒数
+#define HOUR_US           (3600ULL * 1000000ULL)
+
+//! 動作統計の出力周期(ミリ秒, ファームウェアと同じ値)
+#define STAT_INTERVAL     (10000)
+
+//! 1バイトの送信時間(ナノ秒, 8N1で10ビット)
+#define BYTE_NS           (10ULL * 1000000000ULL / LP_BAUDRATE)
+
+//! イベント行を本来の行の後に送るまでの時間(マイクロ秒)
+#define BURST_DELAY       (5000)
+
+//! 行バッファのサイズ(レコーダの受信タスクと同じ値)
+#define LINE_SIZE         (256)
+
+//! センサーの出力周期のデフォルト値(ミリ秒)
+#define DEFAULT_PERIOD    (1000)
+
+//! 出力周期の揺らぎのデフォルト値(±ミリ秒)
+#define DEFAULT_JITTER    (20)
+
+//! イベント行が続く確率のデフォルト値(パーセント)
+#define DEFAULT_BURST     (5)
+
+//! 起床してからUARTが受信可能になるまでの時間のデフォルト値(マイクロ秒)
+#define DEFAULT_LATENCY   (1000)
+
+//! 書き込み用バッファのサイズのデフォルト値(LOW_POWERのWRITER_BUFF_SIZE)
+#define DEFAULT_BUFFER    (32768)
+
+//! ブロックの書き込みに要する時間のデフォルト値(ミリ秒, LED表示を含む)
+#define DEFAULT_WRITE     (60)
+
+//! スリープ中の消費電流のデフォルト値(マイクロアンペア)
+#define DEFAULT_SLEEP_UA  (1500)
+
+//! 動作中の消費電流のデフォルト値(マイクロアンペア)
+#define DEFAULT_ACTIVE_UA (30000)
+
+//! シミュレーションの状態
+typedef struct {
+  /*
+   * parameters
+   */
+  uint64_t period;
+  uint64_t jitter;
+  uint32_t burst;
+  uint64_t latency;
+  uint32_t bufSize;
+  uint64_t writeTime;
+  bool preamble;
+
+  //! 乱数の状態
+  uint32_t seed;
+
+  /*
+   * sensor
+   */
+  lp_tx_t tx;
+  uint64_t plan;
+  bool pending;
+
+  /*
+   * recorder
+   */
+  lp_rx_t rx;
+  bool asleep;
+  uint64_t sleepStart;
+  uint64_t sleepUntil;
+  uint64_t checkAt;
+  hal_interval_t statTimer;
+
+  //! 受信タスクの行の組み立て状態
+  char line[LINE_SIZE];
+  size_t size;
+
+  //! 書き込み用バッファの使用量と書き込み中の期限
+  uint32_t buffered;
+  uint64_t writerUntil;
+
+  //! 受信による起床の時刻(0の場合は行の待ち無し)
+  uint64_t wakeAt;
+
+  //! 送信中の行について、正しい行・正しくない行を受け取ったか否か
+  bool gotGood;
+  bool gotBad;
+
+  /*
+   * results
+   */
+  uint64_t sent;
+  uint64_t good;
+  uint64_t corrupt;
+  uint64_t resync;
+  uint64_t preambles;
+  uint64_t lostBytes;
+  uint64_t garbled;
+  uint64_t blocks;
+  uint64_t sleeps;
+  uint64_t sleepUs;
+  uint64_t wakeRx;
+  uint64_t wakeTimer;
+  uint64_t latSum;
+  uint64_t latCount;
+  uint64_t latMax;
+  uint64_t stats;
+} sim_t;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 使用方法の表示
+ */
+static void
+usage()
+{
+  fprintf(stderr,
+          "usage: sleepsim [options]\n"
+          "\n"
+          "options:\n"
+          "  -d HOURS    simulated duration (default 24)\n"
+          "  -p MS       sensor line period (default %d)\n"
+          "  -j MS       period jitter, +-MS (default %d)\n"
+          "  -b PCT      chance of an event line after a row (default %d)\n"
+          "  -l US       wake-up latency until the UART receives (default %d)\n"
+          "  -B BYTES    writer buffer size (default %d)\n"
+          "  -w MS       time to write one buffer to the card (default %d)\n"
+          "  -P          do not send the wake-up preamble\n"
+          "  -s SEED     random seed (default 1)\n",
+          DEFAULT_PERIOD,
+          DEFAULT_JITTER,
+          DEFAULT_BURST,
+          DEFAULT_LATENCY,
+          DEFAULT_BUFFER,
+          DEFAULT_WRITE);
+}
+
+/**
+ * 乱数の生成
+ */
+static uint32_t
+next_random(sim_t* sim)
+{
+  sim->seed = sim->seed * 1103515245 + 12345;
+  return (sim->seed >> 16);
+}
+
+/**
+ * マイクロ秒からhal_millis()相当の値への変換
+ */
+static inline uint32_t
+to_millis(uint64_t us)
+{
+  return (uint32_t)(us / 1000);
+}
+
+static void on_check(void* arg);
+
+/**
+ * レコーダのloop()の評価
+ *
+ * @param [in] sim  シミュレーションの状態
+ *
+ * @remark
+ *  ファームウェアのprint_stats()とlight_sleep()の判定を行う。スリープしない
+ *  場合は、判定が変わり得る次の時刻に再評価を予約する。
+ */
+static void
+recorder_poll(sim_t* sim)
+{
+  uint64_t now;
+  uint32_t msec;
+  uint32_t idle;
+  uint64_t next;
+  bool busy;
+
+  now = vclock_now();
+
+  if (hal_interval_check(&sim->statTimer)) sim->stats++;
+
+  busy = (sim->size > 0 || sim->writerUntil > now);
+  msec = lp_rx_sleep_time(&sim->rx,
+                          hal_millis(),
+                          hal_interval_remain(&sim->statTimer),
+                          busy);
+
+  if (msec > 0) {
+    sim->asleep     = true;
+    sim->sleepStart = now;
+    sim->sleepUntil = now + msec * 1000ULL;
+    sim->checkAt    = 0;
+    sim->sleeps++;
+
+    vclock_schedule(sim->sleepUntil, on_check, sim);
+    return;
+  }
+
+  // 次に判定が変わり得る時刻(受信の途絶・書き込み完了)、それ以外はloop()
+  // の周回に相当する1ミリ秒後
+  idle = hal_millis() - sim->rx.last;
+  next = now + 1000;
+
+  if (idle < LP_SLEEP_IDLE) next = now + (LP_SLEEP_IDLE - idle) * 1000ULL;
+  if (sim->writerUntil > next) next = sim->writerUntil;
+
+  sim->checkAt = next;
+  vclock_schedule(next, on_check, sim);
+}
+
+/**
+ * 再評価・タイマー起床の事象のハンドラ
+ *
+ * @remark
+ *  行の受信で取り消された予約は無視する。
+ */
+static void
+on_check(void* arg)
+{
+  sim_t* sim;
+  uint64_t now;
+
+  sim = (sim_t*)arg;
+  now = vclock_now();
+
+  if (sim->asleep) {
+    if (now != sim->sleepUntil) return;
+
+    sim->asleep   = false;
+    sim->sleepUs += now - sim->sleepStart;
+    sim->wakeTimer++;
+
+  } else if (now != sim->checkAt) {
+    return;
+  }
+
+  recorder_poll(sim);
+}
+
+/**
+ * 受信タスクでの一バイトの処理
+ *
+ * @param [in] sim     シミュレーションの状態
+ * @param [in] b       受信したバイト
+ * @param [in] expect  センサーが送った行
+ * @param [in] end     行の受信を終えた時刻
+ *
+ * @remark
+ *  receiver.cppと同じく、NUL文字で組み立て中の行を捨てる。
+ */
+static void
+receive_byte(sim_t* sim, uint8_t b, const std::string& expect, uint64_t end)
+{
+  uint64_t lat;
+
+  if (b == '\0') {
+    if (sim->size > 0) {
+      sim->resync++;
+      sim->size = 0;
+    }
+    return;
+  }
+
+  if (sim->size < sizeof(sim->line)) sim->line[sim->size] = (char)b;
+  sim->size++;
+
+  if (b != '\n') return;
+
+  if (sim->size == expect.size() &&
+      memcmp(sim->line, expect.data(), sim->size) == 0) {
+    sim->gotGood = true;
+  } else {
+    sim->gotBad = true;
+  }
+
+  // 書き込み用バッファが一杯になると書き込みタスクが動作する
+  sim->buffered += sim->size;
+  while (sim->buffered >= sim->bufSize) {
+    sim->buffered   -= sim->bufSize;
+    sim->writerUntil = ((sim->writerUntil > end)? sim->writerUntil: end) +
+                       sim->writeTime;
+    sim->blocks++;
+  }
+
+  sim->size = 0;
+
+  if (sim->wakeAt != 0) {
+    lat = end - sim->wakeAt;
+
+    sim->latSum += lat;
+    sim->latCount++;
+    if (lat > sim->latMax) sim->latMax = lat;
+
+    sim->wakeAt = 0;
+  }
+}
+
+/**
+ * 行の送信事象のハンドラ
+ *
+ * @remark
+ *  センサーが一行(必要な場合はプリアンブル付き)を送信し、レコーダがそれを
+ *  受信する様子を模擬する。レコーダがスリープしていた場合は最初のバイトの
+ *  スタートビットで起床し、UARTが受信可能になるまでに送られたバイトは失わ
+ *  れ、受信可能になった時点で送信中だったバイトは半分の確率で化ける(NUL文
+ *  字は1ビットのみが立った値に、それ以外は任意の値になる)。
+ */
+static void
+on_line(void* arg)
+{
+  sim_t* sim;
+  uint64_t now;
+  uint64_t ready;
+  uint64_t end;
+  uint64_t start;
+  char row[64];
+  std::string text;
+  std::string bytes;
+  uint32_t r;
+  size_t i;
+  uint8_t b;
+  bool event;
+
+  sim = (sim_t*)arg;
+  now = vclock_now();
+
+  /*
+   * sensor
+   */
+  event        = sim->pending;
+  sim->pending = false;
+
+  if (event) {
+    snprintf(row, sizeof(row), "!event,%llu\n",
+             (unsigned long long)(now / 1000));
+  } else {
+    r = next_random(sim);
+    snprintf(row, sizeof(row), "%llu,%.1f,%.3f,%.1f\n",
+             (unsigned long long)(now / 1000),
+             100.0 + (r % 20) * 0.1,
+             0.5 + (r % 500) * 0.001,
+             50.0 + (r % 300) * 0.1);
+  }
+
+  text = row;
+
+  if (sim->preamble && lp_tx_begin(&sim->tx, hal_millis())) {
+    bytes.assign(LP_PREAMBLE_BYTES, '\0');
+    sim->preambles++;
+  }
+
+  bytes += text;
+  end    = now + (bytes.size() * BYTE_NS + 999) / 1000;
+
+  sim->sent++;
+
+  /*
+   * recorder
+   */
+  sim->checkAt = 0;
+  sim->gotGood = false;
+  sim->gotBad  = false;
+  ready        = now;
+
+  if (sim->asleep) {
+    sim->asleep   = false;
+    sim->sleepUs += now - sim->sleepStart;
+    sim->wakeAt   = now;
+    sim->wakeRx++;
+
+    ready = now + sim->latency;
+  }
+
+  for (i = 0; i < bytes.size(); i++) {
+    start = now + (i * BYTE_NS) / 1000;
+    b     = (uint8_t)bytes[i];
+
+    if (start + BYTE_NS / 1000 <= ready) {
+      sim->lostBytes++;
+      continue;
+    }
+
+    if (start < ready) {
+      r = next_random(sim);
+
+      if (r & 1) {
+        sim->lostBytes++;
+        continue;
+      }
+
+      b = (b == '\0')? (uint8_t)(1 << ((r >> 1) % 8)): (uint8_t)(r >> 1);
+      if (b == '\0') b = 0x80;
+      sim->garbled++;
+    }
+
+    receive_byte(sim, b, text, end);
+  }
+
+  // 化けた改行文字で行が分かれる場合もあるので、送信した行単位で判定する
+  if (sim->gotGood) {
+    sim->good++;
+  } else if (sim->gotBad) {
+    sim->corrupt++;
+  }
+
+  lp_rx_activity(&sim->rx, to_millis(end));
+
+  /*
+   * schedule
+   *   イベント行は本来の行の直後に挟み、本来の行の予定は保つ。
+   */
+  if (!event) {
+    sim->pending = (next_random(sim) % 100 < sim->burst);
+
+    r          = next_random(sim);
+    sim->plan += sim->period + (r % (2 * sim->jitter + 1)) - sim->jitter;
+  }
+
+  if (sim->pending) {
+    vclock_schedule(end + BURST_DELAY, on_line, sim);
+  } else {
+    vclock_schedule((sim->plan > end)? sim->plan: end, on_line, sim);
+  }
+
+  sim->checkAt = end;
+  vclock_schedule(end, on_check, sim);
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+main(int argc, char* argv[])
+{
+  double hours;
+  int period;
+  int jitter;
+  int burst;
+  int latency;
+  int buffer;
+  int write;
+  int opt;
+  uint64_t duration;
+  uint64_t start;
+  uint64_t lost;
+  sim_t sim = {};
+  uint32_t current;
+  bool ok;
+
+  /*
+   * parse options
+   */
+  hours        = 24.0;
+  period       = DEFAULT_PERIOD;
+  jitter       = DEFAULT_JITTER;
+  burst        = DEFAULT_BURST;
+  latency      = DEFAULT_LATENCY;
+  buffer       = DEFAULT_BUFFER;
+  write        = DEFAULT_WRITE;
+  sim.preamble = true;
+  sim.seed     = 1;
+
+  while ((opt = getopt(argc, argv, "d:p:j:b:l:B:w:Ps:h")) != -1) {
+    switch (opt) {
+    case 'd':
+      hours = atof(optarg);
+      break;
+
+    case 'p':
+      period = atoi(optarg);
+      break;
+
+    case 'j':
+      jitter = atoi(optarg);
+      break;
+
+    case 'b':
+      burst = atoi(optarg);
+      break;
+
+    case 'l':
+      latency = atoi(optarg);
+      break;
+
+    case 'B':
+      buffer = atoi(optarg);
+      break;
+
+    case 'w':
+      write = atoi(optarg);
+      break;
+
+    case 'P':
+      sim.preamble = false;
+      break;
+
+    case 's':
+      sim.seed = strtoul(optarg, NULL, 10);
+      break;
+
+    default:
+      usage();
+      return (opt == 'h')? 0: 1;
+    }
+  }
+
+  if (hours <= 0.0 || period <= 0 || jitter < 0 || jitter >= period ||
+      burst < 0 || burst > 100 || latency < 0 || buffer <= 0 || write < 0) {
+    usage();
+    return 1;
+  }
+
+  if ((uint32_t)latency > LP_MAX_WAKE_US) {
+    fprintf(stderr,
+            "warning: latency exceeds what the preamble covers (%u us)\n",
+            (unsigned)LP_MAX_WAKE_US);
+  }
+
+  /*
+   * setup virtual clock
+   */
+  duration      = (uint64_t)(hours * HOUR_US);
+  start         = 1000000;
+  sim.period    = (uint64_t)period * 1000;
+  sim.jitter    = (uint64_t)jitter * 1000;
+  sim.burst     = burst;
+  sim.latency   = latency;
+  sim.bufSize   = buffer;
+  sim.writeTime = (uint64_t)write * 1000;
+  sim.plan      = start + sim.period;
+
+  vclock_reset(start, 0);
+
+  lp_tx_init(&sim.tx);
+  lp_rx_init(&sim.rx, hal_millis());
+  hal_interval_init(&sim.statTimer, STAT_INTERVAL);
+
+  vclock_schedule(sim.plan, on_line, &sim);
+  recorder_poll(&sim);
+
+  /*
+   * run
+   */
+  vclock_advance(duration);
+
+  if (sim.asleep) sim.sleepUs += vclock_now() - sim.sleepStart;
+
+  /*
+   * report
+   */
+  lost    = sim.sent - sim.good - sim.corrupt;
+  current = lp_estimate_current(sim.sleepUs,
+                                duration,
+                                DEFAULT_SLEEP_UA,
+                                DEFAULT_ACTIVE_UA);
+  ok      = (sim.corrupt == 0 && lost == 0);
+
+  printf("simulated_hours=%.2f preamble=%s wake_latency_us=%d\n",
+         hours,
+         (sim.preamble)? "on": "off",
+         latency);
+
+  printf("lines_sent=%llu lines_ok=%llu lines_corrupt=%llu lines_lost=%llu"
+         " rx_resync=%llu preambles=%llu bytes_lost=%llu bytes_garbled=%llu\n",
+         (unsigned long long)sim.sent,
+         (unsigned long long)sim.good,
+         (unsigned long long)sim.corrupt,
+         (unsigned long long)lost,
+         (unsigned long long)sim.resync,
+         (unsigned long long)sim.preambles,
+         (unsigned long long)sim.lostBytes,
+         (unsigned long long)sim.garbled);
+
+  printf("sleeps=%llu sleep_pct=%.1f wake_rx=%llu wake_timer=%llu"
+         " wr_blocks=%llu stats=%llu\n",
+         (unsigned long long)sim.sleeps,
+         100.0 * sim.sleepUs / duration,
+         (unsigned long long)sim.wakeRx,
+         (unsigned long long)sim.wakeTimer,
+         (unsigned long long)sim.blocks,
+         (unsigned long long)sim.stats);
+
+  printf("wake_lat_avg_us=%llu wake_lat_max_us=%llu est_current_ua=%lu"
+         " result=%s\n",
+         (unsigned long long)((sim.latCount > 0)?
+                                  sim.latSum / sim.latCount: 0),
+         (unsigned long long)sim.latMax,
+         (unsigned long)current,
+         (ok)? "ok": "NG");
+
+  return (ok)? 0: 1;
+}
@@ -0,0 +1,535 @@
+/*
+ * UART link capture and timing analyzer
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <reclog.h>
+
+#include "uartcap.h"
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+//! 欠測の判定に用いる周期の倍率(閾値の指定が無い場合)
+#define GAP_FACTOR      (2.5)
+
+//! 欠測の原因(区間内に壊れた行がある)
+#define CAUSE_CORRUPT   (0)
+
+//! 欠測の原因(センサーのタイムスタンプも進んでおり、何も受信していない)
+#define CAUSE_SILENT    (1)
+
+//! 欠測の原因(センサーのタイムスタンプは連続しているが到着が遅れた)
+#define CAUSE_DELAYED   (2)
+
+//! 欠測の原因(到着間隔は正常だがセンサーのタイムスタンプが飛んでいる)
+#define CAUSE_SKIPPED   (3)
+
+//! 欠測の原因の表示名
+static const char* cause_names[] = {"corrupt", "silent", "delayed", "skipped"};
+
+//! データ行一件分
+typedef struct {
+  //! 受信時刻(改行を受信した時刻, ミリ秒)
+  double host;
+
+  //! センサーのタイムスタンプ(ミリ秒)
+  int64_t ts;
+
+  //! 直前のデータ行からの間に受信した壊れた行の数
+  uint32_t corrupt;
+} record_t;
+
+//! 行の集計
+typedef struct {
+  uint64_t data;
+  uint64_t telemetry;
+  uint64_t events;
+  uint64_t blank;
+  uint64_t corrupt;
+  uint64_t overlong;
+  uint64_t badBytes;
+} line_stats_t;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * ファイル全体の読み込み
+ */
+static int
+load_file(const char* path, std::vector<char>* dst)
+{
+  FILE* fp;
+  long size;
+
+  fp = fopen(path, "rb");
+  if (fp == NULL) return DEFAULT_ERROR;
+
+  fseek(fp, 0, SEEK_END);
+  size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  dst->resize(size);
+  if (size > 0 && fread(dst->data(), 1, size, fp) != (size_t)size) {
+    fclose(fp);
+    return DEFAULT_ERROR;
+  }
+
+  fclose(fp);
+
+  return 0;
+}
+
+/**
+ * 対数ヒストグラムのバケット番号の算出
+ *
+ * @remark
+ *  バケットiは値が(2^(i-1), 2^i]の範囲(バケット0は1以下、最後のバケットは
+ *  それより上の全て)。
+ */
+static int
+bucket_of(double v)
+{
+  int i;
+
+  for (i = 0; i < UARTCAP_BUCKETS - 1; i++) {
+    if (v <= (double)(1U << i)) return i;
+  }
+
+  return UARTCAP_BUCKETS - 1;
+}
+
+/**
+ * パーセンタイルの取得
+ */
+static double
+percentile(const std::vector<double>& sorted, double p)
+{
+  size_t i;
+
+  if (sorted.empty()) return NAN;
+
+  i = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+  return sorted[i];
+}
+
+/**
+ * 行の分類
+ *
+ * @param [in] line   行の内容(改行を含まない)
+ * @param [in] size   行の長さ
+ * @param [in] bad    行に含まれる不正なバイトの数
+ * @param [in] host   改行の受信時刻(ミリ秒)
+ * @param [in,out] st 行の集計
+ * @param [in,out] recs データ行の一覧
+ * @param [in,out] corrupt 直前のデータ行以降の壊れた行の数
+ */
+static void
+classify(const char* line,
+         size_t size,
+         size_t bad,
+         double host,
+         line_stats_t* st,
+         std::vector<record_t>* recs,
+         uint32_t* corrupt)
+{
+  reclog_row_t row;
+
+  // 受信側の行バッファを超える長さの行は分割して記録される
+  if (size + 1 > UARTCAP_LINE_SIZE) st->overlong++;
+
+  if (bad > 0) {
+    st->badBytes += bad;
+    st->corrupt++;
+    (*corrupt)++;
+
+  } else if (size == 0 || (size == 1 && line[0] == '\r')) {
+    st->blank++;
+
+  } else if (line[0] == '#') {
+    st->telemetry++;
+
+  } else if (line[0] == '!') {
+    st->events++;
+
+  } else if (reclog_parse_row(line, line + size, &row) == RECLOG_ROW) {
+    st->data++;
+    recs->push_back({host, row.ts, *corrupt});
+    *corrupt = 0;
+
+  } else {
+    st->corrupt++;
+    (*corrupt)++;
+  }
+}
+
+/**
+ * レコーダの記録ファイルとの突き合わせ
+ *
+ * @param [in] path  記録ファイルのパス
+ * @param [in] recs  キャプチャしたデータ行の一覧
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  両者の時間範囲が重なる部分で、キャプチャにあって記録に無いタイムスタン
+ *  プ(レコーダ側での取りこぼし)と、記録にあってキャプチャに無いタイムスタン
+ *  プ(タップ側での取りこぼし)を数える。
+ */
+static int
+compare_recording(const char* path, const std::vector<record_t>& recs)
+{
+  reclog_map_t map;
+  reclog_row_t row;
+  const char* p;
+  const char* eol;
+  const char* tail;
+  std::vector<int64_t> rec;
+  std::vector<int64_t> cap;
+  int64_t lo;
+  int64_t hi;
+  size_t notRecorded;
+  size_t notCaptured;
+
+  if (reclog_open(&map, path)) {
+    perror(path);
+    return DEFAULT_ERROR;
+  }
+
+  tail = map.head + map.size;
+  for (p = map.head; p < tail; p = eol + 1) {
+    eol = (const char*)memchr(p, '\n', tail - p);
+    if (eol == NULL) break;
+
+    if (reclog_parse_row(p, eol, &row) == RECLOG_ROW) rec.push_back(row.ts);
+  }
+
+  reclog_close(&map);
+
+  for (auto& r: recs) cap.push_back(r.ts);
+
+  std::sort(rec.begin(), rec.end());
+  std::sort(cap.begin(), cap.end());
+
+  if (rec.empty() || cap.empty()) {
+    printf("recording: rows=%zu, no overlap\n", rec.size());
+    return 0;
+  }
+
+  lo = std::max(rec.front(), cap.front());
+  hi = std::min(rec.back(), cap.back());
+
+  notRecorded = 0;
+  for (auto ts: cap) {
+    if (ts < lo || ts > hi) continue;
+    if (!std::binary_search(rec.begin(), rec.end(), ts)) notRecorded++;
+  }
+
+  notCaptured = 0;
+  for (auto ts: rec) {
+    if (ts < lo || ts > hi) continue;
+    if (!std::binary_search(cap.begin(), cap.end(), ts)) notCaptured++;
+  }
+
+  printf("recording: rows=%zu overlap=[%lld, %lld] "
+         "not_recorded=%zu not_captured=%zu\n",
+         rec.size(),
+         (long long)lo,
+         (long long)hi,
+         notRecorded,
+         notCaptured);
+
+  return 0;
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+analyze_run(const char* path, const analyze_param_t* param)
+{
+  std::vector<char> data;
+  const capture_header_t* hdr;
+  chunk_header_t chunk;
+  size_t off;
+  double byteMs;
+  double host;
+  double last;
+  std::string line;
+  size_t bad;
+  line_stats_t st;
+  std::vector<record_t> recs;
+  uint32_t corrupt;
+  uint64_t bytes;
+  uint64_t chunks;
+  std::vector<double> hostDelta;
+  std::vector<double> sensorDelta;
+  uint64_t hostHist[UARTCAP_BUCKETS];
+  uint64_t sensorHist[UARTCAP_BUCKETS];
+  uint64_t causes[4];
+  double period;
+  double gap;
+  double dh;
+  double ds;
+  int cause;
+  uint64_t lost;
+  uint64_t backsteps;
+  size_t ngaps;
+  uint32_t i;
+  size_t j;
+  unsigned char c;
+
+  /*
+   * load
+   */
+  if (load_file(path, &data)) {
+    perror(path);
+    return DEFAULT_ERROR;
+  }
+
+  hdr = (const capture_header_t*)data.data();
+
+  if (data.size() < sizeof(*hdr) ||
+      memcmp(hdr->magic, UARTCAP_MAGIC, sizeof(hdr->magic)) ||
+      hdr->version != UARTCAP_VERSION ||
+      hdr->baud == 0) {
+    fprintf(stderr, "%s: not a capture file\n", path);
+    return DEFAULT_ERROR;
+  }
+
+  /*
+   * reassemble lines
+   *   チャンク内の各バイトの受信時刻は、チャンクの時刻(最後のバイトの受信時
+   *   刻)から1文字分の伝送時間ずつ遡って推定する。
+   */
+  byteMs  = 1000.0 * hdr->bits / hdr->baud;
+  off     = sizeof(*hdr);
+  last    = 0.0;
+  bad     = 0;
+  corrupt = 0;
+  bytes   = 0;
+  chunks  = 0;
+
+  memset(&st, 0, sizeof(st));
+
+  while (off + sizeof(chunk) <= data.size()) {
+    memcpy(&chunk, data.data() + off, sizeof(chunk));
+    off += sizeof(chunk);
+
+    if (off + chunk.size > data.size()) {
+      fprintf(stderr, "%s: truncated chunk at %zu\n", path, off);
+      break;
+    }
+
+    for (i = 0; i < chunk.size; i++) {
+      c    = data[off + i];
+      host = chunk.t / 1e6 - (chunk.size - 1 - i) * byteMs;
+
+      if (c != '\n') {
+        // センサーの出力は印字可能なASCII文字とCRのみで構成される
+        if ((c < 0x20 && c != '\r') || c >= 0x7f) bad++;
+        line.push_back(c);
+        continue;
+      }
+
+      classify(line.data(), line.size(), bad, host, &st, &recs, &corrupt);
+      line.clear();
+      bad = 0;
+    }
+
+    off   += chunk.size;
+    last   = chunk.t / 1e6;
+    bytes += chunk.size;
+    chunks++;
+  }
+
+  /*
+   * intervals
+   */
+  memset(hostHist, 0, sizeof(hostHist));
+  memset(sensorHist, 0, sizeof(sensorHist));
+  backsteps = 0;
+
+  for (j = 1; j < recs.size(); j++) {
+    dh = recs[j].host - recs[j - 1].host;
+    ds = (double)(recs[j].ts - recs[j - 1].ts);
+
+    if (ds < 0) {
+      backsteps++;
+      continue;
+    }
+
+    hostDelta.push_back(dh);
+    sensorDelta.push_back(ds);
+    hostHist[bucket_of(dh)]++;
+    sensorHist[bucket_of(ds)]++;
+  }
+
+  std::sort(hostDelta.begin(), hostDelta.end());
+  std::sort(sensorDelta.begin(), sensorDelta.end());
+
+  /*
+   *   区間が全て逆行(センサーの再起動等)の場合は間隔の統計が無いので、周期
+   *   は0(不明)として扱い、以降の表示は"n/a"とする。
+   */
+  period = (sensorDelta.empty())? 0.0: percentile(sensorDelta, 50.0);
+  gap    = (param->gap > 0.0)? param->gap: period * GAP_FACTOR;
+
+  /*
+   * summary
+   */
+  printf("capture: %llu bytes in %llu chunks, %.3f s, link utilization %.1f%%\n",
+         (unsigned long long)bytes,
+         (unsigned long long)chunks,
+         last / 1e3,
+         (last > 0.0)? bytes * byteMs / last * 100.0: 0.0);
+
+  printf("lines: data=%llu telemetry=%llu events=%llu blank=%llu "
+         "corrupt=%llu overlong=%llu bad_bytes=%llu\n",
+         (unsigned long long)st.data,
+         (unsigned long long)st.telemetry,
+         (unsigned long long)st.events,
+         (unsigned long long)st.blank,
+         (unsigned long long)st.corrupt,
+         (unsigned long long)st.overlong,
+         (unsigned long long)st.badBytes);
+
+  if (recs.size() < 2) {
+    printf("records: too few data rows to analyze\n");
+    return 0;
+  }
+
+  printf("records: first_ts=%lld last_ts=%lld ",
+         (long long)recs.front().ts,
+         (long long)recs.back().ts);
+
+  if (period > 0.0) {
+    printf("period=%.0f ms ", period);
+  } else {
+    printf("period=n/a ");
+  }
+
+  printf("backsteps=%llu\n", (unsigned long long)backsteps);
+
+  // 受信時刻とセンサーのタイムスタンプの進み方の差(センサーの時計の偏差)
+  dh = recs.back().host - recs.front().host;
+  ds = (double)(recs.back().ts - recs.front().ts);
+  if (backsteps == 0 && ds > 0) {
+    printf("clock: sensor drift %+.1f ppm relative to host\n",
+           (ds - dh) / dh * 1e6);
+  }
+
+  /*
+   * gaps
+   */
+  if (gap > 0.0) {
+    printf("gaps (> %.0f ms, or with corrupt lines):\n", gap);
+  } else {
+    printf("gaps (n/a, no forward intervals):\n");
+  }
+
+  memset(causes, 0, sizeof(causes));
+  lost  = 0;
+  ngaps = 0;
+
+  for (j = 1; j < recs.size(); j++) {
+    dh = recs[j].host - recs[j - 1].host;
+    ds = (double)(recs[j].ts - recs[j - 1].ts);
+
+    // 壊れた行を挟む区間は間隔によらず一覧に含める
+    if (ds < 0 || (dh <= gap && ds <= gap && recs[j].corrupt == 0)) continue;
+
+    if (recs[j].corrupt > 0) {
+      cause = CAUSE_CORRUPT;
+    } else if (ds > gap && dh > gap) {
+      cause = CAUSE_SILENT;
+    } else if (dh > gap) {
+      cause = CAUSE_DELAYED;
+    } else {
+      cause = CAUSE_SKIPPED;
+    }
+
+    causes[cause]++;
+    if (cause != CAUSE_DELAYED && period > 0) {
+      lost += (uint64_t)std::max(0.0, round(ds / period) - 1.0);
+    }
+
+    if (ngaps++ < param->maxGaps) {
+      printf("  at %10.3f s  ts %lld -> %lld  host %+9.1f ms  "
+             "sensor %+7lld ms  %s",
+             recs[j].host / 1e3,
+             (long long)recs[j - 1].ts,
+             (long long)recs[j].ts,
+             dh,
+             (long long)(recs[j].ts - recs[j - 1].ts),
+             cause_names[cause]);
+
+      if (recs[j].corrupt > 0) printf(" (%u lines)", recs[j].corrupt);
+      printf("\n");
+    }
+  }
+
+  if (ngaps > param->maxGaps) {
+    printf("  ... %zu more\n", ngaps - param->maxGaps);
+  }
+
+  printf("  total=%zu corrupt=%llu silent=%llu delayed=%llu skipped=%llu "
+         "est_lost_records=%llu\n",
+         ngaps,
+         (unsigned long long)causes[CAUSE_CORRUPT],
+         (unsigned long long)causes[CAUSE_SILENT],
+         (unsigned long long)causes[CAUSE_DELAYED],
+         (unsigned long long)causes[CAUSE_SKIPPED],
+         (unsigned long long)lost);
+
+  /*
+   * histogram
+   */
+  printf("interval histogram (ms):\n");
+  printf("  %8s %12s %12s\n", "le", "host", "sensor");
+
+  for (i = 0; i < UARTCAP_BUCKETS; i++) {
+    if (hostHist[i] == 0 && sensorHist[i] == 0) continue;
+
+    if (i < UARTCAP_BUCKETS - 1) {
+      printf("  %8u", 1U << i);
+    } else {
+      printf("  %8s", "+Inf");
+    }
+
+    printf(" %12llu %12llu\n",
+           (unsigned long long)hostHist[i],
+           (unsigned long long)sensorHist[i]);
+  }
+
+  if (hostDelta.empty()) {
+    printf("host interval: n/a\n");
+  } else {
+    printf("host interval: p50=%.1f p99=%.1f p99.9=%.1f max=%.1f ms\n",
+           percentile(hostDelta, 50.0),
+           percentile(hostDelta, 99.0),
+           percentile(hostDelta, 99.9),
+           hostDelta.back());
+  }
+
+  /*
+   * recording
+   */
+  if (!param->recording.empty()) {
+    return compare_recording(param->recording.c_str(), recs);
+  }
+
+  return 0;
+}
@@ -0,0 +1,252 @@
+/*
+ * UART link capture and timing analyzer
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+
+#include "uartcap.h"
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+//! 読み出しバッファのサイズ
+#define READ_SIZE       (4096)
+
+//! 停止要求の確認周期(ミリ秒)
+#define POLL_INTERVAL   (100)
+
+//! 停止要求フラグ
+static volatile sig_atomic_t stop = 0;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * SIGINTのハンドラ
+ */
+static void
+on_signal(int sig)
+{
+  stop = 1;
+}
+
+/**
+ * 単調増加時刻の取得(ナノ秒)
+ */
+static uint64_t
+now_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * 通信速度の定数への変換
+ */
+static speed_t
+to_speed(int baud)
+{
+  switch (baud) {
+  case 4800:    return B4800;
+  case 9600:    return B9600;
+  case 19200:   return B19200;
+  case 38400:   return B38400;
+  case 57600:   return B57600;
+  case 115200:  return B115200;
+  case 230400:  return B230400;
+  case 460800:  return B460800;
+  case 921600:  return B921600;
+  default:      return B0;
+  }
+}
+
+/**
+ * シリアルデバイスのオープン
+ *
+ * @param [in] path  デバイスファイルのパス
+ * @param [in] baud  通信速度
+ *
+ * @return
+ *  ファイルディスクリプタを返す。失敗した場合は-1を返す。
+ *
+ * @remark
+ *  USBシリアル変換器の受信データはドライバのレイテンシタイマ(FTDIでは既定
+ *  16ミリ秒)単位にまとめて届くので、ASYNC_LOW_LATENCYの設定を試みる(対応し
+ *  ていないドライバやptyでは失敗するが無視する)。
+ */
+static int
+open_serial(const char* path, speed_t baud)
+{
+  int fd;
+  struct termios tio;
+  struct serial_struct ss;
+
+  fd = open(path, O_RDONLY | O_NOCTTY);
+  if (fd < 0) return -1;
+
+  if (tcgetattr(fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, baud);
+    cfsetospeed(&tio, baud);
+
+    tio.c_cc[VMIN]  = 1;
+    tio.c_cc[VTIME] = 0;
+
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+
+  if (ioctl(fd, TIOCGSERIAL, &ss) == 0) {
+    ss.flags |= ASYNC_LOW_LATENCY;
+    ioctl(fd, TIOCSSERIAL, &ss);
+  }
+
+  tcflush(fd, TCIFLUSH);
+
+  return fd;
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+capture_run(const char* dev,
+            int baud,
+            int bits,
+            const char* out,
+            double duration)
+{
+  int ret;
+  int fd;
+  FILE* fp;
+  speed_t speed;
+  capture_header_t hdr;
+  chunk_header_t chunk;
+  char buf[READ_SIZE];
+  struct pollfd pfd;
+  uint64_t t0;
+  uint64_t limit;
+  uint64_t bytes;
+  uint64_t chunks;
+  ssize_t n;
+
+  /*
+   * initialize
+   */
+  ret    = 0;
+  fd     = -1;
+  fp     = NULL;
+  bytes  = 0;
+  chunks = 0;
+  speed  = to_speed(baud);
+
+  if (speed == B0) {
+    fprintf(stderr, "unsupported baud rate %d\n", baud);
+    ret = DEFAULT_ERROR;
+  }
+
+  /*
+   * open
+   */
+  if (!ret) {
+    fd = open_serial(dev, speed);
+    if (fd < 0) {
+      perror(dev);
+      ret = DEFAULT_ERROR;
+    }
+  }
+
+  if (!ret) {
+    fp = fopen(out, "wb");
+    if (fp == NULL) {
+      perror(out);
+      ret = DEFAULT_ERROR;
+    }
+  }
+
+  if (!ret) {
+    memcpy(hdr.magic, UARTCAP_MAGIC, sizeof(hdr.magic));
+    hdr.version = UARTCAP_VERSION;
+    hdr.baud    = baud;
+    hdr.bits    = bits;
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1) {
+      perror(out);
+      ret = DEFAULT_ERROR;
+    }
+  }
+
+  /*
+   * capture loop
+   *   read()が返した時刻をそのチャンクの最後のバイトの受信時刻として記録す
+   *   る。バイト毎の時刻は解析時に通信速度から逆算する。
+   */
+  if (!ret) {
+    signal(SIGINT, on_signal);
+
+    t0    = now_ns();
+    limit = (uint64_t)(duration * 1e9);
+
+    pfd.fd     = fd;
+    pfd.events = POLLIN;
+
+    fprintf(stderr, "capturing %s at %d bps, ^C to stop\n", dev, baud);
+
+    while (!stop) {
+      if (limit > 0 && now_ns() - t0 >= limit) break;
+      if (poll(&pfd, 1, POLL_INTERVAL) <= 0) continue;
+
+      n = read(fd, buf, sizeof(buf));
+      if (n <= 0) {
+        fprintf(stderr, "%s: device closed\n", dev);
+        break;
+      }
+
+      chunk.t    = now_ns() - t0;
+      chunk.size = n;
+
+      if (fwrite(&chunk, sizeof(chunk), 1, fp) != 1 ||
+          fwrite(buf, 1, n, fp) != (size_t)n) {
+        perror(out);
+        ret = DEFAULT_ERROR;
+        break;
+      }
+
+      bytes += n;
+      chunks++;
+    }
+
+    fprintf(stderr,
+            "%llu bytes in %llu chunks\n",
+            (unsigned long long)bytes,
+            (unsigned long long)chunks);
+  }
+
+  /*
+   * post process
+   */
+  if (fp != NULL) {
+    if (fclose(fp) != 0 && !ret) {
+      perror(out);
+      ret = DEFAULT_ERROR;
+    }
+  }
+
+  if (fd >= 0) close(fd);
+
+  return ret;
+}
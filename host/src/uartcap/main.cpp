@@ -0,0 +1,128 @@
+/*
+ * UART link capture and timing analyzer
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "uartcap.h"
+
+//! デフォルトの通信速度(センサー部・レコーダ部間のリンクの値)
+#define DEFAULT_BAUD      (115200)
+
+//! デフォルトの1文字当たりのビット数(8N1)
+#define DEFAULT_BITS      (10)
+
+//! 欠測一覧のデフォルトの最大表示件数
+#define DEFAULT_MAX_GAPS  (50)
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 使用方法の表示
+ */
+static void
+usage()
+{
+  fprintf(stderr,
+          "usage: uartcap -c DEVICE [-b BAUD] [-s BITS] [-t SECONDS] OUTPUT\n"
+          "       uartcap [-g MSEC] [-n COUNT] [-r RECORDING] CAPTURE\n"
+          "\n"
+          "options:\n"
+          "  -c DEVICE   capture the serial device to OUTPUT\n"
+          "  -b BAUD     baud rate (default %d)\n"
+          "  -s BITS     bits per character incl. start/stop (default %d)\n"
+          "  -t SECONDS  stop capturing after SECONDS (default: ^C)\n"
+          "  -g MSEC     gap threshold (default: 2.5x median period)\n"
+          "  -n COUNT    max gaps to list (default %d)\n"
+          "  -r FILE     cross-check against the recorder's CSV file\n",
+          DEFAULT_BAUD,
+          DEFAULT_BITS,
+          DEFAULT_MAX_GAPS);
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+main(int argc, char* argv[])
+{
+  int opt;
+  const char* dev;
+  int baud;
+  int bits;
+  double duration;
+  analyze_param_t param;
+  int err;
+
+  /*
+   * initialize
+   */
+  dev           = NULL;
+  baud          = DEFAULT_BAUD;
+  bits          = DEFAULT_BITS;
+  duration      = 0.0;
+  param.gap     = 0.0;
+  param.maxGaps = DEFAULT_MAX_GAPS;
+
+  /*
+   * parse options
+   */
+  while ((opt = getopt(argc, argv, "c:b:s:t:g:n:r:h")) != -1) {
+    switch (opt) {
+    case 'c':
+      dev = optarg;
+      break;
+
+    case 'b':
+      baud = atoi(optarg);
+      break;
+
+    case 's':
+      bits = atoi(optarg);
+      break;
+
+    case 't':
+      duration = atof(optarg);
+      break;
+
+    case 'g':
+      param.gap = atof(optarg);
+      break;
+
+    case 'n':
+      param.maxGaps = strtoul(optarg, NULL, 10);
+      break;
+
+    case 'r':
+      param.recording = optarg;
+      break;
+
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  if (optind + 1 != argc || baud <= 0 || bits <= 0) {
+    usage();
+    return 1;
+  }
+
+  /*
+   * run
+   */
+  if (dev != NULL) {
+    err = capture_run(dev, baud, bits, argv[optind], duration);
+  } else {
+    err = analyze_run(argv[optind], &param);
+  }
+
+  return (err)? 1: 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * UART link capture and timing analyzer
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __UARTCAP_H__
+#define __UARTCAP_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+
+//! キャプチャファイルのマジック
+#define UARTCAP_MAGIC       "UCAP"
+
+//! キャプチャファイルの版数
+#define UARTCAP_VERSION     (1)
+
+//! 受信側(レコーダ)の行バッファ長(これを超える行は分割して記録される)
+#define UARTCAP_LINE_SIZE   (128)
+
+//! 区間統計のヒストグラムのバケット数(上限が1,2,4,...,2^(n-2)と+Inf)
+#define UARTCAP_BUCKETS     (16)
+
+/**
+ * キャプチャファイルのヘッダ
+ *
+ * @remark
+ *  ヘッダの後ろに、read()一回分毎のチャンク(chunk_header_tとデータ本体)が
+ *  続く。数値はすべてリトルエンディアン。
+ */
+typedef struct {
+  //! マジック("UCAP")
+  char magic[4];
+
+  //! 版数
+  uint32_t version;
+
+  //! 通信速度(bps, バイト毎の時刻の推定に用いる)
+  uint32_t baud;
+
+  //! 1文字当たりのビット数(スタート・パリティ・ストップビットを含む)
+  uint32_t bits;
+} capture_header_t;
+
+//! チャンクのヘッダ
+typedef struct {
+  //! 受信時刻(キャプチャ開始からの経過時間, ナノ秒, CLOCK_MONOTONIC)
+  uint64_t t;
+
+  //! データ長
+  uint32_t size;
+} __attribute__((packed)) chunk_header_t;
+
+//! 解析のパラメータ
+typedef struct {
+  //! 欠測とみなす間隔(ミリ秒, 0の場合は周期の中央値の2.5倍)
+  double gap;
+
+  //! 突き合わせを行うレコーダの記録ファイル(空の場合は行わない)
+  std::string recording;
+
+  //! 欠測一覧の最大表示件数
+  size_t maxGaps;
+} analyze_param_t;
+
+/**
+ * キャプチャの実行
+ *
+ * @param [in] dev       シリアルデバイスのパス
+ * @param [in] baud      通信速度
+ * @param [in] bits      1文字当たりのビット数
+ * @param [in] out       キャプチャファイルのパス
+ * @param [in] duration  キャプチャする時間(秒, 0の場合はSIGINTまで)
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ */
+int capture_run(const char* dev,
+                int baud,
+                int bits,
+                const char* out,
+                double duration);
+
+/**
+ * キャプチャファイルの解析
+ *
+ * @param [in] path   キャプチャファイルのパス
+ * @param [in] param  パラメータ
+ *
+ * @return
+ *  処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ */
+int analyze_run(const char* path, const analyze_param_t* param);
+
+#endif /* !defined(__UARTCAP_H__) */
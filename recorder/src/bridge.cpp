@@ -0,0 +1,339 @@
+/*
+ * Recorder for AC power monitor
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
+#include <bridge.h>
+#include <stats.h>
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR       (__LINE__)
+
+//! USBシリアルの送信バッファのサイズ
+#ifndef BRIDGE_TX_BUFF_SIZE
+#define BRIDGE_TX_BUFF_SIZE (8192)
+#endif /* !defined(BRIDGE_TX_BUFF_SIZE) */
+
+//! 受信タスクと転送タスクの間のチャンクキューの段数
+//  115200bpsのリンクでは64バイトのチャンクが約5.6ms毎に届くので、128段で
+//  約0.7秒分のフロー制御による停止を吸収できる。
+#ifndef BRIDGE_QUEUE_DEPTH
+#define BRIDGE_QUEUE_DEPTH  (128)
+#endif /* !defined(BRIDGE_QUEUE_DEPTH) */
+
+//! 一回のwrite()で送信する最大のチャンク数
+#define BRIDGE_BATCH        (32)
+
+//! テレメトリ行のキューの段数
+#define BRIDGE_LINE_DEPTH   (4)
+
+//! テレメトリ行の挿入を待つ最大の時間(マイクロ秒)
+#define BRIDGE_LINE_WAIT    (2000000)
+
+//! 転送タスクの一回の待ち時間(ミリ秒)
+#define BRIDGE_POLL         (10)
+
+//! 転送タスクの優先度(受信タスクより低く、loop()の優先度1より高くする)
+#define TASK_PRIORITY       (3)
+
+//! チャンクキューの要素
+struct Chunk {
+  //! 受信時刻(esp_timer_get_time()の値)
+  int64_t time;
+
+  uint16_t size;
+  uint8_t data[BRIDGE_CHUNK_SIZE];
+};
+
+//! テレメトリ行のキューの要素
+struct Line {
+  //! 登録時刻(esp_timer_get_time()の値)
+  int64_t time;
+
+  uint16_t size;
+  char data[BRIDGE_LINE_SIZE];
+};
+
+//! 受信タスクとの連絡用キュー
+static QueueHandle_t queue = NULL;
+
+//! テレメトリ行のキュー
+static QueueHandle_t lines = NULL;
+
+//! 転送タスクのハンドラ
+static TaskHandle_t task = NULL;
+
+//! 最後に送信したバイトが改行文字か否か
+static bool atLineHead = true;
+
+//! フロー制御で送信を止めているか否か
+static bool paused = false;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * ホストからのフロー制御の処理
+ *
+ * @remark
+ *  USBシリアルで受信したXOFF/XON以外のバイトは捨てる。
+ */
+static void
+poll_flow_control()
+{
+  int ch;
+
+  while ((ch = Serial.read()) >= 0) {
+    if (ch == BRIDGE_XOFF) {
+      if (!paused) stats.bridge_xoff++;
+      paused = true;
+
+    } else if (ch == BRIDGE_XON) {
+      paused = false;
+    }
+  }
+}
+
+/**
+ * 溜まっているテレメトリ行の送信
+ *
+ * @param [in] force  行境界でなくても期限切れの行を捨てるか否か
+ *
+ * @remark
+ *  行境界(最後に送信したバイトが改行文字)の場合のみ送信する。
+ */
+static void
+flush_lines(bool force)
+{
+  static Line line;
+
+  while (xQueuePeek(lines, &line, 0) == pdPASS) {
+    if (atLineHead) {
+      Serial.write((const uint8_t*)line.data, line.size);
+
+    } else if (force && esp_timer_get_time() - line.time > BRIDGE_LINE_WAIT) {
+      stats.bridge_line_drops++;
+
+    } else {
+      break;
+    }
+
+    xQueueReceive(lines, &line, 0);
+  }
+}
+
+/**
+ * データの送信
+ *
+ * @param [in] data  送信データ
+ * @param [in] size  送信データのサイズ
+ *
+ * @remark
+ *  テレメトリ行が溜まっている場合は、データ中の最後の改行文字の直後に挿入
+ *  する。
+ */
+static void
+send_data(const uint8_t* data, size_t size)
+{
+  const uint8_t* p;
+  size_t head;
+
+  head = 0;
+
+  if (uxQueueMessagesWaiting(lines) > 0) {
+    p = (const uint8_t*)memrchr(data, '\n', size);
+
+    if (p != NULL) {
+      head = p - data + 1;
+
+      Serial.write(data, head);
+      atLineHead = true;
+      flush_lines(false);
+    }
+  }
+
+  if (head < size) {
+    Serial.write(data + head, size - head);
+    atLineHead = (data[size - 1] == '\n');
+  }
+
+  stats.bridge_writes++;
+  stats.bridge_bytes += size;
+}
+
+static void
+bridge_task_func(void* arg)
+{
+  static uint8_t buf[BRIDGE_CHUNK_SIZE * BRIDGE_BATCH];
+  int64_t times[BRIDGE_BATCH];
+  Chunk chunk;
+  int64_t now;
+  uint32_t lat;
+  size_t used;
+  int n;
+  int i;
+
+  while (true) {
+    poll_flow_control();
+
+    if (paused) {
+      vTaskDelay(pdMS_TO_TICKS(BRIDGE_POLL));
+      continue;
+    }
+
+    /*
+     * チャンクの取り出し
+     *   最初のチャンクのみ待ち、以降はキューに溜まっている分をまとめる。
+     */
+    used = 0;
+    n    = 0;
+
+    if (xQueueReceive(queue, &chunk, pdMS_TO_TICKS(BRIDGE_POLL)) == pdPASS) {
+      do {
+        memcpy(buf + used, chunk.data, chunk.size);
+        used       += chunk.size;
+        times[n++]  = chunk.time;
+      } while (n < BRIDGE_BATCH &&
+               xQueueReceive(queue, &chunk, 0) == pdPASS);
+    }
+
+    /*
+     * 送信
+     */
+    if (used > 0) send_data(buf, used);
+    flush_lines(true);
+
+    /*
+     * 遅延の計上(受信からドライバへの受け渡しの完了まで)
+     */
+    now = esp_timer_get_time();
+
+    for (i = 0; i < n; i++) {
+      lat = (uint32_t)(now - times[i]);
+
+      stats.bridge_chunks++;
+      stats.bridge_lat_sum_us += lat;
+      if (lat > stats.bridge_lat_peak_us) stats.bridge_lat_peak_us = lat;
+    }
+  }
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+bridge_start(uint32_t baud)
+{
+  int ret;
+  BaseType_t err;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * state check
+   */
+  if (task != NULL) ret = DEFAULT_ERROR;
+
+  /*
+   * initialize serial
+   *   ドライバのバッファサイズはbegin()の前に設定しておく必要がある。
+   */
+  if (!ret) {
+    Serial.setTxBufferSize(BRIDGE_TX_BUFF_SIZE);
+    Serial.begin(baud);
+  }
+
+  /*
+   * start task
+   */
+  if (!ret) {
+    queue = xQueueCreate(BRIDGE_QUEUE_DEPTH, sizeof(Chunk));
+    lines = xQueueCreate(BRIDGE_LINE_DEPTH, sizeof(Line));
+    if (queue == NULL || lines == NULL) ret = DEFAULT_ERROR;
+  }
+
+  if (!ret) {
+    // 受信タスクと同じAPP_CPUで、受信タスクより低い優先度で動作させる
+    err = xTaskCreateUniversal(bridge_task_func,
+                               "Bridge task",
+                               3072,
+                               NULL,
+                               TASK_PRIORITY,
+                               &task,
+                               APP_CPU_NUM);
+    if (err != pdPASS) ret = DEFAULT_ERROR;
+  }
+
+  /*
+   * post process
+   */
+  if (ret) {
+    if (queue != NULL) vQueueDelete(queue);
+    if (lines != NULL) vQueueDelete(lines);
+
+    queue = NULL;
+    lines = NULL;
+    task  = NULL;
+  }
+
+  return ret;
+}
+
+void
+bridge_push(const uint8_t* data, size_t size)
+{
+  Chunk chunk;
+  size_t n;
+
+  if (queue == NULL) return;
+
+  chunk.time = esp_timer_get_time();
+
+  while (size > 0) {
+    n = (size < BRIDGE_CHUNK_SIZE)? size: BRIDGE_CHUNK_SIZE;
+
+    chunk.size = n;
+    memcpy(chunk.data, data, n);
+
+    if (xQueueSend(queue, &chunk, 0) != pdPASS) stats.bridge_drops += n;
+
+    data += n;
+    size -= n;
+  }
+}
+
+void
+bridge_puts(const char* s)
+{
+  static Line line;
+  size_t n;
+
+  if (lines == NULL) return;
+
+  n = strlen(s);
+  if (n >= sizeof(line.data)) n = sizeof(line.data) - 1;
+
+  line.time = esp_timer_get_time();
+  line.size = n;
+  memcpy(line.data, s, n);
+
+  if (xQueueSend(lines, &line, 0) != pdPASS) {
+    ESP_LOGE("bridge_puts", "line queue full");
+  }
+}
@@ -0,0 +1,77 @@
+/*
+ * Recorder for AC power monitor
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef __BRIDGE_H__
+#define __BRIDGE_H__
+
+//! 受信タスクから受け取るチャンクの最大サイズ
+#define BRIDGE_CHUNK_SIZE     (64)
+
+//! テレメトリ行の最大長(終端を含む)
+#define BRIDGE_LINE_SIZE      (1280)
+
+//! フロー制御の停止要求(XOFF)
+#define BRIDGE_XOFF           (0x13)
+
+//! フロー制御の再開要求(XON)
+#define BRIDGE_XON            (0x11)
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* defined(__cplusplus) */
+
+/**
+ * ブリッジモジュールの動作開始
+ *
+ * @param [in] baud  USBシリアルの通信速度
+ *
+ * @retrun
+ *   処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  本関数を呼び出すと、SerialをBRIDGE_TX_BUFF_SIZEの送信バッファで初期化し、
+ *  受信タスクから渡されたデータをUSBシリアルに転送するタスクを起動する。
+ *  receiver_start()より前に呼び出すこと。
+ *  転送タスクはキューに溜まったチャンクをまとめて一回のwrite()で送信する。
+ *  ホストからXOFFを受信すると再開要求(XON)を受信するまで送信を止め、その間
+ *  のデータはキューに蓄える。キューが溢れた分は捨てて動作統計に計上する(受
+ *  信タスクとSDカードへの記録は転送の状態の影響を受けない)。
+ */
+int bridge_start(uint32_t baud);
+
+/**
+ * 受信データの転送の登録
+ *
+ * @param [in] data  受信データ
+ * @param [in] size  受信データのサイズ
+ *
+ * @remark
+ *  受信タスクから呼び出す。待たずに復帰し、キューに空きが無い場合は捨てる。
+ *  記録状態にかかわらず、受信した全てのバイト(CSV・バイナリを問わない)を
+ *  登録すること。
+ */
+void bridge_push(const uint8_t* data, size_t size);
+
+/**
+ * テレメトリ行の送信の登録
+ *
+ * @param [in] s  送信する行(改行で終わる文字列)
+ *
+ * @remark
+ *  転送中のデータの行の途中に割り込まないよう、転送タスクは次に改行文字を
+ *  送信した直後に挿入する。BRIDGE_LINE_WAITの間に行境界が現れない場合(バイ
+ *  ナリの転送中等)は捨てる。
+ */
+void bridge_puts(const char* s);
+
+#ifdef __cplusplus
+}
+#endif /* defined(__cplusplus) */
+#endif /* !defined(__BRIDGE_H__) */
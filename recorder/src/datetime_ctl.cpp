@@ -4,6 +4,12 @@
  *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>.
  */
 
+/*
+ * NO_TIME_SYNCを定義したビルドでは本モジュールを空にして、WiFiライブラリへ
+ * の依存を断つ(platformio.iniのlib_ldf_mode = chain+で条件付きのインクルー
+ * ドが評価される)。
+ */
+#ifndef NO_TIME_SYNC
 #include <Arduino.h>
 #include <WiFi.h>
 #include <SdFat.h>
@@ -11,6 +17,8 @@
 
 #include "datetime_ctl.h"
 
+#include <hal_clock.h>
+
 //! 内部用のデフォルトエラーコード
 #define DEFAULT_ERROR       (__LINE__)
 
@@ -198,7 +206,7 @@ connect_to_wifi_ap(char* ssid, char* pass)
       if (WiFi.status() == WL_CONNECTED) break;
       if (i >= AP_TIMEOUT) break;
 
-      delay(500);
+      hal_delay(500);
     }
 
     if (WiFi.status() != WL_CONNECTED) {
@@ -276,7 +284,7 @@ datetime_initialize()
     /*
      * test load
      */
-    if (!getLocalTime(&tm)) {
+    if (!hal_get_local_time(&tm)) {
       ret = DEFAULT_ERROR;
       debug_println("date time configuration failed.");
       break;
@@ -296,3 +304,4 @@ datetime_initialize()
 
   return ret;
 }
+#endif /* !defined(NO_TIME_SYNC) */
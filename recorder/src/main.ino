@@ -8,9 +8,29 @@
 #include <FastLED.h>
 #include <SdFat.h>
 #include <time.h>
+#include <stdarg.h>
+#ifdef LOW_POWER
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <driver/gpio.h>
+#endif /* defined(LOW_POWER) */
 
 #include "writer.h"
+#include "receiver.h"
+#include "stats.h"
+#include "resample.h"
+#include "trim.h"
+#include "recdir.h"
+#ifndef NO_TIME_SYNC
 #include "datetime_ctl.h"
+#endif /* !defined(NO_TIME_SYNC) */
+#ifdef BRIDGE
+#include "bridge.h"
+#endif /* defined(BRIDGE) */
+
+#include <hal_clock.h>
+#include <lowpower.h>
+#include <segment.h>
 
 //! RGBLED制御に割り当てられているGPIOの番号
 #define LED_PIN         (27)
@@ -21,6 +41,9 @@
 //! データ受信に使用するシリアルの送信信号に割り当てるGPIOの番号
 #define TXPIN           (26)
 
+//! ボタンに割り当てられているGPIOの番号
+#define BTNPIN          (39)
+
 //! SPI制御のSCKに割り当てるGPIOの番号
 #define  SCK            (23)
 
@@ -55,6 +78,160 @@
 //! デフォルトのエラーコード
 #define DEFAULT_ERROR   (__LINE__)
 
+//! コンソールへの動作統計の出力周期(ミリ秒)
+#define STAT_INTERVAL   (10000)
+
+//! 動作統計の文字列化用バッファのサイズ
+#define STAT_BUFF_SIZE  (1024)
+
+/*
+ * ファイルの切り替え
+ *   FAT12/16/32ではSEGMENT_SIZE_FAT(segment.h参照)で切り替える。exFATでは
+ *   SEGMENT_SIZE_EXFATを定義した場合のみ指定サイズで切り替える。
+ */
+#ifndef SEGMENT_SIZE_EXFAT
+#define SEGMENT_SIZE_EXFAT  (0)
+#endif /* !defined(SEGMENT_SIZE_EXFAT) */
+
+/*
+ * 再標本化
+ *   ビルドフラグでRESAMPLEを定義すると、受信したデータ行をセッション開始時
+ *   の最初のサンプルを起点とするRESAMPLE_PERIOD毎の格子点に線形補間して記録
+ *   する(RESAMPLE_ZOHを定義した場合は0次ホールド)。データ行以外の行("!"で
+ *   始まるイベント行等)はそのまま記録する。
+ */
+#ifdef RESAMPLE
+#ifdef CHAINED_SENSOR
+#error "RESAMPLE can not be used with CHAINED_SENSOR"
+#endif /* defined(CHAINED_SENSOR) */
+
+#ifndef RESAMPLE_PERIOD
+//! 格子の間隔(ミリ秒)
+#define RESAMPLE_PERIOD   (100)
+#endif /* !defined(RESAMPLE_PERIOD) */
+
+#ifndef RESAMPLE_MAX_GAP
+//! 補間を行わない最大のサンプル間隔(ミリ秒)
+#define RESAMPLE_MAX_GAP  (2000)
+#endif /* !defined(RESAMPLE_MAX_GAP) */
+
+#ifdef RESAMPLE_ZOH
+#define RESAMPLE_HOLD     (true)
+#else /* defined(RESAMPLE_ZOH) */
+#define RESAMPLE_HOLD     (false)
+#endif /* defined(RESAMPLE_ZOH) */
+#endif /* defined(RESAMPLE) */
+
+/*
+ * 精度の切り詰め
+ *   ビルドフラグでTRIMを定義すると、データ行の電圧・電流・消費電力の列を小
+ *   数点以下TRIM_DIGITS_V/TRIM_DIGITS_A/TRIM_DIGITS_Wの桁数に丸めて記録する
+ *   (センサーの"%f"の6桁はHLW8032の分解能を大きく超えている)。書式が不正
+ *   なデータ行は破棄する。RESAMPLEと併用した場合は再標本化後の行に適用する。
+ */
+#ifdef TRIM
+#ifndef TRIM_DIGITS_V
+//! 電圧の小数点以下の桁数
+#define TRIM_DIGITS_V     (1)
+#endif /* !defined(TRIM_DIGITS_V) */
+
+#ifndef TRIM_DIGITS_A
+//! 電流の小数点以下の桁数
+#define TRIM_DIGITS_A     (3)
+#endif /* !defined(TRIM_DIGITS_A) */
+
+#ifndef TRIM_DIGITS_W
+//! 消費電力の小数点以下の桁数
+#define TRIM_DIGITS_W     (1)
+#endif /* !defined(TRIM_DIGITS_W) */
+
+#if TRIM_DIGITS_V > TRIM_MAX_DIGITS || \
+    TRIM_DIGITS_A > TRIM_MAX_DIGITS || \
+    TRIM_DIGITS_W > TRIM_MAX_DIGITS
+#error "TRIM_DIGITS_* must not exceed TRIM_MAX_DIGITS"
+#endif
+#endif /* defined(TRIM) */
+
+/*
+ * 省電力動作
+ *   ビルドフラグでLOW_POWERを定義すると、CPUクロックを80MHzに下げ、受信が
+ *   LP_SLEEP_IDLE以上途絶えていて受信中の行・書き込み中のデータ・ボタン操作
+ *   が無い場合に、次の動作統計の出力時刻までライトスリープする。起床はRX信
+ *   号もしくはボタンのLowレベル(GPIOウェイクアップ)とタイマーで行う(ESP32
+ *   のUARTウェイクアップはUART0/1のみで、受信に使用しているUART2では使用で
+ *   きない)。起床中に届いたバイトは失われるので、センサー側はWAKE_PREAMBLE
+ *   を定義してビルドし、行の前にプリアンブルを送らせること(lowpower.h参照)。
+ *   書き込み用バッファは起床回数を減らすため大きく取る(writer.cpp参照)。
+ *
+ *   動作統計にはスリープ時間と起床要因毎の回数、LOW_POWER_SLEEP_UAと
+ *   LOW_POWER_ACTIVE_UAから見積もった平均電流(est_current_ua)が含まれる。
+ *   SDカードの電源は制御できないので、カードの待機電流は含まれない。
+ */
+#ifdef LOW_POWER
+#ifndef LOW_POWER_SLEEP_UA
+//! ライトスリープ中の消費電流(マイクロアンペア, 見積もり用)
+#define LOW_POWER_SLEEP_UA    (1500)
+#endif /* !defined(LOW_POWER_SLEEP_UA) */
+
+#ifndef LOW_POWER_ACTIVE_UA
+//! 動作中の消費電流(マイクロアンペア, 見積もり用)
+#define LOW_POWER_ACTIVE_UA   (30000)
+#endif /* !defined(LOW_POWER_ACTIVE_UA) */
+
+//! 省電力動作時のCPUクロック(MHz, APBクロックが変わらない下限)
+#define LOW_POWER_CPU_MHZ     (80)
+#endif /* defined(LOW_POWER) */
+
+/*
+ * ビルドプロファイル
+ *   以下のフラグの組み合わせをplatformio.iniのenv(minimal, timesync, uplink)
+ *   として定義している。
+ *
+ *   NO_TIME_SYNCを定義すると時刻合わせ(ap_info.txtの読み込み、WiFiへの接続、
+ *   NTP)をコンパイルせず、WiFiスタックをリンクしない。記録ファイルは常にセッ
+ *   ション毎のディレクトリに作成する。
+ *
+ *   NO_UPLINKを定義するとUSBシリアルへの受信データのミラーと動作統計の出力
+ *   を行わない(セッション統計の.logファイルは作成する)。
+ *
+ *   いずれのプロファイルでも、起動処理の完了時にPROFILE_NAMEとsetup()の完了
+ *   までの時間を"#boot profile=名前 ms=時間"の形式でUSBシリアルに出力し、
+ *   セッション統計の.logファイルにも記録する。
+ */
+#ifndef PROFILE_NAME
+//! プロファイル名
+#define PROFILE_NAME          "custom"
+#endif /* !defined(PROFILE_NAME) */
+
+/*
+ * USBブリッジ
+ *   ビルドフラグでBRIDGEを定義すると、受信タスクが受信したバイト列(CSV・バ
+ *   イナリを問わない)を記録状態にかかわらずそのままUSBシリアルに転送する。
+ *   転送は専用のタスクがチャンクをまとめて行い、USBシリアルの通信速度は
+ *   BRIDGE_BAUDとする。ホストはXOFF/XONで転送を一時停止できる(停止中のデー
+ *   タはキューに蓄え、溢れた分は捨てて計上する)。SDカードへの記録は通常通
+ *   り行い、記録中のCSVデータの一文字毎のミラーは行わない。
+ *
+ *   動作統計と"#boot"の行は転送データの行境界に挿入する。動作統計には転送
+ *   バイト数・キュー溢れ・遅延(受信から転送まで)の最大値に加え、区間中の平
+ *   均転送レート(bridge_rate_avg_bps)・平均遅延(bridge_lat_avg_us)・USBシリ
+ *   アルの使用率(bridge_util_pct)が含まれる。
+ */
+#ifdef BRIDGE
+#ifdef NO_UPLINK
+#error "BRIDGE can not be used with NO_UPLINK"
+#endif /* defined(NO_UPLINK) */
+
+#ifdef LOW_POWER
+#error "BRIDGE can not be used with LOW_POWER"
+#endif /* defined(LOW_POWER) */
+
+#ifndef BRIDGE_BAUD
+//! USBシリアルの通信速度
+#define BRIDGE_BAUD           (921600)
+#endif /* !defined(BRIDGE_BAUD) */
+#endif /* defined(BRIDGE) */
+
 //! SDカードインタフェースオブジェクト
 SdFat SD;
 
@@ -67,6 +244,58 @@ static int state;
 //! 時刻情報が使用可能か否かを示すフラグ
 static bool enableDatetime = false;
 
+/**
+ * 記録中のファイルの名前(記録先ディレクトリからの相対パス)
+ *
+ * @remarks
+ *  書き込みタスクに渡したパス文字列は、writer_finish()が呼び出されるまで保持
+ *  し続ける必要がある。状態遷移的に、記録終了まで内容は変更されない。
+ */
+static char path[64];
+
+//! 記録開始時点の動作統計(セッション中の増分の算出用)
+static stats_t sessionBase;
+
+//! ファイルを切り替えるサイズ(0の場合は切り替えない)
+static uint64_t segmentSize = SEGMENT_SIZE_FAT;
+
+//! 動作統計の出力周期の判定状態(起動時から周期を数える)
+static hal_interval_t statTimer = {STAT_INTERVAL, 0};
+
+//! setup()の完了までに要した時間(ミリ秒)
+static uint32_t bootTime = 0;
+
+#ifdef LOW_POWER
+//! 受信側の省電力動作の状態
+static lp_rx_t lpRx;
+
+//! 受信による起床の時刻(esp_timer_get_time()の値, 0の場合は行の待ち無し)
+static int64_t wakeTime = 0;
+#endif /* defined(LOW_POWER) */
+
+#ifdef RESAMPLE
+//! 再標本化の状態
+static resample_t resampler;
+#endif /* defined(RESAMPLE) */
+
+#ifdef TRIM
+//! 精度の切り詰めのパラメータ
+static const trim_param_t trimParam = {
+  {TRIM_DIGITS_V, TRIM_DIGITS_A, TRIM_DIGITS_W}
+};
+#endif /* defined(TRIM) */
+
+#if defined(RESAMPLE) || defined(TRIM)
+//! 組み立て中の行
+static char lineBuff[RECEIVER_LINE_SIZE];
+
+//! 組み立て中の行の長さ
+static size_t lineSize = 0;
+
+//! 組み立て中の行がバッファ長を超えたか否か
+static bool lineOverflow = false;
+#endif /* defined(RESAMPLE) || defined(TRIM) */
+
 /*
  * 内部関数
  */
@@ -181,51 +410,99 @@ was_hold()
   return ret;
 }
 
+#if defined(RESAMPLE) || defined(TRIM)
 /**
- * 書き込みタスクの起動
+ * 行の出力
+ *
+ * @param [in] s    出力する文字列(改行を含む一行)
+ * @param [in] arg  未使用
+ *
+ * @remarks
+ *  モニタ用シリアルへの出力もこの関数で行う。再標本化の出力先としても使用
+ *  する。TRIMが定義されている場合は、データ行の精度を切り詰めてから出力す
+ *  る(書式が不正な行は出力しない)。
  */
 static void
-start_writer_task()
+output_line(const char* s, void* arg)
 {
-  // あまり良い方法ではないが、管理が面倒だったので書き込みタスクに渡すパス文
-  // 字列を保持し続けるためにstaticローカルにしています。
-  // ※状態遷移的に、writer_finish()が呼び出されるまでこの関数が呼び出されるこ
-  //   とはないので内容は変更されないはず…
-  
-  static char path[64];
+#ifdef TRIM
+  char trimmed[RECEIVER_LINE_SIZE];
 
-  bool err;
+  if (s[0] >= '0' && s[0] <= '9') {
+    if (trim_row(s, trimmed, sizeof(trimmed), &trimParam)) return;
+    s = trimmed;
+  }
+#endif /* defined(TRIM) */
+
+  writer_puts(s, NULL);
+#if !defined(NO_UPLINK) && !defined(BRIDGE)
+  Serial.print(s);
+#endif /* !defined(NO_UPLINK) && !defined(BRIDGE) */
+}
+#endif /* defined(RESAMPLE) || defined(TRIM) */
+
+/**
+ * 書き込みタスクの起動
+ *
+ * @param [in] session  新しい記録セッションの開始か否か(ファイルの切り替え
+ *                      の場合はfalse)
+ *
+ * @remarks
+ *  記録ファイルは時刻情報が使用できる場合は"/YYYY/MM/DD"に、使用できない場
+ *  合はセッション毎のディレクトリに作成する(recdir.h参照)。ディレクトリを
+ *  作成できなかった場合はカレントディレクトリ(ルート)に記録する。
+ */
+static void
+start_writer_task(bool session)
+{
   time_t t;
   struct tm* tm;
-
-  int fno = 1;
+  bool err;
 
   if (enableDatetime) {
-    t  = time(NULL);
+    t  = hal_time();
     tm = localtime(&t);
-
-    sprintf(path,
-            "/output-%04d%02d%02d-%02d%02d%02d.csv",
-            1900 + tm->tm_year,
-            tm->tm_mon + 1,
-            tm->tm_mday,
-            tm->tm_hour,
-            tm->tm_min,
-            tm->tm_sec);
-
   } else {
-    do {
-      sprintf(path, "/output-%03d.csv", fno++);
-    } while (SD.exists(path));
+    tm = NULL;
   }
 
-  writer_start(path);
+  err = (session && recdir_begin(tm) != 0);
+  if (recdir_next(tm, path, sizeof(path)) != 0) err = true;
+  if (err) stats.wr_errors++;
+
+  writer_start(recdir_handle(), path);
+
+  stats_snapshot(&sessionBase);
 
   // UTF-8 BOM (これがないとExcelで化ける)
   writer_puts("\xef\xbb\xbf", NULL);
 
   // CSVヘッダ
-  writer_puts("\"タイムスタンプ\",\"電圧\",\"電流\",\"消費電力\"\n", NULL);
+  //   出力レート制御を行うセンサーの出力には区間長の列が、デイジーチェーン
+  //   接続されたセンサーの出力にはノードIDの列がこの順で付与される
+  writer_puts("\"タイムスタンプ\",\"電圧\",\"電流\",\"消費電力\"", NULL);
+#if defined(ADAPTIVE_SENSOR) && !defined(RESAMPLE)
+  // 再標本化した行には区間長の列は含まれない
+  writer_puts(",\"区間長\"", NULL);
+#endif /* defined(ADAPTIVE_SENSOR) && !defined(RESAMPLE) */
+#ifdef CHAINED_SENSOR
+  writer_puts(",\"ノードID\"", NULL);
+#endif /* defined(CHAINED_SENSOR) */
+  writer_puts("\n", NULL);
+
+#ifdef RESAMPLE
+  resample_init(&resampler,
+                RESAMPLE_PERIOD,
+                RESAMPLE_MAX_GAP,
+                RESAMPLE_HOLD,
+                output_line,
+                NULL);
+#endif /* defined(RESAMPLE) */
+
+#if defined(RESAMPLE) || defined(TRIM)
+  lineSize     = 0;
+  lineOverflow = false;
+#endif /* defined(RESAMPLE) || defined(TRIM) */
 }
 
 /**
@@ -234,13 +511,103 @@ start_writer_task()
  * @param [in] ch  出力する文字データ
  *
  * @remarks
- *  モニタ用シリアルへの出力もこの関数で行う
+ *  モニタ用シリアルへの出力もこの関数で行う。RESAMPLEもしくはTRIMが定義さ
+ *  れている場合は行単位に組み立てて再標本化・精度の切り詰めを行う。
  */
 static void
 output_data(char ch)
 {
+#if defined(RESAMPLE) || defined(TRIM)
+#ifdef RESAMPLE
+  resample_sample_t smp;
+#endif /* defined(RESAMPLE) */
+
+  // 改行文字と終端の分を残しておく
+  if (ch != '\n') {
+    if (lineSize < sizeof(lineBuff) - 2) {
+      lineBuff[lineSize++] = ch;
+    } else {
+      lineOverflow = true;
+    }
+    return;
+  }
+
+  lineBuff[lineSize++] = '\n';
+  lineBuff[lineSize]   = '\0';
+
+  if (lineBuff[0] >= '0' && lineBuff[0] <= '9') {
+    // データ行
+#ifdef RESAMPLE
+    stats.resample_in++;
+
+    if (!lineOverflow && !resample_parse(lineBuff, &smp)) {
+      resample_push(&resampler, &smp);
+    } else {
+      stats.resample_rejects++;
+    }
+#else /* defined(RESAMPLE) */
+    if (!lineOverflow) {
+      output_line(lineBuff, NULL);
+    } else {
+      stats.trim_rejects++;
+    }
+#endif /* defined(RESAMPLE) */
+
+  } else if (!lineOverflow) {
+    // データ行以外はそのまま出力
+    output_line(lineBuff, NULL);
+  }
+
+  lineSize     = 0;
+  lineOverflow = false;
+#else /* defined(RESAMPLE) || defined(TRIM) */
   writer_push(ch, NULL);
+#if !defined(NO_UPLINK) && !defined(BRIDGE)
   Serial.print(ch);
+#endif /* !defined(NO_UPLINK) && !defined(BRIDGE) */
+#endif /* defined(RESAMPLE) || defined(TRIM) */
+}
+
+/**
+ * セッション統計の記録
+ *
+ * @remarks
+ *  記録ファイルと同じ名前で拡張子を".log"としたファイルに、記録中の動作統計
+ *  の増分を"名前=値"の形式で一行ずつ書き込む。UARTの取りこぼし等の発生有無を
+ *  記録データと突き合わせて確認するためのもの。
+ */
+static void
+write_session_stats()
+{
+  char name[sizeof(path)];
+  char buf[STAT_BUFF_SIZE];
+  stats_t cur;
+  char* ext;
+  SdFile f;
+
+  strcpy(name, path);
+  ext = strrchr(name, '.');
+  if (ext == NULL) return;
+  strcpy(ext, ".log");
+
+  stats_snapshot(&cur);
+  if (stats_format(buf, sizeof(buf), &cur, &sessionBase, '\n')) return;
+
+  if (recdir_handle() != NULL) {
+    f.open(recdir_handle(), name, O_WRONLY | O_CREAT | O_TRUNC);
+  } else {
+    f.open(name, O_WRONLY | O_CREAT | O_TRUNC);
+  }
+
+  if (f.isOpen()) {
+    f.printf("file=%s/%s\nprofile=%s\nboot_ms=%lu\n%s\n",
+             recdir_path(),
+             path,
+             PROFILE_NAME,
+             (unsigned long)bootTime,
+             buf);
+    f.close();
+  }
 }
 
 /**
@@ -250,7 +617,193 @@ static void
 stop_writer_task()
 {
   writer_finish();
+  write_session_stats();
+}
+
+/**
+ * 記録ファイルの切り替え
+ *
+ * @remarks
+ *  行境界で呼び出すこと。切り替え後のファイルにもヘッダ行が書き込まれ、セッ
+ *  ション統計もファイル毎に記録される。書き込みタスクの停止を待つ間の受信デ
+ *  ータは受信タスクのバッファに蓄積される。
+ */
+static void
+rotate_writer_task()
+{
+  stop_writer_task();
+  stats.wr_segments++;
+  start_writer_task(false);
+}
+
+/**
+ * コンソールへの一行の出力
+ *
+ * @param [in] fmt  書式(改行で終わること)
+ *
+ * @remarks
+ *  BRIDGEが定義されている場合は、転送データの行境界に挿入するためにブリッ
+ *  ジモジュールに登録する。
+ */
+static void
+put_uplink(const char* fmt, ...)
+{
+  char line[STAT_BUFF_SIZE + 128];
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+
+#ifdef BRIDGE
+  bridge_puts(line);
+#else /* defined(BRIDGE) */
+  Serial.print(line);
+#endif /* defined(BRIDGE) */
+}
+
+/**
+ * 動作統計のコンソールへの出力
+ *
+ * @remarks
+ *  STAT_INTERVAL毎に"#stat 名前=値 ..."の形式の一行と、ヒストグラム毎に
+ *  "#hist 名前 sum=合計 count=件数 上限=累積件数 ..."の形式の一行をコンソー
+ *  ルに出力する。記録中はコンソールにCSVデータがミラーされているので、行
+ *  の途中に割り込まないよう行境界でのみ呼び出すこと。NO_UPLINKが定義されて
+ *  いる場合は出力時刻の更新のみを行う。
+ */
+static void
+print_stats()
+{
+#ifndef NO_UPLINK
+  char buf[STAT_BUFF_SIZE];
+  stats_t cur;
+#ifdef LOW_POWER
+  static uint32_t sleepBase = 0;
+  uint32_t current;
+#endif /* defined(LOW_POWER) */
+#ifdef BRIDGE
+  static stats_t bridgeBase;
+  uint32_t bytes;
+  uint32_t chunks;
+#endif /* defined(BRIDGE) */
+#endif /* !defined(NO_UPLINK) */
+  uint32_t elapsed;
+
+  elapsed = hal_interval_check(&statTimer);
+  if (elapsed == 0) return;
+
+#ifndef NO_UPLINK
+  stats_snapshot(&cur);
+  if (!stats_format(buf, sizeof(buf), &cur, NULL, ' ')) {
+#ifdef LOW_POWER
+    current = lp_estimate_current((cur.lp_sleep_ms - sleepBase) * 1000ULL,
+                                  elapsed * 1000ULL,
+                                  LOW_POWER_SLEEP_UA,
+                                  LOW_POWER_ACTIVE_UA);
+    sleepBase = cur.lp_sleep_ms;
+
+    put_uplink("#stat %s est_current_ua=%lu\n", buf, (unsigned long)current);
+#elif defined(BRIDGE)
+    /*
+     * 区間中の転送レートと遅延
+     *   8N1では1バイトあたり10ビットを占有するので、転送バイト数から
+     *   BRIDGE_BAUDに対する使用率(%)を求める。
+     */
+    bytes  = cur.bridge_bytes - bridgeBase.bridge_bytes;
+    chunks = cur.bridge_chunks - bridgeBase.bridge_chunks;
+
+    put_uplink("#stat %s bridge_rate_avg_bps=%lu bridge_lat_avg_us=%lu"
+               " bridge_util_pct=%.1f\n",
+               buf,
+               (unsigned long)(bytes * 8000ULL / elapsed),
+               (unsigned long)((chunks > 0)?
+                   (cur.bridge_lat_sum_us - bridgeBase.bridge_lat_sum_us) /
+                   chunks: 0),
+               (bytes * 10 * 100000.0f) / ((float)BRIDGE_BAUD * elapsed));
+
+    bridgeBase = cur;
+#else /* defined(LOW_POWER) || defined(BRIDGE) */
+    put_uplink("#stat %s\n", buf);
+#endif /* defined(LOW_POWER) || defined(BRIDGE) */
+  }
+
+  if (!stats_format_hist(buf, sizeof(buf), "wr_latency_ms", &wr_latency)) {
+    put_uplink("#hist %s\n", buf);
+  }
+#endif /* !defined(NO_UPLINK) */
+}
+
+#ifdef LOW_POWER
+/**
+ * ライトスリープ
+ *
+ * @remarks
+ *  受信が途絶えていて処理中のデータが無い場合に、次の動作統計の出力時刻ま
+ *  でライトスリープする(条件はlp_rx_sleep_time()参照)。起床要因を動作統計
+ *  に記録し、受信による起床の場合は最初の行を取り出すまでの時間を計るため
+ *  に起床時刻を記録する。
+ */
+static void
+light_sleep()
+{
+  uint32_t msec;
+  int64_t t0;
+  int64_t t1;
+  bool busy;
+
+  /*
+   * initialize
+   */
+  busy = receiver_busy() || writer_busy() || M5.BtnA.isPressed();
+
+  /*
+   * check sleep time
+   */
+  msec = lp_rx_sleep_time(&lpRx,
+                          hal_millis(),
+                          hal_interval_remain(&statTimer),
+                          busy);
+  if (msec == 0) return;
+
+  /*
+   * sleep
+   */
+  Serial.flush();
+
+  gpio_wakeup_enable((gpio_num_t)RXPIN, GPIO_INTR_LOW_LEVEL);
+  gpio_wakeup_enable((gpio_num_t)BTNPIN, GPIO_INTR_LOW_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+  esp_sleep_enable_timer_wakeup(msec * 1000ULL);
+
+  t0 = esp_timer_get_time();
+  esp_light_sleep_start();
+  t1 = esp_timer_get_time();
+
+  gpio_wakeup_disable((gpio_num_t)RXPIN);
+  gpio_wakeup_disable((gpio_num_t)BTNPIN);
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
+
+  /*
+   * post process
+   */
+  stats.lp_sleeps++;
+  stats.lp_sleep_ms += (uint32_t)((t1 - t0) / 1000);
+
+  if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO) {
+    // 両方のピンのどちらで起床したかは取得できないのでボタンの状態で判別
+    if (gpio_get_level((gpio_num_t)BTNPIN) == 0) {
+      stats.lp_wake_button++;
+    } else {
+      stats.lp_wake_rx++;
+      wakeTime = t1;
+    }
+
+  } else {
+    stats.lp_wake_timer++;
+  }
 }
+#endif /* defined(LOW_POWER) */
 
 /**
  * 待機状態の処理の実装
@@ -265,15 +818,17 @@ stop_writer_task()
  *   - 出力ファイル名の決定
  *   - 書き込みタスクの起動
  *
- *  出力先のファイル名は "output-[番号].csv"で、未使用の空いているファイル名を
- *  自動的に探査する。
+ *  出力先のファイル名は時刻情報が使用できる場合は"/YYYY/MM/DD/output-[記録
+ *  開始時刻].csv"、使用できない場合はセッション毎のディレクトリ(
+ *  "/S0012/34"等)の"output-[番号].csv"となる(既存のファイル名の探索は行わな
+ *  い)。
  */
 static void
 do_idle_state_proc(char ch, bool btn)
 {
   if (btn) {
     transition_to_ready();
-    start_writer_task();
+    start_writer_task(true);
   }
 }
 
@@ -331,6 +886,9 @@ do_record_state_proc(char ch, bool btn)
     if (btn) {
       stop_writer_task();
       transition_to_idle();
+
+    } else if (segment_due(writer_size(), segmentSize, ch)) {
+      rotate_writer_task();
     }
     break;
 
@@ -435,55 +993,63 @@ show_csd_info()
 /**
  * マウントされているカードのファイルシステム情報の表示
  *
- * @param [in] card  カードインタフェースのポインタ
+ * @remarks
+ *  空きクラスタ数の取得はFAT(exFATではビットマップ)全体を走査するので、大容
+ *  量のカードでは数秒を要する。
  */
 static void
 show_fs_info()
 {
   FsVolume* vol = SD.vol();
-  FsVolume::FsInfo_t info;
-
-  if (vol->readInfo(&fsInfo)) {
-    Serial.print("File system type: ");
-    switch (vol->fatType()) {
-      case FAT_TYPE_FAT12:
-        Serial.println("FAT12");
-        break;
+  uint32_t clusters;
+  int32_t nfree;
+  uint32_t bytes;
+
+  Serial.print("File system type: ");
+  switch (vol->fatType()) {
+    case FAT_TYPE_FAT12:
+      Serial.println("FAT12");
+      break;
+
+    case FAT_TYPE_FAT16:
+      Serial.println("FAT16");
+      break;
+
+    case FAT_TYPE_FAT32:
+      Serial.println("FAT32");
+      break;
+
+    case FAT_TYPE_EXFAT:
+      Serial.println("exFAT");
+      break;
+
+    default:
+      Serial.println("Unknown");
+  }
 
-      case FAT_TYPE_FAT16:
-        Serial.println("FAT16");
-        break;
+  clusters = vol->clusterCount();
+  bytes    = vol->bytesPerCluster();
 
-      case FAT_TYPE_FAT32:
-        Serial.println("FAT32");
-        break;
+  Serial.print("Volume size: ");
+  Serial.print((uint64_t)clusters * bytes / (1024 * 1024));
+  Serial.println("MB");
 
-      case FAT_TYPE_EXFAT:
-        Serial.println("exFAT");
-        break;
+  Serial.print("Cluster count: ");
+  Serial.println(clusters);
 
-      default:
-        Serial.println("Unknown");
-    }
+  Serial.print("Cluster size: ");
+  Serial.print(bytes);
+  Serial.println("bytes");
 
-    Serial.print("Volume size: ");
-    Serial.print(fsInfo.volumeSize);
-    Serial.println("MB");
+  nfree = vol->freeClusterCount();
+  if (nfree >= 0) {
+    Serial.print("Clusters free: ");
+    Serial.println(nfree);
 
     Serial.print("Free space: ");
-    Serial.print(fsInfo.freeSpace);
+    Serial.print((uint64_t)nfree * bytes / (1024 * 1024));
     Serial.println("MB");
 
-    Serial.print("Cluster count: ");
-    Serial.println(fsInfo.clusterCount);
-
-    Serial.print("Clusters free: ");
-    Serial.println(fsInfo.freeClusterCount);
-
-    Serial.print("Cluster size: ");
-    Serial.print(fsInfo.bytesPerCluster);
-    Serial.println("bytes");
-
   } else {
     Serial.println("Failed to read file system information.");
   }
@@ -512,6 +1078,7 @@ show_card_info()
 }
 #endif /* defined(DEBUG) */
 
+#ifndef NO_TIME_SYNC
 /**
  * SdFatの時刻情報取得用のコールバック関数
  *
@@ -530,7 +1097,7 @@ datetime(uint16_t* dst1, uint16_t* dst2, uint8_t* dst3)
   struct tm* tm;
 
   if (enableDatetime) {
-    t  = time(NULL);
+    t  = hal_time();
     tm = localtime(&t);   // for Windows
     // tm = gmtime(&t);    // for Linux
 
@@ -539,6 +1106,7 @@ datetime(uint16_t* dst1, uint16_t* dst2, uint8_t* dst3)
     *dst3 = 0;
   }
 }
+#endif /* !defined(NO_TIME_SYNC) */
 
 /*
  * 公開関数
@@ -570,13 +1138,33 @@ setup()
   led = CRGB::Yellow;
   FastLED.show();
 
+#ifdef LOW_POWER
+  /*
+   * CPUクロックの設定
+   */
+  setCpuFrequencyMhz(LOW_POWER_CPU_MHZ);
+#endif /* defined(LOW_POWER) */
+
   /*
    * シリアルの初期化
    *   Seirialはコンソール出力として使用。
-   *   Serial2はセンサーモジュールからのデータ受信用として使用。
+   *   Serial2はセンサーモジュールからのデータ受信用として使用(初期化はレ
+   *   シーバモジュールで行う)。
    */
+#ifdef BRIDGE
+  // 受信タスクが転送を登録するので、受信モジュールより先に起動する
+  if (bridge_start(BRIDGE_BAUD)) {
+    transition_to_error();
+    return;
+  }
+#else /* defined(BRIDGE) */
   Serial.begin(115200);
-  Serial2.begin(115200, SERIAL_8N1, RXPIN, TXPIN);
+#endif /* defined(BRIDGE) */
+
+  if (receiver_start(RXPIN, TXPIN)) {
+    transition_to_error();
+    return;
+  }
 
   /*
    * SDカードの初期化
@@ -596,6 +1184,10 @@ setup()
   show_card_info();
 #endif /* defined(DEBUG) */
 
+  segmentSize = segment_limit(SD.fatType() == FAT_TYPE_EXFAT,
+                              SEGMENT_SIZE_EXFAT);
+
+#ifndef NO_TIME_SYNC
   /*
    * 時刻の設定
    */
@@ -603,29 +1195,31 @@ setup()
     FsDateTime::setCallback(datetime);
     enableDatetime = true;
   }
+#endif /* !defined(NO_TIME_SYNC) */
+
+#ifdef LOW_POWER
+  lp_rx_init(&lpRx, hal_millis());
+#endif /* defined(LOW_POWER) */
 
   /*
    * 状態をIDLEに遷移
    */
   transition_to_idle();
+
+  bootTime = hal_millis();
+  put_uplink("#boot profile=%s ms=%lu\n",
+             PROFILE_NAME, (unsigned long)bootTime);
 }
 
 /**
- * ルーパー本体
+ * 状態遷移の駆動
  *
- * @remarks
- *  本プログラムの主処理。setup()呼び出し後に、本関数が繰り返し呼び出される。
- *  本関数は、シリアルからの受信（1文字単位）に対する異イベントハンドラのよう
- *  な動作を行う。一文字ごとに状態遷移を回す構成になっている。
+ * @param [in] ch   シリアルで受信した文字(受信がなかった場合はNUL文字)
+ * @param [in] btn  ボタン操作状態(trueの場合は長押し検知)
  */
-void
-loop()
+static void
+dispatch(char ch, bool btn)
 {
-  M5.update();
-
-  char ch = (Serial2.available())? Serial2.read(): 0;
-  bool btn = was_hold();
-
   switch (state) {
   case ST_IDLE:     // 待機状態
     do_idle_state_proc(ch, btn);
@@ -648,3 +1242,54 @@ loop()
     break;
   }
 }
+
+/**
+ * ルーパー本体
+ *
+ * @remarks
+ *  本プログラムの主処理。setup()呼び出し後に、本関数が繰り返し呼び出される。
+ *  シリアルの受信は受信タスクが行単位で行っているので、本関数では受信済みの
+ *  行を一行取り出し、一文字ごとに状態遷移を回す。ボタン操作は行の処理を終え
+ *  た後に「受信なし」と組み合わせて評価する。LOW_POWERが定義されている場合、
+ *  受信が無かった周回ではライトスリープを試みる。
+ */
+void
+loop()
+{
+  static char line[RECEIVER_LINE_SIZE];
+  static bool midline = false;
+  size_t len;
+  size_t i;
+  bool btn;
+#ifdef LOW_POWER
+  uint32_t lat;
+#endif /* defined(LOW_POWER) */
+
+  M5.update();
+
+  btn = was_hold();
+
+  if (receiver_get(line, &len)) len = 0;
+
+  for (i = 0; i < len; i++) dispatch(line[i], false);
+
+  dispatch(0, btn);
+
+  if (len > 0) midline = (line[len - 1] != '\n');
+  if (!midline) print_stats();
+
+#ifdef LOW_POWER
+  if (len > 0) {
+    lp_rx_activity(&lpRx, hal_millis());
+
+    if (wakeTime != 0) {
+      lat = (uint32_t)(esp_timer_get_time() - wakeTime);
+      if (lat > stats.lp_wake_lat_peak_us) stats.lp_wake_lat_peak_us = lat;
+      wakeTime = 0;
+    }
+
+  } else if (state != ST_ERROR) {
+    light_sleep();
+  }
+#endif /* defined(LOW_POWER) */
+}
@@ -0,0 +1,201 @@
+/*
+ * Recorder for AC power monitor
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include <SdFat.h>
+
+#include <recdir.h>
+#include <stats.h>
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+//! セッション番号を記録するファイル
+#define SESSION_FILE    "/session.idx"
+
+//! SDカードインタフェースオブジェクト
+extern SdFat SD;
+
+//! 記録先ディレクトリ
+static SdFile dir;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 記録ファイルの数え上げ
+ *
+ * @remark
+ *  ディレクトリを開いた時に一度だけ行う(開き直すまでは作成した数を加算して
+ *  いく)。走査する範囲はRECDIR_MAX_FILESで抑えられている。
+ */
+static uint32_t
+count_files()
+{
+  uint32_t ret;
+  SdFile f;
+  char name[64];
+  char* ext;
+
+  ret = 0;
+
+  dir.rewind();
+
+  while (f.openNext(&dir, O_RDONLY)) {
+    if (!f.isDir() && f.getName(name, sizeof(name)) > 0) {
+      ext = strrchr(name, '.');
+      if (ext != NULL && strcasecmp(ext, ".csv") == 0) ret++;
+    }
+
+    f.close();
+  }
+
+  dir.rewind();
+
+  return ret;
+}
+
+/**
+ * 記録先ディレクトリのオープン(recpath_fs_t::open_dir)
+ */
+static int
+open_dir(void* arg, const char* path, uint32_t* files)
+{
+  int ret;
+  bool created;
+
+  /*
+   * initialize
+   */
+  ret     = 0;
+  created = false;
+
+  (void)arg;
+
+  /*
+   * open directory
+   */
+  if (dir.isOpen()) dir.close();
+
+  if (!dir.open(path, O_RDONLY)) {
+    if (!SD.mkdir(path, true) || !dir.open(path, O_RDONLY)) {
+      ret = DEFAULT_ERROR;
+    } else {
+      created = true;
+    }
+  }
+
+  if (!ret && !dir.isDir()) {
+    dir.close();
+    ret = DEFAULT_ERROR;
+  }
+
+  /*
+   * count files
+   */
+  if (!ret) {
+    *files = (created)? 0: count_files();
+    stats.wr_dir_opens++;
+  }
+
+  return ret;
+}
+
+/**
+ * セッション番号の読み出し(recpath_fs_t::load_session)
+ */
+static int
+load_session(void* arg, uint32_t* session)
+{
+  SdFile f;
+  char buf[16];
+  int n;
+
+  (void)arg;
+
+  *session = 0;
+
+  if (f.open(SESSION_FILE, O_RDONLY)) {
+    n = f.read(buf, sizeof(buf) - 1);
+    f.close();
+
+    buf[(n > 0)? n: 0] = '\0';
+    *session = strtoul(buf, NULL, 10);
+  }
+
+  return 0;
+}
+
+/**
+ * セッション番号の書き込み(recpath_fs_t::save_session)
+ */
+static int
+save_session(void* arg, uint32_t session)
+{
+  SdFile f;
+
+  (void)arg;
+
+  if (!f.open(SESSION_FILE, O_WRONLY | O_CREAT | O_TRUNC)) {
+    return DEFAULT_ERROR;
+  }
+
+  f.printf("%lu\n", (unsigned long)session);
+  f.close();
+
+  return 0;
+}
+
+//! ファイルシステムの操作(SdFat)
+static const recpath_fs_t fs = {open_dir, load_session, save_session, NULL};
+
+//! 記録先ディレクトリの決定の状態
+static recpath_t ctx;
+
+/**
+ * 状態の初期化(初回のみ)
+ */
+static void
+init_ctx()
+{
+  if (ctx.fs == NULL) recpath_init(&ctx, &fs, RECDIR_MAX_FILES);
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+recdir_begin(const struct tm* tm)
+{
+  init_ctx();
+  return recpath_begin(&ctx, tm);
+}
+
+int
+recdir_next(const struct tm* tm, char* dst, size_t size)
+{
+  init_ctx();
+  return recpath_next(&ctx, tm, dst, size);
+}
+
+SdFile*
+recdir_handle()
+{
+  return (dir.isOpen())? &dir: NULL;
+}
+
+const char*
+recdir_path()
+{
+  return ctx.path;
+}
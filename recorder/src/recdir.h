@@ -0,0 +1,83 @@
+/*
+ * Recorder for AC power monitor
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include <SdFat.h>
+#include <recpath.h>
+
+#ifndef __RECDIR_H__
+#define __RECDIR_H__
+
+//! 一つのディレクトリに置く記録ファイルの数の上限
+//  記録ファイル毎に".log"のファイルも作られるので、エントリ数はこの2倍(長
+//  いファイル名の分を含めるとさらに数倍)になる。
+#ifndef RECDIR_MAX_FILES
+#define RECDIR_MAX_FILES    (RECPATH_MAX_FILES)
+#endif /* !defined(RECDIR_MAX_FILES) */
+
+/**
+ * 記録セッションの開始
+ *
+ * @param [in] tm  記録開始時刻(時刻情報が使用できない場合はNULL)
+ *
+ * @retrun
+ *   処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  記録開始時(ファイルの切り替えを除く)に呼び出す。時刻情報が使用できない
+ *  場合は、ルートの"session.idx"に記録したセッション番号を一つ進め、新しい
+ *  セッションディレクトリ("/S0012/34"の形式、セッション番号1234の場合)を
+ *  作成する。ディレクトリの決定はrecpath_begin()で行う。
+ */
+int recdir_begin(const struct tm* tm);
+
+/**
+ * 次の記録ファイル名の取得
+ *
+ * @param [in] tm     記録開始時刻(時刻情報が使用できない場合はNULL)
+ * @param [out] dst   ファイル名(ディレクトリを含まない)の書き込み先
+ * @param [in] size   書き込み先のサイズ
+ *
+ * @retrun
+ *   処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  時刻情報が使用できる場合は"/YYYY/MM/DD"に"output-YYYYmmdd-HHMMSS.csv"を、
+ *  使用できない場合はセッションディレクトリに"output-NNN.csv"を置く。記録先
+ *  のディレクトリはオープンしたまま保持しておき、日付が変わった場合と、記録
+ *  ファイルの数がRECDIR_MAX_FILESに達した場合にのみ開き直す(日付のディレ
+ *  クトリは"_1", "_2", ...を付けた名前で、セッションディレクトリは次のセッ
+ *  ション番号で作り直す)。このため、記録ファイルの作成時に既存のファイル名
+ *  の探索は行わず、カードに蓄積されたファイル数に依らず一定の時間で次のファ
+ *  イルを開くことができる。
+ *  ディレクトリを開けなかった場合(ルートディレクトリが満杯の場合等)も0以外
+ *  の値を返した上でファイル名は生成する。
+ */
+int recdir_next(const struct tm* tm, char* dst, size_t size);
+
+/**
+ * 記録先ディレクトリの取得
+ *
+ * @return
+ *  recdir_next()で決定した記録先のディレクトリのハンドルを返す。記録ファイ
+ *  ルと".log"のファイルは、このハンドルからの相対パスでオープンする。ディレ
+ *  クトリを開けていない場合はNULLを返す。
+ */
+SdFile* recdir_handle();
+
+/**
+ * 記録先ディレクトリのパスの取得
+ *
+ * @return
+ *  recdir_next()で決定した記録先のディレクトリのパスを返す。
+ */
+const char* recdir_path();
+
+#endif /* !defined(__RECDIR_H__) */
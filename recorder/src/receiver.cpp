@@ -0,0 +1,294 @@
+/*
+ * Recorder for AC power monitor
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdint.h>
+
+#include <Arduino.h>
+#include <driver/uart.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
+#include <receiver.h>
+#include <stats.h>
+#ifdef BRIDGE
+#include <bridge.h>
+#endif /* defined(BRIDGE) */
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+//! 受信に使用するUARTのポート番号(Serial2)
+#define RX_PORT         (UART_NUM_2)
+
+//! 受信ボーレート
+#define RX_BAUDRATE     (115200)
+
+//! 想定する最悪のloop()の停止時間(ミリ秒)
+//  書き込み完了待ち(LED表示のための500ms)と、SDカードの書き込みビジー(SDXC
+//  の規格上の上限の500ms)の合計。
+#define RX_STALL_MS     (1000)
+
+//! UARTドライバの受信バッファのサイズ
+//  8N1では1バイトあたり10ビットなので、停止時間中に届く最大バイト数を2のべき
+//  に切り上げたもの。
+#define RX_BUFF_SIZE    (16384)
+
+#if RX_BUFF_SIZE < (RX_BAUDRATE / 10) * RX_STALL_MS / 1000
+#error "RX_BUFF_SIZE is too small for RX_STALL_MS"
+#endif
+
+//! 受信タスクとloop()の間の行キューの段数
+#define QUEUE_DEPTH     (32)
+
+//! 受信タスクの一回の読み出しの待ち時間(ミリ秒)
+#define READ_TIMEOUT    (20)
+
+//! 受信タスクの優先度(loop()の優先度1より高くする)
+#define TASK_PRIORITY   (5)
+
+//! 行キューの要素
+struct Line {
+  uint16_t size;
+  char data[RECEIVER_LINE_SIZE];
+};
+
+//! 受信タスクとの連絡用キュー
+static QueueHandle_t queue = NULL;
+
+//! 受信タスクのハンドラ
+static TaskHandle_t task = NULL;
+
+//! 受信タスクが行を組み立て中か否か
+static volatile bool partial = false;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 組み立て中の行のキューへの登録
+ *
+ * @param [in,out] line  組み立て中の行(登録後にクリアされる)
+ *
+ * @remark
+ *  キューが満杯の場合はloop()側が取り出すまで待つ。この間の受信データはUART
+ *  ドライバのバッファに蓄えられる。
+ */
+static void
+flush_line(Line* line)
+{
+  if (line->size > 0) {
+    if (xQueueSend(queue, line, portMAX_DELAY) != pdPASS) {
+      ESP_LOGE("receiver_task_func", "queue send failed");
+    }
+
+    line->size = 0;
+  }
+}
+
+/**
+ * UARTドライバのエラーイベントのハンドラ
+ *
+ * @param [in] err  エラー種別
+ *
+ * @remark
+ *  HardwareSerialのイベントタスクから呼び出される。UARTドライバのイベントキ
+ *  ューに通知されたエラーを動作統計に計上する。
+ */
+static void
+on_receive_error(hardwareSerial_error_t err)
+{
+  switch (err) {
+  case UART_BREAK_ERROR:
+    stats.uart_break++;
+    break;
+
+  case UART_BUFFER_FULL_ERROR:
+    stats.uart_buffer_full++;
+    break;
+
+  case UART_FIFO_OVF_ERROR:
+    stats.uart_fifo_ovf++;
+    break;
+
+  case UART_FRAME_ERROR:
+    stats.uart_frame++;
+    break;
+
+  case UART_PARITY_ERROR:
+    stats.uart_parity++;
+    break;
+
+  default:
+    break;
+  }
+}
+
+static void
+receiver_task_func(void* arg)
+{
+  uint8_t buf[64];
+  Line line;
+  int n;
+  int i;
+
+  line.size = 0;
+
+  while (true) {
+    n = uart_read_bytes(RX_PORT,
+                        buf,
+                        sizeof(buf),
+                        pdMS_TO_TICKS(READ_TIMEOUT));
+    if (n <= 0) continue;
+
+    stats.rx_bytes += n;
+
+#ifdef BRIDGE
+    // 記録状態にかかわらず、受信したバイト列をそのままUSBシリアルに転送する
+    bridge_push(buf, n);
+#endif /* defined(BRIDGE) */
+
+    for (i = 0; i < n; i++) {
+      // NUL文字はloop()側で「受信なし」と区別できないので捨てる。センサーの
+      // 起床用プリアンブル(NUL文字の並び)の前に起床中に化けたバイトがある
+      // ので、組み立て中の行も捨てる(lowpower.h参照)。
+      if (buf[i] == '\0') {
+        if (line.size > 0) {
+          stats.rx_resync++;
+          line.size = 0;
+        }
+        continue;
+      }
+
+      line.data[line.size++] = (char)buf[i];
+
+      if (buf[i] == '\n') {
+        stats.rx_lines++;
+        flush_line(&line);
+
+      } else if (line.size == RECEIVER_LINE_SIZE) {
+        stats.rx_split++;
+        flush_line(&line);
+      }
+    }
+
+    partial = (line.size > 0);
+  }
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+receiver_start(int rx, int tx)
+{
+  int ret;
+  BaseType_t err;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * state check
+   */
+  if (task != NULL) ret = DEFAULT_ERROR;
+
+  /*
+   * initialize serial
+   *   ドライバのバッファサイズはbegin()の前に設定しておく必要がある。
+   */
+  if (!ret) {
+    Serial2.setRxBufferSize(RX_BUFF_SIZE);
+    Serial2.begin(RX_BAUDRATE, SERIAL_8N1, rx, tx);
+    Serial2.onReceiveError(on_receive_error);
+  }
+
+  /*
+   * start task
+   */
+  if (!ret) {
+    queue = xQueueCreate(QUEUE_DEPTH, sizeof(Line));
+    if (queue == NULL) ret = DEFAULT_ERROR;
+  }
+
+  if (!ret) {
+    // 書き込みタスクがPRO_CPUで動作するので、受信はAPP_CPUで行う
+    err = xTaskCreateUniversal(receiver_task_func,
+                               "Receiver task",
+                               2048,
+                               NULL,
+                               TASK_PRIORITY,
+                               &task,
+                               APP_CPU_NUM);
+    if (err != pdPASS) ret = DEFAULT_ERROR;
+  }
+
+  /*
+   * post process
+   */
+  if (ret) {
+    if (queue != NULL) vQueueDelete(queue);
+
+    queue = NULL;
+    task  = NULL;
+  }
+
+  return ret;
+}
+
+int
+receiver_get(char* dst, size_t* len)
+{
+  int ret;
+  Line line;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * argument check
+   */
+  if (dst == NULL || len == NULL) ret = DEFAULT_ERROR;
+
+  /*
+   * state check
+   */
+  if (!ret) {
+    if (queue == NULL) ret = DEFAULT_ERROR;
+  }
+
+  /*
+   * receive line
+   */
+  if (!ret) {
+    if (xQueueReceive(queue, &line, 0) == pdPASS) {
+      memcpy(dst, line.data, line.size);
+      *len = line.size;
+    } else {
+      *len = 0;
+    }
+  }
+
+  return ret;
+}
+
+bool
+receiver_busy()
+{
+  size_t n;
+
+  if (queue == NULL) return false;
+  if (partial || uxQueueMessagesWaiting(queue) > 0) return true;
+
+  return (uart_get_buffered_data_len(RX_PORT, &n) == ESP_OK && n > 0);
+}
@@ -0,0 +1,74 @@
+/*
+ * Recorder for AC power monitor
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef __RECEIVER_H__
+#define __RECEIVER_H__
+
+//! 受け渡しを行う一行分のバッファのサイズ
+#define RECEIVER_LINE_SIZE    (128)
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* defined(__cplusplus) */
+
+/**
+ * レシーバモジュールの動作開始
+ *
+ * @param [in] rx  受信信号に割り当てるGPIOの番号
+ * @param [in] tx  送信信号に割り当てるGPIOの番号
+ *
+ * @retrun
+ *   処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  本関数を呼び出すと、Serial2を拡張したドライババッファで初期化し、バックグ
+ *  ラウンドで受信を行うタスクを起動する。受信タスクは受信データを行単位に組み
+ *  立ててキューに登録するので、receiver_get()で取り出すこと。
+ *  受信タスクは書き込みタスク(PRO_CPU)とは別のコア(APP_CPU)で、loop()より
+ *  高い優先度で動作する。このためloop()側がSDカードの書き込み完了待ち等でブ
+ *  ロックしている間も受信が継続され、その間のデータはドライババッファとキュ
+ *  ーに蓄えられる。
+ */
+int receiver_start(int rx, int tx);
+
+/**
+ * 受信済みデータの取り出し
+ *
+ * @param [out] dst  取り出したデータの書き込み先(RECEIVER_LINE_SIZEバイト)
+ * @param [out] len  取り出したデータの長さの書き込み先
+ *
+ * @retrun
+ *   処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  受信済みの行を一行取り出す。受信済みの行がない場合は待たずに復帰し、lenに
+ *  0が書き込まれる。
+ *  取り出されるデータは通常は改行文字で終わる一行分だが、行がバッファサイズを
+ *  超える場合はバッファサイズ単位で分割されたものが順に取り出される。データは
+ *  NULターミネートされない。
+ */
+int receiver_get(char* dst, size_t* len);
+
+/**
+ * 受信処理中か否かの取得
+ *
+ * @return
+ *  UARTドライバのバッファに未処理のデータがある場合、受信タスクが行を組み立
+ *  て中の場合、もしくは取り出されていない行がある場合はtrueを返す。
+ *
+ * @remark
+ *  省電力動作でスリープに入ってよいかの判定に用いる。
+ */
+bool receiver_busy();
+
+#ifdef __cplusplus
+}
+#endif /* defined(__cplusplus) */
+#endif /* !defined(__RECEIVER_H__) */
@@ -0,0 +1,329 @@
+/*
+ * Recorder for AC power monitor
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <resample.h>
+#include <stats.h>
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+//! 固定小数点の小数部の桁数
+#define FRAC_DIGITS     (3)
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 符号無し整数の文字列化
+ *
+ * @param [out] dst  書き込み先
+ * @param [in] val   値
+ * @param [in] min   最小桁数(不足分は0で埋める)
+ *
+ * @return
+ *  書き込んだ文字数を返す。
+ */
+static int
+format_uint(char* dst, uint64_t val, int min)
+{
+  char tmp[20];
+  int n;
+  int i;
+
+  n = 0;
+
+  do {
+    tmp[n++] = '0' + (char)(val % 10);
+    val /= 10;
+  } while (val > 0 || n < min);
+
+  for (i = 0; i < n; i++) dst[i] = tmp[n - 1 - i];
+
+  return n;
+}
+
+/**
+ * 固定小数点値の文字列化
+ *
+ * @param [out] dst  書き込み先
+ * @param [in] val   値(1/1000単位)
+ *
+ * @return
+ *  書き込んだ文字数を返す。
+ */
+static int
+format_fixed(char* dst, int32_t val)
+{
+  uint32_t abs;
+  int n;
+
+  n   = 0;
+  abs = (val < 0)? -(uint32_t)val: (uint32_t)val;
+
+  if (val < 0) dst[n++] = '-';
+
+  n += format_uint(dst + n, abs / 1000, 1);
+  dst[n++] = '.';
+  n += format_uint(dst + n, abs % 1000, FRAC_DIGITS);
+
+  return n;
+}
+
+/**
+ * 一行の出力
+ *
+ * @param [in] ctx  状態
+ * @param [in] ts   格子点の時刻
+ * @param [in] val  格子点の値
+ */
+static void
+emit(resample_t* ctx, uint64_t ts, const int32_t* val)
+{
+  char line[RESAMPLE_LINE_SIZE];
+  int n;
+  int i;
+
+  n = format_uint(line, ts, 1);
+
+  for (i = 0; i < 3; i++) {
+    line[n++] = ',';
+    n += format_fixed(line + n, val[i]);
+  }
+
+  line[n++] = '\r';
+  line[n++] = '\n';
+  line[n]   = '\0';
+
+  ctx->output(line, ctx->arg);
+  stats.resample_out++;
+}
+
+/**
+ * 補間値の算出
+ *
+ * @param [in] ctx  状態
+ * @param [in] smp  新しいサンプル
+ * @param [in] ts   格子点の時刻(直前のサンプルより後、smp以前)
+ * @param [out] dst 補間値の書き込み先
+ */
+static void
+interpolate(const resample_t* ctx,
+            const resample_sample_t* smp,
+            uint64_t ts,
+            int32_t* dst)
+{
+  const resample_sample_t* a;
+  int64_t num;
+  int64_t den;
+  int64_t d;
+  int i;
+
+  a = &ctx->prev;
+
+  if (ts == smp->ts) {
+    memcpy(dst, smp->val, sizeof(smp->val));
+
+  } else if (ctx->zoh) {
+    memcpy(dst, a->val, sizeof(a->val));
+
+  } else {
+    num = (int64_t)(ts - a->ts);
+    den = (int64_t)(smp->ts - a->ts);
+
+    // 四捨五入(ゼロから遠い方向)
+    for (i = 0; i < 3; i++) {
+      d      = ((int64_t)smp->val[i] - a->val[i]) * num;
+      dst[i] = a->val[i] + (int32_t)((d + ((d < 0)? -den: den) / 2) / den);
+    }
+  }
+}
+
+/**
+ * 格子の取り直し
+ *
+ * @param [in,out] ctx  状態
+ * @param [in] smp      起点とするサンプル
+ */
+static void
+restart(resample_t* ctx, const resample_sample_t* smp)
+{
+  ctx->prev = *smp;
+  ctx->next = smp->ts + ctx->period;
+
+  emit(ctx, smp->ts, smp->val);
+}
+
+/*
+ * 公開関数の定義
+ */
+
+void
+resample_init(resample_t* ctx,
+              uint32_t period,
+              uint32_t maxGap,
+              bool zoh,
+              resample_output_t output,
+              void* arg)
+{
+  memset(ctx, 0, sizeof(resample_t));
+
+  ctx->period = period;
+  ctx->maxGap = maxGap;
+  ctx->zoh    = zoh;
+  ctx->output = output;
+  ctx->arg    = arg;
+}
+
+int
+resample_parse(const char* line, resample_sample_t* dst)
+{
+  int ret;
+  const char* p;
+  uint64_t ts;
+  int64_t v;
+  int digits;
+  bool neg;
+  int i;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+  p   = line;
+  ts  = 0;
+
+  /*
+   * parse timestamp
+   */
+  if (*p < '0' || *p > '9') ret = DEFAULT_ERROR;
+
+  if (!ret) {
+    while (*p >= '0' && *p <= '9') ts = ts * 10 + (*p++ - '0');
+    if (*p != ',') ret = DEFAULT_ERROR;
+  }
+
+  /*
+   * parse values
+   */
+  for (i = 0; !ret && i < 3; i++) {
+    p++;
+
+    neg = (*p == '-');
+    if (neg) p++;
+
+    if (*p < '0' || *p > '9') {
+      ret = DEFAULT_ERROR;
+      break;
+    }
+
+    v = 0;
+    while (*p >= '0' && *p <= '9' && v < INT32_MAX) v = v * 10 + (*p++ - '0');
+
+    v *= 1000;
+
+    if (*p == '.') {
+      p++;
+
+      for (digits = 0; *p >= '0' && *p <= '9'; p++, digits++) {
+        if (digits < FRAC_DIGITS) {
+          v += (*p - '0') * ((digits == 0)? 100: (digits == 1)? 10: 1);
+        } else if (digits == FRAC_DIGITS && *p >= '5') {
+          v += 1;
+        }
+      }
+    }
+
+    if (v > INT32_MAX) {
+      ret = DEFAULT_ERROR;
+      break;
+    }
+
+    dst->val[i] = (neg)? -(int32_t)v: (int32_t)v;
+
+    if (*p != ',' && *p != '\r' && *p != '\n' && *p != '\0') {
+      ret = DEFAULT_ERROR;
+      break;
+    }
+
+    if (i < 2 && *p != ',') ret = DEFAULT_ERROR;
+  }
+
+  if (!ret) dst->ts = ts;
+
+  return ret;
+}
+
+int
+resample_push(resample_t* ctx, const resample_sample_t* smp)
+{
+  int32_t val[3];
+  uint64_t skip;
+  int n;
+
+  n = 0;
+
+  /*
+   * 最初のサンプル、もしくはタイムスタンプが戻った場合
+   */
+  if (!ctx->started || smp->ts < ctx->prev.ts) {
+    if (ctx->started) stats.resample_restarts++;
+
+    ctx->started = true;
+    restart(ctx, smp);
+
+    return 1;
+  }
+
+  /*
+   * 直前と同じタイムスタンプ
+   *   格子点は直前のサンプルまでで出力済みなので、破棄して格子を維持する。
+   */
+  if (smp->ts == ctx->prev.ts) {
+    stats.resample_dups++;
+    return 0;
+  }
+
+  /*
+   * 欠測
+   *   補間を行わず、次の格子点をsmp以降に送る。
+   */
+  if (smp->ts - ctx->prev.ts > ctx->maxGap) {
+    stats.resample_gaps++;
+
+    if (ctx->next < smp->ts) {
+      skip       = (smp->ts - ctx->next + ctx->period - 1) / ctx->period;
+      ctx->next += skip * ctx->period;
+    }
+
+    if (ctx->next == smp->ts) {
+      emit(ctx, smp->ts, smp->val);
+      ctx->next += ctx->period;
+      n++;
+    }
+
+    ctx->prev = *smp;
+    return n;
+  }
+
+  /*
+   * 区間内の格子点の補間
+   */
+  while (ctx->next <= smp->ts) {
+    interpolate(ctx, smp, ctx->next, val);
+    emit(ctx, ctx->next, val);
+
+    ctx->next += ctx->period;
+    n++;
+  }
+
+  ctx->prev = *smp;
+
+  return n;
+}
@@ -0,0 +1,124 @@
+/*
+ * Recorder for AC power monitor
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef __RESAMPLE_H__
+#define __RESAMPLE_H__
+
+//! 出力する一行の最大長(改行文字と終端を含む)
+#define RESAMPLE_LINE_SIZE    (80)
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* defined(__cplusplus) */
+
+/**
+ * サンプル
+ *
+ * @remark
+ *  測定値は小数点以下3桁の固定小数点(mV, mA, mW)で保持する。
+ */
+typedef struct {
+  //! タイムスタンプ(ミリ秒)
+  uint64_t ts;
+
+  //! 電圧・電流・消費電力(1/1000単位)
+  int32_t val[3];
+} resample_sample_t;
+
+/**
+ * 行の出力先
+ *
+ * @param [in] line  出力する行(CR+LFを含む)
+ * @param [in] arg   resample_init()に渡した引数
+ */
+typedef void (*resample_output_t)(const char* line, void* arg);
+
+//! 再標本化の状態
+typedef struct {
+  //! 格子の間隔(ミリ秒)
+  uint32_t period;
+
+  //! 補間を行わない最大のサンプル間隔(ミリ秒)
+  uint32_t maxGap;
+
+  //! 0次ホールドで出力する場合はtrue、線形補間の場合はfalse
+  bool zoh;
+
+  //! 出力先
+  resample_output_t output;
+  void* arg;
+
+  //! 直前のサンプル
+  resample_sample_t prev;
+
+  //! 次に出力する格子点の時刻
+  uint64_t next;
+
+  //! 最初のサンプルを受け取ったか否か
+  bool started;
+} resample_t;
+
+/**
+ * 再標本化の初期化
+ *
+ * @param [out] ctx     初期化する状態
+ * @param [in] period   格子の間隔(ミリ秒)
+ * @param [in] maxGap   補間を行わない最大のサンプル間隔(ミリ秒)
+ * @param [in] zoh      0次ホールドで出力する場合はtrue
+ * @param [in] output   行の出力先
+ * @param [in] arg      出力先に渡す引数
+ *
+ * @remark
+ *  格子は最初のサンプルのタイムスタンプを起点とする。
+ */
+void resample_init(resample_t* ctx,
+                   uint32_t period,
+                   uint32_t maxGap,
+                   bool zoh,
+                   resample_output_t output,
+                   void* arg);
+
+/**
+ * データ行の解析
+ *
+ * @param [in] line   解析する行("タイムスタンプ,電圧,電流,消費電力[,...]")
+ * @param [out] dst   解析結果の書き込み先
+ *
+ * @retrun
+ *   処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  浮動小数点演算は行わず、小数点以下4桁目で四捨五入する。5列目以降は無視
+ *  する。
+ */
+int resample_parse(const char* line, resample_sample_t* dst);
+
+/**
+ * サンプルの投入
+ *
+ * @param [in,out] ctx  状態
+ * @param [in] smp      サンプル
+ *
+ * @return
+ *  出力した行数を返す。
+ *
+ * @remark
+ *  直前のサンプルとの間にある格子点の値を補間して出力する。サンプル間隔が
+ *  maxGapを超えた場合は補間を行わず、その区間の格子点を出力しない(欠測と
+ *  する)。タイムスタンプが戻った場合(センサーの再起動)は、そのサンプルを
+ *  起点として格子を取り直す。直前と同じタイムスタンプのサンプルは破棄する
+ *  (格子は取り直さない)。
+ */
+int resample_push(resample_t* ctx, const resample_sample_t* smp);
+
+#ifdef __cplusplus
+}
+#endif /* defined(__cplusplus) */
+#endif /* !defined(__RESAMPLE_H__) */
@@ -0,0 +1,239 @@
+/*
+ * Recorder for AC power monitor
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <stats.h>
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+//! フィールド表の要素
+struct Field {
+  const char* name;
+  size_t offset;
+
+  //! 64ビットのフィールドか否か(省略時は32ビット)
+  bool wide;
+};
+
+//! フィールド表
+static const Field fields[] = {
+  {"rx_bytes",          offsetof(stats_t, rx_bytes)},
+  {"rx_lines",          offsetof(stats_t, rx_lines)},
+  {"rx_split",          offsetof(stats_t, rx_split)},
+  {"rx_resync",         offsetof(stats_t, rx_resync)},
+  {"uart_break",        offsetof(stats_t, uart_break)},
+  {"uart_buffer_full",  offsetof(stats_t, uart_buffer_full)},
+  {"uart_fifo_ovf",     offsetof(stats_t, uart_fifo_ovf)},
+  {"uart_frame",        offsetof(stats_t, uart_frame)},
+  {"uart_parity",       offsetof(stats_t, uart_parity)},
+  {"resample_in",       offsetof(stats_t, resample_in)},
+  {"resample_out",      offsetof(stats_t, resample_out)},
+  {"resample_rejects",  offsetof(stats_t, resample_rejects)},
+  {"resample_gaps",     offsetof(stats_t, resample_gaps)},
+  {"resample_restarts", offsetof(stats_t, resample_restarts)},
+  {"resample_dups",     offsetof(stats_t, resample_dups)},
+  {"wr_blocks",         offsetof(stats_t, wr_blocks)},
+  {"wr_errors",         offsetof(stats_t, wr_errors)},
+  {"wr_queue_peak",     offsetof(stats_t, wr_queue_peak)},
+  {"wr_segments",       offsetof(stats_t, wr_segments)},
+  {"wr_prealloc_errors", offsetof(stats_t, wr_prealloc_errors)},
+  {"wr_open_peak_ms",   offsetof(stats_t, wr_open_peak_ms)},
+  {"wr_dir_opens",      offsetof(stats_t, wr_dir_opens)},
+  {"lp_sleeps",         offsetof(stats_t, lp_sleeps)},
+  {"lp_sleep_ms",       offsetof(stats_t, lp_sleep_ms)},
+  {"lp_wake_rx",        offsetof(stats_t, lp_wake_rx)},
+  {"lp_wake_button",    offsetof(stats_t, lp_wake_button)},
+  {"lp_wake_timer",     offsetof(stats_t, lp_wake_timer)},
+  {"lp_wake_lat_peak_us", offsetof(stats_t, lp_wake_lat_peak_us)},
+  {"trim_rows",         offsetof(stats_t, trim_rows)},
+  {"trim_rejects",      offsetof(stats_t, trim_rejects)},
+  {"trim_bytes_in",     offsetof(stats_t, trim_bytes_in), true},
+  {"trim_bytes_out",    offsetof(stats_t, trim_bytes_out), true},
+  {"bridge_bytes",      offsetof(stats_t, bridge_bytes)},
+  {"bridge_chunks",     offsetof(stats_t, bridge_chunks)},
+  {"bridge_writes",     offsetof(stats_t, bridge_writes)},
+  {"bridge_drops",      offsetof(stats_t, bridge_drops)},
+  {"bridge_xoff",       offsetof(stats_t, bridge_xoff)},
+  {"bridge_lat_sum_us", offsetof(stats_t, bridge_lat_sum_us)},
+  {"bridge_lat_peak_us", offsetof(stats_t, bridge_lat_peak_us)},
+  {"bridge_line_drops", offsetof(stats_t, bridge_line_drops)},
+};
+
+//! 動作統計
+stats_t stats;
+
+//! SDカードへの書き込みの所要時間のヒストグラム
+stats_hist_t wr_latency;
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * フィールド値の取得
+ */
+static uint64_t
+field_value(const stats_t* s, const Field* f)
+{
+  const uint8_t* p = (const uint8_t*)s + f->offset;
+
+  return (f->wide)? *(const uint64_t*)p: *(const uint32_t*)p;
+}
+
+/*
+ * 公開関数の定義
+ */
+
+void
+stats_snapshot(stats_t* dst)
+{
+  memcpy(dst, (const void*)&stats, sizeof(stats_t));
+}
+
+int
+stats_format(char* dst,
+             size_t size,
+             const stats_t* cur,
+             const stats_t* base,
+             char sep)
+{
+  int ret;
+  size_t used;
+  char delim[2];
+  uint64_t val;
+  int n;
+  size_t i;
+
+  /*
+   * initialize
+   */
+  ret      = 0;
+  used     = 0;
+  delim[0] = sep;
+  delim[1] = '\0';
+
+  /*
+   * argument check
+   */
+  if (dst == NULL || cur == NULL || size == 0) ret = DEFAULT_ERROR;
+
+  /*
+   * format fields
+   */
+  if (!ret) {
+    dst[0] = '\0';
+
+    for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+      val = field_value(cur, &fields[i]);
+      if (base != NULL) val -= field_value(base, &fields[i]);
+
+      n = snprintf(dst + used,
+                   size - used,
+                   "%s%s=%llu",
+                   (i > 0)? delim: "",
+                   fields[i].name,
+                   (unsigned long long)val);
+
+      if (n < 0 || (size_t)n >= size - used) {
+        ret = DEFAULT_ERROR;
+        break;
+      }
+
+      used += n;
+    }
+  }
+
+  return ret;
+}
+
+void
+stats_hist_add(stats_hist_t* hist, uint32_t val)
+{
+  int i;
+
+  for (i = 0; i < STATS_HIST_BUCKETS - 1; i++) {
+    if (val <= (1UL << i)) break;
+  }
+
+  hist->bucket[i]++;
+  hist->sum += val;
+  hist->count++;
+}
+
+int
+stats_format_hist(char* dst,
+                  size_t size,
+                  const char* name,
+                  const stats_hist_t* hist)
+{
+  int ret;
+  size_t used;
+  uint32_t cum;
+  int n;
+  int i;
+
+  /*
+   * initialize
+   */
+  ret  = 0;
+  used = 0;
+  cum  = 0;
+
+  /*
+   * argument check
+   */
+  if (dst == NULL || name == NULL || hist == NULL || size == 0) {
+    ret = DEFAULT_ERROR;
+  }
+
+  /*
+   * format header
+   */
+  if (!ret) {
+    n = snprintf(dst,
+                 size,
+                 "%s sum=%lu count=%lu",
+                 name,
+                 (unsigned long)hist->sum,
+                 (unsigned long)hist->count);
+
+    if (n < 0 || (size_t)n >= size) {
+      ret = DEFAULT_ERROR;
+    } else {
+      used = n;
+    }
+  }
+
+  /*
+   * format buckets
+   */
+  for (i = 0; !ret && i < STATS_HIST_BUCKETS; i++) {
+    cum += hist->bucket[i];
+
+    if (i < STATS_HIST_BUCKETS - 1) {
+      n = snprintf(dst + used,
+                   size - used,
+                   " %lu=%lu",
+                   1UL << i,
+                   (unsigned long)cum);
+    } else {
+      n = snprintf(dst + used, size - used, " +Inf=%lu", (unsigned long)cum);
+    }
+
+    if (n < 0 || (size_t)n >= size - used) {
+      ret = DEFAULT_ERROR;
+      break;
+    }
+
+    used += n;
+  }
+
+  return ret;
+}
@@ -0,0 +1,238 @@
+/*
+ * Recorder for AC power monitor
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+//! ヒストグラムのバケット数(上限が1,2,4,...,2^(n-2)と+Infのバケット)
+#define STATS_HIST_BUCKETS    (12)
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* defined(__cplusplus) */
+
+/**
+ * 動作統計のカウンタ
+ *
+ * @remark
+ *  各カウンタは単一のタスク(もしくはコールバック)からのみ更新されるので、
+ *  更新時の排他制御は行わない。参照側はstats_snapshot()で複製を取得してか
+ *  ら使用すること(フィールド間の厳密な一貫性は保証されない)。
+ *  フィールドを追加した場合は、stats.cppのフィールド表にも追加すること。
+ */
+typedef struct {
+  //! 受信バイト数
+  uint32_t rx_bytes;
+
+  //! 受信行数
+  uint32_t rx_lines;
+
+  //! 行バッファ長を超えたために分割して受け渡した回数
+  uint32_t rx_split;
+
+  //! NUL文字の受信で組み立て中の行を捨てた回数
+  uint32_t rx_resync;
+
+  //! UARTのブレーク検出回数
+  uint32_t uart_break;
+
+  //! UARTドライバのリングバッファ溢れの回数
+  uint32_t uart_buffer_full;
+
+  //! UARTのハードウェアFIFO溢れの回数
+  uint32_t uart_fifo_ovf;
+
+  //! UARTのフレーミングエラーの回数
+  uint32_t uart_frame;
+
+  //! UARTのパリティエラーの回数
+  uint32_t uart_parity;
+
+  //! 再標本化に投入したデータ行数
+  uint32_t resample_in;
+
+  //! 再標本化で出力した行数
+  uint32_t resample_out;
+
+  //! 解析できずに破棄したデータ行数
+  uint32_t resample_rejects;
+
+  //! 補間を行わなかったサンプル間隔(欠測)の数
+  uint32_t resample_gaps;
+
+  //! タイムスタンプが戻ったために格子を取り直した回数
+  uint32_t resample_restarts;
+
+  //! 直前と同じタイムスタンプのために破棄したデータ行数
+  uint32_t resample_dups;
+
+  //! SDカードに書き込んだブロック数
+  uint32_t wr_blocks;
+
+  //! SDカードへの書き込みエラーの回数
+  uint32_t wr_errors;
+
+  //! 書き込み待ちのブロック数の最大値
+  uint32_t wr_queue_peak;
+
+  //! ファイルサイズの上限によるファイルの切り替え回数
+  uint32_t wr_segments;
+
+  //! exFATでの連続領域の確保に失敗した回数
+  uint32_t wr_prealloc_errors;
+
+  //! 記録ファイルのオープンに要した時間の最大値(ミリ秒)
+  uint32_t wr_open_peak_ms;
+
+  //! 記録先ディレクトリを開き直した回数
+  uint32_t wr_dir_opens;
+
+  //! ライトスリープに入った回数
+  uint32_t lp_sleeps;
+
+  //! ライトスリープしていた時間(ミリ秒)
+  uint32_t lp_sleep_ms;
+
+  //! 受信による起床の回数
+  uint32_t lp_wake_rx;
+
+  //! ボタンによる起床の回数
+  uint32_t lp_wake_button;
+
+  //! タイマーによる起床の回数
+  uint32_t lp_wake_timer;
+
+  //! 受信による起床から行を取り出すまでの時間の最大値(マイクロ秒)
+  uint32_t lp_wake_lat_peak_us;
+
+  //! 精度を切り詰めたデータ行数
+  uint32_t trim_rows;
+
+  //! 書式が不正なために破棄したデータ行数
+  uint32_t trim_rejects;
+
+  //! 精度の切り詰め前のバイト数(長期の記録で桁溢れしないよう64ビット)
+  uint64_t trim_bytes_in;
+
+  //! 精度の切り詰め後のバイト数(同上)
+  uint64_t trim_bytes_out;
+
+  //! USBシリアルに転送したバイト数
+  uint32_t bridge_bytes;
+
+  //! USBシリアルに転送したチャンク数
+  uint32_t bridge_chunks;
+
+  //! USBシリアルへのwrite()の回数
+  uint32_t bridge_writes;
+
+  //! 転送キューの溢れで捨てたバイト数
+  uint32_t bridge_drops;
+
+  //! ホストからXOFFを受信した回数
+  uint32_t bridge_xoff;
+
+  //! チャンクの受信から転送までの時間の合計(マイクロ秒)
+  uint32_t bridge_lat_sum_us;
+
+  //! チャンクの受信から転送までの時間の最大値(マイクロ秒)
+  uint32_t bridge_lat_peak_us;
+
+  //! 行境界が現れずに捨てたテレメトリ行の数
+  uint32_t bridge_line_drops;
+} stats_t;
+
+/**
+ * ヒストグラム
+ *
+ * @remark
+ *  bucket[i]は値が(2^(i-1), 2^i]の範囲(bucket[0]は1以下、最後の要素はそれ
+ *  より上の全て)のサンプル数を保持する。累積は出力時に行う。
+ */
+typedef struct {
+  //! 値の合計
+  uint32_t sum;
+
+  //! サンプル数
+  uint32_t count;
+
+  //! バケット毎のサンプル数
+  uint32_t bucket[STATS_HIST_BUCKETS];
+} stats_hist_t;
+
+//! 動作統計
+extern stats_t stats;
+
+//! SDカードへの書き込み(write+sync)の所要時間のヒストグラム(ミリ秒)
+extern stats_hist_t wr_latency;
+
+/**
+ * 動作統計の複製
+ *
+ * @param [out] dst  複製の書き込み先
+ */
+void stats_snapshot(stats_t* dst);
+
+/**
+ * 動作統計の文字列化
+ *
+ * @param [out] dst   書き込み先
+ * @param [in] size   書き込み先のサイズ
+ * @param [in] cur    現在の値
+ * @param [in] base   基準とする値(NULLの場合は累積値を出力する)
+ * @param [in] sep    フィールドの区切り文字
+ *
+ * @retrun
+ *   処理に成功した場合は0を、失敗した場合(書き込み先が不足した場合を含む)は
+ *   0以外の値を返す。
+ *
+ * @remark
+ *  "名前=値"の組をsepで区切って出力する(末尾には区切り文字を付与しない)。
+ *  baseを指定した場合は、curとbaseの差分(セッション中の増分等)を出力する。
+ */
+int stats_format(char* dst,
+                 size_t size,
+                 const stats_t* cur,
+                 const stats_t* base,
+                 char sep);
+
+/**
+ * ヒストグラムへの値の追加
+ *
+ * @param [in,out] hist  ヒストグラム
+ * @param [in] val       値
+ */
+void stats_hist_add(stats_hist_t* hist, uint32_t val);
+
+/**
+ * ヒストグラムの文字列化
+ *
+ * @param [out] dst   書き込み先
+ * @param [in] size   書き込み先のサイズ
+ * @param [in] name   ヒストグラムの名前
+ * @param [in] hist   ヒストグラム
+ *
+ * @retrun
+ *   処理に成功した場合は0を、失敗した場合(書き込み先が不足した場合を含む)は
+ *   0以外の値を返す。
+ *
+ * @remark
+ *  "名前 sum=合計 count=件数 上限=累積件数 ... +Inf=累積件数"の形式で出力す
+ *  る(上限はバケットの上限値、累積件数はその上限以下のサンプル数)。
+ */
+int stats_format_hist(char* dst,
+                      size_t size,
+                      const char* name,
+                      const stats_hist_t* hist);
+
+#ifdef __cplusplus
+}
+#endif /* defined(__cplusplus) */
+#endif /* !defined(__STATS_H__) */
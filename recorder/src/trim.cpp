@@ -0,0 +1,246 @@
+/*
+ * Recorder for AC power monitor
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <trim.h>
+#include <stats.h>
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+//! 整数部の最大桁数(64ビットでの桁溢れの防止)
+#define MAX_INT_DIGITS  (12)
+
+//! 10のべき乗の表
+static const uint64_t pow10_tbl[] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL
+};
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 符号無し整数の文字列化
+ *
+ * @param [out] dst  書き込み先
+ * @param [in] val   値
+ * @param [in] min   最小桁数(不足分は0で埋める)
+ *
+ * @return
+ *  書き込んだ文字数を返す。
+ */
+static int
+format_uint(char* dst, uint64_t val, int min)
+{
+  char tmp[20];
+  int n;
+  int i;
+
+  n = 0;
+
+  do {
+    tmp[n++] = '0' + (char)(val % 10);
+    val /= 10;
+  } while (val > 0 || n < min);
+
+  for (i = 0; i < n; i++) dst[i] = tmp[n - 1 - i];
+
+  return n;
+}
+
+/**
+ * 測定値の列の切り詰め
+ *
+ * @param [in,out] p  解析位置(解析後は列の直後を指す)
+ * @param [out] dst   書き込み先
+ * @param [in] digits 小数点以下の桁数
+ *
+ * @return
+ *  書き込んだ文字数を返す。書式が不正な場合は負の値を返す。
+ *
+ * @remark
+ *  dstには最大で符号・整数部・小数点・小数部の分(MAX_INT_DIGITS +
+ *  TRIM_MAX_DIGITS + 2文字)を書き込む。
+ */
+static int
+trim_value(const char** p, char* dst, int digits)
+{
+  const char* s;
+  uint64_t ip;
+  uint64_t fp;
+  uint64_t q;
+  uint64_t div;
+  int nint;
+  int nfrac;
+  bool neg;
+  int n;
+
+  s  = *p;
+  n  = 0;
+  ip = 0;
+  fp = 0;
+
+  neg = (*s == '-');
+  if (neg) s++;
+
+  /*
+   * 測定値が得られていない場合の"nan"等はそのまま出力する
+   */
+  if (!strncmp(s, "nan", 3) || !strncmp(s, "inf", 3)) {
+    if (neg) dst[n++] = '-';
+    memcpy(dst + n, s, 3);
+    *p = s + 3;
+    return n + 3;
+  }
+
+  /*
+   * 整数部
+   */
+  for (nint = 0; *s >= '0' && *s <= '9'; s++, nint++) {
+    if (nint == MAX_INT_DIGITS) return -1;
+    ip = ip * 10 + (*s - '0');
+  }
+
+  if (nint == 0) return -1;
+
+  /*
+   * 小数部(TRIM_MAX_DIGITS桁までを1/10^6単位で保持し、次の桁で丸める)
+   */
+  if (*s == '.') {
+    s++;
+
+    for (nfrac = 0; *s >= '0' && *s <= '9'; s++, nfrac++) {
+      if (nfrac < TRIM_MAX_DIGITS) {
+        fp = fp * 10 + (*s - '0');
+      } else if (nfrac == TRIM_MAX_DIGITS && *s >= '5') {
+        fp++;
+      }
+    }
+
+    if (nfrac < TRIM_MAX_DIGITS) fp *= pow10_tbl[TRIM_MAX_DIGITS - nfrac];
+  }
+
+  /*
+   * 指定桁数への丸め
+   */
+  div = pow10_tbl[TRIM_MAX_DIGITS - digits];
+  q   = (ip * pow10_tbl[TRIM_MAX_DIGITS] + fp + div / 2) / div;
+
+  if (neg && q > 0) dst[n++] = '-';
+
+  n += format_uint(dst + n, q / pow10_tbl[digits], 1);
+
+  if (digits > 0) {
+    dst[n++] = '.';
+    n += format_uint(dst + n, q % pow10_tbl[digits], digits);
+  }
+
+  *p = s;
+
+  return n;
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+trim_row(const char* src,
+         char* dst,
+         size_t size,
+         const trim_param_t* param)
+{
+  int ret;
+  const char* p;
+  char* d;
+  char* end;
+  int n;
+  int i;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+  p   = src;
+  d   = dst;
+  end = dst + size;
+
+  /*
+   * タイムスタンプ
+   */
+  if (*p < '0' || *p > '9') ret = DEFAULT_ERROR;
+
+  while (!ret && *p >= '0' && *p <= '9') {
+    if (d == end) {
+      ret = DEFAULT_ERROR;
+      break;
+    }
+    *d++ = *p++;
+  }
+
+  /*
+   * 測定値
+   */
+  for (i = 0; !ret && i < TRIM_COLUMNS; i++) {
+    if (*p != ',' ||
+        end - d < 1 + MAX_INT_DIGITS + TRIM_MAX_DIGITS + 2) {
+      ret = DEFAULT_ERROR;
+      break;
+    }
+
+    *d++ = *p++;
+
+    n = trim_value(&p, d, param->digits[i]);
+    if (n < 0) {
+      ret = DEFAULT_ERROR;
+      break;
+    }
+
+    d += n;
+  }
+
+  /*
+   * 5列目以降(整数の列)と行末
+   */
+  while (!ret && *p != '\0') {
+    if (!((*p >= '0' && *p <= '9') || *p == ',' ||
+          *p == '\r' || *p == '\n')) {
+      ret = DEFAULT_ERROR;
+      break;
+    }
+
+    if (d == end) {
+      ret = DEFAULT_ERROR;
+      break;
+    }
+
+    *d++ = *p++;
+  }
+
+  if (!ret) {
+    if (d == end) {
+      ret = DEFAULT_ERROR;
+    } else {
+      *d = '\0';
+    }
+  }
+
+  /*
+   * update statistics
+   */
+  if (!ret) {
+    stats.trim_rows++;
+    stats.trim_bytes_in  += p - src;
+    stats.trim_bytes_out += d - dst;
+  } else {
+    stats.trim_rejects++;
+  }
+
+  return ret;
+}
@@ -0,0 +1,56 @@
+/*
+ * Recorder for AC power monitor
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef __TRIM_H__
+#define __TRIM_H__
+
+//! 丸めの対象とする列の数(電圧・電流・消費電力)
+#define TRIM_COLUMNS      (3)
+
+//! 指定可能な小数点以下の桁数の最大値(センサーの"%f"の出力の桁数)
+#define TRIM_MAX_DIGITS   (6)
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* defined(__cplusplus) */
+
+//! 精度の切り詰めのパラメータ
+typedef struct {
+  //! 列毎の小数点以下の桁数(0〜TRIM_MAX_DIGITS)
+  uint8_t digits[TRIM_COLUMNS];
+} trim_param_t;
+
+/**
+ * データ行の精度の切り詰め
+ *
+ * @param [in] src    データ行("タイムスタンプ,電圧,電流,消費電力[,...]")
+ * @param [out] dst   切り詰めた行の書き込み先
+ * @param [in] size   書き込み先のサイズ
+ * @param [in] param  パラメータ
+ *
+ * @retrun
+ *   処理に成功した場合は0を、失敗した場合(行の書式が不正な場合)は0以外の値
+ *   を返す。
+ *
+ * @remark
+ *  測定値の列は浮動小数点演算を行わずに指定桁数で四捨五入する(ゼロから遠い
+ *  方向)。"nan"等の値と、5列目以降の整数の列(区間長、ノードID)および行末の
+ *  CR・LFはそのまま出力する。動作統計(trim_rows, trim_rejects,
+ *  trim_bytes_in, trim_bytes_out)の更新も本関数で行う。
+ */
+int trim_row(const char* src,
+             char* dst,
+             size_t size,
+             const trim_param_t* param);
+
+#ifdef __cplusplus
+}
+#endif /* defined(__cplusplus) */
+#endif /* !defined(__TRIM_H__) */
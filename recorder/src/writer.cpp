@@ -14,9 +14,21 @@
 #include <freertos/semphr.h>
 
 #include <writer.h>
+#include <hal_clock.h>
+#include <stats.h>
 
 //! バッファのサイズ
-#define BUFF_SIZE       (8192)
+//  省電力動作(LOW_POWER)ではSDカードへの書き込みをまとめて、カードが動作す
+//  る回数を減らす(電源断時に失われる量はその分増える)。
+#ifndef WRITER_BUFF_SIZE
+#ifdef LOW_POWER
+#define WRITER_BUFF_SIZE  (32768)
+#else /* defined(LOW_POWER) */
+#define WRITER_BUFF_SIZE  (8192)
+#endif /* defined(LOW_POWER) */
+#endif /* !defined(WRITER_BUFF_SIZE) */
+
+#define BUFF_SIZE       (WRITER_BUFF_SIZE)
 
 //! デフォルトのエラーコード
 #define DEFAULT_ERROR   (__LINE__)
@@ -27,6 +39,14 @@
 //! LED点灯用のウェイト時間 (ミリ秒で指定)
 #define EMIT_DURATION   (500)
 
+//! exFATで記録開始時に連続領域として確保するサイズ
+//  ビットマップから連続したクラスタを一括で割り当てておくことで、書き込み毎
+//  のクラスタ割り当て(ビットマップとFATの更新)を省く。超過した分は通常の割
+//  り当てで伸長される。
+#ifndef WRITER_PREALLOC_SIZE
+#define WRITER_PREALLOC_SIZE  (256ULL * 1024 * 1024)
+#endif /* !defined(WRITER_PREALLOC_SIZE) */
+
 //! SDカードインタフェースオブジェクト
 extern SdFat SD;
 
@@ -60,6 +80,12 @@ static uint8_t* cur_buff = buff_plane1;
 //! 現在のバッファ使用量
 static size_t used = 0;
 
+//! 書き込みを受け付けた総バイト数(バッファ中のものを含む)
+static uint64_t total = 0;
+
+//! 書き込みタスクに渡して書き込みが完了していないブロック数
+static uint32_t inflight = 0;
+
 //! 書き込み情報
 struct Command {
   enum {
@@ -71,18 +97,53 @@ struct Command {
   size_t size;
 };
 
+//! 書き込み対象のファイルを置くディレクトリ
+static SdFile* target_dir = NULL;
+
+//! 書き込み対象のファイルへのパス
+static const char* target_path = NULL;
+
 /*
  * 内部関数の定義
  */
 static void
 writer_task_func(void* arg)
 {
-  char *path = (char*)arg;
   bool error;
   Command cmd;
   SdFile file;
+  uint32_t t0;
+  bool prealloc;
+
+  /*
+   * ファイルのオープン
+   *   ディレクトリのハンドルからの相対パスで開くことで、パスの上位のディレ
+   *   クトリの探索を省く。
+   */
+  t0 = hal_millis();
 
-  error = !file.open(path, O_WRONLY | O_CREAT | O_TRUNC);
+  if (target_dir != NULL) {
+    error = !file.open(target_dir, target_path, O_WRONLY | O_CREAT | O_TRUNC);
+  } else {
+    error = !file.open(target_path, O_WRONLY | O_CREAT | O_TRUNC);
+  }
+
+  t0 = hal_millis() - t0;
+  if (t0 > stats.wr_open_peak_ms) stats.wr_open_peak_ms = t0;
+
+  prealloc = false;
+
+  /*
+   * 連続領域の確保
+   *   FAT12/16/32では確保した領域が電源断時に孤立クラスタとして残るので、
+   *   exFATの場合のみ行う(電源断時は確保した範囲の末尾がNULで埋まったファ
+   *   イルとして残る)。確保に失敗した場合(空き領域の断片化等)は通常の割り
+   *   当てで記録を続ける。
+   */
+  if (!error && SD.fatType() == FAT_TYPE_EXFAT) {
+    prealloc = file.preAllocate(WRITER_PREALLOC_SIZE);
+    if (!prealloc) stats.wr_prealloc_errors++;
+  }
 
   /*
    * コマンド受信ループ
@@ -97,16 +158,22 @@ writer_task_func(void* arg)
           led = CRGB::Red;
           FastLED.show();
 
+          t0 = hal_millis();
+
           if (file.write((const uint8_t*)cmd.data, cmd.size) == cmd.size) {
             error = !file.sync();
           } else {
             error = true;
           }
 
+          stats_hist_add(&wr_latency, hal_millis() - t0);
+          stats.wr_blocks++;
+          if (error) stats.wr_errors++;
+
           // 受信レートと、SDカードへの書き込みレートを考えると時間的に余裕が
           // 十分あるので書き込みインディケータが視認できるようにディレイをか
           // ける。
-          vTaskDelay(pdMS_TO_TICKS(EMIT_DURATION));
+          hal_delay(EMIT_DURATION);
 
           /*
            * LEDを書き込み後の色に変更
@@ -122,6 +189,10 @@ writer_task_func(void* arg)
         }
       }
 
+      if (cmd.op == Command::OP_FLUSH) {
+        __atomic_sub_fetch(&inflight, 1, __ATOMIC_SEQ_CST);
+      }
+
       if (cmd.op == Command::OP_EXIT) break;
 
     } else {
@@ -129,6 +200,9 @@ writer_task_func(void* arg)
     }
   }
 
+  // 確保したまま使わなかった領域を解放する
+  if (prealloc) file.truncate();
+
   file.close();
 
   xEventGroupSetBits(events, TASK_COMPLETE);
@@ -140,6 +214,7 @@ push_byte(uint8_t b, bool* dst)
 {
   int ret;
   Command cmd;
+  uint32_t depth;
 
   /*
    * initialize
@@ -150,17 +225,24 @@ push_byte(uint8_t b, bool* dst)
    * push data
    */
   cur_buff[used++] = b;
+  total++;
 
   if (used == BUFF_SIZE) {
     cmd.op   = Command::OP_FLUSH;
     cmd.data = cur_buff;
     cmd.size = BUFF_SIZE;
 
+    __atomic_add_fetch(&inflight, 1, __ATOMIC_SEQ_CST);
+
     if (xQueueSend(queue, &cmd, portMAX_DELAY) != pdPASS) {
+      __atomic_sub_fetch(&inflight, 1, __ATOMIC_SEQ_CST);
       ESP_LOGD("writer_push", "Queue fauled.");
       ret = DEFAULT_ERROR;
     }
 
+    depth = uxQueueMessagesWaiting(queue);
+    if (depth > stats.wr_queue_peak) stats.wr_queue_peak = depth;
+
     cur_buff = (cur_buff == buff_plane1)? buff_plane2: buff_plane1;
     used     = 0;
 
@@ -181,7 +263,7 @@ push_byte(uint8_t b, bool* dst)
  */
 
 int
-writer_start(const char* path)
+writer_start(SdFile* dir, const char* path)
 {
   int ret;
   BaseType_t err;
@@ -205,6 +287,9 @@ writer_start(const char* path)
    * start task
    */
   if (!ret) {
+    target_dir  = dir;
+    target_path = path;
+
     queue = xQueueCreate(3, sizeof(Command));
     if (queue == NULL) ret = DEFAULT_ERROR;
   }
@@ -224,7 +309,7 @@ writer_start(const char* path)
     err = xTaskCreateUniversal(writer_task_func,
                                "Writer task",
                                4096,
-                               (void*)path,
+                               NULL,
                                1,
                                &task,
                                PRO_CPU_NUM);
@@ -234,7 +319,10 @@ writer_start(const char* path)
   /*
    * transition state
    */
-  if (!ret) state = 1;
+  if (!ret) {
+    total = 0;
+    state = 1;
+  }
 
   /*
    * post process
@@ -368,6 +456,18 @@ writer_push(uint8_t b, bool* dst)
   return ret;
 }
 
+uint64_t
+writer_size()
+{
+  return total;
+}
+
+bool
+writer_busy()
+{
+  return (__atomic_load_n(&inflight, __ATOMIC_SEQ_CST) > 0);
+}
+
 int
 writer_finish()
 {
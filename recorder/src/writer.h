@@ -8,6 +8,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include <SdFat.h>
+
 #ifndef __WRITER_H__
 #define __WRITER_H__
 
@@ -18,7 +20,9 @@ extern "C" {
 /**
  * ライターモジュールの動作開始
  *
- * @param [in] path   書き込み対象のファイルへのパス
+ * @param [in] dir    書き込み対象のファイルを置くディレクトリ(NULLの場合は
+ *                    カレントディレクトリ)
+ * @param [in] path   書き込み対象のファイルへのパス(dirからの相対パス)
  *
  * @retrun
  *   処理に成功した場合は0を、失敗した場合は0以外の値を返す。
@@ -28,10 +32,10 @@ extern "C" {
  *  する。本関数呼び出し後、writer_push()関数でデータを書き込むことができる。
  *
  * @warning
- *  引数pathで渡した文字列は、writer_finish()を呼び出して書き込みタスクを停止
- *  させるまで、呼び出し側で保持する必要がある。
+ *  引数dirで渡したハンドルと引数pathで渡した文字列は、writer_finish()を呼び
+ *  出して書き込みタスクを停止させるまで、呼び出し側で保持する必要がある。
  */
-int writer_start(const char* path);
+int writer_start(SdFile* dir, const char* path);
 
 /**
  * データ書き込み
@@ -77,6 +81,31 @@ int writer_puts(const char* s, bool *dst);
  */
 int writer_push(uint8_t b, bool* dst);
 
+/**
+ * 書き込み済みサイズの取得
+ *
+ * @return
+ *  writer_start()以降に書き込みを受け付けたバイト数(内部バッファ中で未書き込
+ *  みのものを含む)を返す。
+ *
+ * @remark
+ *  FAT32のファイルサイズ上限(4GB)を超える前にファイルを切り替える判定に用い
+ *  る。writer_puts()等を呼び出すタスクからのみ呼び出すこと。
+ */
+uint64_t writer_size();
+
+/**
+ * 書き込み中か否かの取得
+ *
+ * @return
+ *  書き込みタスクに渡したブロックの書き込みが完了していない場合はtrueを返す。
+ *
+ * @remark
+ *  省電力動作でスリープに入ってよいかの判定に用いる(書き込み後のLED表示の
+ *  ための待ち時間を含む)。
+ */
+bool writer_busy();
+
 /**
  * ライターモジュールの動作終了
  *
@@ -1,5 +1,7 @@
 #include "AtomSocket.h"
 
+#include <hal_clock.h>
+
 void ATOMSOCKET::Init(HardwareSerial& SerialData, int _RelayIO, int _RXD) {
     AtomSerial = &SerialData;
     RelayIO    = _RelayIO;
@@ -8,6 +10,7 @@ void ATOMSOCKET::Init(HardwareSerial& SerialData, int _RelayIO, int _RXD) {
     pinMode(RelayIO, OUTPUT);
     VF = VolR1 / VolR2 / 1000.0;
     CF = 1.0 / (CurrentRF * 1000.0);
+    UpdateScale();
 }
 
 void ATOMSOCKET::SetPowerOn() {
@@ -20,19 +23,50 @@ void ATOMSOCKET::SetPowerOff() {
 
 void ATOMSOCKET::setVF(float Data) {
     VF = Data;
+    UpdateScale();
 }
 
 void ATOMSOCKET::setCF(float Data) {
     CF = Data;
+    UpdateScale();
+}
+
+// 有効電力にのみ掛かる利得 (電力の換算係数はVF * CF * PG)
+void ATOMSOCKET::setPG(float Data) {
+    PG = Data;
+    UpdateScale();
+}
+
+void ATOMSOCKET::setOffsets(int32_t Vol, int32_t Current, int32_t Power) {
+    VolOffset     = Vol;
+    CurrentOffset = Current;
+    PowerOffset   = Power;
+}
+
+// 換算係数の変更時に一度だけ浮動小数点演算を行い、フレーム毎の換算は整数で
+// 行う
+void ATOMSOCKET::UpdateScale() {
+    VolScale     = (uint32_t)lroundf(VF * 1000.0f * 65536.0f);
+    CurrentScale = (uint32_t)lroundf(CF * 1000.0f * 65536.0f);
+    PowerScale   = (uint32_t)lroundf(VF * CF * PG * 1000.0f * 65536.0f);
 }
 
 void ATOMSOCKET::SerialReadLoop() {
     if (AtomSerial->available() > 0) {
-        delay(55);
+        hal_delay(55);
         SeriaDataLen = AtomSerial->available();
 
         if (SeriaDataLen != 24) {
-            while (AtomSerial->read() >= 0) {
+            LengthErrors++;
+            // 破棄するバイト列もフック関数には先頭の24バイトまでを渡す
+            int n = 0;
+            int ch;
+            while ((ch = AtomSerial->read()) >= 0) {
+                if (n < (int)sizeof(SerialTemps)) SerialTemps[n] = ch;
+                n++;
+            }
+            if (RawHook != NULL) {
+                RawHook(SerialTemps, n, ATOMSOCKET_RAW_LENGTH);
             }
             return;
         }
@@ -42,14 +76,27 @@ void ATOMSOCKET::SerialReadLoop() {
         }
 
         if (SerialTemps[1] != 0x5A) {
+            HeaderErrors++;
             while (AtomSerial->read() >= 0) {
             }
+            if (RawHook != NULL) {
+                RawHook(SerialTemps, SeriaDataLen, ATOMSOCKET_RAW_HEADER);
+            }
             return;
         }
         if (Checksum() == false) {
+            ChecksumErrors++;
+            if (RawHook != NULL) {
+                RawHook(SerialTemps, SeriaDataLen, ATOMSOCKET_RAW_CHECKSUM);
+            }
             return;
         }
 
+        if (RawHook != NULL) {
+            RawHook(SerialTemps, SeriaDataLen, ATOMSOCKET_RAW_OK);
+        }
+
+        Frames++;
         SerialRead = 1;
         VolPar     = ((uint32_t)SerialTemps[2] << 16) |
                  ((uint32_t)SerialTemps[3] << 8) | SerialTemps[4];
@@ -130,6 +177,34 @@ float ATOMSOCKET::GetKWh() {
     return KWh;
 }
 
+// 電圧値(mV)、測定値が無い場合は負の値を返す
+int32_t ATOMSOCKET::GetVolMilli() {
+    if (VolData == 0) return -1;
+    return (int32_t)(((uint64_t)VolPar * VolScale / VolData) >> 16) +
+           VolOffset;
+}
+
+// 電流値(mA)、既定値ではGetCurrent()と同じく60mAのオフセットを差し引くので、
+// 無負荷時や測定値が無い場合は負の値を返す
+int32_t ATOMSOCKET::GetCurrentMilli() {
+    if (CurrentData == 0) return -1;
+    return (int32_t)(((uint64_t)CurrentPar * CurrentScale / CurrentData) >>
+                     16) + CurrentOffset;
+}
+
+// 有効電力(mW)、測定値が無い場合は負の値を返す
+int32_t ATOMSOCKET::GetActivePowerMilli() {
+    if (PowerData == 0) return -1;
+    return (int32_t)(((uint64_t)PowerPar * PowerScale / PowerData) >> 16) +
+           PowerOffset;
+}
+
+// PFパルス1つ当たりの電力量(μJ)、PowerData(パルス周期, μs)との比が有効電力
+// になるので換算係数は有効電力と同じ。測定値が無い場合は0を返す
+uint32_t ATOMSOCKET::GetPulseEnergyMicro() {
+    return (uint32_t)(((uint64_t)PowerPar * PowerScale / 1000) >> 16);
+}
+
 bool ATOMSOCKET::Checksum() {
     byte check = 0;
     for (byte a = 2; a <= 22; a++) {
@@ -3,11 +3,22 @@
 
 #include "M5AtomS3.h"
 
+// RawHookに渡される受信結果
+#define ATOMSOCKET_RAW_OK       0
+#define ATOMSOCKET_RAW_LENGTH   1
+#define ATOMSOCKET_RAW_HEADER   2
+#define ATOMSOCKET_RAW_CHECKSUM 3
+
+// 受信毎に呼び出されるフック関数 (バイト列, 受信したバイト数, 受信結果)
+typedef void (*AtomSocketRawHook)(const byte* data, int len, int status);
+
 class ATOMSOCKET {
    public:
     void Init(HardwareSerial& SerialData, int _RelayIO, int _RXD);
     void setVF(float Data);
     void setCF(float Data);
+    void setPG(float Data);
+    void setOffsets(int32_t Vol, int32_t Current, int32_t Power);
     void SerialReadLoop();
     void SetPowerOn();
     void SetPowerOff();
@@ -21,21 +32,40 @@ class ATOMSOCKET {
     uint16_t GetPF();
     uint32_t GetPFAll();
     float GetKWh();
+    int32_t GetVolMilli();
+    int32_t GetCurrentMilli();
+    int32_t GetActivePowerMilli();
+    uint32_t GetPulseEnergyMicro();
 
     byte SerialTemps[24];
     byte SeriaDataLen = 0;
     bool SerialRead   = 0;
 
+    uint32_t Frames         = 0;
+    uint32_t LengthErrors   = 0;
+    uint32_t HeaderErrors   = 0;
+    uint32_t ChecksumErrors = 0;
+
+    // 長さの異常で破棄するフレームも含めて受信毎に呼び出される
+    AtomSocketRawHook RawHook = NULL;
+
     uint32_t VolPar;
     uint32_t CurrentPar;
     uint32_t PowerPar;
     uint32_t CurrentData;
     float VF;
     float CF;
+    float PG = 1.0;
+
+    // ミリ単位の値に加える補正値 (mV, mA, mW)
+    int32_t VolOffset     = 0;
+    int32_t CurrentOffset = -60;
+    int32_t PowerOffset   = 0;
 
    private:
     HardwareSerial* AtomSerial;
     bool Checksum();
+    void UpdateScale();
 
     int RelayIO;
     int RXD;
@@ -49,6 +79,11 @@ class ATOMSOCKET {
     uint32_t VolR1  = 1880000;
     uint32_t VolR2  = 1000;
     float CurrentRF = 0.001;
+
+    // 整数演算用の換算係数 (VF, CFを1000 * 2^16倍したもの)
+    uint32_t VolScale;
+    uint32_t CurrentScale;
+    uint32_t PowerScale;
 };
 
 #endif
@@ -0,0 +1,154 @@
+/*
+ * AC power monitor for M5Atomic Socket with AtomS3
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "adaptive.h"
+
+//! 変動の指数移動平均の平滑化係数の逆数
+#define EWMA_WEIGHT     (8)
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 保留中のフレームの出力
+ *
+ * @param [in,out] ctx  状態
+ * @param [out] dst     出力レコードの書き込み先
+ */
+static void
+flush(adaptive_t* ctx, adaptive_record_t* dst)
+{
+  dst->ts       = ctx->lastTs;
+  dst->voltage  = (float)(ctx->sumVoltage / ctx->count);
+  dst->current  = (float)(ctx->sumCurrent / ctx->count);
+  dst->wattage  = (float)(ctx->sumWattage / ctx->count);
+  dst->interval = (uint32_t)(ctx->lastTs - ctx->recordTs);
+
+  ctx->recordTs   = ctx->lastTs;
+  ctx->count      = 0;
+  ctx->sumVoltage = 0.0;
+  ctx->sumCurrent = 0.0;
+  ctx->sumWattage = 0.0;
+}
+
+/**
+ * 単一フレームの出力
+ *
+ * @param [in,out] ctx  状態
+ * @param [in] ts       フレームのタイムスタンプ(ミリ秒)
+ * @param [in] vol      電圧値(V)
+ * @param [in] cur      電流値(A)
+ * @param [in] wat      消費電力(W)
+ * @param [out] dst     出力レコードの書き込み先
+ */
+static void
+emit(adaptive_t* ctx,
+     uint64_t ts,
+     float vol,
+     float cur,
+     float wat,
+     adaptive_record_t* dst)
+{
+  dst->ts       = ts;
+  dst->voltage  = vol;
+  dst->current  = cur;
+  dst->wattage  = wat;
+  dst->interval = (uint32_t)(ts - ctx->recordTs);
+
+  ctx->recordTs = ts;
+}
+
+/*
+ * 公開関数の定義
+ */
+
+void
+adaptive_init(adaptive_t* ctx, const adaptive_param_t* param)
+{
+  memset(ctx, 0, sizeof(adaptive_t));
+  ctx->param = *param;
+}
+
+int
+adaptive_push(adaptive_t* ctx,
+              uint64_t ts,
+              float vol,
+              float cur,
+              float wat,
+              adaptive_record_t* dst)
+{
+  int n;
+  float diff;
+  float ref;
+  float thr;
+
+  n = 0;
+
+  /*
+   * 測定値が得られていない(非数の)フレームは無視する
+   */
+  if (!(isfinite(vol) && isfinite(cur) && isfinite(wat))) return n;
+
+  /*
+   * 初回のフレームは区間の起点としてそのまま出力する
+   */
+  if (!ctx->started) {
+    ctx->started     = true;
+    ctx->recordTs    = ts;
+    ctx->prevWattage = wat;
+
+    emit(ctx, ts, vol, cur, wat, &dst[n++]);
+    return n;
+  }
+
+  /*
+   * 変動の推定
+   *   前フレームとの差の絶対値の指数移動平均を変動の推定値とする。閾値は保
+   *   留中の区間の平均(保留が無い場合は現在値)に対する相対値と絶対値の大き
+   *   い方とし、単発の差が閾値を超えるか、推定値が閾値の半分を超えた場合に
+   *   変動中とみなす。
+   */
+  diff             = fabsf(wat - ctx->prevWattage);
+  ctx->prevWattage = wat;
+  ctx->deviation  += (diff - ctx->deviation) / EWMA_WEIGHT;
+
+  ref = (ctx->count > 0)? (float)(ctx->sumWattage / ctx->count): wat;
+  thr = ctx->param.relThreshold * fabsf(ref);
+  if (thr < ctx->param.absThreshold) thr = ctx->param.absThreshold;
+
+  if (diff > thr || ctx->deviation > thr * 0.5f) {
+    ctx->fast = ctx->param.holdoff;
+  }
+
+  /*
+   * 変動中はフレームレートで出力
+   */
+  if (ctx->fast > 0) {
+    ctx->fast--;
+
+    if (ctx->count > 0) flush(ctx, &dst[n++]);
+    emit(ctx, ts, vol, cur, wat, &dst[n++]);
+
+    return n;
+  }
+
+  /*
+   * 定常状態ではフレームを保留し、最大間隔に達したら平均を出力
+   */
+  ctx->count++;
+  ctx->sumVoltage += vol;
+  ctx->sumCurrent += cur;
+  ctx->sumWattage += wat;
+  ctx->lastTs      = ts;
+
+  if (ts - ctx->recordTs >= ctx->param.maxInterval) flush(ctx, &dst[n++]);
+
+  return n;
+}
@@ -0,0 +1,117 @@
+/*
+ * AC power monitor for M5Atomic Socket with AtomS3
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __ADAPTIVE_H__
+#define __ADAPTIVE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//! adaptive_push()が一回の呼び出しで出力する最大のレコード数
+#define ADAPTIVE_MAX_OUTPUT   (2)
+
+//! 出力レコード
+typedef struct {
+  //! タイムスタンプ(区間の終端, ミリ秒)
+  uint64_t ts;
+
+  //! 区間内の平均電圧(V)
+  float voltage;
+
+  //! 区間内の平均電流(A)
+  float current;
+
+  //! 区間内の平均消費電力(W)
+  float wattage;
+
+  //! レコードが表す区間の長さ(直前のレコードからの経過時間, ミリ秒)
+  uint32_t interval;
+} adaptive_record_t;
+
+//! 出力レート制御のパラメータ
+typedef struct {
+  //! 定常状態での最大の出力間隔(ミリ秒)
+  uint32_t maxInterval;
+
+  //! 変動とみなす消費電力の変化量の絶対閾値(W)
+  float absThreshold;
+
+  //! 変動とみなす消費電力の変化量の相対閾値(区間平均に対する比)
+  float relThreshold;
+
+  //! 変動検出後にフレームレートでの出力を継続するフレーム数
+  uint32_t holdoff;
+} adaptive_param_t;
+
+//! 出力レート制御の状態
+typedef struct {
+  adaptive_param_t param;
+
+  //! 保留中のフレーム数
+  uint32_t count;
+
+  //! 保留中のフレームの合計値
+  double sumVoltage;
+  double sumCurrent;
+  double sumWattage;
+
+  //! 保留中の最後のフレームのタイムスタンプ
+  uint64_t lastTs;
+
+  //! 直前のレコードのタイムスタンプ
+  uint64_t recordTs;
+
+  //! 直前のフレームの消費電力
+  float prevWattage;
+
+  //! 変化量の指数移動平均(フレーム毎の変動の推定値)
+  float deviation;
+
+  //! フレームレート出力の残りフレーム数
+  uint32_t fast;
+
+  //! 初回のフレームを受け取ったか否か
+  bool started;
+} adaptive_t;
+
+/**
+ * 出力レート制御の初期化
+ *
+ * @param [out] ctx   初期化する状態
+ * @param [in] param  パラメータ
+ */
+void adaptive_init(adaptive_t* ctx, const adaptive_param_t* param);
+
+/**
+ * フレームの投入
+ *
+ * @param [in,out] ctx  状態
+ * @param [in] ts       フレームのタイムスタンプ(ミリ秒)
+ * @param [in] vol      電圧値(V)
+ * @param [in] cur      電流値(A)
+ * @param [in] wat      消費電力(W)
+ * @param [out] dst     出力レコードの書き込み先(ADAPTIVE_MAX_OUTPUT要素)
+ *
+ * @return
+ *  出力すべきレコードの数を返す。
+ *
+ * @remark
+ *  フレーム毎に消費電力の前フレームとの差の指数移動平均を更新し、これが閾値
+ *  を超える間(および超えてからholdoffフレームの間)は全フレームを出力する。
+ *  定常状態ではフレームを保留して平均を取り、maxIntervalが経過した時点で一つ
+ *  のレコードとして出力する。保留中に変動を検出した場合は、保留分を先に出力
+ *  してから変動したフレームを出力する。
+ *  出力値は区間の平均なので、消費電力×区間長の合計は全フレームを出力した場合
+ *  の電力量と一致する。
+ */
+int adaptive_push(adaptive_t* ctx,
+                  uint64_t ts,
+                  float vol,
+                  float cur,
+                  float wat,
+                  adaptive_record_t* dst);
+
+#endif /* !defined(__ADAPTIVE_H__) */
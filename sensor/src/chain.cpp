@@ -0,0 +1,237 @@
+/*
+ * AC power monitor for M5Atomic Socket with AtomS3
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <string.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "chain.h"
+
+#include <hal_clock.h>
+#include <lowpower.h>
+
+//! デフォルトのエラーコード
+#define DEFAULT_ERROR   (__LINE__)
+
+//! 通信速度
+#define BAUDRATE        (115200)
+
+//! UARTドライバの受信バッファのサイズ
+#define RX_BUFF_SIZE    (2048)
+
+//! UARTドライバの送信バッファのサイズ
+#define TX_BUFF_SIZE    (2048)
+
+//! 下流との通信に使用するシリアル
+static HardwareSerial* port = NULL;
+
+//! 送信の排他制御用のミューテックス
+static SemaphoreHandle_t mutex = NULL;
+
+//! 統計情報
+static chain_stats_t stats;
+
+//! 組み立て中の上流の行
+static char line[CHAIN_LINE_SIZE];
+
+//! 組み立て中の上流の行の長さ
+static size_t used = 0;
+
+//! 組み立て中の行が行長超過で破棄中か否か
+static bool discard = false;
+
+//! 組み立て中の行の最初のバイトを受信した時刻(マイクロ秒)
+static uint32_t t0;
+
+//! 起床用プリアンブルを送るか否か
+static bool preamble = false;
+
+//! プリアンブルの送信判定の状態
+static lp_tx_t lpTx;
+
+//! プリアンブル(NUL文字の並び)
+static const uint8_t preambleBytes[LP_PREAMBLE_BYTES] = {0};
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 行の送信
+ *
+ * @param [in] data  送信するデータ
+ * @param [in] size  送信するデータのサイズ
+ * @param [in] eol   行末にCR+LFを付与する場合はtrue
+ */
+static void
+send_line(const char* data, size_t size, bool eol)
+{
+  if (xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE) {
+    if (preamble && lp_tx_begin(&lpTx, hal_millis())) {
+      port->write(preambleBytes, sizeof(preambleBytes));
+      stats.preambles++;
+    }
+
+    port->write((const uint8_t*)data, size);
+    if (eol) port->write((const uint8_t*)"\r\n", 2);
+
+    xSemaphoreGive(mutex);
+  }
+}
+
+/**
+ * 上流からの受信ハンドラ
+ *
+ * @remarks
+ *  HardwareSerialのイベントタスクから呼び出される。受信したバイト列を行に組
+ *  み立て、改行文字を受信した時点で下流に転送する。転送遅延は、行の最初のバ
+ *  イトを受け取ったハンドラ呼び出しから転送完了までの時間とする。
+ */
+static void
+on_receive()
+{
+  int ch;
+  uint32_t lat;
+
+  while ((ch = port->read()) >= 0) {
+    // 上流のプリアンブルは転送しない(必要なら自ノードが付け直す)
+    if (ch == '\0') continue;
+
+    if (used == 0 && !discard) t0 = hal_micros();
+
+    if (!discard) {
+      if (used < CHAIN_LINE_SIZE) {
+        line[used++] = (char)ch;
+      } else {
+        // 行長を超える行は途中までの転送を避けるため丸ごと破棄する
+        discard = true;
+        used    = 0;
+      }
+    }
+
+    if (ch == '\n') {
+      if (discard) {
+        stats.dropLines++;
+
+      } else {
+        send_line(line, used, false);
+
+        lat = hal_micros() - t0;
+
+        stats.fwdLines++;
+        stats.fwdBytes   += used;
+        stats.latencySum += lat;
+        if (lat > stats.latencyMax) stats.latencyMax = lat;
+      }
+
+      used    = 0;
+      discard = false;
+    }
+  }
+}
+
+/*
+ * 公開関数の定義
+ */
+
+int
+chain_start(HardwareSerial* _port, int rx, int tx, bool forward)
+{
+  int ret;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * argument check
+   */
+  if (_port == NULL) ret = DEFAULT_ERROR;
+
+  /*
+   * state check
+   */
+  if (!ret) {
+    if (port != NULL) ret = DEFAULT_ERROR;
+  }
+
+  /*
+   * create mutex
+   */
+  if (!ret) {
+    mutex = xSemaphoreCreateMutex();
+    if (mutex == NULL) ret = DEFAULT_ERROR;
+  }
+
+  /*
+   * initialize serial
+   *   ドライバのバッファサイズはbegin()の前に設定しておく必要がある。
+   */
+  if (!ret) {
+    memset(&stats, 0, sizeof(stats));
+
+    port = _port;
+    port->setRxBufferSize(RX_BUFF_SIZE);
+    port->setTxBufferSize(TX_BUFF_SIZE);
+    port->begin(BAUDRATE, SERIAL_8N1, rx, tx);
+
+    if (forward) port->onReceive(on_receive);
+  }
+
+  return ret;
+}
+
+int
+chain_send(const char* s)
+{
+  int ret;
+  size_t n;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * argument check
+   */
+  if (s == NULL) ret = DEFAULT_ERROR;
+
+  /*
+   * state check
+   */
+  if (!ret) {
+    if (port == NULL) ret = DEFAULT_ERROR;
+  }
+
+  /*
+   * send line
+   */
+  if (!ret) {
+    n = strlen(s);
+    send_line(s, n, true);
+
+    stats.ownLines++;
+    stats.ownBytes += n + 2;
+  }
+
+  return ret;
+}
+
+void
+chain_enable_preamble()
+{
+  lp_tx_init(&lpTx);
+  preamble = true;
+}
+
+void
+chain_get_stats(chain_stats_t* dst)
+{
+  memcpy(dst, &stats, sizeof(chain_stats_t));
+}
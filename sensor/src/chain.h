@@ -0,0 +1,92 @@
+/*
+ * AC power monitor for M5Atomic Socket with AtomS3
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __CHAIN_H__
+#define __CHAIN_H__
+
+#include <Arduino.h>
+
+//! 転送を行う一行の最大長(改行文字を含む)
+#define CHAIN_LINE_SIZE   (128)
+
+//! 下流(レコーダ側)への出力の統計情報
+typedef struct {
+  //! 自ノードの出力行数
+  uint32_t ownLines;
+
+  //! 自ノードの出力バイト数
+  uint32_t ownBytes;
+
+  //! 上流から転送した行数
+  uint32_t fwdLines;
+
+  //! 上流から転送したバイト数
+  uint32_t fwdBytes;
+
+  //! 行長超過で破棄した上流の行数
+  uint32_t dropLines;
+
+  //! 転送遅延の合計(マイクロ秒)
+  uint64_t latencySum;
+
+  //! 転送遅延の最大値(マイクロ秒)
+  uint32_t latencyMax;
+
+  //! 送信したプリアンブルの数
+  uint32_t preambles;
+} chain_stats_t;
+
+/**
+ * 出力モジュールの動作開始
+ *
+ * @param [in] port     下流との通信に使用するシリアル
+ * @param [in] rx       受信信号に割り当てるGPIOの番号
+ * @param [in] tx       送信信号に割り当てるGPIOの番号
+ * @param [in] forward  上流からの受信データを転送する場合はtrue
+ *
+ * @retrun
+ *   処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  forwardにtrueを指定すると、受信(上流のセンサーの出力)を行単位で組み立て
+ *  て下流へそのまま転送する。転送はUARTドライバのイベントタスクから行われる
+ *  ので、loop()がセンサーデバイスからの受信待ちで停止している間も遅延なく転
+ *  送される。自ノードの出力と上流の行が混ざらないよう、送信は行単位で排他制
+ *  御される。
+ */
+int chain_start(HardwareSerial* port, int rx, int tx, bool forward);
+
+/**
+ * 自ノードの行の出力
+ *
+ * @param [in] line  出力する行(改行文字を含まない)
+ *
+ * @retrun
+ *   処理に成功した場合は0を、失敗した場合は0以外の値を返す。
+ *
+ * @remark
+ *  行末にはCR+LFが付与される(Print::println()と同じ)。
+ */
+int chain_send(const char* line);
+
+/**
+ * 起床用プリアンブルの有効化
+ *
+ * @remark
+ *  省電力動作のレコーダと接続する場合に呼び出す。送信が途絶えた後の行(自ノ
+ *  ードの行、転送する行のいずれも)の前に、レコーダを起床させるためのNUL文
+ *  字の並びを送る(lowpower.h参照)。上流から受信したNUL文字は転送しない。
+ */
+void chain_enable_preamble();
+
+/**
+ * 統計情報の取得
+ *
+ * @param [out] dst  統計情報の書き込み先
+ */
+void chain_get_stats(chain_stats_t* dst);
+
+#endif /* !defined(__CHAIN_H__) */
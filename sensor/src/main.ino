@@ -5,11 +5,262 @@
  */
 #include <M5AtomS3.h>
 #include <AtomSocket.h>
+#include <chain.h>
+#include <adaptive.h>
+#include <hal_clock.h>
+#include <appliance.h>
+#include <pq.h>
+#include <pfpower.h>
+#include <rawring.h>
+#include <lowpower.h>
+#include <Preferences.h>
 #include <math.h>
 #include <float.h>
 
 #undef DISPLAY_TEST
 
+/*
+ * デイジーチェーン接続
+ *   ビルドフラグでNODE_ID(例: -DNODE_ID=2)を定義すると、上流のセンサーの出
+ *   力をRXで受けて下流にそのまま転送し、自ノードの出力行の末尾にノードIDの
+ *   列を付与する。
+ */
+
+/*
+ * 起床用プリアンブル
+ *   ビルドフラグでWAKE_PREAMBLEを定義すると、送信が途絶えた後の行の前にNUL
+ *   文字の並びを送り、ライトスリープ中のレコーダ(LOW_POWERを定義してビルド
+ *   したもの)を起床させる。デイジーチェーン接続の場合は、レコーダに直接接続
+ *   するノードで定義すればよい。
+ */
+
+/*
+ * ビルドプロファイル
+ *   ビルドフラグでNO_UPLINKを定義すると、USBシリアルへの動作統計の出力を行
+ *   わない(レコーダへの出力には影響しない)。platformio.iniのenv(minimal)は
+ *   これとHEADLESSを定義したもの。センサー部は時刻合わせを行わない(タイムス
+ *   タンプは起動時からの経過時間)ので、レコーダ側のtimesyncに相当するプロ
+ *   ファイルは無い。起動処理の完了時にPROFILE_NAMEとsetup()の完了までの時間
+ *   を"#boot profile=名前 ms=時間"の形式でUSBシリアルに出力する。
+ */
+#ifndef PROFILE_NAME
+//! プロファイル名
+#define PROFILE_NAME        "custom"
+#endif /* !defined(PROFILE_NAME) */
+
+/*
+ * ヘッドレス動作
+ *   長押しでLCDを消灯するとフレームバッファを解放し、描画とSPI転送を一切行
+ *   わずにCPUクロックを下げて動作する。再点灯時にクロックを戻し、フレーム
+ *   バッファは次の描画時に再確保する。ビルドフラグでHEADLESSを定義すると起
+ *   動時からこの状態で動作する。
+ */
+
+//! 通常時のCPUクロック周波数(MHz)
+#define CPU_FREQ_ACTIVE     (240)
+
+//! ヘッドレス時のCPUクロック周波数(MHz)
+//!   APBクロック(UARTのクロック源)が80MHzに保たれる下限の値とする
+#define CPU_FREQ_HEADLESS   (80)
+
+/*
+ * 出力レート制御
+ *   ビルドフラグでADAPTIVE_OUTPUTを定義すると、消費電力が変動している間は
+ *   フレーム毎に、安定している間はADAPTIVE_MAX_INTERVAL毎に区間平均を出力す
+ *   る。各行には消費電力の列の後に、その行が表す区間の長さ(ミリ秒)の列が付
+ *   与される。
+ */
+#ifdef ADAPTIVE_OUTPUT
+#ifndef ADAPTIVE_MAX_INTERVAL
+//! 定常状態での最大の出力間隔(ミリ秒)
+#define ADAPTIVE_MAX_INTERVAL   (10000)
+#endif /* !defined(ADAPTIVE_MAX_INTERVAL) */
+
+#ifndef ADAPTIVE_ABS_THRESHOLD
+//! 変動とみなす消費電力の変化量の絶対閾値(W)
+#define ADAPTIVE_ABS_THRESHOLD  (2.0f)
+#endif /* !defined(ADAPTIVE_ABS_THRESHOLD) */
+
+#ifndef ADAPTIVE_REL_THRESHOLD
+//! 変動とみなす消費電力の変化量の相対閾値
+#define ADAPTIVE_REL_THRESHOLD  (0.02f)
+#endif /* !defined(ADAPTIVE_REL_THRESHOLD) */
+
+#ifndef ADAPTIVE_HOLDOFF
+//! 変動検出後にフレームレートでの出力を継続するフレーム数
+#define ADAPTIVE_HOLDOFF        (10)
+#endif /* !defined(ADAPTIVE_HOLDOFF) */
+#endif /* defined(ADAPTIVE_OUTPUT) */
+
+/*
+ * 家電の識別
+ *   ビルドフラグでAPPLIANCE_EVENTSを定義すると、消費電力のステップを検出し
+ *   てsignatures.hのシグネチャと照合し、"!タイムスタンプ,app,名前,on|off,ス
+ *   テップ(W),力率,行き過ぎ量,整定フレーム数,デューティ比(%)"の形式のイベン
+ *   ト行を出力する。
+ */
+#ifdef APPLIANCE_EVENTS
+#ifndef APPLIANCE_STEP_THRESHOLD
+//! ステップとみなす変化量の閾値(0.1W)
+#define APPLIANCE_STEP_THRESHOLD  (100)
+#endif /* !defined(APPLIANCE_STEP_THRESHOLD) */
+
+#ifndef APPLIANCE_MAX_DISTANCE
+//! 識別を受け入れる最大の距離
+#define APPLIANCE_MAX_DISTANCE    (40000)
+#endif /* !defined(APPLIANCE_MAX_DISTANCE) */
+
+#include <signatures.h>
+#endif /* defined(APPLIANCE_EVENTS) */
+
+/*
+ * 電源品質イベント
+ *   ビルドフラグでPQ_EVENTSを定義すると、フレーム毎の電圧を公称電圧
+ *   PQ_NOMINAL(mV)に対する閾値で判定し、電圧低下(sag)・電圧上昇(swell)・瞬
+ *   時停電(int)の終了時に"!開始時刻,pq,種類,継続時間(ms),極値(V),偏差(%)"
+ *   の形式のイベント行を出力する。また、PQ_AGG_INTERVAL毎に"!開始時刻,pq,
+ *   agg,フレーム数,最小(V),平均(V),最大(V),イベント数"の形式の集計行を、起
+ *   動時にリセット要因を"!0,pq,boot,要因"の形式で出力する(停電でセンサー自
+ *   体の電源が落ちた場合は、起動時の行で検知する)。PQ_EVENT_ONLYを定義す
+ *   ると測定値の行を出力せず、イベント行のみを出力する。
+ */
+#ifdef PQ_EVENTS
+#ifndef PQ_NOMINAL
+//! 公称電圧(mV)
+#define PQ_NOMINAL          (100000)
+#endif /* !defined(PQ_NOMINAL) */
+
+#ifndef PQ_SAG_PCT
+//! 電圧低下とみなす閾値(公称電圧に対する%)
+#define PQ_SAG_PCT          (90)
+#endif /* !defined(PQ_SAG_PCT) */
+
+#ifndef PQ_SWELL_PCT
+//! 電圧上昇とみなす閾値(公称電圧に対する%)
+#define PQ_SWELL_PCT        (110)
+#endif /* !defined(PQ_SWELL_PCT) */
+
+#ifndef PQ_INTERRUPTION_PCT
+//! 瞬時停電とみなす閾値(公称電圧に対する%)
+#define PQ_INTERRUPTION_PCT (10)
+#endif /* !defined(PQ_INTERRUPTION_PCT) */
+
+#ifndef PQ_HYSTERESIS_PCT
+//! イベント終了の判定のヒステリシス(公称電圧に対する%)
+#define PQ_HYSTERESIS_PCT   (2)
+#endif /* !defined(PQ_HYSTERESIS_PCT) */
+
+#ifndef PQ_AGG_INTERVAL
+//! 集計区間の長さ(ミリ秒)
+#define PQ_AGG_INTERVAL     (600000)
+#endif /* !defined(PQ_AGG_INTERVAL) */
+#else /* defined(PQ_EVENTS) */
+#ifdef PQ_EVENT_ONLY
+#error "PQ_EVENT_ONLY requires PQ_EVENTS"
+#endif /* defined(PQ_EVENT_ONLY) */
+#endif /* defined(PQ_EVENTS) */
+
+/*
+ * PFパルスによる消費電力の推定
+ *   ビルドフラグでPF_POWERを定義すると、HLW8032のPFレジスタ(一定の電力量毎
+ *   のパルスの計数)の増分とフレームのタイムスタンプから、最大PF_POWER_WINDOW
+ *   の区間の平均電力を求める。消費電力がPF_POWER_LOW(mW)を下回るとこの推定値
+ *   を、PF_POWER_HIGH(mW)を上回るとフレーム毎の瞬時値を消費電力として用いる
+ *   (表示・出力行・積算電力量のいずれも)。数W以下の待機電力は瞬時値のばらつ
+ *   きが大きいため。パルスが足りない間は瞬時値を用いる。
+ */
+#ifdef PF_POWER
+#ifndef PF_POWER_WINDOW
+//! 平均を取る最大の時間幅(ミリ秒)
+#define PF_POWER_WINDOW       (120000)
+#endif /* !defined(PF_POWER_WINDOW) */
+
+#ifndef PF_POWER_MIN_PULSES
+//! 平均を取るのに必要な最小のパルス数
+#define PF_POWER_MIN_PULSES   (2)
+#endif /* !defined(PF_POWER_MIN_PULSES) */
+
+#ifndef PF_POWER_LOW
+//! パルスによる推定に切り替える消費電力(mW)
+#define PF_POWER_LOW          (10000)
+#endif /* !defined(PF_POWER_LOW) */
+
+#ifndef PF_POWER_HIGH
+//! 瞬時値に戻す消費電力(mW)
+#define PF_POWER_HIGH         (15000)
+#endif /* !defined(PF_POWER_HIGH) */
+
+#if PF_POWER_HIGH < PF_POWER_LOW
+#error "PF_POWER_HIGH must not be less than PF_POWER_LOW"
+#endif
+#endif /* defined(PF_POWER) */
+
+/*
+ * 生フレームの取得
+ *   ビルドフラグでRAW_CAPTUREを定義すると、HLW8032から受信したフレーム(長
+ *   さ・ヘッダ・チェックサムの異常で破棄したものを含む)を受信時刻と共に直近
+ *   RAWRING_SIZE個分保持し、トリガ後にRAW_CAPTURE_POST個を記録した時点で凍結
+ *   する。トリガは消費電力のステップ(RAW_CAPTURE_STEP(mW)以上の変化)、受信異
+ *   常の連続(RAW_CAPTURE_ERR_WINDOWの間にRAW_CAPTURE_ERR_BURST回)、ボタンの
+ *   トリプルクリック、USBシリアルからのコマンド'T'で、RAW_CAPTURE_TRIGGERSで
+ *   有効な要因を選択する。凍結した内容は"#raw"で始まる行としてUSBシリアルに
+ *   ループ毎にRAW_DUMP_LINES行ずつ出力する(レコーダへの出力には影響しない)。
+ *   コマンド'D'で再出力、'R'で記録を再開する。
+ */
+#ifdef RAW_CAPTURE
+#ifdef NO_UPLINK
+#error "RAW_CAPTURE requires the USB uplink (undefine NO_UPLINK)"
+#endif /* defined(NO_UPLINK) */
+
+#ifndef RAW_CAPTURE_TRIGGERS
+//! 有効なトリガ要因
+#define RAW_CAPTURE_TRIGGERS    \
+  (RAWRING_TRIG_STEP | RAWRING_TRIG_ERRORS | RAWRING_TRIG_MANUAL)
+#endif /* !defined(RAW_CAPTURE_TRIGGERS) */
+
+#ifndef RAW_CAPTURE_STEP
+//! ステップとみなす消費電力の変化量(mW)
+#define RAW_CAPTURE_STEP        (50000)
+#endif /* !defined(RAW_CAPTURE_STEP) */
+
+#ifndef RAW_CAPTURE_ERR_BURST
+//! 受信異常の連続とみなす異常の数
+#define RAW_CAPTURE_ERR_BURST   (3)
+#endif /* !defined(RAW_CAPTURE_ERR_BURST) */
+
+#ifndef RAW_CAPTURE_ERR_WINDOW
+//! 受信異常を数える時間幅(ミリ秒)
+#define RAW_CAPTURE_ERR_WINDOW  (5000)
+#endif /* !defined(RAW_CAPTURE_ERR_WINDOW) */
+
+#ifndef RAW_CAPTURE_POST
+//! トリガ後に記録するフレーム数
+#define RAW_CAPTURE_POST        (16)
+#endif /* !defined(RAW_CAPTURE_POST) */
+
+#ifndef RAW_DUMP_LINES
+//! ループ一回当たりに出力する行数
+#define RAW_DUMP_LINES          (4)
+#endif /* !defined(RAW_DUMP_LINES) */
+
+#if RAW_CAPTURE_POST >= RAWRING_SIZE
+#error "RAW_CAPTURE_POST must be less than RAWRING_SIZE"
+#endif
+#endif /* defined(RAW_CAPTURE) */
+
+/*
+ * 較正値
+ *   起動時にNVSの名前空間CALIB_NAMESPACEから較正値を読み込み、公称の抵抗値
+ *   から求めた換算係数に合成する。較正値はホスト側ツールcalibで基準計の測定
+ *   値から求め、NVSパーティションとして書き込む。利得はppm単位("v_gain",
+ *   "a_gain", "w_gain")、切片はミリ単位("v_off", "a_off", "w_off")の整数で、
+ *   いずれも既定の換算での出力値に対する補正とする。書き込まれていないキー
+ *   は補正無し(利得1, 切片0)として扱う。
+ */
+
+//! 較正値を格納するNVSの名前空間
+#define CALIB_NAMESPACE   "calib"
+
 //! レコーダと接続するシリアルのRX信号に割り当てるGPIOの番号
 #define RXPIN         (2)
 
@@ -31,7 +282,28 @@
 //! 画面表示モード指定子（消費電力表示モード）
 #define MODE_WATTAGE  (3)
 
-//! 記録用M5Atomとの通信用シリアル
+//! コンソールへの動作統計の出力周期(ミリ秒)
+#define STAT_INTERVAL (10000)
+
+//! UARTドライバから通知されたエラーの計数
+typedef struct {
+  //! ブレーク検出
+  uint32_t brk;
+
+  //! ドライバのリングバッファ溢れ
+  uint32_t bufferFull;
+
+  //! ハードウェアFIFO溢れ
+  uint32_t fifoOvf;
+
+  //! フレーミングエラー
+  uint32_t frame;
+
+  //! パリティエラー
+  uint32_t parity;
+} uart_errors_t;
+
+//! 記録用M5Atom(もしくは下流のセンサー)との通信用シリアル
 static HardwareSerial LoComm(1);
 
 //! 測定値受信用の数信用シリアル
@@ -43,8 +315,8 @@ static ATOMSOCKET ATOM;
 //! 画面表示用スプライト(フレームバッファとして使用)
 static M5Canvas canvas(&M5.Lcd);
 
-//! タイムスタンプ計算用区間時刻
-static unsigned long t0;
+//! タイムスタンプ計算用の経過時間の積算状態
+static hal_uptime_t uptime;
 
 //! 表示モード
 static int dispMode;
@@ -52,29 +324,88 @@ static int dispMode;
 //! 表示を行うか否かをあらわすフラグ
 static bool enableLcd;
 
+//! センサーデバイスとの通信のエラー計数
+static uart_errors_t hlwErrors;
+
+//! 記録用M5Atomとの通信のエラー計数
+static uart_errors_t loErrors;
+
+//! フレーム処理時間の合計(統計出力区間内, マイクロ秒)
+static uint32_t procSum;
+
+//! フレーム処理時間の最大値(統計出力区間内, マイクロ秒)
+static uint32_t procMax;
+
+//! 処理したフレーム数(統計出力区間内)
+static uint32_t procCount;
+
+//! 較正値を読み込んだか否か
+static bool calibrated = false;
+
+#ifdef ADAPTIVE_OUTPUT
+//! 出力レート制御の状態
+static adaptive_t adaptive;
+#endif /* defined(ADAPTIVE_OUTPUT) */
+
+#ifdef APPLIANCE_EVENTS
+//! 家電の識別の状態
+static appliance_t appliance;
+#endif /* defined(APPLIANCE_EVENTS) */
+
+#ifdef PQ_EVENTS
+//! 電源品質の判定の状態
+static pq_t pq;
+#endif /* defined(PQ_EVENTS) */
+
+#ifdef PF_POWER
+//! PFパルスによる消費電力の推定の状態
+static pfpower_t pfPower;
+#endif /* defined(PF_POWER) */
+
+#ifdef RAW_CAPTURE
+//! 生フレームの記録の状態
+static rawring_t rawRing;
+
+//! 次に出力するフレームの位置(出力中でない場合は-1)
+static int rawDumpPos = -1;
+
+//! 出力済みのトリガの回数
+static uint32_t rawDumped = 0;
+#endif /* defined(RAW_CAPTURE) */
+
 /**
  * タイムスタンプ
  *
  * @remarks
  *  m5Atomは RTCが無いので、電源投入時刻起点としたタイムスタンプを管理する。ま
  *  た、millis()は32ビット値を返すためそのままでは50日間程度で桁溢れが発生する。
- *  このため、ループ先頭の時刻の差分を積算し64ビットのタイムタンプとして用いる。
+ *  このため、hal_uptime_update()で時刻の差分を積算し64ビットのタイムタンプと
+ *  して用いる。
  */
 uint64_t ts;
 
 //! データ出力用行バッファ
 char buf[80];
 
-//! 計測値格納用の構造体
+//! 測定値が得られていないことを示す値
+#define MEASURE_NONE  (INT32_MIN)
+
+/**
+ * 計測値格納用の構造体
+ *
+ * @remarks
+ *  値はセンサーデバイスのレジスタ値から整数演算で換算したミリ単位の値で保持
+ *  し、浮動小数点数への変換は表示・出力の時点でのみ行う。
+ */
 typedef struct {
-  //! 電圧値(V)
-  float voltage;
+  //! 電圧値(mV)
+  int32_t voltage;
 
-  //! 電流値(A)
-  float current;
+  //! 電流値(mA)
+  int32_t current;
 
-  //! 消費電力(W)
-  float wattage;
+  //! 消費電力(mW)
+  int32_t wattage;
 } measure_value_t;
 
 //! 電力測定モジュールから読み出した値を格納する領域
@@ -82,18 +413,64 @@ typedef struct {
   //! 最後に読み出した値
   measure_value_t latest;
 
-  //! 最小値
+  //! 最小値(値が無い場合はINT32_MAX)
   measure_value_t min;
 
-  //! 最大値
+  //! 最大値(値が無い場合はINT32_MIN)
   measure_value_t max;
+
+  //! 積算電力量(mW・ミリ秒, 起動時からの累積)
+  uint64_t energy;
 } value_set_t;
 
+//! 最小値の初期値
+static const measure_value_t MIN_RESET = {INT32_MAX, INT32_MAX, INT32_MAX};
+
+//! 最大値の初期値
+static const measure_value_t MAX_RESET = {INT32_MIN, INT32_MIN, INT32_MIN};
+
 //! データを格納する領域
 value_set_t data = {
-  {NAN, NAN, NAN}, {NAN, NAN, NAN}, {NAN, NAN, NAN}
+  {MEASURE_NONE, MEASURE_NONE, MEASURE_NONE}, MIN_RESET, MAX_RESET, 0
 };
 
+/**
+ * 計測値の浮動小数点数への変換
+ *
+ * param [in] v  計測値(ミリ単位)
+ *
+ * @return
+ *  基本単位に換算した値を返す。値が無い場合はNANを返す。
+ */
+static inline float
+to_float(int32_t v)
+{
+  return (v == MEASURE_NONE)? NAN: v / 1000.0f;
+}
+
+/**
+ * 最小・最大値の区間の浮動小数点数への変換
+ *
+ * param [in] min   最小値(ミリ単位)
+ * param [in] max   最大値(ミリ単位)
+ * param [out] dst1 最小値の書き込み先
+ * param [out] dst2 最大値の書き込み先
+ *
+ * @remarks
+ *  区間が空の(クリア後に値が得られていない)場合はNANを書き込む。
+ */
+static void
+to_float_range(int32_t min, int32_t max, float* dst1, float* dst2)
+{
+  if (min > max) {
+    *dst1 = NAN;
+    *dst2 = NAN;
+  } else {
+    *dst1 = min / 1000.0f;
+    *dst2 = max / 1000.0f;
+  }
+}
+
 /**
  * 液晶表示更新
  *
@@ -113,6 +490,19 @@ display_update()
   char* unit;
   char buf[30];
 
+  /*
+   * ヘッドレス時は何もしない
+   */
+  if (!enableLcd) return;
+
+  /*
+   * フレームバッファの確保(起動時およびヘッドレスからの復帰時)
+   */
+  if (canvas.getBuffer() == NULL) {
+    canvas.setColorDepth(16);
+    if (!canvas.createSprite(M5.Lcd.width(), M5.Lcd.height())) return;
+  }
+
   /*
    * 表示モードに応じて出力内容を選択
    */
@@ -121,9 +511,8 @@ display_update()
     label = (char*)"電圧";
     fmt1  = (char*)"%5.1f";
     fmt2  = (char*)"(%.1f〜%.1f)";
-    value = data.latest.voltage;
-    min   = data.min.voltage;
-    max   = data.max.voltage;
+    value = to_float(data.latest.voltage);
+    to_float_range(data.min.voltage, data.max.voltage, &min, &max);
     unit  = (char*)"V";
     break;
 
@@ -131,9 +520,8 @@ display_update()
     label = (char*)"電流";
     fmt1  = (char*)"%5.2f";
     fmt2  = (char*)"(%.2f〜%.2f)";
-    value = data.latest.current;
-    min   = data.min.current;
-    max   = data.max.current;
+    value = to_float(data.latest.current);
+    to_float_range(data.min.current, data.max.current, &min, &max);
     unit  = (char*)"A";
     break;
 
@@ -141,9 +529,8 @@ display_update()
     label = (char*)"消費電力";
     fmt1  = (char*)"%5.1f";
     fmt2  = (char*)"(%.1f〜%.1f)";
-    value = data.latest.wattage;
-    min   = data.min.wattage;
-    max   = data.max.wattage;
+    value = to_float(data.latest.wattage);
+    to_float_range(data.min.wattage, data.max.wattage, &min, &max);
     unit  = (char*)"W";
     break;
 
@@ -195,6 +582,532 @@ display_update()
   M5.Lcd.endWrite();
 }
 
+/**
+ * ヘッドレス動作への移行
+ */
+static void
+enter_headless()
+{
+  enableLcd = false;
+
+  canvas.deleteSprite();
+  M5.Lcd.sleep();
+
+  setCpuFrequencyMhz(CPU_FREQ_HEADLESS);
+}
+
+/**
+ * ヘッドレス動作からの復帰
+ *
+ * @remarks
+ *  フレームバッファは次のdisplay_update()の呼び出しで再確保される。
+ */
+static void
+leave_headless()
+{
+  setCpuFrequencyMhz(CPU_FREQ_ACTIVE);
+
+  M5.Lcd.wakeup();
+  enableLcd = true;
+}
+
+/**
+ * 一行分のデータの出力
+ *
+ * param [in] ts        タイムスタンプ(ミリ秒)
+ * param [in] vol       電圧の値(V)
+ * param [in] cur       電流の値(A)
+ * param [in] wat       消費電力の値(W)
+ * param [in] interval  行が表す区間の長さ(ミリ秒)
+ *
+ * @remarks
+ *  区間の長さはADAPTIVE_OUTPUTが定義されている場合のみ出力される。
+ */
+static void
+output_record(uint64_t ts, float vol, float cur, float wat, uint32_t interval)
+{
+  int n;
+
+  n = sprintf(buf,
+              "%llu,%f,%f,%f",
+              (unsigned long long)ts,
+              vol,
+              cur,
+              wat);
+
+#ifdef ADAPTIVE_OUTPUT
+  n += sprintf(buf + n, ",%lu", (unsigned long)interval);
+#endif /* defined(ADAPTIVE_OUTPUT) */
+
+#ifdef NODE_ID
+  n += sprintf(buf + n, ",%d", NODE_ID);
+#endif /* defined(NODE_ID) */
+
+  chain_send(buf);
+}
+
+#ifdef APPLIANCE_EVENTS
+/**
+ * 家電の識別のイベント行の出力
+ *
+ * param [in] ev  イベント
+ */
+static void
+output_appliance_event(const appliance_event_t* ev)
+{
+  int n;
+
+  n = sprintf(buf,
+              "!%llu,app,%s,%s,%.1f,%.3f,%d,%d,%.1f",
+              (unsigned long long)ev->ts,
+              appliance_name(&appliance, ev->cls),
+              (ev->on)? "on": "off",
+              ev->step / 10.0f,
+              ev->pf / 1000.0f,
+              ev->overshoot,
+              ev->settle,
+              ev->duty / 10.0f);
+
+#ifdef NODE_ID
+  n += sprintf(buf + n, ",%d", NODE_ID);
+#endif /* defined(NODE_ID) */
+
+  chain_send(buf);
+}
+
+/**
+ * 家電の識別へのフレームの投入
+ *
+ * @remarks
+ *  計測値を0.1W単位に丸め、力率(1/1000単位)を有効電力と皮相電力から整数演
+ *  算で求めて投入する。力率が得られない(電流が0の)場合は1とみなす。
+ */
+static void
+push_appliance_frame()
+{
+  appliance_event_t ev;
+  int64_t va;
+  int32_t pf;
+
+  if (data.latest.wattage == MEASURE_NONE) return;
+
+  // 皮相電力(mVA)
+  va = (data.latest.voltage != MEASURE_NONE &&
+        data.latest.current != MEASURE_NONE)?
+       (int64_t)data.latest.voltage * data.latest.current / 1000: 0;
+
+  pf = (va > 0)? (int32_t)((int64_t)data.latest.wattage * 1000 / va): 1000;
+  if (pf > 1000) pf = 1000;
+
+  if (appliance_push(&appliance,
+                     ts,
+                     (data.latest.wattage + 50) / 100,
+                     pf,
+                     &ev)) {
+    output_appliance_event(&ev);
+  }
+}
+#endif /* defined(APPLIANCE_EVENTS) */
+
+#ifdef PQ_EVENTS
+//! 電源品質イベントの種類の表示名
+static const char* pq_kind_names[] = {"", "sag", "swell", "int"};
+
+/**
+ * 電源品質のイベント行の出力
+ *
+ * param [in] ev  イベント
+ */
+static void
+output_pq_event(const pq_event_t* ev)
+{
+  int n;
+
+  n = sprintf(buf,
+              "!%llu,pq,%s,%lu,%.1f,%.1f",
+              (unsigned long long)ev->ts,
+              pq_kind_names[ev->kind],
+              (unsigned long)ev->duration,
+              ev->extreme / 1000.0f,
+              ev->depth / 10.0f);
+
+#ifdef NODE_ID
+  n += sprintf(buf + n, ",%d", NODE_ID);
+#endif /* defined(NODE_ID) */
+
+  chain_send(buf);
+}
+
+/**
+ * 電源品質の集計行の出力
+ *
+ * param [in] agg  集計区間の統計
+ */
+static void
+output_pq_aggregate(const pq_aggregate_t* agg)
+{
+  int n;
+
+  n = sprintf(buf,
+              "!%llu,pq,agg,%lu,%.1f,%.2f,%.1f,%lu",
+              (unsigned long long)agg->ts,
+              (unsigned long)agg->count,
+              agg->min / 1000.0f,
+              agg->avg / 1000.0f,
+              agg->max / 1000.0f,
+              (unsigned long)agg->events);
+
+#ifdef NODE_ID
+  n += sprintf(buf + n, ",%d", NODE_ID);
+#endif /* defined(NODE_ID) */
+
+  chain_send(buf);
+}
+
+/**
+ * 起動時のリセット要因の出力
+ *
+ * @remarks
+ *  停電でセンサー自体の電源が落ちた場合はイベントを出力できないので、復電
+ *  後の起動時にリセット要因(poweron, brownout等)を出力して検知できるように
+ *  する。
+ */
+static void
+output_pq_boot()
+{
+  const char* reason;
+  int n;
+
+  switch (esp_reset_reason()) {
+  case ESP_RST_POWERON:   reason = "poweron";   break;
+  case ESP_RST_BROWNOUT:  reason = "brownout";  break;
+  case ESP_RST_SW:        reason = "sw";        break;
+  case ESP_RST_PANIC:     reason = "panic";     break;
+  case ESP_RST_INT_WDT:
+  case ESP_RST_TASK_WDT:
+  case ESP_RST_WDT:       reason = "wdt";       break;
+  default:                reason = "other";     break;
+  }
+
+  n = sprintf(buf, "!0,pq,boot,%s", reason);
+
+#ifdef NODE_ID
+  n += sprintf(buf + n, ",%d", NODE_ID);
+#endif /* defined(NODE_ID) */
+
+  chain_send(buf);
+}
+
+/**
+ * 電源品質の判定へのフレームの投入
+ */
+static void
+push_pq_frame()
+{
+  pq_event_t ev;
+  pq_aggregate_t agg;
+  int out;
+
+  if (data.latest.voltage == MEASURE_NONE) return;
+
+  out = pq_push(&pq, ts, data.latest.voltage, &ev, &agg);
+
+  if (out & PQ_OUT_AGGREGATE) output_pq_aggregate(&agg);
+  if (out & PQ_OUT_EVENT) output_pq_event(&ev);
+}
+#endif /* defined(PQ_EVENTS) */
+
+#ifdef RAW_CAPTURE
+/**
+ * トリガ要因の表示名の取得
+ *
+ * param [in] cause  トリガ要因(RAWRING_TRIG_*)
+ */
+static const char*
+raw_cause_name(uint32_t cause)
+{
+  switch (cause) {
+  case RAWRING_TRIG_STEP:   return "step";
+  case RAWRING_TRIG_ERRORS: return "errors";
+  case RAWRING_TRIG_MANUAL: return "manual";
+  default:                  return "none";
+  }
+}
+
+/**
+ * 受信したフレームの記録
+ *
+ * param [in] data    受信したバイト列
+ * param [in] len     受信したバイト数
+ * param [in] status  受信結果(ATOMSOCKET_RAW_*)
+ *
+ * @remarks
+ *  ATOMSOCKET::SerialReadLoop()から受信毎に呼び出される。受信時刻は測定値
+ *  の行と同じ時間軸(起動時からの経過時間)とする。
+ */
+static void
+raw_capture_hook(const byte* data, int len, int status)
+{
+  rawring_push(&rawRing, hal_uptime_update(&uptime), data, len, status);
+}
+
+/**
+ * 生フレームの取得のコマンド処理と出力
+ *
+ * @remarks
+ *  USBシリアルから'T'(トリガ)、'D'(再出力)、'R'(記録の再開)を受け付ける。
+ *  凍結した内容は"#raw begin ..."、フレーム毎の"#raw 受信時刻,バイト数,受
+ *  信結果,16進数"、"#raw end"の行として出力する。測定値の処理を遅らせない
+ *  よう、一回の呼び出しではRAW_DUMP_LINES行までに留める。
+ */
+static void
+raw_capture_poll()
+{
+  const rawring_frame_t* frame;
+  char hex[RAWRING_FRAME_SIZE * 2 + 1];
+  int i;
+  int j;
+
+  /*
+   * コマンドの処理
+   */
+  while (Serial.available() > 0) {
+    switch (Serial.read()) {
+    case 'T':
+      rawring_trigger(&rawRing,
+                      hal_uptime_update(&uptime),
+                      RAWRING_TRIG_MANUAL);
+      break;
+
+    case 'D':
+      if (rawRing.state == RAWRING_FROZEN) rawDumped = rawRing.count - 1;
+      break;
+
+    case 'R':
+      rawring_rearm(&rawRing);
+      rawDumpPos = -1;
+      rawDumped  = rawRing.count;
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  /*
+   * 凍結した内容の出力
+   */
+  if (rawDumpPos < 0) {
+    if (rawRing.state != RAWRING_FROZEN || rawDumped == rawRing.count) return;
+
+    Serial.printf("#raw begin cause=%s trig_ts=%llu trig_index=%d frames=%d"
+                  " count=%lu\n",
+                  raw_cause_name(rawRing.cause),
+                  (unsigned long long)rawRing.trigTs,
+                  rawRing.trigIndex,
+                  rawRing.used,
+                  (unsigned long)rawRing.count);
+
+    rawDumpPos = 0;
+    rawDumped  = rawRing.count;
+    return;
+  }
+
+  for (i = 0; i < RAW_DUMP_LINES && rawDumpPos < rawRing.used; i++) {
+    frame = rawring_get(&rawRing, rawDumpPos++);
+
+    for (j = 0; j < RAWRING_FRAME_SIZE; j++) {
+      sprintf(hex + j * 2, "%02x", frame->data[j]);
+    }
+
+    Serial.printf("#raw %llu,%u,%u,%s\n",
+                  (unsigned long long)frame->ts,
+                  (unsigned)frame->len,
+                  (unsigned)frame->status,
+                  hex);
+  }
+
+  if (rawDumpPos >= rawRing.used) {
+    Serial.printf("#raw end\n");
+    rawDumpPos = -1;
+  }
+}
+#endif /* defined(RAW_CAPTURE) */
+
+/**
+ * UARTエラーの計数
+ *
+ * param [out] dst 計数先
+ * param [in] err  UARTドライバから通知されたエラー種別
+ *
+ * @remarks
+ *  HardwareSerialのイベントタスクから呼び出される。
+ */
+static void
+count_uart_error(uart_errors_t* dst, hardwareSerial_error_t err)
+{
+  switch (err) {
+  case UART_BREAK_ERROR:
+    dst->brk++;
+    break;
+
+  case UART_BUFFER_FULL_ERROR:
+    dst->bufferFull++;
+    break;
+
+  case UART_FIFO_OVF_ERROR:
+    dst->fifoOvf++;
+    break;
+
+  case UART_FRAME_ERROR:
+    dst->frame++;
+    break;
+
+  case UART_PARITY_ERROR:
+    dst->parity++;
+    break;
+
+  default:
+    break;
+  }
+}
+
+#ifndef NO_UPLINK
+/**
+ * 動作統計のコンソールへの出力
+ *
+ * @remarks
+ *  STAT_INTERVAL毎に"#stat 名前=値 ..."の形式の一行をコンソール(USBシリア
+ *  ル)に出力する。値は起動時からの累積値。レコーダへの出力には影響しない。
+ */
+static void
+print_stats()
+{
+  static hal_interval_t timer = {STAT_INTERVAL, 0};
+  static uint32_t bytes0 = 0;
+  chain_stats_t chain;
+  uint32_t elapsed;
+  uint32_t bytes;
+  uint32_t avg;
+  float util;
+
+  elapsed = hal_interval_check(&timer);
+  if (elapsed == 0) return;
+
+  /*
+   * 下流へのリンク使用率の算出
+   *   8N1では1バイトあたり10ビットを占有するので、区間中の送信バイト数から
+   *   115200bpsに対する使用率(%)を求める。
+   */
+  chain_get_stats(&chain);
+
+  bytes  = chain.ownBytes + chain.fwdBytes +
+           chain.preambles * LP_PREAMBLE_BYTES;
+  util   = ((bytes - bytes0) * 1000.0f) / (115.2f * elapsed);
+  avg    = (chain.fwdLines > 0)? chain.latencySum / chain.fwdLines: 0;
+  bytes0 = bytes;
+
+  Serial.printf("#stat frames=%lu len_err=%lu hdr_err=%lu sum_err=%lu",
+                (unsigned long)ATOM.Frames,
+                (unsigned long)ATOM.LengthErrors,
+                (unsigned long)ATOM.HeaderErrors,
+                (unsigned long)ATOM.ChecksumErrors);
+
+  Serial.printf(" hlw_break=%lu hlw_buffer_full=%lu hlw_fifo_ovf=%lu"
+                " hlw_frame=%lu hlw_parity=%lu",
+                (unsigned long)hlwErrors.brk,
+                (unsigned long)hlwErrors.bufferFull,
+                (unsigned long)hlwErrors.fifoOvf,
+                (unsigned long)hlwErrors.frame,
+                (unsigned long)hlwErrors.parity);
+
+  Serial.printf(" chain_own=%lu chain_fwd=%lu chain_drop=%lu"
+                " chain_lat_avg_us=%lu chain_lat_max_us=%lu link_util_pct=%.1f"
+                " chain_preamble=%lu",
+                (unsigned long)chain.ownLines,
+                (unsigned long)chain.fwdLines,
+                (unsigned long)chain.dropLines,
+                (unsigned long)avg,
+                (unsigned long)chain.latencyMax,
+                util,
+                (unsigned long)chain.preambles);
+
+  Serial.printf(" headless=%d calibrated=%d cpu_mhz=%lu proc_avg_us=%lu"
+                " proc_max_us=%lu",
+                (enableLcd)? 0: 1,
+                (calibrated)? 1: 0,
+                (unsigned long)getCpuFrequencyMhz(),
+                (unsigned long)((procCount > 0)? procSum / procCount: 0),
+                (unsigned long)procMax);
+
+  // 積算電力量(mW・ミリ秒)をmWh単位で出力する
+  Serial.printf(" energy_mwh=%llu",
+                (unsigned long long)(data.energy / 3600000ULL));
+
+#ifdef PF_POWER
+  Serial.printf(" pf_source=%d pf_pulses=%lu",
+                pfPower.source,
+                (unsigned long)pfPower.total);
+#endif /* defined(PF_POWER) */
+
+#ifdef RAW_CAPTURE
+  Serial.printf(" raw_state=%d raw_triggers=%lu",
+                rawRing.state,
+                (unsigned long)rawRing.count);
+#endif /* defined(RAW_CAPTURE) */
+
+  procSum   = 0;
+  procMax   = 0;
+  procCount = 0;
+
+  Serial.printf(" lo_break=%lu lo_buffer_full=%lu lo_fifo_ovf=%lu"
+                " lo_frame=%lu lo_parity=%lu\n",
+                (unsigned long)loErrors.brk,
+                (unsigned long)loErrors.bufferFull,
+                (unsigned long)loErrors.fifoOvf,
+                (unsigned long)loErrors.frame,
+                (unsigned long)loErrors.parity);
+}
+#endif /* !defined(NO_UPLINK) */
+
+/**
+ * 較正値の読み込み
+ *
+ * @remarks
+ *  較正値は既定の換算での出力(y = 利得 * x + 切片)に対して求めたものなので、
+ *  電圧・電流の利得はVF・CFに、消費電力の利得はVF・CFの補正分を除いてPGに
+ *  合成し、既定の補正値(電流の-60mA)にも利得を掛けた上で切片を加える。
+ */
+static void
+load_calibration()
+{
+  Preferences prefs;
+  float gv;
+  float ga;
+  float gw;
+
+  // 名前空間が無い(較正値が書き込まれていない)場合は既定値のまま動作する
+  if (!prefs.begin(CALIB_NAMESPACE, true)) return;
+
+  gv = prefs.getInt("v_gain", 1000000) / 1e6f;
+  ga = prefs.getInt("a_gain", 1000000) / 1e6f;
+  gw = prefs.getInt("w_gain", 1000000) / 1e6f;
+
+  if (gv > 0.0f && ga > 0.0f && gw > 0.0f) {
+    ATOM.setOffsets(lroundf(ATOM.VolOffset * gv) + prefs.getInt("v_off", 0),
+                    lroundf(ATOM.CurrentOffset * ga) + prefs.getInt("a_off", 0),
+                    lroundf(ATOM.PowerOffset * gw) + prefs.getInt("w_off", 0));
+
+    ATOM.setVF(ATOM.VF * gv);
+    ATOM.setCF(ATOM.CF * ga);
+    ATOM.setPG(ATOM.PG * gw / (gv * ga));
+
+    calibrated = true;
+  }
+
+  prefs.end();
+}
+
 /**
  * セットアップ関数
  */
@@ -210,92 +1123,193 @@ setup()
    * センサデバイスの初期化
    */
   ATOM.Init(AtomSerial, RELAY, RXD);
+  load_calibration();
   ATOM.SetPowerOn();
 
+  AtomSerial.onReceiveError([](hardwareSerial_error_t err) {
+    count_uart_error(&hlwErrors, err);
+  });
+
   /*
    * ローカル通信用シリアルの初期化
    */
-  LoComm.begin(115200, SERIAL_8N1, RXPIN, TXPIN);
+#ifdef NODE_ID
+  chain_start(&LoComm, RXPIN, TXPIN, true);
+#else /* defined(NODE_ID) */
+  chain_start(&LoComm, RXPIN, TXPIN, false);
+#endif /* defined(NODE_ID) */
+
+#ifdef WAKE_PREAMBLE
+  chain_enable_preamble();
+#endif /* defined(WAKE_PREAMBLE) */
+
+  LoComm.onReceiveError([](hardwareSerial_error_t err) {
+    count_uart_error(&loErrors, err);
+  });
 
   /*
    * ディスプレイの初期化
    */
   M5.Lcd.begin();
   M5.Lcd.fillScreen(TFT_BLACK);
+  enableLcd = true;
+
+#ifdef HEADLESS
+  enter_headless();
+#endif /* defined(HEADLESS) */
 
+#ifdef ADAPTIVE_OUTPUT
   /*
-   * フレームバッファの初期化
+   * 出力レート制御の初期化
    */
-  canvas.setColorDepth(16);
-  canvas.createSprite(M5.Lcd.width(), M5.Lcd.height());
+  adaptive_param_t param = {
+    ADAPTIVE_MAX_INTERVAL,
+    ADAPTIVE_ABS_THRESHOLD,
+    ADAPTIVE_REL_THRESHOLD,
+    ADAPTIVE_HOLDOFF
+  };
+
+  adaptive_init(&adaptive, &param);
+#endif /* defined(ADAPTIVE_OUTPUT) */
+
+#ifdef APPLIANCE_EVENTS
+  /*
+   * 家電の識別の初期化
+   */
+  appliance_param_t appParam = {
+    APPLIANCE_STEP_THRESHOLD,
+    30,                           // stableBand: 3W
+    5,                            // stableFrames
+    200,                          // maxTransient
+    APPLIANCE_MAX_DISTANCE
+  };
+
+  appliance_init(&appliance, &appParam, signatures);
+#endif /* defined(APPLIANCE_EVENTS) */
+
+#ifdef PF_POWER
+  /*
+   * PFパルスによる消費電力の推定の初期化
+   */
+  pfpower_param_t pfParam = {
+    PF_POWER_WINDOW,
+    PF_POWER_MIN_PULSES,
+    PF_POWER_LOW,
+    PF_POWER_HIGH
+  };
+
+  pfpower_init(&pfPower, &pfParam);
+#endif /* defined(PF_POWER) */
+
+#ifdef PQ_EVENTS
+  /*
+   * 電源品質の判定の初期化
+   */
+  pq_param_t pqParam = {
+    PQ_NOMINAL,
+    PQ_SAG_PCT,
+    PQ_SWELL_PCT,
+    PQ_INTERRUPTION_PCT,
+    PQ_HYSTERESIS_PCT,
+    PQ_AGG_INTERVAL
+  };
+
+  pq_init(&pq, &pqParam);
+  output_pq_boot();
+#endif /* defined(PQ_EVENTS) */
 
   /*
    * 各変数の初期化
    */
-  t0        = millis();
-  ts        = 0;
-  dispMode  = MODE_VOLTAGE;
-  enableLcd = true;
+  ts       = 0;
+  hal_uptime_init(&uptime);
+  dispMode = MODE_VOLTAGE;
+
+#ifdef RAW_CAPTURE
+  /*
+   * 生フレームの取得の初期化
+   *   フレームの受信時刻をuptimeから求めるので、その初期化後に登録する。
+   */
+  rawring_param_t rawParam = {
+    RAW_CAPTURE_TRIGGERS,
+    RAW_CAPTURE_STEP,
+    RAW_CAPTURE_ERR_BURST,
+    RAW_CAPTURE_ERR_WINDOW,
+    RAW_CAPTURE_POST
+  };
+
+  rawring_init(&rawRing, &rawParam);
+  ATOM.RawHook = raw_capture_hook;
+#endif /* defined(RAW_CAPTURE) */
+
+  Serial.printf("#boot profile=%s ms=%lu\n",
+                PROFILE_NAME, (unsigned long)hal_millis());
 }
 
+/**
+ * 計測値の更新
+ *
+ * param [in] v        新しい計測値(負の値の場合は更新しない)
+ * param [out] latest  最新値の書き込み先
+ * param [in,out] min  最小値
+ * param [in,out] max  最大値
+ */
+static inline void
+update_value(int32_t v, int32_t* latest, int32_t* min, int32_t* max)
+{
+  if (v < 0) return;
+
+  *latest = v;
+  if (v < *min) *min = v;
+  if (v > *max) *max = v;
+}
+
+/**
+ * 計測値の読み込み
+ *
+ * param [in] now  フレームのタイムスタンプ(ミリ秒)
+ * param [in] dt   前回のフレームからの経過時間(ミリ秒)
+ *
+ * @remarks
+ *  電力量は前回のフレームで得た消費電力が経過時間の間続いたものとして積算
+ *  する(最初のフレームでは積算しない)。PF_POWERが定義されている場合、消費
+ *  電力は低負荷時にPFパルスの計数による平均値に置き換える。
+ */
 void
-load_measure_data()
+load_measure_data(uint64_t now, uint32_t dt)
 {
 #ifdef DISPLAY_TEST
-  float vol = 103.77;
-  float cur = 2.3;
-  float wat = 60.2;
+  int32_t vol = 103770;
+  int32_t cur = 2300;
+  int32_t wat = 60200;
 #else /* defined(DISPLAY_TEST) */
-  float vol = ATOM.GetVol();
-  float cur = ATOM.GetCurrent();
-  float wat = ATOM.GetActivePower();
+  int32_t vol = ATOM.GetVolMilli();
+  int32_t cur = ATOM.GetCurrentMilli();
+  int32_t wat = ATOM.GetActivePowerMilli();
+
+#ifdef PF_POWER
+  wat = pfpower_push(&pfPower,
+                     now,
+                     ATOM.GetPF(),
+                     ATOM.GetPulseEnergyMicro(),
+                     wat,
+                     ATOM.PowerOffset);
+#endif /* defined(PF_POWER) */
 #endif /* defined(DISPLAY_TEST) */
 
   /*
-   * 電圧値の最小・最大を更新
+   * 電力量の積算
    */
-  if (vol >= 0.0) {
-    data.latest.voltage = vol;
-
-    if (isnan(data.min.voltage) || vol < data.min.voltage) {
-      data.min.voltage = vol;
-    }
-
-    if (isnan(data.max.voltage) || vol > data.max.voltage) {
-      data.max.voltage = vol;
-    }
-  }
-
-
-  /*
-   * 電流値の最小・最大を更新
-   */
-  if (cur >= 0.0) {
-    data.latest.current = cur;
-
-    if (isnan(data.min.current) || cur < data.min.current) {
-      data.min.current = cur;
-    }
-
-    if (isnan(data.max.current) || cur > data.max.current) {
-      data.max.current = cur;
-    }
+  if (data.latest.wattage != MEASURE_NONE) {
+    data.energy += (uint64_t)data.latest.wattage * dt;
   }
 
   /*
-   * 消費電力の最小・最大を更新
+   * 最新値と最小・最大を更新
    */
-  if (wat >= 0.0) {
-    data.latest.wattage = wat;
-
-    if (isnan(data.min.wattage) || wat < data.min.wattage) {
-      data.min.wattage = wat;
-    }
-
-    if (isnan(data.max.wattage) || wat > data.max.wattage) {
-      data.max.wattage = wat;
-    }
-  }
+  update_value(vol, &data.latest.voltage, &data.min.voltage, &data.max.voltage);
+  update_value(cur, &data.latest.current, &data.min.current, &data.max.current);
+  update_value(wat, &data.latest.wattage, &data.min.wattage, &data.max.wattage);
 }
 
 /**
@@ -331,20 +1345,24 @@ loop()
   } else if (M5.BtnA.wasDoubleClicked()) {
     // ダブルクリックの場合 (最大最小値のクリア)
  
-    data.min = {NAN, NAN, NAN};
-    data.max = {NAN, NAN, NAN};
+    data.min = MIN_RESET;
+    data.max = MAX_RESET;
 
   } else if (M5.BtnA.wasHold()) {
     // 長押しの場合 (LCDの表示・消灯のトグル)
 
     if (enableLcd) {
-      enableLcd = false;
-      M5.Lcd.sleep();
-
+      enter_headless();
     } else {
-      enableLcd = true;
-      M5.Lcd.wakeup();
+      leave_headless();
     }
+
+#ifdef RAW_CAPTURE
+  } else if (M5.BtnA.wasDecideClickCount() && M5.BtnA.getClickCount() == 3) {
+    // トリプルクリックの場合 (生フレームの取得のトリガ)
+
+    rawring_trigger(&rawRing, hal_uptime_update(&uptime), RAWRING_TRIG_MANUAL);
+#endif /* defined(RAW_CAPTURE) */
   }
 
   /*
@@ -360,35 +1378,89 @@ loop()
 #ifndef DISPLAY_TEST
   if (ATOM.SerialRead == 1) {
 #endif /* defined(DISPLAY_TEST) */
-    M5.Display.startWrite();
+    // 処理時間の計測開始
+    uint32_t c0 = ESP.getCycleCount();
 
-    // 区間先頭時刻の記録
-    unsigned long t = millis() - t0;
+    // 前回のフレームからの経過時間の記録
+    uint64_t now = hal_uptime_update(&uptime);
+    uint32_t t   = (uint32_t)(now - ts);
 
     // データのロード
-    load_measure_data();
+    load_measure_data(now, t);
+
+#ifdef RAW_CAPTURE
+    // 消費電力のステップによるトリガの判定
+    rawring_check_power(&rawRing, now, data.latest.wattage);
+#endif /* defined(RAW_CAPTURE) */
 
     // 画面表示の更新
     display_update();
 
-    // タイムスタンプの計算
-    ts += t;
+    // タイムスタンプの更新
+    ts = now;
 
     // データの出力
-    sprintf(buf,
-            "%lu,%f,%f,%f",
-            ts,
-            data.latest.voltage,
-            data.latest.current,
-            data.latest.wattage);
-
-    LoComm.println(buf);
-
-    // 区間先頭時刻の更新
-    t0 += t;
+#if defined(PQ_EVENT_ONLY)
+    // イベント行のみを出力する
+#elif defined(ADAPTIVE_OUTPUT)
+    adaptive_record_t rec[ADAPTIVE_MAX_OUTPUT];
+    int n;
+
+    n = adaptive_push(&adaptive,
+                      ts,
+                      to_float(data.latest.voltage),
+                      to_float(data.latest.current),
+                      to_float(data.latest.wattage),
+                      rec);
+
+    for (int i = 0; i < n; i++) {
+      output_record(rec[i].ts,
+                    rec[i].voltage,
+                    rec[i].current,
+                    rec[i].wattage,
+                    rec[i].interval);
+    }
+#else /* defined(PQ_EVENT_ONLY) || defined(ADAPTIVE_OUTPUT) */
+    output_record(ts,
+                  to_float(data.latest.voltage),
+                  to_float(data.latest.current),
+                  to_float(data.latest.wattage),
+                  t);
+#endif /* defined(PQ_EVENT_ONLY) || defined(ADAPTIVE_OUTPUT) */
+
+#ifdef APPLIANCE_EVENTS
+    // 家電の識別
+    push_appliance_frame();
+#endif /* defined(APPLIANCE_EVENTS) */
+
+#ifdef PQ_EVENTS
+    // 電源品質の判定
+    push_pq_frame();
+#endif /* defined(PQ_EVENTS) */
+
+    // 処理時間の計測終了
+    uint32_t us = (ESP.getCycleCount() - c0) / getCpuFrequencyMhz();
+
+    procSum += us;
+    procCount++;
+    if (us > procMax) procMax = us;
 
 #ifndef DISPLAY_TEST
     ATOM.SerialRead = 0;
   }
 #endif /* defined(DISPLAY_TEST) */
+
+#ifdef RAW_CAPTURE
+  /*
+   * 生フレームの取得のコマンド処理と出力
+   */
+  raw_capture_poll();
+#endif /* defined(RAW_CAPTURE) */
+
+#ifndef NO_UPLINK
+  /*
+   * 動作統計の出力
+   */
+  print_stats();
+#endif /* !defined(NO_UPLINK) */
 }
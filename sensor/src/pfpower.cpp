@@ -0,0 +1,144 @@
+/*
+ * AC power monitor for M5Atomic Socket with AtomS3
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <string.h>
+
+#include "pfpower.h"
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * パルス計数による平均電力の算出
+ *
+ * @param [in] ctx     状態
+ * @param [in] ts      現在のフレームのタイムスタンプ(ミリ秒)
+ * @param [in] energy  1パルス当たりの電力量(μJ)
+ * @param [out] dst    平均電力(mW, 補正前)の書き込み先
+ *
+ * @return
+ *  算出できた場合はtrueを返す。
+ */
+static bool
+estimate(const pfpower_t* ctx, uint64_t ts, uint32_t energy, int64_t* dst)
+{
+  int oldest;
+  int idx;
+  uint32_t pulses;
+  uint64_t span;
+  uint64_t silent;
+  uint64_t interval;
+  int i;
+
+  if (ctx->used < 2 || energy == 0) return false;
+
+  /*
+   * window以内の最も古い記録を探す
+   */
+  oldest = ctx->head;
+
+  for (i = 1; i < ctx->used; i++) {
+    idx = (ctx->head - i + PFPOWER_HISTORY) % PFPOWER_HISTORY;
+    if (ts - ctx->ts[idx] > ctx->param.window) break;
+    oldest = idx;
+  }
+
+  pulses = ctx->count[ctx->head] - ctx->count[oldest];
+  span   = ctx->ts[ctx->head] - ctx->ts[oldest];
+
+  if (pulses < ctx->param.minPulses || span == 0) return false;
+
+  /*
+   * 平均電力(μJ/ミリ秒 = mW)
+   *   最新のパルスから平均間隔を超えて途絶えている場合は、負荷が下がった
+   *   ものとして超えた分の時間を区間に加える(平均間隔の時点で連続)。
+   */
+  interval = span / pulses;
+  silent   = ts - ctx->ts[ctx->head];
+
+  if (silent > interval) span += silent - interval;
+
+  *dst = (int64_t)((uint64_t)pulses * energy / span);
+
+  return true;
+}
+
+/*
+ * 公開関数の定義
+ */
+
+void
+pfpower_init(pfpower_t* ctx, const pfpower_param_t* param)
+{
+  memset(ctx, 0, sizeof(pfpower_t));
+
+  ctx->param  = *param;
+  ctx->source = PFPOWER_INSTANT;
+}
+
+int32_t
+pfpower_push(pfpower_t* ctx,
+             uint64_t ts,
+             uint16_t pf,
+             uint32_t energy,
+             int32_t instant,
+             int32_t offset)
+{
+  uint16_t delta;
+  int64_t avg;
+  int32_t level;
+  bool valid;
+
+  /*
+   * パルスの計数
+   *   PFレジスタは16ビットで桁溢れするので差分で数える(フレーム周期の間に
+   *   65536パルスを超えることは無い)。
+   */
+  if (!ctx->started) {
+    ctx->prevPF  = pf;
+    ctx->started = true;
+  }
+
+  delta       = (uint16_t)(pf - ctx->prevPF);
+  ctx->prevPF = pf;
+
+  if (delta > 0) {
+    ctx->total += delta;
+    ctx->head   = (ctx->head + 1) % PFPOWER_HISTORY;
+
+    ctx->ts[ctx->head]    = ts;
+    ctx->count[ctx->head] = ctx->total;
+
+    if (ctx->used < PFPOWER_HISTORY) ctx->used++;
+  }
+
+  /*
+   * 推定値の算出
+   */
+  valid = estimate(ctx, ts, energy, &avg);
+
+  if (valid) {
+    avg += offset;
+    if (avg < 0) avg = 0;
+    if (avg > INT32_MAX) avg = INT32_MAX;
+  }
+
+  /*
+   * 出所の切り替え(ヒステリシス付き)
+   */
+  level = (valid)? (int32_t)avg: instant;
+
+  if (ctx->source == PFPOWER_INSTANT) {
+    if (level >= 0 && level < ctx->param.lowThreshold) {
+      ctx->source = PFPOWER_PULSE;
+    }
+  } else {
+    if (level > ctx->param.highThreshold) ctx->source = PFPOWER_INSTANT;
+  }
+
+  return (ctx->source == PFPOWER_PULSE && valid)? (int32_t)avg: instant;
+}
@@ -0,0 +1,106 @@
+/*
+ * AC power monitor for M5Atomic Socket with AtomS3
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __PFPOWER_H__
+#define __PFPOWER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//! パルスの到着を記録するフレーム数(リングバッファの要素数)
+#define PFPOWER_HISTORY     (32)
+
+//! 推定値の出所(フレーム毎の瞬時値)
+#define PFPOWER_INSTANT     (0)
+
+//! 推定値の出所(PFパルスの計数による平均値)
+#define PFPOWER_PULSE       (1)
+
+//! パルス計数による推定のパラメータ
+typedef struct {
+  //! 平均を取る最大の時間幅(ミリ秒)
+  uint32_t window;
+
+  //! 平均を取るのに必要な最小のパルス数
+  uint32_t minPulses;
+
+  //! パルス計数による推定に切り替える消費電力(mW)
+  int32_t lowThreshold;
+
+  //! 瞬時値に戻す消費電力(mW, lowThreshold以上の値とする)
+  int32_t highThreshold;
+} pfpower_param_t;
+
+//! パルス計数による推定の状態
+typedef struct {
+  pfpower_param_t param;
+
+  //! パルスが増えたフレームのタイムスタンプ(ミリ秒)
+  uint64_t ts[PFPOWER_HISTORY];
+
+  //! 上記のフレームでの累積パルス数
+  uint32_t count[PFPOWER_HISTORY];
+
+  //! 最も新しい要素の位置
+  int head;
+
+  //! 有効な要素数
+  int used;
+
+  //! 直前のフレームのPFレジスタの値
+  uint16_t prevPF;
+
+  //! 起動時からの累積パルス数
+  uint32_t total;
+
+  //! 現在の推定値の出所(PFPOWER_INSTANT, PFPOWER_PULSE)
+  int source;
+
+  //! 初回のフレームを受け取ったか否か
+  bool started;
+} pfpower_t;
+
+/**
+ * パルス計数による推定の初期化
+ *
+ * @param [out] ctx   初期化する状態
+ * @param [in] param  パラメータ
+ */
+void pfpower_init(pfpower_t* ctx, const pfpower_param_t* param);
+
+/**
+ * フレームの投入
+ *
+ * @param [in,out] ctx  状態
+ * @param [in] ts       フレームのタイムスタンプ(ミリ秒)
+ * @param [in] pf       PFレジスタの値(16ビットのパルスカウンタ)
+ * @param [in] energy   1パルス当たりの電力量(μJ, 0の場合は不明)
+ * @param [in] instant  フレームの消費電力の瞬時値(mW, 負の場合は値無し)
+ * @param [in] offset   瞬時値と同じく推定値に加える補正値(mW)
+ *
+ * @return
+ *  消費電力の推定値(mW)を返す。瞬時値を用いる場合はinstantをそのまま返す。
+ *
+ * @remark
+ *  HLW8032はPFピンのパルス(一定の電力量毎に一つ)をPFレジスタで数えている。
+ *  パルス数が増えたフレームの時刻を記録し、window以内の最も古い記録と最新
+ *  の記録の間のパルス数と経過時間から平均電力を求める。端点をパルスが増え
+ *  たフレームに揃えるので、分解能はパルス数ではなくフレーム周期で決まる。
+ *  最新の記録から平均間隔を超えてパルスが途絶えている場合(負荷が下がった場
+ *  合)は、超えた分の時間を区間に加える。
+ *
+ *  推定値(パルス数が足りない間は瞬時値)がlowThresholdを下回るとパルス計数
+ *  による推定値を、highThresholdを上回ると瞬時値を返すように切り替える。
+ *  パルス数が足りない場合は瞬時値を返す(出所はctx->sourceで確認できる)。
+ */
+int32_t pfpower_push(pfpower_t* ctx,
+                     uint64_t ts,
+                     uint16_t pf,
+                     uint32_t energy,
+                     int32_t instant,
+                     int32_t offset);
+
+#endif /* !defined(__PFPOWER_H__) */
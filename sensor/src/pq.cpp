@@ -0,0 +1,154 @@
+/*
+ * AC power monitor for M5Atomic Socket with AtomS3
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <string.h>
+
+#include "pq.h"
+
+/*
+ * 内部関数の定義
+ */
+
+/**
+ * 集計区間の開始
+ *
+ * @param [in,out] ctx  状態
+ * @param [in] ts       区間の開始時刻
+ */
+static void
+start_aggregate(pq_t* ctx, uint64_t ts)
+{
+  ctx->agg.ts     = ts;
+  ctx->agg.count  = 0;
+  ctx->agg.min    = INT32_MAX;
+  ctx->agg.max    = INT32_MIN;
+  ctx->agg.avg    = 0;
+  ctx->agg.events = 0;
+  ctx->sum        = 0;
+}
+
+/**
+ * 公称電圧からの偏差の算出
+ *
+ * @return
+ *  偏差の絶対値を0.1%単位で返す。
+ */
+static int32_t
+deviation(const pq_t* ctx, int32_t v)
+{
+  int64_t d;
+
+  d = (int64_t)v - ctx->param.nominal;
+  if (d < 0) d = -d;
+
+  return (int32_t)(d * 1000 / ctx->param.nominal);
+}
+
+/*
+ * 公開関数の定義
+ */
+
+void
+pq_init(pq_t* ctx, const pq_param_t* param)
+{
+  int64_t nom;
+
+  memset(ctx, 0, sizeof(pq_t));
+  ctx->param = *param;
+
+  nom = param->nominal;
+
+  ctx->sagLevel          = (int32_t)(nom * param->sagPct / 100);
+  ctx->swellLevel        = (int32_t)(nom * param->swellPct / 100);
+  ctx->interruptionLevel = (int32_t)(nom * param->interruptionPct / 100);
+  ctx->hysteresis        = (int32_t)(nom * param->hysteresisPct / 100);
+}
+
+int
+pq_push(pq_t* ctx,
+        uint64_t ts,
+        int32_t voltage,
+        pq_event_t* ev,
+        pq_aggregate_t* agg)
+{
+  int ret;
+  uint64_t elapsed;
+
+  ret = 0;
+
+  /*
+   * 集計区間の切り替え
+   *   区間の境界は最初のフレームを起点とした集計区間の長さの倍数に揃える
+   *   (フレームが途絶えた場合は空の区間を飛ばす)。
+   */
+  if (!ctx->started) {
+    ctx->started = true;
+    start_aggregate(ctx, ts);
+
+  } else if (ts - ctx->agg.ts >= ctx->param.aggInterval) {
+    if (ctx->agg.count > 0) {
+      ctx->agg.avg = (int32_t)(ctx->sum / ctx->agg.count);
+      *agg         = ctx->agg;
+      ret         |= PQ_OUT_AGGREGATE;
+    }
+
+    elapsed = ts - ctx->agg.ts;
+    start_aggregate(ctx, ts - elapsed % ctx->param.aggInterval);
+  }
+
+  ctx->agg.count++;
+  ctx->sum += voltage;
+  if (voltage < ctx->agg.min) ctx->agg.min = voltage;
+  if (voltage > ctx->agg.max) ctx->agg.max = voltage;
+
+  /*
+   * イベントの判定
+   */
+  switch (ctx->cur.kind) {
+  case 0:
+    if (voltage < ctx->sagLevel) {
+      ctx->cur.kind = PQ_SAG;
+    } else if (voltage > ctx->swellLevel) {
+      ctx->cur.kind = PQ_SWELL;
+    } else {
+      break;
+    }
+
+    ctx->cur.ts      = ts;
+    ctx->cur.extreme = voltage;
+    ctx->agg.events++;
+    break;
+
+  case PQ_SAG:
+    if (voltage < ctx->cur.extreme) ctx->cur.extreme = voltage;
+    if (voltage < ctx->sagLevel + ctx->hysteresis) break;
+
+    // 下限が停電の閾値を下回っていた場合は瞬時停電とする
+    if (ctx->cur.extreme < ctx->interruptionLevel) {
+      ctx->cur.kind = PQ_INTERRUPTION;
+    }
+
+    ret |= PQ_OUT_EVENT;
+    break;
+
+  case PQ_SWELL:
+    if (voltage > ctx->cur.extreme) ctx->cur.extreme = voltage;
+    if (voltage > ctx->swellLevel - ctx->hysteresis) break;
+
+    ret |= PQ_OUT_EVENT;
+    break;
+  }
+
+  if (ret & PQ_OUT_EVENT) {
+    ctx->cur.duration = (uint32_t)(ts - ctx->cur.ts);
+    ctx->cur.depth    = deviation(ctx, ctx->cur.extreme);
+
+    *ev = ctx->cur;
+    memset(&ctx->cur, 0, sizeof(ctx->cur));
+  }
+
+  return ret;
+}
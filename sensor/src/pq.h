@@ -0,0 +1,140 @@
+/*
+ * AC power monitor for M5Atomic Socket with AtomS3
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __PQ_H__
+#define __PQ_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//! イベントの種類(電圧低下)
+#define PQ_SAG            (1)
+
+//! イベントの種類(電圧上昇)
+#define PQ_SWELL          (2)
+
+//! イベントの種類(瞬時停電, 電圧低下のうち下限が停電の閾値を下回ったもの)
+#define PQ_INTERRUPTION   (3)
+
+//! pq_push()の戻り値(イベントが終了した)
+#define PQ_OUT_EVENT      (0x01)
+
+//! pq_push()の戻り値(集計区間が終了した)
+#define PQ_OUT_AGGREGATE  (0x02)
+
+//! 電源品質の判定のパラメータ
+typedef struct {
+  //! 公称電圧(mV)
+  int32_t nominal;
+
+  //! 電圧低下とみなす閾値(公称電圧に対する%)
+  uint8_t sagPct;
+
+  //! 電圧上昇とみなす閾値(公称電圧に対する%)
+  uint8_t swellPct;
+
+  //! 瞬時停電とみなす閾値(公称電圧に対する%)
+  uint8_t interruptionPct;
+
+  //! イベント終了の判定のヒステリシス(公称電圧に対する%)
+  uint8_t hysteresisPct;
+
+  //! 集計区間の長さ(ミリ秒)
+  uint32_t aggInterval;
+} pq_param_t;
+
+//! イベント
+typedef struct {
+  //! 種類
+  int kind;
+
+  //! 開始時刻(閾値を超えた最初のフレームのタイムスタンプ, ミリ秒)
+  uint64_t ts;
+
+  //! 継続時間(ミリ秒)
+  uint32_t duration;
+
+  //! 期間中の極値(電圧低下・停電は最小値, 電圧上昇は最大値, mV)
+  int32_t extreme;
+
+  //! 公称電圧からの偏差の最大値(0.1%単位)
+  int32_t depth;
+} pq_event_t;
+
+//! 集計区間の統計
+typedef struct {
+  //! 区間の開始時刻(ミリ秒)
+  uint64_t ts;
+
+  //! フレーム数
+  uint32_t count;
+
+  //! 最小・最大値(mV)
+  int32_t min;
+  int32_t max;
+
+  //! 平均値(mV)
+  int32_t avg;
+
+  //! 区間内で開始したイベントの数
+  uint32_t events;
+} pq_aggregate_t;
+
+//! 電源品質の判定の状態
+typedef struct {
+  pq_param_t param;
+
+  //! 閾値(mV, 初期化時に算出)
+  int32_t sagLevel;
+  int32_t swellLevel;
+  int32_t interruptionLevel;
+  int32_t hysteresis;
+
+  //! 進行中のイベント(種類が0の場合はイベント無し)
+  pq_event_t cur;
+
+  //! 集計中の区間
+  pq_aggregate_t agg;
+
+  //! 集計中の区間の合計値(mV)
+  int64_t sum;
+
+  //! 初回のフレームを受け取ったか否か
+  bool started;
+} pq_t;
+
+/**
+ * 電源品質の判定の初期化
+ *
+ * @param [out] ctx    初期化する状態
+ * @param [in] param   パラメータ
+ */
+void pq_init(pq_t* ctx, const pq_param_t* param);
+
+/**
+ * フレームの投入
+ *
+ * @param [in,out] ctx  状態
+ * @param [in] ts       フレームのタイムスタンプ(ミリ秒)
+ * @param [in] voltage  電圧(mV)
+ * @param [out] ev      終了したイベントの書き込み先
+ * @param [out] agg     終了した集計区間の統計の書き込み先
+ *
+ * @return
+ *  PQ_OUT_EVENT, PQ_OUT_AGGREGATEの論理和を返す(該当する出力が無い場合は0)。
+ *
+ * @remark
+ *  電圧が電圧低下(上昇)の閾値を下回った(上回った)フレームでイベントを開始
+ *  し、閾値からヒステリシス分内側に戻ったフレームで終了する。演算はすべて整
+ *  数で行う。
+ */
+int pq_push(pq_t* ctx,
+            uint64_t ts,
+            int32_t voltage,
+            pq_event_t* ev,
+            pq_aggregate_t* agg);
+
+#endif /* !defined(__PQ_H__) */
@@ -0,0 +1,144 @@
+/*
+ * AC power monitor for M5Atomic Socket with AtomS3
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <string.h>
+
+#include "rawring.h"
+
+/*
+ * 公開関数の定義
+ */
+
+void
+rawring_init(rawring_t* ctx, const rawring_param_t* param)
+{
+  memset(ctx, 0, sizeof(rawring_t));
+
+  ctx->param    = *param;
+  ctx->state    = RAWRING_ARMED;
+  ctx->prevWatt = -1;
+
+  if (ctx->param.post >= RAWRING_SIZE) ctx->param.post = RAWRING_SIZE - 1;
+}
+
+void
+rawring_push(rawring_t* ctx,
+             uint64_t ts,
+             const uint8_t* data,
+             int len,
+             int status)
+{
+  rawring_frame_t* frame;
+  int n;
+
+  if (ctx->state == RAWRING_FROZEN) return;
+
+  /*
+   * フレームの記録
+   */
+  n     = (len < RAWRING_FRAME_SIZE)? len: RAWRING_FRAME_SIZE;
+  frame = &ctx->frames[ctx->head];
+
+  frame->ts     = ts;
+  frame->len    = (len < UINT16_MAX)? len: UINT16_MAX;
+  frame->status = status;
+
+  memset(frame->data, 0, sizeof(frame->data));
+  if (n > 0) memcpy(frame->data, data, n);
+
+  ctx->head = (ctx->head + 1) % RAWRING_SIZE;
+  if (ctx->used < RAWRING_SIZE) ctx->used++;
+
+  /*
+   * トリガ後のフレームの計数
+   */
+  if (ctx->state == RAWRING_TRIGGERED) {
+    if (--ctx->remain == 0) ctx->state = RAWRING_FROZEN;
+    return;
+  }
+
+  /*
+   * 受信異常の連続の判定
+   */
+  if (status != RAWRING_OK) {
+    if (ctx->errCount == 0 || ts - ctx->errStart > ctx->param.errorWindow) {
+      ctx->errStart = ts;
+      ctx->errCount = 0;
+    }
+
+    ctx->errCount++;
+
+    if (ctx->errCount >= ctx->param.errorBurst) {
+      rawring_trigger(ctx, ts, RAWRING_TRIG_ERRORS);
+    }
+  }
+}
+
+void
+rawring_check_power(rawring_t* ctx, uint64_t ts, int32_t wattage)
+{
+  int32_t prev;
+
+  prev          = ctx->prevWatt;
+  ctx->prevWatt = wattage;
+
+  if (prev < 0 || wattage < 0) return;
+
+  if (wattage - prev >= ctx->param.stepThreshold ||
+      prev - wattage >= ctx->param.stepThreshold) {
+    rawring_trigger(ctx, ts, RAWRING_TRIG_STEP);
+  }
+}
+
+bool
+rawring_trigger(rawring_t* ctx, uint64_t ts, uint32_t cause)
+{
+  if (!(ctx->param.triggers & cause)) return false;
+  if (ctx->state != RAWRING_ARMED) return false;
+
+  ctx->state  = RAWRING_TRIGGERED;
+  ctx->cause  = cause;
+  ctx->trigTs = ts;
+  ctx->remain = ctx->param.post;
+  ctx->count++;
+
+  /*
+   * トリガ時のフレームの位置(凍結後の古い方からの位置)
+   *   凍結までにpost個のフレームが追加されるので、溢れる場合はその分だけ前
+   *   にずれる。
+   */
+  if (ctx->used + ctx->param.post <= RAWRING_SIZE) {
+    ctx->trigIndex = (ctx->used > 0)? ctx->used - 1: 0;
+  } else {
+    ctx->trigIndex = RAWRING_SIZE - 1 - ctx->param.post;
+  }
+
+  if (ctx->remain == 0) ctx->state = RAWRING_FROZEN;
+
+  return true;
+}
+
+void
+rawring_rearm(rawring_t* ctx)
+{
+  ctx->head     = 0;
+  ctx->used     = 0;
+  ctx->remain   = 0;
+  ctx->cause    = 0;
+  ctx->errCount = 0;
+  ctx->prevWatt = -1;
+  ctx->state    = RAWRING_ARMED;
+}
+
+const rawring_frame_t*
+rawring_get(const rawring_t* ctx, int idx)
+{
+  int pos;
+
+  pos = (ctx->head - ctx->used + idx + RAWRING_SIZE) % RAWRING_SIZE;
+
+  return &ctx->frames[pos];
+}
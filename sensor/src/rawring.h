@@ -0,0 +1,210 @@
+/*
+ * AC power monitor for M5Atomic Socket with AtomS3
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __RAWRING_H__
+#define __RAWRING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//! 保持するフレーム数(リングバッファの要素数)
+#define RAWRING_SIZE          (64)
+
+//! 1フレーム当たりに保持するバイト数(HLW8032のフレーム長)
+#define RAWRING_FRAME_SIZE    (24)
+
+/*
+ * 受信結果(ATOMSOCKET::RawHookに渡される値と同じ)
+ */
+
+//! 受信結果(正常なフレーム)
+#define RAWRING_OK            (0)
+
+//! 受信結果(長さの異常, 先頭のRAWRING_FRAME_SIZEバイトのみ保持)
+#define RAWRING_LENGTH        (1)
+
+//! 受信結果(ヘッダの異常)
+#define RAWRING_HEADER        (2)
+
+//! 受信結果(チェックサムの異常)
+#define RAWRING_CHECKSUM      (3)
+
+/*
+ * トリガ要因(rawring_param_t::triggersにはビットの論理和を指定する)
+ */
+
+//! トリガ要因(消費電力のステップ)
+#define RAWRING_TRIG_STEP     (0x01)
+
+//! トリガ要因(受信異常の連続)
+#define RAWRING_TRIG_ERRORS   (0x02)
+
+//! トリガ要因(ボタン・コマンドによる手動のトリガ)
+#define RAWRING_TRIG_MANUAL   (0x04)
+
+/*
+ * 状態
+ */
+
+//! 状態(記録中, トリガ待ち)
+#define RAWRING_ARMED         (0)
+
+//! 状態(トリガ後のフレームを記録中)
+#define RAWRING_TRIGGERED     (1)
+
+//! 状態(凍結, 記録を停止)
+#define RAWRING_FROZEN        (2)
+
+//! 受信したフレームの記録
+typedef struct {
+  //! 受信時刻(ミリ秒, 測定値の行のタイムスタンプと同じ時間軸)
+  uint64_t ts;
+
+  //! 受信したバイト数(RAWRING_FRAME_SIZEを超えた分は保持しない)
+  uint16_t len;
+
+  //! 受信結果(RAWRING_OK, RAWRING_LENGTH, RAWRING_HEADER, RAWRING_CHECKSUM)
+  uint8_t status;
+
+  //! 受信したバイト列
+  uint8_t data[RAWRING_FRAME_SIZE];
+} rawring_frame_t;
+
+//! トリガのパラメータ
+typedef struct {
+  //! 有効なトリガ要因(RAWRING_TRIG_*の論理和)
+  uint32_t triggers;
+
+  //! ステップとみなす消費電力の変化量(mW)
+  int32_t stepThreshold;
+
+  //! 受信異常の連続とみなす異常の数
+  uint32_t errorBurst;
+
+  //! 上記の異常を数える時間幅(ミリ秒)
+  uint32_t errorWindow;
+
+  //! トリガ後に記録するフレーム数(RAWRING_SIZE未満とする)
+  uint32_t post;
+} rawring_param_t;
+
+//! フレームの記録の状態
+typedef struct {
+  rawring_param_t param;
+
+  //! フレームの記録
+  rawring_frame_t frames[RAWRING_SIZE];
+
+  //! 次に書き込む位置
+  int head;
+
+  //! 有効な要素数
+  int used;
+
+  //! 状態(RAWRING_ARMED, RAWRING_TRIGGERED, RAWRING_FROZEN)
+  int state;
+
+  //! トリガ後に記録する残りのフレーム数
+  uint32_t remain;
+
+  //! トリガ要因(RAWRING_TRIG_*のいずれか)
+  uint32_t cause;
+
+  //! トリガの時刻(ミリ秒)
+  uint64_t trigTs;
+
+  //! トリガ時のフレームの位置(凍結後の先頭からの位置)
+  int trigIndex;
+
+  //! 起動時からのトリガ回数
+  uint32_t count;
+
+  //! 受信異常の計数を始めた時刻(ミリ秒)
+  uint64_t errStart;
+
+  //! 上記の時刻からの受信異常の数
+  uint32_t errCount;
+
+  //! 直前のフレームの消費電力(mW, 負の場合は値無し)
+  int32_t prevWatt;
+} rawring_t;
+
+/**
+ * フレームの記録の初期化
+ *
+ * @param [out] ctx   初期化する状態
+ * @param [in] param  パラメータ
+ */
+void rawring_init(rawring_t* ctx, const rawring_param_t* param);
+
+/**
+ * 受信したフレームの記録
+ *
+ * @param [in,out] ctx  状態
+ * @param [in] ts       受信時刻(ミリ秒)
+ * @param [in] data     受信したバイト列
+ * @param [in] len      受信したバイト数
+ * @param [in] status   受信結果
+ *
+ * @remark
+ *  異常なフレームも含めて受信毎に呼び出す。凍結中は何もしない。受信異常が
+ *  errorWindowの間にerrorBurst回続いた場合はトリガする(RAWRING_TRIG_ERRORS
+ *  が有効な場合)。トリガ後にpostフレームを記録すると凍結する。
+ */
+void rawring_push(rawring_t* ctx,
+                  uint64_t ts,
+                  const uint8_t* data,
+                  int len,
+                  int status);
+
+/**
+ * 消費電力のステップの判定
+ *
+ * @param [in,out] ctx  状態
+ * @param [in] ts       フレームのタイムスタンプ(ミリ秒)
+ * @param [in] wattage  フレームの消費電力(mW, 負の場合は値無し)
+ *
+ * @remark
+ *  正常なフレームの換算後に呼び出す。直前のフレームとの差がstepThreshold以
+ *  上の場合はトリガする(RAWRING_TRIG_STEPが有効な場合)。
+ */
+void rawring_check_power(rawring_t* ctx, uint64_t ts, int32_t wattage);
+
+/**
+ * トリガ
+ *
+ * @param [in,out] ctx  状態
+ * @param [in] ts       トリガの時刻(ミリ秒)
+ * @param [in] cause    トリガ要因(RAWRING_TRIG_*のいずれか)
+ *
+ * @return
+ *  トリガした場合はtrueを返す。要因が無効な場合や、既にトリガ済み・凍結中の
+ *  場合はfalseを返す。
+ */
+bool rawring_trigger(rawring_t* ctx, uint64_t ts, uint32_t cause);
+
+/**
+ * 記録の再開
+ *
+ * @param [in,out] ctx  状態
+ *
+ * @remark
+ *  記録済みのフレームを破棄してトリガ待ちに戻る。
+ */
+void rawring_rearm(rawring_t* ctx);
+
+/**
+ * 記録したフレームの取得
+ *
+ * @param [in] ctx   状態
+ * @param [in] idx   古い方からの位置([0, ctx->used)の範囲)
+ *
+ * @return
+ *  フレームの記録へのポインタを返す。
+ */
+const rawring_frame_t* rawring_get(const rawring_t* ctx, int idx);
+
+#endif /* !defined(__RAWRING_H__) */
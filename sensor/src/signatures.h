@@ -0,0 +1,27 @@
+/*
+ * AC power monitor for M5Atomic Socket with AtomS3
+ *
+ *  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __SIGNATURES_H__
+#define __SIGNATURES_H__
+
+#include <appliance.h>
+
+/*
+ * 家電のシグネチャ表
+ *   ホスト側ツールappliance(-L -C)でラベル付きのイベント行から学習した結果
+ *   を貼り付ける。要素は{名前, ステップ(0.1W), 力率(1/1000), 行き過ぎ量(1/
+ *   256), 整定フレーム数}で、nameがNULLの要素で終端する。表が空の場合は全て
+ *   のイベントが"?"として出力される。
+ *
+ *   例:
+ *     {"kettle",   12450, 998,   0, 1},
+ *     {"fridge",     950, 640, 310, 9},
+ */
+static const appliance_signature_t signatures[] = {
+  {NULL, 0, 0, 0, 0}
+};
+
+#endif /* !defined(__SIGNATURES_H__) */
@@ -0,0 +1,121 @@
+#!/bin/sh
+#
+# Size and boot-time report for the firmware build profiles
+#
+#  Copyright (C) 2024 Hiroshi Kuwagata <kgt9221@gmail.com>
+#
+# usage: profile_report.sh [-p PORT] PROJECT_DIR [ENV ...]
+#
+#   PROJECT_DIR(recorder, sensor)のplatformio.iniに定義されているenv毎に
+#   ビルドし、RAM(静的確保分)とFlashの使用量を表示する。-pでシリアルポート
+#   を指定すると、書き込み後に起動時の"#boot"行を待って起動時間も表示する
+#   (デバイスは一台ずつ接続すること)。ENVを省略した場合は全envを対象とする。
+#
+
+set -u
+
+#
+# 起動時の"#boot"行を待つ時間(秒, Wi-Fiへの接続待ちを含む)
+#
+BOOT_TIMEOUT=40
+
+usage() {
+  echo "usage: $0 [-p PORT] PROJECT_DIR [ENV ...]" >&2
+  exit 1
+}
+
+port=""
+
+while getopts "p:h" opt; do
+  case "$opt" in
+  p) port="$OPTARG" ;;
+  *) usage ;;
+  esac
+done
+
+shift $((OPTIND - 1))
+[ $# -ge 1 ] || usage
+
+dir="$1"
+shift
+
+[ -f "$dir/platformio.ini" ] || {
+  echo "$dir: platformio.ini not found" >&2
+  exit 1
+}
+
+if [ $# -eq 0 ]; then
+  set -- $(sed -n 's/^\[env:\(.*\)\]$/\1/p' "$dir/platformio.ini")
+fi
+
+#
+# envのシリアルポートの速度の取得
+#   [env:名前]のmonitor_speedを、無ければ[env]のものを使う(どちらも無い場合
+#   は115200)。bridgeのように"#boot"行を別の速度で出力するenvでは、
+#   platformio.iniにその速度をmonitor_speedとして記述しておくこと。
+#
+monitor_speed() {
+  awk -v env="$2" '
+    /^\[/ {
+      sec = $0
+      next
+    }
+    /^monitor_speed[ \t]*=/ {
+      val = $0
+      sub(/^[^=]*=[ \t]*/, "", val)
+      if (sec == "[env:" env "]") own = val
+      if (sec == "[env]") common = val
+    }
+    END {
+      print (own != "")? own: (common != "")? common: 115200
+    }
+  ' "$1/platformio.ini"
+}
+
+log=$(mktemp)
+trap 'rm -f "$log"' EXIT
+
+printf "%-16s %10s %10s %8s\n" "env" "ram" "flash" "boot_ms"
+
+ret=0
+
+for env in "$@"; do
+  #
+  # build and size
+  #   PlatformIOが出力する"RAM: ... (used N bytes from M bytes)"の行を使う。
+  #
+  if ! pio run -d "$dir" -e "$env" > "$log" 2>&1; then
+    printf "%-16s %10s %10s %8s\n" "$env" "-" "-" "-"
+    echo "$env: build failed (see 'pio run -d $dir -e $env')" >&2
+    ret=1
+    continue
+  fi
+
+  ram=$(sed -n 's/^RAM:.*used \([0-9]*\) bytes.*/\1/p' "$log")
+  flash=$(sed -n 's/^Flash:.*used \([0-9]*\) bytes.*/\1/p' "$log")
+
+  #
+  # boot time
+  #   書き込み後のリセットから"#boot"行を受け取るまでを待つ。値はファーム
+  #   ウェアが計測したsetup()の完了までの時間(ブートローダの時間は含まない)。
+  #
+  boot="-"
+
+  if [ -n "$port" ]; then
+    if pio run -d "$dir" -e "$env" -t upload --upload-port "$port" \
+         > "$log" 2>&1; then
+      stty -F "$port" "$(monitor_speed "$dir" "$env")" raw -echo \
+        2> /dev/null
+      boot=$(timeout "$BOOT_TIMEOUT" grep -a -m 1 '^#boot' "$port" |
+             sed -n 's/.* ms=\([0-9]*\).*/\1/p')
+      [ -n "$boot" ] || boot="timeout"
+    else
+      boot="upload"
+      ret=1
+    fi
+  fi
+
+  printf "%-16s %10s %10s %8s\n" "$env" "${ram:--}" "${flash:--}" "$boot"
+done
+
+exit $ret